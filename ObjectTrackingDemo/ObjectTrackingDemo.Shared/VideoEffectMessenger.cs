@@ -17,6 +17,32 @@ namespace ObjectTrackingDemo
         public int height;
     }
 
+    /// <summary>
+    /// Note: These has to be in sync with the native side!
+    /// </summary>
+    public enum ProfilerStage
+    {
+        Lock = 0,
+        NoiseRemoval = 1,
+        Effect = 2,
+        Labelling = 3,
+        Hulls = 4,
+        LockUpdate = 5,
+        Overlay = 6,
+        Frame = 7
+    };
+
+    /// <summary>
+    /// Durations of a processing stage in microseconds.
+    /// </summary>
+    public struct StageDurations
+    {
+        public int p50;
+        public int p95;
+        public int p99;
+        public int max;
+    }
+
     /// <summary>
     /// Implements MessengerInterface defined in the native video effect. This implementation
     /// enables the communication between the native and the managed side.
@@ -31,6 +57,7 @@ namespace ObjectTrackingDemo
         private Settings _settings = App.Settings;
         private StateManager _stateManager;
         private int _operationDurationInMilliseconds;
+        private int[] _stageDurationsInMicroseconds;
 
         public ObjectDetails LockedRect
         {
@@ -38,6 +65,27 @@ namespace ObjectTrackingDemo
             private set;
         }
 
+        /// <summary>
+        /// Number of the stage durations in the latest reporting window that
+        /// were recorded by the threads beyond the per-thread buffers of the
+        /// profiler. They are included in the durations.
+        /// </summary>
+        public int ProfilerOverflowCount
+        {
+            get;
+            private set;
+        }
+
+        /// <summary>
+        /// Number of the frames in the latest reporting window that were
+        /// not analyzed, since the pipelined analysis was still busy.
+        /// </summary>
+        public int RejectedAnalysisCount
+        {
+            get;
+            private set;
+        }
+
         public int OperationDurationInMilliseconds
         {
             get
@@ -133,9 +181,37 @@ namespace ObjectTrackingDemo
             LockedRect = lockedRect;
         }
 
-        public void UpdateOperationDurationInMilliseconds(int milliseconds)
+        public void UpdateStageDurations(int[] durationsInMicroseconds)
         {
-            OperationDurationInMilliseconds = milliseconds;
+            _stageDurationsInMicroseconds = durationsInMicroseconds;
+            OperationDurationInMilliseconds = StageDurationsOf(ProfilerStage.Frame).p50 / 1000;
+
+            if (durationsInMicroseconds.Length % 4 == 2)
+            {
+                ProfilerOverflowCount = durationsInMicroseconds[durationsInMicroseconds.Length - 2];
+                RejectedAnalysisCount = durationsInMicroseconds[durationsInMicroseconds.Length - 1];
+            }
+        }
+
+        /// <summary>
+        /// Returns the durations of the given stage over the latest
+        /// reporting window or zeros, if nothing has been reported yet.
+        /// </summary>
+        public StageDurations StageDurationsOf(ProfilerStage stage)
+        {
+            StageDurations stageDurations = new StageDurations();
+            int[] durations = _stageDurationsInMicroseconds;
+            int index = (int)stage * 4;
+
+            if (durations != null && index + 3 < durations.Length)
+            {
+                stageDurations.p50 = durations[index];
+                stageDurations.p95 = durations[index + 1];
+                stageDurations.p99 = durations[index + 2];
+                stageDurations.max = durations[index + 3];
+            }
+
+            return stageDurations;
         }
 
         public void SaveFrame(byte[] pictureArray, int width, int height, int counter, int seriesIdentifier)
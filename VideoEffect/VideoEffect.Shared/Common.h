@@ -83,6 +83,98 @@ enum Mode
 };
 
 
+//-------------------------------------------------------------------
+// EdgeOperator
+//
+// ForwardDifference: Differences to the right and lower neighbours
+// Sobel: 3x3 Sobel operator
+// Scharr: 3x3 Scharr operator, better rotational symmetry than Sobel
+//-------------------------------------------------------------------
+enum EdgeOperator
+{
+    ForwardDifference = 0,
+    Sobel = 1,
+    Scharr = 2
+};
+
+
+//-------------------------------------------------------------------
+// NoiseFilter
+//
+// BoxFilter: Average of the (2r + 1) x (2r + 1) neighbourhood
+// GaussianFilter: Binomial approximation of a Gaussian, radius 1 or 2
+// Median3x3Filter, Median5x5Filter: Median of the neighbourhood
+// BilateralFilter: Range weighted Gaussian, radius 1 or 2
+//
+// The median and bilateral filters keep the edges sharp.
+//-------------------------------------------------------------------
+enum NoiseFilter
+{
+    BoxFilter = 0,
+    GaussianFilter = 1,
+    Median3x3Filter = 2,
+    Median5x5Filter = 3,
+    BilateralFilter = 4
+};
+
+
+//-------------------------------------------------------------------
+// BufferStorage
+//
+// FullFrameStorage: Every buffered frame is kept as it is
+// ProxyStorage: Downscaled proxies of the buffered frames and a small
+// pool of full frames around the trigger and the newest frames
+//-------------------------------------------------------------------
+enum BufferStorage
+{
+    FullFrameStorage = 0,
+    ProxyStorage = 1
+};
+
+
+//-------------------------------------------------------------------
+// ProfilerStage
+//
+// The timed stages of processing a frame. FrameStage covers the whole
+// frame including the untimed work between the stages.
+//
+// Note: These has to be in sync with the managed side!
+//-------------------------------------------------------------------
+enum ProfilerStage
+{
+    LockStage = 0,
+    NoiseRemovalStage = 1,
+    EffectStage = 2,
+    LabellingStage = 3,
+    HullsStage = 4,
+    LockUpdateStage = 5,
+    OverlayStage = 6,
+    FrameStage = 7,
+    ProfilerStageCount = 8
+};
+
+
+//-------------------------------------------------------------------
+// SchedulingPolicy
+//
+// How the realtime transform keeps up when the analysis takes longer
+// than the frame interval:
+//
+// LatencyPolicy: Keeps the output at the camera rate with a margin,
+// lowers the analysis resolution before the analysis rate drops far
+// BalancedPolicy: Keeps the output at the camera rate, lowers the
+// analysis rate before the resolution
+// AccuracyPolicy: Analyzes every frame at the full resolution, the
+// output runs late under overload
+//-------------------------------------------------------------------
+enum SchedulingPolicy
+{
+    LatencyPolicy = 0,
+    BalancedPolicy = 1,
+    AccuracyPolicy = 2
+};
+
+
 //------------------------------------------------------------------
 // DeletePointerVector
 //
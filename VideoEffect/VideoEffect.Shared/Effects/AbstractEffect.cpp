@@ -5,7 +5,8 @@
 
 AbstractEffect::AbstractEffect(GUID videoFormatSubtype)
     : m_videoFormatSubtype(videoFormatSubtype),
-    m_settings(Settings::instance())
+    m_settings(Settings::instance()),
+    m_parallelExecutionEnabled(false)
 {
 }
 
@@ -13,3 +14,23 @@ GUID AbstractEffect::videoFormatSubtype() const
 {
     return m_videoFormatSubtype;
 }
+
+void AbstractEffect::setParallelExecutionEnabled(const bool& enabled)
+{
+    m_parallelExecutionEnabled = enabled;
+}
+
+bool AbstractEffect::parallelExecutionEnabled() const
+{
+    return m_parallelExecutionEnabled;
+}
+
+bool AbstractEffect::captureSettings()
+{
+    const bool hadSnapshot = (bool)m_snapshot;
+    const UINT32 previousVersion = hadSnapshot ? m_snapshot->version : 0;
+
+    m_snapshot = m_settings->snapshot();
+
+    return !hadSnapshot || m_snapshot->version != previousVersion;
+}
@@ -2,8 +2,10 @@
 #define ABSTRACTEFFECT_H
 
 #include <d2d1.h>
+#include <memory>
 
 class Settings;
+struct SettingsSnapshot;
 
 
 class AbstractEffect
@@ -23,9 +25,23 @@ public: // Methods
 
     GUID videoFormatSubtype() const;
 
+    // Effects that split their work into row bands (see RowBandExecutor)
+    // run the bands in parallel when enabled. Disabled by default, the
+    // effects whose bands share no state enable it. Others ignore this.
+    void setParallelExecutionEnabled(const bool& enabled);
+    bool parallelExecutionEnabled() const;
+
+protected: // New methods
+    // Takes the current settings snapshot to m_snapshot. Called once per
+    // frame. Returns true, if the settings have changed since the last
+    // call, so that the values derived from them need updating.
+    bool captureSettings();
+
 protected: // Members
     GUID m_videoFormatSubtype;
     Settings* m_settings;
+    std::shared_ptr<const SettingsSnapshot> m_snapshot; // Of the frame being processed
+    bool m_parallelExecutionEnabled;
 };
 
 #endif // ABSTRACTEFFECT_H
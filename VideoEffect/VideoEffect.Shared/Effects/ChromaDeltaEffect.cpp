@@ -7,9 +7,27 @@
 #include "Settings.h"
 
 
+// Constants
+const UINT32 MaxFramesBack = 8;
+const int MaxLearningShift = 7;
+
+
+//-------------------------------------------------------------------
+// exceedsBackground
+//
+// Returns true if the deviation from the background is over the
+// threshold and, with an adaptive threshold, over the spread of the
+// background as well.
+//-------------------------------------------------------------------
+static inline bool exceedsBackground(
+    const int& deviation, const int& spread, const int& threshold, const bool& adaptiveThreshold)
+{
+    return deviation > (adaptiveThreshold ? max(threshold, spread) : threshold);
+}
+
+
 ChromaDeltaEffect::ChromaDeltaEffect(GUID videoFormatSubtype)
-    : AbstractEffect(videoFormatSubtype),
-    m_previousFrame(NULL)
+    : AbstractEffect(videoFormatSubtype)
 {
 
 }
@@ -17,11 +35,18 @@ ChromaDeltaEffect::ChromaDeltaEffect(GUID videoFormatSubtype)
 
 ChromaDeltaEffect::~ChromaDeltaEffect()
 {
-    free(m_previousFrame);
 }
 
 
-
+//-------------------------------------------------------------------
+// apply
+//
+// Compares the chroma of the frame to the frame the configured number
+// of frames back. Only the chroma samples are kept in the history and
+// the current frame is stored into the slot of the oldest frame while
+// it is being compared, so no separate frame copy is needed. Until the
+// history is full, an empty frame is produced.
+//-------------------------------------------------------------------
 void ChromaDeltaEffect::apply(
     const D2D_RECT_U& targetRect,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* destination,
@@ -36,27 +61,45 @@ void ChromaDeltaEffect::apply(
         throw "Video format not supported";
     }
 
-    if (!m_previousFrame)
+    captureSettings();
+
+    if (m_snapshot->chromaDeltaBackgroundModel)
     {
-        m_previousFrame = ImageProcessingUtils::newEmptyFrame(widthInPixels, heightInPixels, m_videoFormatSubtype);
-        memcpy(destination, m_previousFrame, ImageProcessingUtils::frameSize(widthInPixels, heightInPixels, m_videoFormatSubtype));
+        subtractBackground(targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
+        return;
     }
-    else
+
+    // NV12 has one U-V pair per two pixels on every other line, YUY2 on
+    // every line
+    const UINT32 chromaLineCount =
+        (m_videoFormatSubtype == MFVideoFormat_NV12) ? heightInPixels / 2 : heightInPixels;
+    const UINT32 framesBack = clamp<UINT32>((UINT32)m_snapshot->chromaDeltaFramesBack, 1, MaxFramesBack);
+
+    if (!m_chromaHistory.matches(widthInPixels, chromaLineCount, framesBack))
     {
-        BYTE* sourceBegin = const_cast<BYTE*>(source);
+        m_chromaHistory.reset(widthInPixels, chromaLineCount, framesBack);
+    }
 
-        if (m_videoFormatSubtype == MFVideoFormat_NV12)
-        {
-            applyChromaDeltaNV12((BYTE)m_settings->m_threshold, true, targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
-        }
-        else if (m_videoFormatSubtype == MFVideoFormat_YUY2)
-        {
-            applyChromaDeltaYUY2((BYTE)m_settings->m_threshold, true, targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
-        }
+    if (!m_chromaHistory.isFull())
+    {
+        BYTE* emptyFrame = ImageProcessingUtils::newEmptyFrame(widthInPixels, heightInPixels, m_videoFormatSubtype);
+        memcpy(destination, emptyFrame, ImageProcessingUtils::frameSize(widthInPixels, heightInPixels, m_videoFormatSubtype));
+        free(emptyFrame);
 
-        ImageProcessingUtils::copyFrame(sourceBegin, m_previousFrame,
-            ImageProcessingUtils::frameSize(widthInPixels, heightInPixels, m_videoFormatSubtype));
+        storeChroma(source, sourceStride, widthInPixels, heightInPixels);
+    }
+    else if (m_videoFormatSubtype == MFVideoFormat_NV12)
+    {
+        applyChromaDeltaNV12((BYTE)m_snapshot->threshold, true, m_snapshot->chromaDeltaRoiHistoryOnly,
+            targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
+    }
+    else if (m_videoFormatSubtype == MFVideoFormat_YUY2)
+    {
+        applyChromaDeltaYUY2((BYTE)m_snapshot->threshold, true, m_snapshot->chromaDeltaRoiHistoryOnly,
+            targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
     }
+
+    m_chromaHistory.advance();
 }
 
 
@@ -75,9 +118,16 @@ float ChromaDeltaEffect::calculateDelta(
 }
 
 
+//-------------------------------------------------------------------
+// applyChromaDeltaYUY2
+//
+// If roiHistoryOnly is true, the chroma outside the destination
+// rectangle is not stored and the history there goes stale.
+//-------------------------------------------------------------------
 void ChromaDeltaEffect::applyChromaDeltaYUY2(
     const BYTE& threshold,
     const bool& dimmFilteredPixels,
+    const bool& roiHistoryOnly,
     const D2D_RECT_U& rcDest,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
     _In_ LONG lDestStride,
@@ -86,26 +136,12 @@ void ChromaDeltaEffect::applyChromaDeltaYUY2(
     _In_ DWORD dwWidthInPixels,
     _In_ DWORD dwHeightInPixels)
 {
-    DWORD y = 0;
-    const BYTE* pPreviousFrame = m_previousFrame;
-
-    // Lines above the destination rectangle.
-    for (; y < rcDest.top; y++)
-    {
-        memcpy(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-        pPreviousFrame += lSrcStride;
-    }
-
+    BYTE* history = m_chromaHistory.oldestFrame();
     const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
-    WORD* pSrc_Pixel = NULL;
-    WORD* pDest_Pixel = NULL;
-    WORD* pPreviousFramePixel = NULL;
-    BYTE y0 = 0x0;
-    BYTE y1 = 0x0;
-    BYTE y2 = 0x0;
-    BYTE y3 = 0x0;
+    const DWORD yBegin = min(rcDest.top, yEnd);
+    const UINT32 pairEnd = dwWidthInPixels & ~1;
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
+    const UINT32 xBegin = min(rcDest.left & ~1, xEnd);
     BYTE u0 = 0x0;
     BYTE v0 = 0x0;
     BYTE u1 = 0x0;
@@ -116,32 +152,43 @@ void ChromaDeltaEffect::applyChromaDeltaYUY2(
     float dTotal = 0;
     BYTE newY = 0x0;
 
-    // Lines within the destination rectangle.
-    for (; y < yEnd; y++)
+    for (DWORD y = 0; y < dwHeightInPixels; y++)
     {
-        pSrc_Pixel = (WORD*)pSrc;
-        pDest_Pixel = (WORD*)pDest;
-        pPreviousFramePixel = (WORD*)pPreviousFrame;
+        const WORD* pSrc_Pixel = (const WORD*)(pSrc + (LONG)y * lSrcStride);
+        WORD* pDest_Pixel = (WORD*)(pDest + (LONG)y * lDestStride);
+        BYTE* chroma = history + y * dwWidthInPixels;
 
-        for (UINT32 x = 0; (x + 1) < dwWidthInPixels; x += 2)
+        if (y < yBegin || y >= yEnd)
+        {
+            // Lines above and below the destination rectangle.
+            memcpy(pDest_Pixel, pSrc_Pixel, dwWidthInPixels * 2);
+
+            if (!roiHistoryOnly)
+            {
+                for (UINT32 x = 0; x < pairEnd; ++x)
+                {
+                    chroma[x] = pSrc_Pixel[x] >> 8;
+                }
+            }
+
+            continue;
+        }
+
+        for (UINT32 x = 0; x < pairEnd; x += 2)
         {
             // Byte order is Y0 U0 Y1 V0
             // Each WORD is a byte pair (Y, U/V)
             // Windows is little-endian so the order appears reversed.
+            u0 = pSrc_Pixel[x] >> 8;
+            v0 = pSrc_Pixel[x + 1] >> 8;
 
-            if (x >= rcDest.left && x < rcDest.right)
+            if (x >= xBegin && x < xEnd)
             {
-                y0 = pSrc_Pixel[x] & 0x00FF;
-                u0 = pSrc_Pixel[x] >> 8;
-                y1 = pSrc_Pixel[x + 1] & 0x00FF;
-                v0 = pSrc_Pixel[x + 1] >> 8;
+                u1 = chroma[x];
+                v1 = chroma[x + 1];
 
-                y2 = pPreviousFramePixel[x] & 0x00FF;
-                u1 = pPreviousFramePixel[x] >> 8;
-                y3 = pPreviousFramePixel[x + 1] & 0x00FF;
-                v1 = pPreviousFramePixel[x + 1] >> 8;
-
-                dTotal = calculateDelta(y0 + y1, u0, v0, y2 + y3, u1, v1, dy, du, dv);
+                // The luma is not part of the delta
+                dTotal = calculateDelta(0, u0, v0, 0, u1, v1, dy, du, dv);
 
                 if (dTotal > threshold)
                 {
@@ -157,34 +204,32 @@ void ChromaDeltaEffect::applyChromaDeltaYUY2(
             }
             else
             {
-#pragma warning(push)
-#pragma warning(disable: 6385) 
-#pragma warning(disable: 6386) 
                 pDest_Pixel[x] = pSrc_Pixel[x];
                 pDest_Pixel[x + 1] = pSrc_Pixel[x + 1];
-#pragma warning(pop)
-            }
-        }
 
-        pDest += lDestStride;
-        pSrc += lSrcStride;
-        pPreviousFrame += lSrcStride;
-    }
+                if (roiHistoryOnly)
+                {
+                    continue;
+                }
+            }
 
-    // Lines below the destination rectangle.
-    for (; y < dwHeightInPixels; y++)
-    {
-        memcpy(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-        pPreviousFrame += lSrcStride;
+            chroma[x] = u0;
+            chroma[x + 1] = v0;
+        }
     }
 }
 
 
+//-------------------------------------------------------------------
+// applyChromaDeltaNV12
+//
+// If roiHistoryOnly is true, the chroma outside the destination
+// rectangle is not stored and the history there goes stale.
+//-------------------------------------------------------------------
 void ChromaDeltaEffect::applyChromaDeltaNV12(
     const BYTE& threshold,
     const bool& dimmFilteredPixels,
+    const bool& roiHistoryOnly,
     const D2D_RECT_U& rcDest,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
     _In_ LONG lDestStride,
@@ -193,45 +238,23 @@ void ChromaDeltaEffect::applyChromaDeltaNV12(
     _In_ DWORD dwWidthInPixels,
     _In_ DWORD dwHeightInPixels)
 {
-    BYTE* pPreviousFrame = m_previousFrame;
-    BYTE* yPlanePreviousFrame = m_previousFrame;
-    BYTE* yPlaneDest = pDest;
-
-    CopyMemory(pDest, pSrc, dwWidthInPixels * dwHeightInPixels);
-
-    pDest += lDestStride * dwHeightInPixels;
-    pSrc += lSrcStride * dwHeightInPixels;
-    pPreviousFrame += lSrcStride * dwHeightInPixels;
-
-    // U-V plane
-
-    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    BYTE* history = m_chromaHistory.oldestFrame();
 
-    // Lines above the destination rectangle.
-    const UINT32 numberOfLinesAboveDestRect = rcDest.top / 2;
-    DWORD y = 0;
-
-    if (numberOfLinesAboveDestRect > 0)
+    for (DWORD y = 0; y < dwHeightInPixels; y++)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels * numberOfLinesAboveDestRect);
-        pSrc += lSrcStride * numberOfLinesAboveDestRect;
-        const LONG temp = lDestStride * numberOfLinesAboveDestRect;
-        pDest += temp;
-        pPreviousFrame += temp;
-        yPlaneDest += temp * 2;
-        yPlanePreviousFrame += temp * 2;
-        y += numberOfLinesAboveDestRect - 1;
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels);
     }
 
-    // Lines within the destination rectangle.
-    const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
-    const DWORD endOfDestinationRectangleY = yEnd / 2;
-
-    const DWORD rectWidth = (rcDest.right > dwWidthInPixels) ? 0 : rcDest.right - rcDest.left;
-    const DWORD endOfDestinationRectangleX = (rectWidth == 0) ? dwWidthInPixels : rectWidth;
+    // U-V plane
 
-    BYTE y0 = 0x0;
-    BYTE y1 = 0x0;
+    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    BYTE* pDestUV = pDest + (LONG)dwHeightInPixels * lDestStride;
+    const BYTE* pSrcUV = pSrc + (LONG)dwHeightInPixels * lSrcStride;
+    const DWORD uvPlaneHeight = dwHeightInPixels / 2;
+    const DWORD uvEnd = min(rcDest.bottom, dwHeightInPixels) / 2;
+    const DWORD uvBegin = min(rcDest.top / 2, uvEnd);
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
+    const UINT32 xBegin = min(rcDest.left & ~1, xEnd);
     BYTE u0 = 0x0;
     BYTE v0 = 0x0;
     BYTE u1 = 0x0;
@@ -239,92 +262,361 @@ void ChromaDeltaEffect::applyChromaDeltaNV12(
     BYTE dy = 0x0;
     BYTE du = 0x0;
     BYTE dv = 0x0;
-    BYTE dTotal = 0x0;
+    float dTotal = 0;
+    BYTE newY = 0x0;
 
-    for (; y < endOfDestinationRectangleY; ++y)
+    for (DWORD y = 0; y < uvPlaneHeight; y++)
     {
-        if (rectWidth > 0 && rcDest.left > 0)
+        const BYTE* srcLine = pSrcUV + (LONG)y * lSrcStride;
+        BYTE* destLine = pDestUV + (LONG)y * lDestStride;
+        BYTE* chroma = history + y * dwWidthInPixels;
+
+        if (y < uvBegin || y >= uvEnd)
         {
-            memcpy(pDest, pSrc, rcDest.left);
-            pDest += rcDest.left;
-            pSrc += rcDest.left;
-            pPreviousFrame += rcDest.left;
-            yPlaneDest += rcDest.left;
-            yPlanePreviousFrame += rcDest.left;
+            // Lines above and below the destination rectangle.
+            memcpy(destLine, srcLine, dwWidthInPixels);
+
+            if (!roiHistoryOnly)
+            {
+                memcpy(chroma, srcLine, dwWidthInPixels);
+            }
+
+            continue;
         }
 
-        for (DWORD x = 0; (x + 1) < endOfDestinationRectangleX; x += 2)
+        memcpy(destLine, srcLine, xBegin);
+        memcpy(destLine + xEnd, srcLine + xEnd, dwWidthInPixels - xEnd);
+
+        if (!roiHistoryOnly)
         {
-            y0 = yPlaneDest[x] + yPlaneDest[x + 1]
-                + yPlaneDest[x + dwWidthInPixels] + yPlaneDest[x + 1 + dwWidthInPixels];
-            u0 = pSrc[x];
-            v0 = pSrc[x + 1];
+            memcpy(chroma, srcLine, xBegin);
+            memcpy(chroma + xEnd, srcLine + xEnd, dwWidthInPixels - xEnd);
+        }
 
-            y1 = yPlanePreviousFrame[x] + yPlanePreviousFrame[x + 1]
-                + yPlanePreviousFrame[x + dwWidthInPixels] + yPlanePreviousFrame[x + 1 + dwWidthInPixels];
-            u1 = pPreviousFrame[x];
-            v1 = pPreviousFrame[x + 1];
+        BYTE* yLine0 = pDest + (LONG)y * 2 * lDestStride;
+        BYTE* yLine1 = yLine0 + lDestStride;
 
-#pragma warning(push)
-#pragma warning(disable: 4244)
-            dTotal = calculateDelta(y0, u0, v0, y1, u1, v1, dy, dy, dv);
-#pragma warning(pop)
+        for (UINT32 x = xBegin; x < xEnd; x += 2)
+        {
+            u0 = srcLine[x];
+            v0 = srcLine[x + 1];
+            u1 = chroma[x];
+            v1 = chroma[x + 1];
+
+            // The luma is not part of the delta
+            dTotal = calculateDelta(0, u0, v0, 0, u1, v1, dy, du, dv);
 
             if (dTotal > threshold * 2)
             {
-                dTotal = SelectedPixelValue;
+                newY = SelectedPixelValue;
+                destLine[x] = 0x0;
+                destLine[x + 1] = 0x0;
             }
             else
             {
-                dTotal = 0x0;
+                newY = 0x0;
+                destLine[x] = 0x80;
+                destLine[x + 1] = 0x80;
             }
 
-            if (dTotal == SelectedPixelValue)
+            yLine0[x] = newY;
+            yLine0[x + 1] = newY;
+            yLine1[x] = newY;
+            yLine1[x + 1] = newY;
+
+            chroma[x] = u0;
+            chroma[x + 1] = v0;
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// subtractBackground
+//
+// Compares the frame to the running average of the previous frames
+// instead of a single frame. The chroma, and optionally the luma, of
+// each sample is compared to its background and the background is
+// updated in the same pass.
+//-------------------------------------------------------------------
+void ChromaDeltaEffect::subtractBackground(
+    const D2D_RECT_U& rcDest,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
+    _In_ LONG lDestStride,
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+    _In_ LONG lSrcStride,
+    _In_ DWORD dwWidthInPixels,
+    _In_ DWORD dwHeightInPixels)
+{
+    const bool isNV12 = (m_videoFormatSubtype == MFVideoFormat_NV12);
+    const UINT32 chromaLineCount = isNV12 ? dwHeightInPixels / 2 : dwHeightInPixels;
+    const bool useLuma = m_snapshot->backgroundUsesLuma;
+
+    if (!m_chromaBackground.matches(dwWidthInPixels, chromaLineCount))
+    {
+        m_chromaBackground.reset(dwWidthInPixels, chromaLineCount);
+        m_chromaDeviation.resize(dwWidthInPixels);
+        m_chromaSpread.resize(dwWidthInPixels);
+    }
+
+    if (!useLuma)
+    {
+        // Start over if the luma is taken into use again
+        m_lumaBackground.reset(0, 0);
+    }
+    else if (!m_lumaBackground.matches(dwWidthInPixels, dwHeightInPixels))
+    {
+        m_lumaBackground.reset(dwWidthInPixels, dwHeightInPixels);
+        m_lumaDeviation.resize(dwWidthInPixels * 2);
+        m_lumaSpread.resize(dwWidthInPixels * 2);
+    }
+
+    const BYTE threshold = (BYTE)m_snapshot->threshold;
+    const bool adaptiveThreshold = m_snapshot->backgroundAdaptiveThreshold;
+    const bool roiOnly = m_snapshot->chromaDeltaRoiHistoryOnly;
+    const int learningShift = clamp(m_snapshot->backgroundLearningShift, 1, MaxLearningShift);
+
+    if (isNV12)
+    {
+        subtractBackgroundNV12(threshold, adaptiveThreshold, useLuma, roiOnly, learningShift,
+            rcDest, pDest, lDestStride, pSrc, lSrcStride, dwWidthInPixels, dwHeightInPixels);
+    }
+    else
+    {
+        subtractBackgroundYUY2(threshold, adaptiveThreshold, useLuma, roiOnly, learningShift,
+            rcDest, pDest, lDestStride, pSrc, lSrcStride, dwWidthInPixels, dwHeightInPixels);
+    }
+
+    m_chromaBackground.advance();
+
+    if (useLuma)
+    {
+        m_lumaBackground.advance();
+    }
+}
+
+
+//-------------------------------------------------------------------
+// subtractBackgroundYUY2
+//
+// If roiOnly is true, the background outside the destination
+// rectangle is not updated.
+//-------------------------------------------------------------------
+void ChromaDeltaEffect::subtractBackgroundYUY2(
+    const BYTE& threshold,
+    const bool& adaptiveThreshold,
+    const bool& useLuma,
+    const bool& roiOnly,
+    const int& learningShift,
+    const D2D_RECT_U& rcDest,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
+    _In_ LONG lDestStride,
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+    _In_ LONG lSrcStride,
+    _In_ DWORD dwWidthInPixels,
+    _In_ DWORD dwHeightInPixels)
+{
+    const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
+    const DWORD yBegin = min(rcDest.top, yEnd);
+    const UINT32 pairEnd = dwWidthInPixels & ~1;
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
+    const UINT32 xBegin = min(rcDest.left & ~1, xEnd);
+    BYTE* chromaDeviation = m_chromaDeviation.data();
+    BYTE* chromaSpread = m_chromaSpread.data();
+    BYTE* lumaDeviation = m_lumaDeviation.data();
+    BYTE* lumaSpread = m_lumaSpread.data();
+
+    for (DWORD y = 0; y < dwHeightInPixels; y++)
+    {
+        const BYTE* srcLine = pSrc + (LONG)y * lSrcStride;
+        BYTE* destLine = pDest + (LONG)y * lDestStride;
+        const bool lineInRect = (y >= yBegin && y < yEnd);
+
+        if (lineInRect || !roiOnly)
+        {
+            const UINT32 updateBegin = roiOnly ? xBegin : 0;
+            const UINT32 updateEnd = roiOnly ? xEnd : pairEnd;
+
+            m_chromaBackground.update(y, srcLine, BackgroundModel::HighBytesOfWords,
+                updateBegin, updateEnd, learningShift, chromaDeviation, chromaSpread);
+
+            if (useLuma)
             {
-                pDest[x] = 0x0;
-                pDest[x + 1] = 0x0;
+                m_lumaBackground.update(y, srcLine, BackgroundModel::LowBytesOfWords,
+                    updateBegin, updateEnd, learningShift, lumaDeviation, lumaSpread);
             }
-            else
+        }
+
+        if (!lineInRect)
+        {
+            // Lines above and below the destination rectangle.
+            memcpy(destLine, srcLine, dwWidthInPixels * 2);
+            continue;
+        }
+
+        memcpy(destLine, srcLine, xBegin * 2);
+        memcpy(destLine + xEnd * 2, srcLine + xEnd * 2, (dwWidthInPixels - xEnd) * 2);
+
+        const WORD* pSrc_Pixel = (const WORD*)srcLine;
+        WORD* pDest_Pixel = (WORD*)destLine;
+
+        for (UINT32 x = xBegin; x < xEnd; x += 2)
+        {
+            const bool chromaChanged = exceedsBackground(
+                chromaDeviation[x] + chromaDeviation[x + 1], chromaSpread[x] + chromaSpread[x + 1],
+                threshold, adaptiveThreshold);
+
+            for (UINT32 i = x; i < x + 2; ++i)
             {
-                pDest[x] = 0x80;
-                pDest[x + 1] = 0x80;
+                const bool changed = chromaChanged
+                    || (useLuma && exceedsBackground(lumaDeviation[i], lumaSpread[i], threshold, adaptiveThreshold));
+
+                pDest_Pixel[i] = (changed ? SelectedPixelValue : 0x0) | (pSrc_Pixel[i] & 0xFF00);
             }
+        }
+    }
+}
 
-            yPlaneDest[x] = dTotal;
-            yPlaneDest[x + 1] = dTotal;
-            yPlaneDest[x + dwWidthInPixels] = dTotal;
-            yPlaneDest[x + 1 + dwWidthInPixels] = dTotal;
+
+//-------------------------------------------------------------------
+// subtractBackgroundNV12
+//
+// If roiOnly is true, the background outside the destination
+// rectangle is not updated.
+//-------------------------------------------------------------------
+void ChromaDeltaEffect::subtractBackgroundNV12(
+    const BYTE& threshold,
+    const bool& adaptiveThreshold,
+    const bool& useLuma,
+    const bool& roiOnly,
+    const int& learningShift,
+    const D2D_RECT_U& rcDest,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
+    _In_ LONG lDestStride,
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+    _In_ LONG lSrcStride,
+    _In_ DWORD dwWidthInPixels,
+    _In_ DWORD dwHeightInPixels)
+{
+    for (DWORD y = 0; y < dwHeightInPixels; y++)
+    {
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels);
+    }
+
+    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    BYTE* pDestUV = pDest + (LONG)dwHeightInPixels * lDestStride;
+    const BYTE* pSrcUV = pSrc + (LONG)dwHeightInPixels * lSrcStride;
+    const DWORD uvPlaneHeight = dwHeightInPixels / 2;
+    const DWORD uvEnd = min(rcDest.bottom, dwHeightInPixels) / 2;
+    const DWORD uvBegin = min(rcDest.top / 2, uvEnd);
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
+    const UINT32 xBegin = min(rcDest.left & ~1, xEnd);
+    const int pairThreshold = threshold * 2;
+    BYTE* chromaDeviation = m_chromaDeviation.data();
+    BYTE* chromaSpread = m_chromaSpread.data();
+
+    for (DWORD y = 0; y < uvPlaneHeight; y++)
+    {
+        const BYTE* srcLine = pSrcUV + (LONG)y * lSrcStride;
+        BYTE* destLine = pDestUV + (LONG)y * lDestStride;
+        const bool lineInRect = (y >= uvBegin && y < uvEnd);
+
+        if (lineInRect || !roiOnly)
+        {
+            const UINT32 updateBegin = roiOnly ? xBegin : 0;
+            const UINT32 updateEnd = roiOnly ? xEnd : (dwWidthInPixels & ~1);
+
+            m_chromaBackground.update(y, srcLine, BackgroundModel::PlanarBytes,
+                updateBegin, updateEnd, learningShift, chromaDeviation, chromaSpread);
+
+            if (useLuma)
+            {
+                for (UINT32 i = 0; i < 2; ++i)
+                {
+                    m_lumaBackground.update(y * 2 + i, pSrc + (LONG)(y * 2 + i) * lSrcStride, BackgroundModel::PlanarBytes,
+                        updateBegin, updateEnd, learningShift,
+                        &m_lumaDeviation[i * dwWidthInPixels], &m_lumaSpread[i * dwWidthInPixels]);
+                }
+            }
         }
 
-        if (rectWidth > 0)
+        if (!lineInRect)
         {
-            pDest += rectWidth;
-            pSrc += rectWidth;
-            pPreviousFrame += rectWidth;
-            yPlaneDest += rectWidth;
-            yPlanePreviousFrame += rectWidth;
-            memcpy(pDest, pSrc, dwWidthInPixels - rcDest.right);
-            pDest += dwWidthInPixels - rcDest.right;
-            pSrc += dwWidthInPixels - rcDest.right;
-            pPreviousFrame += dwWidthInPixels - rcDest.right;
-            yPlaneDest += dwWidthInPixels - rcDest.right + lDestStride;
-            yPlanePreviousFrame += dwWidthInPixels - rcDest.right + lSrcStride;
+            // Lines above and below the destination rectangle.
+            memcpy(destLine, srcLine, dwWidthInPixels);
+            continue;
         }
-        else
+
+        memcpy(destLine, srcLine, xBegin);
+        memcpy(destLine + xEnd, srcLine + xEnd, dwWidthInPixels - xEnd);
+
+        BYTE* yLines[2] =
         {
-            pDest += lDestStride;
-            pSrc += lSrcStride;
-            pPreviousFrame += lSrcStride;
-            yPlaneDest += lDestStride * 2;
-            yPlanePreviousFrame += lSrcStride * 2;
+            pDest + (LONG)y * 2 * lDestStride,
+            pDest + (LONG)(y * 2 + 1) * lDestStride
+        };
+
+        for (UINT32 x = xBegin; x < xEnd; x += 2)
+        {
+            const bool chromaChanged = exceedsBackground(
+                chromaDeviation[x] + chromaDeviation[x + 1], chromaSpread[x] + chromaSpread[x + 1],
+                pairThreshold, adaptiveThreshold);
+
+            destLine[x] = chromaChanged ? 0x0 : 0x80;
+            destLine[x + 1] = chromaChanged ? 0x0 : 0x80;
+
+            for (UINT32 line = 0; line < 2; ++line)
+            {
+                const BYTE* lumaDeviation = &m_lumaDeviation[line * dwWidthInPixels];
+                const BYTE* lumaSpread = &m_lumaSpread[line * dwWidthInPixels];
+
+                for (UINT32 i = x; i < x + 2; ++i)
+                {
+                    const bool changed = chromaChanged
+                        || (useLuma && exceedsBackground(lumaDeviation[i], lumaSpread[i], threshold, adaptiveThreshold));
+
+                    yLines[line][i] = changed ? SelectedPixelValue : 0x0;
+                }
+            }
         }
     }
+}
+
+
+//-------------------------------------------------------------------
+// storeChroma
+//
+// Stores the chroma of the whole frame into the slot of the oldest
+// frame in the history.
+//-------------------------------------------------------------------
+void ChromaDeltaEffect::storeChroma(
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+    _In_ LONG lSrcStride,
+    _In_ DWORD dwWidthInPixels,
+    _In_ DWORD dwHeightInPixels)
+{
+    BYTE* history = m_chromaHistory.oldestFrame();
 
-    // Lines below the destination rectangle.
-    for (; y < dwHeightInPixels / 2; y++)
+    if (m_videoFormatSubtype == MFVideoFormat_NV12)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
+        const BYTE* pSrcUV = pSrc + (LONG)dwHeightInPixels * lSrcStride;
+
+        for (DWORD y = 0; y < dwHeightInPixels / 2; y++)
+        {
+            memcpy(history + y * dwWidthInPixels, pSrcUV + (LONG)y * lSrcStride, dwWidthInPixels);
+        }
+    }
+    else
+    {
+        for (DWORD y = 0; y < dwHeightInPixels; y++)
+        {
+            const WORD* pSrc_Pixel = (const WORD*)(pSrc + (LONG)y * lSrcStride);
+            BYTE* chroma = history + y * dwWidthInPixels;
+
+            for (UINT32 x = 0; x < dwWidthInPixels; ++x)
+            {
+                chroma[x] = pSrc_Pixel[x] >> 8;
+            }
+        }
     }
 }
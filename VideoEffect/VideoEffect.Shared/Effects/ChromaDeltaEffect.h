@@ -2,6 +2,8 @@
 #define CHROMADELTAEFFECT_H
 
 #include "AbstractEffect.h"
+#include "ImageProcessing\BackgroundModel.h"
+#include "ImageProcessing\FrameHistory.h"
 
 
 class ChromaDeltaEffect : public AbstractEffect
@@ -29,6 +31,7 @@ protected: // New methods
     void applyChromaDeltaYUY2(
         const BYTE& threshold,
         const bool& dimmFilteredPixels,
+        const bool& roiHistoryOnly,
         const D2D_RECT_U& rcDest,
         _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
         _In_ LONG lDestStride,
@@ -40,6 +43,7 @@ protected: // New methods
     void applyChromaDeltaNV12(
         const BYTE& threshold,
         const bool& dimmFilteredPixels,
+        const bool& roiHistoryOnly,
         const D2D_RECT_U& rcDest,
         _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
         _In_ LONG lDestStride,
@@ -48,8 +52,57 @@ protected: // New methods
         _In_ DWORD dwWidthInPixels,
         _In_ DWORD dwHeightInPixels);
 
+    void subtractBackground(
+        const D2D_RECT_U& rcDest,
+        _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
+        _In_ LONG lDestStride,
+        _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+        _In_ LONG lSrcStride,
+        _In_ DWORD dwWidthInPixels,
+        _In_ DWORD dwHeightInPixels);
+
+    void subtractBackgroundYUY2(
+        const BYTE& threshold,
+        const bool& adaptiveThreshold,
+        const bool& useLuma,
+        const bool& roiOnly,
+        const int& learningShift,
+        const D2D_RECT_U& rcDest,
+        _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
+        _In_ LONG lDestStride,
+        _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+        _In_ LONG lSrcStride,
+        _In_ DWORD dwWidthInPixels,
+        _In_ DWORD dwHeightInPixels);
+
+    void subtractBackgroundNV12(
+        const BYTE& threshold,
+        const bool& adaptiveThreshold,
+        const bool& useLuma,
+        const bool& roiOnly,
+        const int& learningShift,
+        const D2D_RECT_U& rcDest,
+        _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
+        _In_ LONG lDestStride,
+        _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+        _In_ LONG lSrcStride,
+        _In_ DWORD dwWidthInPixels,
+        _In_ DWORD dwHeightInPixels);
+
+    void storeChroma(
+        _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+        _In_ LONG lSrcStride,
+        _In_ DWORD dwWidthInPixels,
+        _In_ DWORD dwHeightInPixels);
+
 protected: // Members
-    BYTE* m_previousFrame;
+    FrameHistory m_chromaHistory; // Chroma samples only, U and V interleaved
+    BackgroundModel m_chromaBackground; // U and V interleaved
+    BackgroundModel m_lumaBackground;
+    std::vector<BYTE> m_chromaDeviation;
+    std::vector<BYTE> m_chromaSpread;
+    std::vector<BYTE> m_lumaDeviation; // Two lines for NV12
+    std::vector<BYTE> m_lumaSpread;
 };
 
 #endif // CHROMADELTAEFFECT_H
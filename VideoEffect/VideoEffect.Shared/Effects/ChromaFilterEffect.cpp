@@ -2,12 +2,21 @@
 
 #include "ChromaFilterEffect.h"
 #include "ImageProcessing\ImageProcessingCommon.h"
+#include "RowBandExecutor.h"
 #include "Settings.h"
 
 
 ChromaFilterEffect::ChromaFilterEffect(GUID videoFormatSubtype)
-    : AbstractEffect(videoFormatSubtype)
+    : AbstractEffect(videoFormatSubtype),
+    m_threshold(0),
+    m_dimmUnselectedPixels(false)
 {
+    m_targetYuv[0] = 0;
+    m_targetYuv[1] = 0;
+    m_targetYuv[2] = 0;
+
+    // The bands collect their histograms separately
+    m_parallelExecutionEnabled = true;
 }
 
 
@@ -22,17 +31,25 @@ void ChromaFilterEffect::apply(
 {
     m_objectDetails.reset();
 
+    if (captureSettings())
+    {
+        m_targetYuv[0] = static_cast<BYTE>(m_snapshot->targetYuv[0]);
+        m_targetYuv[1] = static_cast<BYTE>(m_snapshot->targetYuv[1]);
+        m_targetYuv[2] = static_cast<BYTE>(m_snapshot->targetYuv[2]);
+        m_threshold = static_cast<BYTE>(m_snapshot->threshold);
+    }
+
     if (m_videoFormatSubtype == MFVideoFormat_YUY2)
     {
         applyYUY2(m_objectDetails,
-            m_settings->m_targetYuv, (BYTE)m_settings->m_threshold,
+            m_targetYuv, m_threshold,
             m_dimmUnselectedPixels, targetRect, destination, destinationStride, source, sourceStride,
             widthInPixels, heightInPixels);
     }
     else if (m_videoFormatSubtype == MFVideoFormat_NV12)
     {
         applyNV12(m_objectDetails,
-            m_settings->m_targetYuv, (BYTE)m_settings->m_threshold,
+            m_targetYuv, m_threshold,
             m_dimmUnselectedPixels, targetRect, destination, destinationStride, source, sourceStride,
             widthInPixels, heightInPixels);
     }
@@ -94,7 +111,7 @@ inline void ChromaFilterEffect::getColorFilteredValues(
 //-------------------------------------------------------------------
 inline void ChromaFilterEffect::applyYUY2(
     ObjectDetails& objectDetails,
-    const float* pTargetYUV,
+    const BYTE* pTargetYUV,
     const BYTE& threshold,
     const bool& dimmFilteredPixels,
     const D2D_RECT_U& rcDest,
@@ -105,120 +122,32 @@ inline void ChromaFilterEffect::applyYUY2(
     _In_ DWORD dwWidthInPixels,
     _In_ DWORD dwHeightInPixels)
 {
-    DWORD y = 0;
-    const DWORD y0 = min(rcDest.bottom, dwHeightInPixels);
+    const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
+    const DWORD yBegin = min(rcDest.top, yEnd);
 
-    // Lines above the destination rectangle.
-    for (; y < rcDest.top; y++)
+    // Lines above and below the destination rectangle.
+    for (DWORD y = 0; y < yBegin; y++)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels * 2);
     }
 
-    const BYTE targetY = static_cast<BYTE>(pTargetYUV[0]);
-    const BYTE targetU = static_cast<BYTE>(pTargetYUV[1]);
-    const BYTE targetV = static_cast<BYTE>(pTargetYUV[2]);
-
-    int greatestSelectedPixelsCountY = 0;
-    int mostSelectedPixelsY = -1;
-    int numberOfSelectedPixelsY = 0;
-    int *numberOfSelectedPixelsX = new int[dwWidthInPixels];
-
-    memset(numberOfSelectedPixelsX, 0, dwWidthInPixels * sizeof(int));
-
-    // Lines within the destination rectangle.
-    for (; y < y0; y++)
+    for (DWORD y = yEnd; y < dwHeightInPixels; y++)
     {
-        numberOfSelectedPixelsY = 0;
-
-        WORD *pSrc_Pixel = (WORD*)pSrc;
-        WORD *pDest_Pixel = (WORD*)pDest;
-
-        for (UINT32 x = 0; (x + 1) < dwWidthInPixels; x += 2)
-        {
-            // Byte order is Y0 U0 Y1 V0
-            // Each WORD is a byte pair (Y, U/V)
-            // Windows is little-endian so the order appears reversed.
-
-            if (x >= rcDest.left && x < rcDest.right)
-            {
-                BYTE y0 = pSrc_Pixel[x] & 0x00FF;
-                BYTE u = pSrc_Pixel[x] >> 8;
-                BYTE y1 = pSrc_Pixel[x + 1] & 0x00FF;
-                BYTE v = pSrc_Pixel[x + 1] >> 8;
-
-                getColorFilteredValues(&y0, &u, &v, targetY, targetU, targetV, threshold, dimmFilteredPixels);
-                getColorFilteredValues(&y1, &u, &v, targetY, targetU, targetV, threshold, dimmFilteredPixels);
-
-                pDest_Pixel[x] = y0 | (u << 8);
-                pDest_Pixel[x + 1] = y1 | (v << 8);
-
-                if (y0 == SelectedPixelValue)
-                {
-                    numberOfSelectedPixelsY++;
-                    numberOfSelectedPixelsX[x]++;
-                }
-
-                if (y1 == SelectedPixelValue)
-                {
-                    numberOfSelectedPixelsY++;
-                    numberOfSelectedPixelsX[x]++;
-                }
-            }
-            else
-            {
-#pragma warning(push)
-#pragma warning(disable: 6385) 
-#pragma warning(disable: 6386) 
-                pDest_Pixel[x] = pSrc_Pixel[x];
-                pDest_Pixel[x + 1] = pSrc_Pixel[x + 1];
-#pragma warning(pop)
-            }
-        }
-
-        pDest += lDestStride;
-        pSrc += lSrcStride;
-
-        if (numberOfSelectedPixelsY > greatestSelectedPixelsCountY)
-        {
-            greatestSelectedPixelsCountY = numberOfSelectedPixelsY;
-#pragma warning(push)
-#pragma warning(disable: 4258)
-            mostSelectedPixelsY = y;
-#pragma warning(pop)
-        }
-    }
-
-    // Lines below the destination rectangle.
-    for (; y < dwHeightInPixels; y++)
-    {
-        memcpy(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels * 2);
     }
 
-    int mostSelectedPixelsX = -1;
-    int greatestSelectedPixelsCountX = 0;
-
-    for (uint32 x = 0; x < dwWidthInPixels; ++x)
-    {
-        if (numberOfSelectedPixelsX[x] > greatestSelectedPixelsCountX)
-        {
-            greatestSelectedPixelsCountX = numberOfSelectedPixelsX[x];
-            mostSelectedPixelsX = x;
-        }
-    }
+    // Lines within the destination rectangle.
+    RowBandExecutor executor(yBegin, yEnd, m_parallelExecutionEnabled);
+    resetRowBandStatistics(executor.bandCount(), dwWidthInPixels);
 
-    if (mostSelectedPixelsX >= 0 && mostSelectedPixelsY >= 0)
+    executor.run([&](const UINT32& bandIndex, const UINT32& top, const UINT32& bottom)
     {
-        objectDetails._centerX = static_cast<UINT32>(mostSelectedPixelsX);
-        objectDetails._centerY = static_cast<UINT32>(mostSelectedPixelsY);
-        objectDetails._width = greatestSelectedPixelsCountY * 2;
-        objectDetails._height = greatestSelectedPixelsCountX * 2;
-    }
+        filterRowBandYUY2(
+            m_rowBandStatistics[bandIndex], pTargetYUV, threshold, dimmFilteredPixels, rcDest,
+            pDest, lDestStride, pSrc, lSrcStride, dwWidthInPixels, top, bottom);
+    });
 
-    delete[] numberOfSelectedPixelsX;
+    mergeRowBandStatistics(executor.bandCount(), dwWidthInPixels, objectDetails);
 }
 
 
@@ -229,7 +158,7 @@ inline void ChromaFilterEffect::applyYUY2(
 //-------------------------------------------------------------------
 inline void ChromaFilterEffect::applyNV12(
     ObjectDetails& objectDetails,
-    const float* pTargetYUV,
+    const BYTE* pTargetYUV,
     const BYTE& threshold,
     const bool& dimmFilteredPixels,
     const D2D_RECT_U& rcDest,
@@ -242,90 +171,209 @@ inline void ChromaFilterEffect::applyNV12(
 {
     // NV12 is planar: Y plane, followed by packed U-V plane.
 
-    BYTE* destBegin = pDest; // Keep the first index stored for later
+    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    const DWORD uvPlaneHeight = dwHeightInPixels / 2;
+    const DWORD uvEnd = min(rcDest.bottom, dwHeightInPixels) / 2;
+    const DWORD uvBegin = min(rcDest.top / 2, uvEnd);
 
-    CopyMemory(pDest, pSrc, dwWidthInPixels * dwHeightInPixels);
-    pDest += lDestStride * dwHeightInPixels;
-    pSrc += lSrcStride * dwHeightInPixels;
+    BYTE* pDestUV = pDest + (LONG)dwHeightInPixels * lDestStride;
+    const BYTE* pSrcUV = pSrc + (LONG)dwHeightInPixels * lSrcStride;
 
-    // U-V plane
+    // Lines above and below the destination rectangle.
+    for (DWORD y = 0; y < uvBegin * 2; y++)
+    {
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels);
+    }
 
-    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    for (DWORD y = uvEnd * 2; y < dwHeightInPixels; y++)
+    {
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels);
+    }
 
-    // Lines above the destination rectangle.
-    const UINT32 numberOfLinesAboveDestRect = rcDest.top / 2;
-    BYTE* yPlaneDest = destBegin;
-    DWORD y = 0;
+    for (DWORD y = 0; y < uvBegin; y++)
+    {
+        memcpy(pDestUV + (LONG)y * lDestStride, pSrcUV + (LONG)y * lSrcStride, dwWidthInPixels);
+    }
 
-    if (numberOfLinesAboveDestRect > 0)
+    for (DWORD y = uvEnd; y < uvPlaneHeight; y++)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels * numberOfLinesAboveDestRect);
-        pSrc += lSrcStride * numberOfLinesAboveDestRect;
-        const LONG temp = lDestStride * numberOfLinesAboveDestRect;
-        pDest += temp;
-        yPlaneDest += temp * 2;
-        y += numberOfLinesAboveDestRect - 1;
+        memcpy(pDestUV + (LONG)y * lDestStride, pSrcUV + (LONG)y * lSrcStride, dwWidthInPixels);
     }
 
-    const BYTE targetY = static_cast<BYTE>(pTargetYUV[0]);
-    const BYTE targetU = static_cast<BYTE>(pTargetYUV[1]);
-    const BYTE targetV = static_cast<BYTE>(pTargetYUV[2]);
+    // Lines within the destination rectangle. The bands are U-V plane
+    // lines, each covering two lines of the Y plane.
+    RowBandExecutor executor(uvBegin, uvEnd, m_parallelExecutionEnabled);
+    resetRowBandStatistics(executor.bandCount(), dwWidthInPixels);
+
+    executor.run([&](const UINT32& bandIndex, const UINT32& uvTop, const UINT32& uvBottom)
+    {
+        filterRowBandNV12(
+            m_rowBandStatistics[bandIndex], pTargetYUV, threshold, dimmFilteredPixels, rcDest,
+            pDest, lDestStride, pSrc, lSrcStride, dwWidthInPixels, dwHeightInPixels, uvTop, uvBottom);
+    });
+
+    mergeRowBandStatistics(executor.bandCount(), dwWidthInPixels, objectDetails);
+}
 
-    int numberOfSelectedPixelsY = 0;
-    int *numberOfSelectedPixelsX = new int[dwWidthInPixels];
 
-    for (uint32 i = 0; i < dwWidthInPixels; ++i)
+//-------------------------------------------------------------------
+// filterRowBandYUY2
+//
+// Filters the lines [top, bottom) of a YUY2 image and collects the
+// selected pixel histograms of the band into the given statistics.
+// Touches only the given lines so that the bands can be processed
+// concurrently.
+//-------------------------------------------------------------------
+void ChromaFilterEffect::filterRowBandYUY2(
+    RowBandStatistics& statistics,
+    const BYTE* pTargetYUV,
+    const BYTE& threshold,
+    const bool& dimmFilteredPixels,
+    const D2D_RECT_U& rcDest,
+    BYTE* pDest, const LONG& lDestStride,
+    const BYTE* pSrc, const LONG& lSrcStride,
+    const DWORD& dwWidthInPixels,
+    const UINT32& top, const UINT32& bottom)
+{
+    // Byte order is Y0 U0 Y1 V0 so only whole pixel pairs starting
+    // from an even X coordinate are filtered
+    const UINT32 xBegin = (rcDest.left + 1) & ~1;
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels & ~1);
+    const BYTE targetY = pTargetYUV[0];
+    const BYTE targetU = pTargetYUV[1];
+    const BYTE targetV = pTargetYUV[2];
+    int* numberOfSelectedPixelsX = &statistics.numberOfSelectedPixelsX[0];
+
+    for (UINT32 y = top; y < bottom; ++y)
     {
-        numberOfSelectedPixelsX[i] = 0;
-    }
+        const BYTE* srcLine = pSrc + (LONG)y * lSrcStride;
+        BYTE* destLine = pDest + (LONG)y * lDestStride;
 
-    int greatestSelectedPixelsCountY = 0;
-    int mostSelectedPixelsY = -1;
+        if (xBegin >= xEnd)
+        {
+            memcpy(destLine, srcLine, dwWidthInPixels * 2);
+            continue;
+        }
 
+        memcpy(destLine, srcLine, xBegin * 2);
+        memcpy(destLine + xEnd * 2, srcLine + xEnd * 2, (dwWidthInPixels - xEnd) * 2);
 
-    // Lines within the destination rectangle.
-    const DWORD y0 = min(rcDest.bottom, dwHeightInPixels);
-    const DWORD endOfDestinationRectangleY = y0 / 2;
+        // Each WORD is a byte pair (Y, U/V)
+        // Windows is little-endian so the order appears reversed.
+        const WORD* pSrc_Pixel = (const WORD*)srcLine;
+        WORD* pDest_Pixel = (WORD*)destLine;
+        int numberOfSelectedPixelsY = 0;
+
+        for (UINT32 x = xBegin; x < xEnd; x += 2)
+        {
+            BYTE y0 = pSrc_Pixel[x] & 0x00FF;
+            BYTE u = pSrc_Pixel[x] >> 8;
+            BYTE y1 = pSrc_Pixel[x + 1] & 0x00FF;
+            BYTE v = pSrc_Pixel[x + 1] >> 8;
+
+            getColorFilteredValues(&y0, &u, &v, targetY, targetU, targetV, threshold, dimmFilteredPixels);
+            getColorFilteredValues(&y1, &u, &v, targetY, targetU, targetV, threshold, dimmFilteredPixels);
 
-    const DWORD rectWidth = (rcDest.right > dwWidthInPixels) ? 0 : rcDest.right - rcDest.left;
-    const DWORD endOfDestinationRectangleX = (rectWidth == 0) ? dwWidthInPixels : rectWidth;
+            pDest_Pixel[x] = y0 | (u << 8);
+            pDest_Pixel[x + 1] = y1 | (v << 8);
+
+            if (y0 == SelectedPixelValue)
+            {
+                numberOfSelectedPixelsY++;
+                numberOfSelectedPixelsX[x]++;
+            }
+
+            if (y1 == SelectedPixelValue)
+            {
+                numberOfSelectedPixelsY++;
+                numberOfSelectedPixelsX[x]++;
+            }
+        }
+
+        if (numberOfSelectedPixelsY > statistics.greatestSelectedPixelsCountY)
+        {
+            statistics.greatestSelectedPixelsCountY = numberOfSelectedPixelsY;
+            statistics.mostSelectedPixelsY = y;
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// filterRowBandNV12
+//
+// Filters the U-V plane lines [uvTop, uvBottom) of an NV12 image,
+// and the corresponding Y plane lines, and collects the selected
+// pixel histograms of the band into the given statistics.
+//-------------------------------------------------------------------
+void ChromaFilterEffect::filterRowBandNV12(
+    RowBandStatistics& statistics,
+    const BYTE* pTargetYUV,
+    const BYTE& threshold,
+    const bool& dimmFilteredPixels,
+    const D2D_RECT_U& rcDest,
+    BYTE* pDest, const LONG& lDestStride,
+    const BYTE* pSrc, const LONG& lSrcStride,
+    const DWORD& dwWidthInPixels, const DWORD& dwHeightInPixels,
+    const UINT32& uvTop, const UINT32& uvBottom)
+{
+    // U and V are interleaved so the filtered area has to start from
+    // an even X coordinate
+    const UINT32 xBegin = rcDest.left & ~1;
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
+    const BYTE targetY = pTargetYUV[0];
+    const BYTE targetU = pTargetYUV[1];
+    const BYTE targetV = pTargetYUV[2];
+    int* numberOfSelectedPixelsX = &statistics.numberOfSelectedPixelsX[0];
+
+    BYTE* pDestUV = pDest + (LONG)dwHeightInPixels * lDestStride;
+    const BYTE* pSrcUV = pSrc + (LONG)dwHeightInPixels * lSrcStride;
 
     BYTE yy = 0;
     BYTE u = 0;
     BYTE v = 0;
 
-    for (; y < endOfDestinationRectangleY; ++y)
+    for (UINT32 y = uvTop; y < uvBottom; ++y)
     {
-        numberOfSelectedPixelsY = 0;
-
-        if (rectWidth > 0 && rcDest.left > 0)
+        const BYTE* srcLineY0 = pSrc + (LONG)(y * 2) * lSrcStride;
+        const BYTE* srcLineY1 = srcLineY0 + lSrcStride;
+        const BYTE* srcLineUV = pSrcUV + (LONG)y * lSrcStride;
+        BYTE* destLineY0 = pDest + (LONG)(y * 2) * lDestStride;
+        BYTE* destLineY1 = destLineY0 + lDestStride;
+        BYTE* destLineUV = pDestUV + (LONG)y * lDestStride;
+
+        if (xBegin >= xEnd)
         {
-            memcpy(pDest, pSrc, rcDest.left);
-            pDest += rcDest.left;
-            pSrc += rcDest.left;
-            yPlaneDest += rcDest.left;
+            memcpy(destLineY0, srcLineY0, dwWidthInPixels);
+            memcpy(destLineY1, srcLineY1, dwWidthInPixels);
+            memcpy(destLineUV, srcLineUV, dwWidthInPixels);
+            continue;
         }
 
-        for (DWORD x = 0; (x + 1) < endOfDestinationRectangleX; x += 2)
+        memcpy(destLineY0, srcLineY0, xBegin);
+        memcpy(destLineY1, srcLineY1, xBegin);
+        memcpy(destLineUV, srcLineUV, xBegin);
+        memcpy(destLineY0 + xEnd, srcLineY0 + xEnd, dwWidthInPixels - xEnd);
+        memcpy(destLineY1 + xEnd, srcLineY1 + xEnd, dwWidthInPixels - xEnd);
+        memcpy(destLineUV + xEnd, srcLineUV + xEnd, dwWidthInPixels - xEnd);
+
+        int numberOfSelectedPixelsY = 0;
+
+        for (UINT32 x = xBegin; x < xEnd; x += 2)
         {
-            /*BYTE y0 = yPlaneDest[x];
-            BYTE y1 = yPlaneDest[x + 1];
-            BYTE y2 = yPlaneDest[x + dwWidthInPixels];
-            BYTE y3 = yPlaneDest[x + 1 + dwWidthInPixels];
-            BYTE yy = (y0 + y1 + y2 + y3) / 4;*/
-            yy = yPlaneDest[x];
-            u = pSrc[x];
-            v = pSrc[x + 1];
+            yy = srcLineY0[x];
+            u = srcLineUV[x];
+            v = srcLineUV[x + 1];
 
             getColorFilteredValues(&yy, &u, &v, targetY, targetU, targetV, threshold, dimmFilteredPixels);
 
-            pDest[x] = u;
-            pDest[x + 1] = v;
+            destLineUV[x] = u;
+            destLineUV[x + 1] = v;
 
-            yPlaneDest[x] = yy;
-            yPlaneDest[x + 1] = yy;
-            yPlaneDest[x + dwWidthInPixels] = yy;
-            yPlaneDest[x + 1 + dwWidthInPixels] = yy;
+            destLineY0[x] = yy;
+            destLineY0[x + 1] = yy;
+            destLineY1[x] = yy;
+            destLineY1[x + 1] = yy;
 
             if (yy == SelectedPixelValue)
             {
@@ -334,50 +382,82 @@ inline void ChromaFilterEffect::applyNV12(
             }
         }
 
-        if (rectWidth > 0)
+        if (numberOfSelectedPixelsY > statistics.greatestSelectedPixelsCountY)
         {
-            pDest += rectWidth;
-            pSrc += rectWidth;
-            yPlaneDest += rectWidth;
-            memcpy(pDest, pSrc, dwWidthInPixels - rcDest.right);
-            pDest += dwWidthInPixels - rcDest.right;
-            pSrc += dwWidthInPixels - rcDest.right;
-            yPlaneDest += dwWidthInPixels - rcDest.right + lDestStride;
-        }
-        else
-        {
-            pDest += lDestStride;
-            pSrc += lSrcStride;
-            yPlaneDest += lDestStride * 2;
+            statistics.greatestSelectedPixelsCountY = numberOfSelectedPixelsY;
+            statistics.mostSelectedPixelsY = y * 2;
         }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// resetRowBandStatistics
+//
+// Prepares the statistics of the given number of bands. The buffers
+// are kept between the frames.
+//-------------------------------------------------------------------
+void ChromaFilterEffect::resetRowBandStatistics(const UINT32& bandCount, const DWORD& dwWidthInPixels)
+{
+    if (m_rowBandStatistics.size() < bandCount)
+    {
+        m_rowBandStatistics.resize(bandCount);
+    }
+
+    for (UINT32 i = 0; i < bandCount; ++i)
+    {
+        RowBandStatistics& statistics = m_rowBandStatistics[i];
+        statistics.mostSelectedPixelsY = -1;
+        statistics.greatestSelectedPixelsCountY = 0;
+        statistics.numberOfSelectedPixelsX.assign(dwWidthInPixels, 0);
+    }
+}
 
-        if (numberOfSelectedPixelsY > greatestSelectedPixelsCountY)
+
+//-------------------------------------------------------------------
+// mergeRowBandStatistics
+//
+// Merges the statistics of the bands in band order and stores the
+// resulting object details. The result is identical to processing
+// the frame as a single band: the first line with the most selected
+// pixels wins, and the column histograms are summed.
+//-------------------------------------------------------------------
+void ChromaFilterEffect::mergeRowBandStatistics(
+    const UINT32& bandCount, const DWORD& dwWidthInPixels, ObjectDetails& objectDetails)
+{
+    int greatestSelectedPixelsCountY = 0;
+    int mostSelectedPixelsY = -1;
+
+    for (UINT32 i = 0; i < bandCount; ++i)
+    {
+        if (m_rowBandStatistics[i].greatestSelectedPixelsCountY > greatestSelectedPixelsCountY)
         {
-            greatestSelectedPixelsCountY = numberOfSelectedPixelsY;
-#pragma warning(push)
-#pragma warning(disable: 4258)
-            mostSelectedPixelsY = y * 2;
-#pragma warning(pop)
+            greatestSelectedPixelsCountY = m_rowBandStatistics[i].greatestSelectedPixelsCountY;
+            mostSelectedPixelsY = m_rowBandStatistics[i].mostSelectedPixelsY;
         }
     }
 
-    // Lines below the destination rectangle.
-    for (; y < dwHeightInPixels / 2; y++)
+    int* numberOfSelectedPixelsX = &m_rowBandStatistics[0].numberOfSelectedPixelsX[0];
+
+    for (UINT32 i = 1; i < bandCount; ++i)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
+        const int* bandSelectedPixelsX = &m_rowBandStatistics[i].numberOfSelectedPixelsX[0];
+
+        for (UINT32 x = 0; x < dwWidthInPixels; ++x)
+        {
+            numberOfSelectedPixelsX[x] += bandSelectedPixelsX[x];
+        }
     }
 
     int mostSelectedPixelsX = -1;
     int greatestSelectedPixelsCountX = 0;
 
-    for (uint32 x = 0; x < dwWidthInPixels; ++x)
+    for (UINT32 x = 0; x < dwWidthInPixels; ++x)
     {
         if (numberOfSelectedPixelsX[x] > greatestSelectedPixelsCountX)
         {
             greatestSelectedPixelsCountX = numberOfSelectedPixelsX[x];
-            mostSelectedPixelsX = x + rcDest.left;
+            mostSelectedPixelsX = x;
         }
     }
 
@@ -388,7 +468,4 @@ inline void ChromaFilterEffect::applyNV12(
         objectDetails._width = greatestSelectedPixelsCountY * 2;
         objectDetails._height = greatestSelectedPixelsCountX * 2;
     }
-
-    delete numberOfSelectedPixelsX;
 }
-
@@ -24,6 +24,15 @@ public: // New methods
     ObjectDetails currentObject() const;
     void setDimmUnselectedPixels(const bool& dimmUnselecctedPixels);
 
+protected: // Types
+    // Selected pixel histograms of a single row band
+    struct RowBandStatistics
+    {
+        int mostSelectedPixelsY;
+        int greatestSelectedPixelsCountY;
+        std::vector<int> numberOfSelectedPixelsX;
+    };
+
 protected: // New methods
     void getColorFilteredValues(
         BYTE* py, BYTE* pu, BYTE* pv,
@@ -32,7 +41,7 @@ protected: // New methods
 
     void applyYUY2(
         ObjectDetails& objectDetails,
-        const float* pTargetYUV,
+        const BYTE* pTargetYUV,
         const BYTE& threshold,
         const bool& dimmFilteredPixels,
         const D2D_RECT_U& rcDest,
@@ -45,7 +54,7 @@ protected: // New methods
 
     void applyNV12(
         ObjectDetails& objectDetails,
-        const float* pTargetYUV,
+        const BYTE* pTargetYUV,
         const BYTE& threshold,
         const bool& dimmFilteredPixels,
         const D2D_RECT_U& rcDest,
@@ -56,9 +65,37 @@ protected: // New methods
         _In_ DWORD dwWidthInPixels,
         _In_ DWORD dwHeightInPixels);
 
+    void filterRowBandYUY2(
+        RowBandStatistics& statistics,
+        const BYTE* pTargetYUV,
+        const BYTE& threshold,
+        const bool& dimmFilteredPixels,
+        const D2D_RECT_U& rcDest,
+        BYTE* pDest, const LONG& lDestStride,
+        const BYTE* pSrc, const LONG& lSrcStride,
+        const DWORD& dwWidthInPixels,
+        const UINT32& top, const UINT32& bottom);
+
+    void filterRowBandNV12(
+        RowBandStatistics& statistics,
+        const BYTE* pTargetYUV,
+        const BYTE& threshold,
+        const bool& dimmFilteredPixels,
+        const D2D_RECT_U& rcDest,
+        BYTE* pDest, const LONG& lDestStride,
+        const BYTE* pSrc, const LONG& lSrcStride,
+        const DWORD& dwWidthInPixels, const DWORD& dwHeightInPixels,
+        const UINT32& uvTop, const UINT32& uvBottom);
+
+    void resetRowBandStatistics(const UINT32& bandCount, const DWORD& dwWidthInPixels);
+    void mergeRowBandStatistics(const UINT32& bandCount, const DWORD& dwWidthInPixels, ObjectDetails& objectDetails);
+
 protected: // Members
     ObjectDetails m_objectDetails;
+    BYTE m_targetYuv[3]; // Of the settings snapshot
+    BYTE m_threshold;
     bool m_dimmUnselectedPixels;
+    std::vector<RowBandStatistics> m_rowBandStatistics;
 };
 
 #endif // CHROMAFILTEREFFECT_H
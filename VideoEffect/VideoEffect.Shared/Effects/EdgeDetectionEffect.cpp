@@ -2,12 +2,349 @@
 
 #include "EdgeDetectionEffect.h"
 #include "ImageProcessing\ImageProcessingCommon.h"
+#include "ImageProcessing\Simd.h"
+#include "RowBandExecutor.h"
 #include "Settings.h"
 
 
+// Constants
+const UINT32 LinePadding = 2; // Replicated samples on both sides of an unpacked line
+const BYTE NeutralChromaValue = 0x80;
+
+
+//-------------------------------------------------------------------
+// unpackLine
+//
+// Unpacks the samples of a line to 16 bits and replicates the first
+// and the last sample of each interleaved component to the padding.
+//-------------------------------------------------------------------
+static void unpackLine(
+    const BYTE* line, short* samples, const DWORD& count, const UINT32& step,
+    const EdgeDetectionEffect::SampleLayout& layout)
+{
+    DWORD i = 0;
+
+    if (layout == EdgeDetectionEffect::PlanarBytes)
+    {
+#if defined(VIDEOEFFECT_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+
+        for (; i + 16 <= count; i += 16)
+        {
+            const __m128i bytes = _mm_loadu_si128((const __m128i*)(line + i));
+            _mm_storeu_si128((__m128i*)(samples + i), _mm_unpacklo_epi8(bytes, zero));
+            _mm_storeu_si128((__m128i*)(samples + i + 8), _mm_unpackhi_epi8(bytes, zero));
+        }
+#elif defined(VIDEOEFFECT_NEON)
+        for (; i + 16 <= count; i += 16)
+        {
+            const uint8x16_t bytes = vld1q_u8(line + i);
+            vst1q_s16(samples + i, vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(bytes))));
+            vst1q_s16(samples + i + 8, vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(bytes))));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            samples[i] = line[i];
+        }
+    }
+    else
+    {
+        // Windows is little-endian so the luma is in the low byte of
+        // each YUY2 WORD and the chroma in the high byte
+        const WORD* words = (const WORD*)line;
+        const bool highBytes = (layout == EdgeDetectionEffect::HighBytesOfWords);
+
+#if defined(VIDEOEFFECT_SSE2)
+        const __m128i lowByteMask = _mm_set1_epi16(0x00FF);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            const __m128i packed = _mm_loadu_si128((const __m128i*)(words + i));
+
+            _mm_storeu_si128((__m128i*)(samples + i),
+                highBytes ? _mm_srli_epi16(packed, 8) : _mm_and_si128(packed, lowByteMask));
+        }
+#elif defined(VIDEOEFFECT_NEON)
+        const uint16x8_t lowByteMask = vdupq_n_u16(0x00FF);
+
+        for (; i + 8 <= count; i += 8)
+        {
+            const uint16x8_t packed = vld1q_u16(words + i);
+
+            vst1q_s16(samples + i, vreinterpretq_s16_u16(
+                highBytes ? vshrq_n_u16(packed, 8) : vandq_u16(packed, lowByteMask)));
+        }
+#endif
+        for (; i < count; ++i)
+        {
+            samples[i] = highBytes ? (words[i] >> 8) : (words[i] & 0x00FF);
+        }
+    }
+
+    for (UINT32 j = 1; j <= step; ++j)
+    {
+        samples[-(int)j] = samples[step - j];
+        samples[count - 1 + j] = samples[count - 1 + j - step];
+    }
+}
+
+
+//-------------------------------------------------------------------
+// filterLineHorizontally
+//
+// Calculates the horizontal difference and the horizontally smoothed
+// value of the samples [begin, end). The vertical pass combines these
+// into the X and Y gradients:
+//
+// ForwardDifference: s[x + 1] - s[x] and s[x]
+// Sobel: s[x + 1] - s[x - 1] and s[x - 1] + 2 s[x] + s[x + 1]
+// Scharr: s[x + 1] - s[x - 1] and 3 s[x - 1] + 10 s[x] + 3 s[x + 1]
+//
+// The results stay within [-4080, 4080] so 16 bits are enough.
+//-------------------------------------------------------------------
+static void filterLineHorizontally(
+    const short* samples, short* difference, short* smoothed,
+    const UINT32& begin, const UINT32& end, const UINT32& step,
+    const EdgeOperator& edgeOperator)
+{
+    UINT32 i = begin;
+    const UINT32 back = (edgeOperator == EdgeOperator::ForwardDifference) ? 0 : step;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i three = _mm_set1_epi16(3);
+    const __m128i ten = _mm_set1_epi16(10);
+
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m128i previous = _mm_loadu_si128((const __m128i*)(samples + i - back));
+        const __m128i current = _mm_loadu_si128((const __m128i*)(samples + i));
+        const __m128i next = _mm_loadu_si128((const __m128i*)(samples + i + step));
+        __m128i smooth = current;
+
+        if (edgeOperator == EdgeOperator::Sobel)
+        {
+            smooth = _mm_add_epi16(_mm_add_epi16(previous, next), _mm_slli_epi16(current, 1));
+        }
+        else if (edgeOperator == EdgeOperator::Scharr)
+        {
+            smooth = _mm_add_epi16(
+                _mm_mullo_epi16(_mm_add_epi16(previous, next), three),
+                _mm_mullo_epi16(current, ten));
+        }
+
+        _mm_storeu_si128((__m128i*)(difference + i), _mm_sub_epi16(next, previous));
+        _mm_storeu_si128((__m128i*)(smoothed + i), smooth);
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    for (; i + 8 <= end; i += 8)
+    {
+        const int16x8_t previous = vld1q_s16(samples + i - back);
+        const int16x8_t current = vld1q_s16(samples + i);
+        const int16x8_t next = vld1q_s16(samples + i + step);
+        int16x8_t smooth = current;
+
+        if (edgeOperator == EdgeOperator::Sobel)
+        {
+            smooth = vaddq_s16(vaddq_s16(previous, next), vshlq_n_s16(current, 1));
+        }
+        else if (edgeOperator == EdgeOperator::Scharr)
+        {
+            smooth = vmlaq_n_s16(vmulq_n_s16(vaddq_s16(previous, next), 3), current, 10);
+        }
+
+        vst1q_s16(difference + i, vsubq_s16(next, previous));
+        vst1q_s16(smoothed + i, smooth);
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        const short previous = samples[i - back];
+        const short current = samples[i];
+        const short next = samples[i + step];
+
+        difference[i] = next - previous;
+
+        if (edgeOperator == EdgeOperator::Sobel)
+        {
+            smoothed[i] = previous + 2 * current + next;
+        }
+        else if (edgeOperator == EdgeOperator::Scharr)
+        {
+            smoothed[i] = 3 * (previous + next) + 10 * current;
+        }
+        else
+        {
+            smoothed[i] = current;
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// combineLinesVertically
+//
+// Calculates the gradient magnitude |Gx| + |Gy| of the entries
+// [begin, end) from the horizontally filtered lines above, at and
+// below the current line. The magnitude is normalized by the weights
+// of the operator so that all the operators produce values within
+// [0, 510], like the forward difference.
+//
+// If direction is given, the gradient direction is quantized into it
+// as described in EdgeThinner. The sector limits are at atan(2/5)
+// and atan(5/2), close enough to 22.5 and 67.5 degrees.
+//-------------------------------------------------------------------
+static void combineLinesVertically(
+    const short* difference0, const short* difference1, const short* difference2,
+    const short* smoothed0, const short* smoothed1, const short* smoothed2,
+    short* magnitude, BYTE* direction, const UINT32& begin, const UINT32& end,
+    const EdgeOperator& edgeOperator)
+{
+    UINT32 i = begin;
+    int shift = 0;
+
+    if (edgeOperator == EdgeOperator::ForwardDifference)
+    {
+        // The Y gradient is the difference to the line below
+        smoothed0 = smoothed1;
+    }
+    else
+    {
+        shift = (edgeOperator == EdgeOperator::Sobel) ? 2 : 4;
+    }
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i minusOne = _mm_set1_epi16(-1);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi16(2);
+    const __m128i three = _mm_set1_epi16(3);
+    const __m128i five = _mm_set1_epi16(5);
+    const __m128i ten = _mm_set1_epi16(10);
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+
+    for (; i + 8 <= end; i += 8)
+    {
+        const __m128i current = _mm_loadu_si128((const __m128i*)(difference1 + i));
+        __m128i gx = current;
+
+        if (edgeOperator != EdgeOperator::ForwardDifference)
+        {
+            const __m128i outer = _mm_adds_epi16(
+                _mm_loadu_si128((const __m128i*)(difference0 + i)),
+                _mm_loadu_si128((const __m128i*)(difference2 + i)));
+
+            gx = (edgeOperator == EdgeOperator::Sobel)
+                ? _mm_adds_epi16(outer, _mm_adds_epi16(current, current))
+                : _mm_adds_epi16(_mm_mullo_epi16(outer, three), _mm_mullo_epi16(current, ten));
+        }
+
+        const __m128i gy = _mm_subs_epi16(
+            _mm_loadu_si128((const __m128i*)(smoothed2 + i)),
+            _mm_loadu_si128((const __m128i*)(smoothed0 + i)));
+
+        // SSE2 has no 16-bit absolute value: |a| = max(a, -a)
+        const __m128i absGx = _mm_max_epi16(gx, _mm_subs_epi16(zero, gx));
+        const __m128i absGy = _mm_max_epi16(gy, _mm_subs_epi16(zero, gy));
+
+        _mm_storeu_si128((__m128i*)(magnitude + i),
+            _mm_sra_epi16(_mm_adds_epi16(absGx, absGy), shiftCount));
+
+        if (direction)
+        {
+            const __m128i horizontal = _mm_cmpgt_epi16(_mm_adds_epi16(absGx, absGx), _mm_mullo_epi16(absGy, five));
+            const __m128i vertical = _mm_cmpgt_epi16(_mm_adds_epi16(absGy, absGy), _mm_mullo_epi16(absGx, five));
+            const __m128i sameSign = _mm_cmpgt_epi16(_mm_xor_si128(gx, gy), minusOne);
+
+            __m128i sector = _mm_or_si128(_mm_and_si128(sameSign, one), _mm_andnot_si128(sameSign, three));
+            sector = _mm_or_si128(_mm_and_si128(vertical, two), _mm_andnot_si128(vertical, sector));
+            sector = _mm_andnot_si128(horizontal, sector);
+
+            _mm_storel_epi64((__m128i*)(direction + i), _mm_packus_epi16(sector, sector));
+        }
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    const int16x8_t shiftCount = vdupq_n_s16((short)-shift);
+
+    for (; i + 8 <= end; i += 8)
+    {
+        const int16x8_t current = vld1q_s16(difference1 + i);
+        int16x8_t gx = current;
+
+        if (edgeOperator != EdgeOperator::ForwardDifference)
+        {
+            const int16x8_t outer = vqaddq_s16(vld1q_s16(difference0 + i), vld1q_s16(difference2 + i));
+
+            gx = (edgeOperator == EdgeOperator::Sobel)
+                ? vqaddq_s16(outer, vqaddq_s16(current, current))
+                : vqaddq_s16(vmulq_n_s16(outer, 3), vmulq_n_s16(current, 10));
+        }
+
+        const int16x8_t gy = vqsubq_s16(vld1q_s16(smoothed2 + i), vld1q_s16(smoothed0 + i));
+        const int16x8_t absGx = vqabsq_s16(gx);
+        const int16x8_t absGy = vqabsq_s16(gy);
+
+        vst1q_s16(magnitude + i, vshlq_s16(vqaddq_s16(absGx, absGy), shiftCount));
+
+        if (direction)
+        {
+            const uint16x8_t horizontal = vcgtq_s16(vqaddq_s16(absGx, absGx), vmulq_n_s16(absGy, 5));
+            const uint16x8_t vertical = vcgtq_s16(vqaddq_s16(absGy, absGy), vmulq_n_s16(absGx, 5));
+            const uint16x8_t sameSign = vcgeq_s16(veorq_s16(gx, gy), vdupq_n_s16(0));
+
+            uint16x8_t sector = vbslq_u16(sameSign, vdupq_n_u16(1), vdupq_n_u16(3));
+            sector = vbslq_u16(vertical, vdupq_n_u16(2), sector);
+            sector = vbicq_u16(sector, horizontal);
+
+            vst1_u8(direction + i, vmovn_u16(sector));
+        }
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        int gx = difference1[i];
+
+        if (edgeOperator == EdgeOperator::Sobel)
+        {
+            gx = difference0[i] + 2 * gx + difference2[i];
+        }
+        else if (edgeOperator == EdgeOperator::Scharr)
+        {
+            gx = 3 * (difference0[i] + difference2[i]) + 10 * gx;
+        }
+
+        const int gy = smoothed2[i] - smoothed0[i];
+        const int absGx = abs(gx);
+        const int absGy = abs(gy);
+
+        magnitude[i] = (short)((absGx + absGy) >> shift);
+
+        if (direction)
+        {
+            if (absGx * 2 > absGy * 5)
+            {
+                direction[i] = 0;
+            }
+            else if (absGy * 2 > absGx * 5)
+            {
+                direction[i] = 2;
+            }
+            else
+            {
+                direction[i] = ((gx ^ gy) >= 0) ? 1 : 3;
+            }
+        }
+    }
+}
+
+
 EdgeDetectionEffect::EdgeDetectionEffect(GUID videoFormatSubtype)
     : AbstractEffect(videoFormatSubtype)
 {
+    // Each band has buffers of its own and writes only its own lines
+    m_parallelExecutionEnabled = true;
 }
 
 
@@ -20,13 +357,19 @@ void EdgeDetectionEffect::apply(
     _In_ DWORD widthInPixels,
     _In_ DWORD heightInPixels)
 {
+    captureSettings();
+
+    const EdgeOperator edgeOperator = (EdgeOperator)m_snapshot->edgeOperator;
+    const bool useChroma = m_snapshot->edgeDetectionUsesChroma;
+    const bool thinEdges = m_snapshot->thinEdges;
+
     if (m_videoFormatSubtype == MFVideoFormat_YUY2)
     {
-        applyYUY2((BYTE)m_settings->m_threshold, true, targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
+        applyYUY2((BYTE)m_snapshot->threshold, edgeOperator, useChroma, thinEdges, targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
     }
     else if (m_videoFormatSubtype == MFVideoFormat_NV12)
     {
-        applyNV12((BYTE)m_settings->m_threshold, true, targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
+        applyNV12((BYTE)m_snapshot->threshold, edgeOperator, useChroma, thinEdges, targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
     }
     else
     {
@@ -35,23 +378,19 @@ void EdgeDetectionEffect::apply(
 }
 
 
-inline BYTE EdgeDetectionEffect::calculateGradient(
-    const BYTE& y0, const BYTE& u0, const BYTE& v0,
-    const BYTE& y1, const BYTE& u1, const BYTE& v1)
-{
-    return abs(y0 - y1) + abs(u0 - u1) + abs(v0 - v1);
-}
-
-
-
 //-------------------------------------------------------------------
-// gradientTransformImageYUY2
-//
+// applyYUY2
 //
+// Marks the pixels, whose gradient magnitude exceeds twice the given
+// threshold, with SelectedPixelValue and the others with zero. If
+// thinEdges is true, the edges are thinned with EdgeThinner using
+// the limit as the low and twice the limit as the high threshold.
 //-------------------------------------------------------------------
 void EdgeDetectionEffect::applyYUY2(
     const BYTE& threshold,
-    const bool& dimmFilteredPixels,
+    const EdgeOperator& edgeOperator,
+    const bool& useChroma,
+    const bool& thinEdges,
     const D2D_RECT_U& rcDest,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
     _In_ LONG lDestStride,
@@ -60,145 +399,79 @@ void EdgeDetectionEffect::applyYUY2(
     _In_ DWORD dwWidthInPixels,
     _In_ DWORD dwHeightInPixels)
 {
-    DWORD y = 0;
     const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
+    const DWORD yBegin = min(rcDest.top, yEnd);
+    const UINT32 xBegin = rcDest.left & ~1;
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
 
-    // Lines above the destination rectangle.
-    for (; y < rcDest.top; y++)
+    // Lines above and below the destination rectangle.
+    for (DWORD y = 0; y < yBegin; y++)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels * 2);
     }
 
-    WORD *pSrc_Pixel = NULL;
-    WORD *pDest_Pixel = NULL;
-    BYTE y0 = 0x0;
-    BYTE y1 = 0x0;
-    BYTE y2 = 0x0;
-    BYTE y3 = 0x0;
-    BYTE u0 = 0x0;
-    BYTE v0 = 0x0;
-    BYTE u1 = 0x0;
-    BYTE v1 = 0x0;
-    //BYTE ySum = 0x0;
-    BYTE newY0 = 0x0;
-    BYTE newY1 = 0x0;
-
-    // Lines within the destination rectangle.
-    for (; y < yEnd; y++)
+    for (DWORD y = yEnd; y < dwHeightInPixels; y++)
     {
-        pSrc_Pixel = (WORD*)pSrc;
-        pDest_Pixel = (WORD*)pDest;
-
-        for (UINT32 x = 0; (x + 1) < dwWidthInPixels; x += 2)
-        {
-            // Byte order is Y0 U0 Y1 V0
-            // Each WORD is a byte pair (Y, U/V)
-            // Windows is little-endian so the order appears reversed.
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels * 2);
+    }
 
-            if (x >= rcDest.left && x < rcDest.right)
-            {
-                y0 = pSrc_Pixel[x] & 0x00FF;
-                u0 = pSrc_Pixel[x] >> 8;
-                y1 = pSrc_Pixel[x + 1] & 0x00FF;
-                v0 = pSrc_Pixel[x + 1] >> 8;
+    // Lines within the destination rectangle.
+    const int limit = threshold * 2;
+    EdgeThinner* thinner = NULL;
 
-                //ySum = y0 + y1;
+    if (thinEdges && xBegin < xEnd)
+    {
+        thinner = &m_edgeThinner;
+        thinner->resize(xEnd - xBegin, yEnd - yBegin);
+    }
 
-                if (x + 2 < dwWidthInPixels)
-                {
-                    // There is at least one pixel on the right
-                    y2 = pSrc_Pixel[x + 2] & 0x00ff;
-                    y3 = pSrc_Pixel[x + 3] & 0x00ff;
-                    u1 = pSrc_Pixel[x + 2] >> 8;
-                    v1 = pSrc_Pixel[x + 3] >> 8;
+    // In place, a band would read the line above its top after the band
+    // above has overwritten it, so the lines are then done in one band
+    RowBandExecutor executor(yBegin, yEnd, m_parallelExecutionEnabled && pDest != pSrc);
+    prepareRowBandBuffers(executor.bandCount(), dwWidthInPixels);
 
-                    newY0 = calculateGradient(y0 + y1, u0, v0, y2 + y3, u1, v1);
-                }
-                else
-                {
-                    newY0 = 0x0;
-                }
+    executor.run([&](const UINT32& bandIndex, const UINT32& top, const UINT32& bottom)
+    {
+        detectEdgesYUY2(
+            m_rowBandBuffers[bandIndex], thinner, limit, edgeOperator, useChroma, rcDest,
+            pDest, lDestStride, pSrc, lSrcStride, dwWidthInPixels, dwHeightInPixels, yBegin, top, bottom);
+    });
 
-                if (y < yEnd - 1)
-                {
-                    // There is at least one line of pixels below
-                    y2 = pSrc_Pixel[x + dwWidthInPixels] & 0x00ff;
-                    y3 = pSrc_Pixel[x + 1 + dwWidthInPixels] & 0x00ff;
-                    u1 = pSrc_Pixel[x + dwWidthInPixels] >> 8;
-                    v1 = pSrc_Pixel[x + 1 + dwWidthInPixels] >> 8;
-
-                    newY1 = calculateGradient(y0 + y1, u0, v0, y2 + y3, u1, v1);
-
-                    if ((float)newY0 + (float)newY1 >= SelectedPixelValue)
-                    {
-                        newY0 = SelectedPixelValue;
-                    }
-                    else
-                    {
-                        newY0 += newY1;
-                    }
-                }
+    if (thinner)
+    {
+        thinner->thin(limit, limit * 2, m_parallelExecutionEnabled);
 
-                if (newY0 > threshold * 2)
-                {
-                    newY0 = SelectedPixelValue;
-                }
-                else
-                {
-                    newY0 = 0x0;
-                }
+        executor.run([&](const UINT32& bandIndex, const UINT32& top, const UINT32& bottom)
+        {
+            for (UINT32 y = top; y < bottom; ++y)
+            {
+                const BYTE* edges = thinner->edgeLine(y - yBegin);
+                WORD* pDest_Pixel = (WORD*)(pDest + (LONG)y * lDestStride) + xBegin;
 
-                if (newY0 == SelectedPixelValue)
-                {
-                    //u0 = 0x0;
-                    //v0 = 0x0;
-                    u0 = 0x80;
-                    v0 = 0x80;
-                }
-                else
+                for (UINT32 x = 0; x < thinner->width(); ++x)
                 {
-                    u0 = 0x80;
-                    v0 = 0x80;
+                    const WORD value = (edges[x] == SelectedPixelValue) ? SelectedPixelValue : 0x0;
+                    pDest_Pixel[x] = value | (NeutralChromaValue << 8);
                 }
-
-                pDest_Pixel[x] = newY0 | (u0 << 8);
-                pDest_Pixel[x + 1] = newY0 | (v0 << 8);
             }
-            else
-            {
-#pragma warning(push)
-#pragma warning(disable: 6385) 
-#pragma warning(disable: 6386) 
-                pDest_Pixel[x] = pSrc_Pixel[x];
-                pDest_Pixel[x + 1] = pSrc_Pixel[x + 1];
-#pragma warning(pop)
-            }
-        }
-
-        pDest += lDestStride;
-        pSrc += lSrcStride;
-    }
-
-    // Lines below the destination rectangle.
-    for (; y < dwHeightInPixels; y++)
-    {
-        memcpy(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
+        });
     }
 }
 
 
 //-------------------------------------------------------------------
-// gradientTransformImageNV12
-//
+// applyNV12
 //
+// Marks the pixels, whose gradient magnitude exceeds twice the given
+// threshold, with SelectedPixelValue and the others with zero. If
+// thinEdges is true, the edges are thinned with EdgeThinner using
+// the limit as the low and twice the limit as the high threshold.
 //-------------------------------------------------------------------
 void EdgeDetectionEffect::applyNV12(
     const BYTE& threshold,
-    const bool& dimmFilteredPixels,
+    const EdgeOperator& edgeOperator,
+    const bool& useChroma,
+    const bool& thinEdges,
     const D2D_RECT_U& rcDest,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
     _In_ LONG lDestStride,
@@ -207,152 +480,341 @@ void EdgeDetectionEffect::applyNV12(
     _In_ DWORD dwWidthInPixels,
     _In_ DWORD dwHeightInPixels)
 {
-    BYTE* destBegin = pDest; // Keep the first index stored for later
+    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    const DWORD uvPlaneHeight = dwHeightInPixels / 2;
+    const DWORD uvEnd = min(rcDest.bottom, dwHeightInPixels) / 2;
+    const DWORD uvBegin = min(rcDest.top / 2, uvEnd);
+    const UINT32 xBegin = rcDest.left & ~1;
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
 
-    CopyMemory(pDest, pSrc, dwWidthInPixels * dwHeightInPixels);
-    pDest += lDestStride * dwHeightInPixels;
-    pSrc += lSrcStride * dwHeightInPixels;
+    BYTE* pDestUV = pDest + (LONG)dwHeightInPixels * lDestStride;
+    const BYTE* pSrcUV = pSrc + (LONG)dwHeightInPixels * lSrcStride;
 
-    // U-V plane
+    // Lines above and below the destination rectangle.
+    for (DWORD y = 0; y < uvBegin * 2; y++)
+    {
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels);
+    }
 
-    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    for (DWORD y = uvEnd * 2; y < dwHeightInPixels; y++)
+    {
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels);
+    }
 
-    // Lines above the destination rectangle.
-    const UINT32 numberOfLinesAboveDestRect = rcDest.top / 2;
-    BYTE* yPlaneDest = destBegin;
-    DWORD y = 0;
+    for (DWORD y = 0; y < uvBegin; y++)
+    {
+        memcpy(pDestUV + (LONG)y * lDestStride, pSrcUV + (LONG)y * lSrcStride, dwWidthInPixels);
+    }
 
-    if (numberOfLinesAboveDestRect > 0)
+    for (DWORD y = uvEnd; y < uvPlaneHeight; y++)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels * numberOfLinesAboveDestRect);
-        pSrc += lSrcStride * numberOfLinesAboveDestRect;
-        const LONG temp = lDestStride * numberOfLinesAboveDestRect;
-        pDest += temp;
-        yPlaneDest += temp * 2;
-        y += numberOfLinesAboveDestRect - 1;
+        memcpy(pDestUV + (LONG)y * lDestStride, pSrcUV + (LONG)y * lSrcStride, dwWidthInPixels);
     }
 
-    // Lines within the destination rectangle.
-    const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
-    const DWORD endOfDestinationRectangleY = yEnd / 2;
+    // Lines within the destination rectangle. The bands are U-V plane
+    // lines, each covering two lines of the Y plane.
+    const int limit = threshold * 2;
+    EdgeThinner* thinner = NULL;
+
+    if (thinEdges && xBegin < xEnd)
+    {
+        thinner = &m_edgeThinner;
+        thinner->resize(xEnd - xBegin, (uvEnd - uvBegin) * 2);
+    }
+
+    // In place, a band would read the line above its top after the band
+    // above has overwritten it, so the lines are then done in one band
+    RowBandExecutor executor(uvBegin, uvEnd, m_parallelExecutionEnabled && pDest != pSrc);
+    prepareRowBandBuffers(executor.bandCount(), dwWidthInPixels);
+
+    executor.run([&](const UINT32& bandIndex, const UINT32& uvTop, const UINT32& uvBottom)
+    {
+        detectEdgesNV12(
+            m_rowBandBuffers[bandIndex], thinner, limit, edgeOperator, useChroma, rcDest,
+            pDest, lDestStride, pSrc, lSrcStride, dwWidthInPixels, dwHeightInPixels, uvBegin * 2, uvTop, uvBottom);
+    });
+
+    if (thinner)
+    {
+        thinner->thin(limit, limit * 2, m_parallelExecutionEnabled);
+
+        executor.run([&](const UINT32& bandIndex, const UINT32& uvTop, const UINT32& uvBottom)
+        {
+            for (UINT32 y = uvTop * 2; y < uvBottom * 2; ++y)
+            {
+                const BYTE* edges = thinner->edgeLine(y - uvBegin * 2);
+                BYTE* destLine = pDest + (LONG)y * lDestStride + xBegin;
+
+                for (UINT32 x = 0; x < thinner->width(); ++x)
+                {
+                    destLine[x] = (edges[x] == SelectedPixelValue) ? SelectedPixelValue : 0x0;
+                }
+            }
+        });
+    }
+}
+
 
-    const DWORD rectWidth = (rcDest.right > dwWidthInPixels) ? 0 : rcDest.right - rcDest.left;
-    const DWORD endOfDestinationRectangleX = (rectWidth == 0) ? dwWidthInPixels : rectWidth;
+//-------------------------------------------------------------------
+// detectEdgesYUY2
+//
+// Detects the edges on the lines [top, bottom) of a YUY2 image. If
+// thinner is given, the magnitudes and the directions are stored
+// into it instead, with firstLine as its first line.
+//-------------------------------------------------------------------
+void EdgeDetectionEffect::detectEdgesYUY2(
+    RowBandBuffers& buffers,
+    EdgeThinner* thinner,
+    const int& limit,
+    const EdgeOperator& edgeOperator,
+    const bool& useChroma,
+    const D2D_RECT_U& rcDest,
+    BYTE* pDest, const LONG& lDestStride,
+    const BYTE* pSrc, const LONG& lSrcStride,
+    const DWORD& dwWidthInPixels, const DWORD& dwHeightInPixels,
+    const UINT32& firstLine, const UINT32& top, const UINT32& bottom)
+{
+    // Byte order is Y0 U0 Y1 V0 so whole pixel pairs are processed
+    const UINT32 xBegin = rcDest.left & ~1;
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
 
-    BYTE y0 = 0x0;
-    BYTE y1 = 0x0;
-    BYTE y2 = 0x0;
-    BYTE y3 = 0x0;
-    BYTE u0 = 0x0;
-    BYTE v0 = 0x0;
-    BYTE u1 = 0x0;
-    BYTE v1 = 0x0;
-    BYTE newY0 = 0x0;
-    BYTE newY1 = 0x0;
+    buffers.luma.nextLine = -2;
+    buffers.chroma.nextLine = -2;
 
-    for (; y < endOfDestinationRectangleY; ++y)
+    for (UINT32 y = top; y < bottom; ++y)
     {
-        if (rectWidth > 0 && rcDest.left > 0)
+        const BYTE* srcLine = pSrc + (LONG)y * lSrcStride;
+        BYTE* destLine = pDest + (LONG)y * lDestStride;
+
+        if (xBegin >= xEnd)
         {
-            memcpy(pDest, pSrc, rcDest.left);
-            pDest += rcDest.left;
-            pSrc += rcDest.left;
-            yPlaneDest += rcDest.left;
+            memcpy(destLine, srcLine, dwWidthInPixels * 2);
+            continue;
         }
 
-        for (DWORD x = 0; (x + 1) < endOfDestinationRectangleX; x += 2)
+        memcpy(destLine, srcLine, xBegin * 2);
+        memcpy(destLine + xEnd * 2, srcLine + xEnd * 2, (dwWidthInPixels - xEnd) * 2);
+
+        calculateMagnitude(
+            buffers.luma, y, pSrc, lSrcStride, dwHeightInPixels,
+            dwWidthInPixels, xBegin, xEnd, 1, LowBytesOfWords, edgeOperator, thinner != NULL);
+
+        if (useChroma)
         {
-            y0 = yPlaneDest[x] + yPlaneDest[x + 1] + yPlaneDest[x + dwWidthInPixels] + yPlaneDest[x + 1 + dwWidthInPixels];
-            u0 = pSrc[x];
-            v0 = pSrc[x + 1];
+            calculateMagnitude(
+                buffers.chroma, y, pSrc, lSrcStride, dwHeightInPixels,
+                dwWidthInPixels, xBegin, xEnd, 2, HighBytesOfWords, edgeOperator, false);
+        }
 
-            if (x + 2 < endOfDestinationRectangleX)
-            {
-                // There is at least one pixel on the right
-                y1 = yPlaneDest[x + 2] + yPlaneDest[x + 3]
-                    + yPlaneDest[x + 2 + dwWidthInPixels] + yPlaneDest[x + 3 + dwWidthInPixels];
-                u1 = pSrc[x + 2];
-                v1 = pSrc[x + 3];
+        const short* lumaMagnitude = &buffers.luma.magnitude[0];
+        const short* chromaMagnitude = &buffers.chroma.magnitude[0];
 
-                newY0 = calculateGradient(y0, u0, v0, y1, u1, v1);
-            }
-            else
+        if (thinner)
+        {
+            short* magnitude = thinner->magnitudeLine(y - firstLine);
+
+            for (UINT32 x = xBegin; x < xEnd; x += 2)
             {
-                newY0 = 0x0;
+                const int chroma = useChroma ? chromaMagnitude[x] + chromaMagnitude[x + 1] : 0;
+                magnitude[x - xBegin] = (short)(lumaMagnitude[x] + chroma);
+                magnitude[x - xBegin + 1] = (short)(lumaMagnitude[x + 1] + chroma);
             }
 
-            if (y < endOfDestinationRectangleY - 1)
-            {
-                // There is at least one line of pixels below
-                y1 = yPlaneDest[x + dwWidthInPixels] + yPlaneDest[x + 1 + dwWidthInPixels]
-                    + yPlaneDest[x + dwWidthInPixels * 2] + yPlaneDest[x + 1 + dwWidthInPixels * 2];
-                u1 = pSrc[x + dwWidthInPixels];
-                v1 = pSrc[x + 1 + dwWidthInPixels];
+            memcpy(thinner->directionLine(y - firstLine), &buffers.luma.direction[xBegin], xEnd - xBegin);
+            continue;
+        }
 
-                newY1 = calculateGradient(y0, u0, v0, y1, u1, v1);
+        WORD* pDest_Pixel = (WORD*)destLine;
 
-                if ((float)newY0 + (float)newY1 >= SelectedPixelValue)
-                {
-                    newY0 = SelectedPixelValue;
-                }
-                else
-                {
-                    newY0 += newY1;
-                }
-            }
+        for (UINT32 x = xBegin; x < xEnd; x += 2)
+        {
+            // The chroma of the pixel pair is at the entries x (U) and x + 1 (V)
+            const int chroma = useChroma ? chromaMagnitude[x] + chromaMagnitude[x + 1] : 0;
+            const WORD y0 = (lumaMagnitude[x] + chroma > limit) ? SelectedPixelValue : 0x0;
+            const WORD y1 = (lumaMagnitude[x + 1] + chroma > limit) ? SelectedPixelValue : 0x0;
 
-            if (newY0 > threshold * 2)
-            {
-                newY0 = SelectedPixelValue;
-            }
-            else
-            {
-                newY0 = 0x0;
-            }
+            pDest_Pixel[x] = y0 | (NeutralChromaValue << 8);
+            pDest_Pixel[x + 1] = y1 | (NeutralChromaValue << 8);
+        }
+    }
+}
 
-            if (newY0 == SelectedPixelValue)
-            {
-                pDest[x] = 0x80;
-                pDest[x + 1] = 0x80;
-                //pDest[x] = 0x0;
-                //pDest[x + 1] = 0x0;
-            }
-            else
-            {
-                pDest[x] = 0x80;
-                pDest[x + 1] = 0x80;
-            }
 
-            yPlaneDest[x] = newY0;
-            yPlaneDest[x + 1] = newY0;
-            yPlaneDest[x + dwWidthInPixels] = newY0;
-            yPlaneDest[x + 1 + dwWidthInPixels] = newY0;
+//-------------------------------------------------------------------
+// detectEdgesNV12
+//
+// Detects the edges on the U-V plane lines [uvTop, uvBottom) of an
+// NV12 image and the corresponding Y plane lines. If thinner is
+// given, the magnitudes and the directions are stored into it
+// instead, with Y plane line firstLine as its first line.
+//-------------------------------------------------------------------
+void EdgeDetectionEffect::detectEdgesNV12(
+    RowBandBuffers& buffers,
+    EdgeThinner* thinner,
+    const int& limit,
+    const EdgeOperator& edgeOperator,
+    const bool& useChroma,
+    const D2D_RECT_U& rcDest,
+    BYTE* pDest, const LONG& lDestStride,
+    const BYTE* pSrc, const LONG& lSrcStride,
+    const DWORD& dwWidthInPixels, const DWORD& dwHeightInPixels,
+    const UINT32& firstLine, const UINT32& uvTop, const UINT32& uvBottom)
+{
+    // U and V are interleaved so the area has to start from an even X
+    const UINT32 xBegin = rcDest.left & ~1;
+    const UINT32 xEnd = min(rcDest.right, dwWidthInPixels) & ~1;
+
+    BYTE* pDestUV = pDest + (LONG)dwHeightInPixels * lDestStride;
+    const BYTE* pSrcUV = pSrc + (LONG)dwHeightInPixels * lSrcStride;
+
+    buffers.luma.nextLine = -2;
+    buffers.chroma.nextLine = -2;
+
+    for (UINT32 uvY = uvTop; uvY < uvBottom; ++uvY)
+    {
+        const BYTE* srcLineUV = pSrcUV + (LONG)uvY * lSrcStride;
+        BYTE* destLineUV = pDestUV + (LONG)uvY * lDestStride;
+
+        if (xBegin >= xEnd)
+        {
+            memcpy(destLineUV, srcLineUV, dwWidthInPixels);
+            memcpy(pDest + (LONG)(uvY * 2) * lDestStride, pSrc + (LONG)(uvY * 2) * lSrcStride, dwWidthInPixels);
+            memcpy(pDest + (LONG)(uvY * 2 + 1) * lDestStride, pSrc + (LONG)(uvY * 2 + 1) * lSrcStride, dwWidthInPixels);
+            continue;
         }
 
-        if (rectWidth > 0)
+        memcpy(destLineUV, srcLineUV, xBegin);
+        memset(destLineUV + xBegin, NeutralChromaValue, xEnd - xBegin);
+        memcpy(destLineUV + xEnd, srcLineUV + xEnd, dwWidthInPixels - xEnd);
+
+        if (useChroma)
         {
-            pDest += rectWidth;
-            pSrc += rectWidth;
-            yPlaneDest += rectWidth;
-            memcpy(pDest, pSrc, dwWidthInPixels - rcDest.right);
-            pDest += dwWidthInPixels - rcDest.right;
-            pSrc += dwWidthInPixels - rcDest.right;
-            yPlaneDest += dwWidthInPixels - rcDest.right + lDestStride;
+            calculateMagnitude(
+                buffers.chroma, uvY, pSrcUV, lSrcStride, dwHeightInPixels / 2,
+                dwWidthInPixels, xBegin, xEnd, 2, PlanarBytes, edgeOperator, false);
         }
-        else
+
+        const short* chromaMagnitude = &buffers.chroma.magnitude[0];
+
+        for (UINT32 y = uvY * 2; y < uvY * 2 + 2; ++y)
         {
-            pDest += lDestStride;
-            pSrc += lSrcStride;
-            yPlaneDest += lDestStride * 2;
+            const BYTE* srcLine = pSrc + (LONG)y * lSrcStride;
+            BYTE* destLine = pDest + (LONG)y * lDestStride;
+
+            memcpy(destLine, srcLine, xBegin);
+            memcpy(destLine + xEnd, srcLine + xEnd, dwWidthInPixels - xEnd);
+
+            calculateMagnitude(
+                buffers.luma, y, pSrc, lSrcStride, dwHeightInPixels,
+                dwWidthInPixels, xBegin, xEnd, 1, PlanarBytes, edgeOperator, thinner != NULL);
+
+            const short* lumaMagnitude = &buffers.luma.magnitude[0];
+
+            if (thinner)
+            {
+                short* magnitude = thinner->magnitudeLine(y - firstLine);
+
+                for (UINT32 x = xBegin; x < xEnd; x += 2)
+                {
+                    const int chroma = useChroma ? chromaMagnitude[x] + chromaMagnitude[x + 1] : 0;
+                    magnitude[x - xBegin] = (short)(lumaMagnitude[x] + chroma);
+                    magnitude[x - xBegin + 1] = (short)(lumaMagnitude[x + 1] + chroma);
+                }
+
+                memcpy(thinner->directionLine(y - firstLine), &buffers.luma.direction[xBegin], xEnd - xBegin);
+                continue;
+            }
+
+            for (UINT32 x = xBegin; x < xEnd; x += 2)
+            {
+                // The chroma of the 2x2 block is at the entries x (U) and x + 1 (V)
+                const int chroma = useChroma ? chromaMagnitude[x] + chromaMagnitude[x + 1] : 0;
+                destLine[x] = (lumaMagnitude[x] + chroma > limit) ? SelectedPixelValue : 0x0;
+                destLine[x + 1] = (lumaMagnitude[x + 1] + chroma > limit) ? SelectedPixelValue : 0x0;
+            }
         }
     }
+}
+
 
-    // Lines below the destination rectangle.
-    for (; y < dwHeightInPixels / 2; y++)
+//-------------------------------------------------------------------
+// calculateMagnitude
+//
+// Calculates the gradient magnitude of the entries [begin, end) of
+// the given line of a plane into window.magnitude, and optionally
+// the quantized gradient direction into window.direction. The lines
+// above and below the image are replicated from the first and the
+// last line. The lines are expected in increasing order so that each
+// line is unpacked and filtered horizontally only once.
+//-------------------------------------------------------------------
+void EdgeDetectionEffect::calculateMagnitude(
+    GradientWindow& window,
+    const int& centerLine,
+    const BYTE* pPlane, const LONG& lStride, const int& lineCount,
+    const DWORD& sampleCount, const UINT32& begin, const UINT32& end,
+    const UINT32& step, const SampleLayout& layout, const EdgeOperator& edgeOperator,
+    const bool& calculateDirection)
+{
+    short* samples = &window.samples[LinePadding];
+
+    if (window.nextLine < centerLine - 1)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
+        window.nextLine = centerLine - 1;
     }
+
+    for (; window.nextLine <= centerLine + 1; ++window.nextLine)
+    {
+        const int line = clamp(window.nextLine, 0, lineCount - 1);
+        const int slot = (window.nextLine + 3) % 3;
+
+        unpackLine(pPlane + (LONG)line * lStride, samples, sampleCount, step, layout);
+
+        filterLineHorizontally(
+            samples, &window.difference[slot][0], &window.smoothed[slot][0],
+            begin, end, step, edgeOperator);
+    }
+
+    const int above = (centerLine + 2) % 3;
+    const int center = centerLine % 3;
+    const int below = (centerLine + 1) % 3;
+
+    combineLinesVertically(
+        &window.difference[above][0], &window.difference[center][0], &window.difference[below][0],
+        &window.smoothed[above][0], &window.smoothed[center][0], &window.smoothed[below][0],
+        &window.magnitude[0], calculateDirection ? &window.direction[0] : NULL,
+        begin, end, edgeOperator);
 }
 
+
+//-------------------------------------------------------------------
+// prepareRowBandBuffers
+//
+// Makes sure there are line buffers for the given number of bands.
+// The buffers are kept between the frames.
+//-------------------------------------------------------------------
+void EdgeDetectionEffect::prepareRowBandBuffers(const UINT32& bandCount, const DWORD& dwWidthInPixels)
+{
+    if (m_rowBandBuffers.size() < bandCount)
+    {
+        m_rowBandBuffers.resize(bandCount);
+    }
+
+    for (UINT32 i = 0; i < bandCount; ++i)
+    {
+        GradientWindow* windows[] = { &m_rowBandBuffers[i].luma, &m_rowBandBuffers[i].chroma };
+
+        for (int j = 0; j < 2; ++j)
+        {
+            GradientWindow& window = *windows[j];
+            window.samples.resize(dwWidthInPixels + LinePadding * 2);
+            window.magnitude.resize(dwWidthInPixels);
+            window.direction.resize(dwWidthInPixels);
+
+            for (int k = 0; k < 3; ++k)
+            {
+                window.difference[k].resize(dwWidthInPixels);
+                window.smoothed[k].resize(dwWidthInPixels);
+            }
+        }
+    }
+}
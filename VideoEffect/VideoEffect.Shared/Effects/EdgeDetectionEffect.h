@@ -2,6 +2,8 @@
 #define EDGEDETECTIONEFFECT_H
 
 #include "AbstractEffect.h"
+#include "Common.h"
+#include "ImageProcessing\EdgeThinner.h"
 
 
 class EdgeDetectionEffect : public AbstractEffect
@@ -19,14 +21,41 @@ public: // From AbstractFilter
         _In_ DWORD widthInPixels,
         _In_ DWORD heightInPixels);
 
-protected: // New methods
-    BYTE calculateGradient(
-        const BYTE& y0, const BYTE& u0, const BYTE& v0,
-        const BYTE& y1, const BYTE& u1, const BYTE& v1);
+public: // Types
+    // How the samples of a plane are stored in a line
+    enum SampleLayout
+    {
+        PlanarBytes = 0, // NV12 Y and U-V planes
+        LowBytesOfWords = 1, // YUY2 luma
+        HighBytesOfWords = 2 // YUY2 chroma
+    };
+
+protected: // Types
+    // Rolling window of the three horizontally filtered lines around the
+    // current line of a single plane. The chroma planes are kept
+    // interleaved (U, V, U, V, ...).
+    struct GradientWindow
+    {
+        std::vector<short> samples; // Unpacked line with replicated borders
+        std::vector<short> difference[3];
+        std::vector<short> smoothed[3];
+        std::vector<short> magnitude;
+        std::vector<BYTE> direction; // See EdgeThinner
+        int nextLine;
+    };
+
+    struct RowBandBuffers
+    {
+        GradientWindow luma;
+        GradientWindow chroma;
+    };
 
+protected: // New methods
     void applyYUY2(
         const BYTE& threshold,
-        const bool& dimmFilteredPixels,
+        const EdgeOperator& edgeOperator,
+        const bool& useChroma,
+        const bool& thinEdges,
         const D2D_RECT_U& rcDest,
         _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
         _In_ LONG lDestStride,
@@ -37,7 +66,9 @@ protected: // New methods
 
     void applyNV12(
         const BYTE& threshold,
-        const bool& dimmFilteredPixels,
+        const EdgeOperator& edgeOperator,
+        const bool& useChroma,
+        const bool& thinEdges,
         const D2D_RECT_U& rcDest,
         _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
         _In_ LONG lDestStride,
@@ -45,6 +76,44 @@ protected: // New methods
         _In_ LONG lSrcStride,
         _In_ DWORD dwWidthInPixels,
         _In_ DWORD dwHeightInPixels);
+
+    void detectEdgesYUY2(
+        RowBandBuffers& buffers,
+        EdgeThinner* thinner,
+        const int& limit,
+        const EdgeOperator& edgeOperator,
+        const bool& useChroma,
+        const D2D_RECT_U& rcDest,
+        BYTE* pDest, const LONG& lDestStride,
+        const BYTE* pSrc, const LONG& lSrcStride,
+        const DWORD& dwWidthInPixels, const DWORD& dwHeightInPixels,
+        const UINT32& firstLine, const UINT32& top, const UINT32& bottom);
+
+    void detectEdgesNV12(
+        RowBandBuffers& buffers,
+        EdgeThinner* thinner,
+        const int& limit,
+        const EdgeOperator& edgeOperator,
+        const bool& useChroma,
+        const D2D_RECT_U& rcDest,
+        BYTE* pDest, const LONG& lDestStride,
+        const BYTE* pSrc, const LONG& lSrcStride,
+        const DWORD& dwWidthInPixels, const DWORD& dwHeightInPixels,
+        const UINT32& firstLine, const UINT32& uvTop, const UINT32& uvBottom);
+
+    void calculateMagnitude(
+        GradientWindow& window,
+        const int& centerLine,
+        const BYTE* pPlane, const LONG& lStride, const int& lineCount,
+        const DWORD& sampleCount, const UINT32& begin, const UINT32& end,
+        const UINT32& step, const SampleLayout& layout, const EdgeOperator& edgeOperator,
+        const bool& calculateDirection);
+
+    void prepareRowBandBuffers(const UINT32& bandCount, const DWORD& dwWidthInPixels);
+
+protected: // Members
+    std::vector<RowBandBuffers> m_rowBandBuffers;
+    EdgeThinner m_edgeThinner;
 };
 
 #endif // EDGEDETECTIONEFFECT_H
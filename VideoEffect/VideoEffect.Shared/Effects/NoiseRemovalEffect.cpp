@@ -2,17 +2,38 @@
 
 #include "NoiseRemovalEffect.h"
 
+#include "Common.h"
 #include "ImageProcessing\ImageProcessingCommon.h"
-#include "ImageProcessing\ImageProcessingUtils.h"
+#include "RowBandExecutor.h"
 #include "Settings.h"
 
-#define TWO_PIXELS_AT_A_TIME 1
+
+//-------------------------------------------------------------------
+// copyLineMargins
+//
+// Copies the bytes of the given line outside [begin, end).
+//-------------------------------------------------------------------
+static void copyLineMargins(
+    BYTE* destLine, const BYTE* srcLine, const UINT32& lineLength,
+    const UINT32& begin, const UINT32& end)
+{
+    if (begin >= end)
+    {
+        memcpy(destLine, srcLine, lineLength);
+        return;
+    }
+
+    memcpy(destLine, srcLine, begin);
+    memcpy(destLine + end, srcLine + end, lineLength - end);
+}
 
 
 NoiseRemovalEffect::NoiseRemovalEffect(GUID videoFormatSubtype)
-    : AbstractEffect(videoFormatSubtype)
+    : AbstractEffect(videoFormatSubtype),
+    m_preserveEdges(false)
 {
-
+    // Each band has filters of its own
+    m_parallelExecutionEnabled = true;
 }
 
 
@@ -35,92 +56,77 @@ void NoiseRemovalEffect::apply(
         throw "Video format not supported";
     }
 
+    captureSettings();
+
     if (m_videoFormatSubtype == MFVideoFormat_NV12)
     {
-        applyNearestNeighborSmootherNv12(targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
-        //destination = ImageProcessingUtils::copyFrame(const_cast<BYTE*>(source), ImageProcessingUtils::frameSize(widthInPixels, heightInPixels, m_videoFormatSubtype));
+        applySmootherNv12(targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
     }
     else if (m_videoFormatSubtype == MFVideoFormat_YUY2)
     {
-        applyNearestNeighborSmootherYuy2(targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
+        applySmootherYuy2(targetRect, destination, destinationStride, source, sourceStride, widthInPixels, heightInPixels);
     }
 }
 
 
-inline void NoiseRemovalEffect::getYuy2Pixel(const WORD* frame, Yuy2Pixel& pixel, const UINT32& index) const
-{
-    pixel._y0 = frame[index] & 0x00FF;
-    pixel._u = frame[index] >> 8;
-    pixel._y1 = frame[index + 1] & 0x00FF;
-    pixel._v = frame[index + 1] >> 8;
-}
-
-
-inline void NoiseRemovalEffect::getYuy2Pixel(
-    const BYTE* frame, Yuy2Pixel& pixel, const UINT32& x, const UINT32& y, const DWORD& frameWidthInPixels) const
+//-------------------------------------------------------------------
+// applySmootherYuy2
+//
+// Smooths the destination rectangle of a YUY2 image. The packed line
+// is filtered as is: the luma samples are two and the chroma samples
+// four bytes apart.
+//-------------------------------------------------------------------
+void NoiseRemovalEffect::applySmootherYuy2(
+    const D2D_RECT_U& rcDest,
+    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
+    _In_ LONG lDestStride,
+    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
+    _In_ LONG lSrcStride,
+    _In_ DWORD dwWidthInPixels,
+    _In_ DWORD dwHeightInPixels)
 {
-    getYuy2Pixel((WORD*)frame, pixel, (y * frameWidthInPixels + x));
-}
-
+    const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
+    const DWORD yBegin = min(rcDest.top, yEnd);
+    const UINT32 lineLength = dwWidthInPixels * 2;
+    const UINT32 begin = (rcDest.left & ~1) * 2;
+    const UINT32 end = (min(rcDest.right, dwWidthInPixels) & ~1) * 2;
 
-inline const UINT8 NoiseRemovalEffect::getYuy2NeighborPixels(
-    const BYTE* frame, const UINT32& x, const UINT32& y, const DWORD& frameWidthInPixels, const DWORD& frameHeightInPixels)
-{
-    UINT8 foundNeighborPixelCount = 0;
-    int currentX = 0;
-    int currentY = 0;
-    bool currentPixelExists = true;
+    // Lines above and below the destination rectangle.
+    for (DWORD y = 0; y < yBegin; y++)
+    {
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, lineLength);
+    }
 
-    for (UINT8 i = 0; i < 8; ++i)
+    for (DWORD y = yEnd; y < dwHeightInPixels; y++)
     {
-        currentX =
-            (i == 0 || i == 3 || i == 5) ? x - 2
-            : (i == 1 || i == 6) ? x
-            : x + 2;
-
-#pragma warning(push)
-#pragma warning(disable: 4018) 
-        if (currentX < 0 || currentX >= frameWidthInPixels)
-        {
-            currentPixelExists = false;
-        }
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, lineLength);
+    }
 
-        if (currentPixelExists)
-        {
-            currentY =
-                (i < 3) ? y - 1
-                : (i > 4) ? y + 1
-                : y;
-
-            if (currentY < 0 || currentY >= frameHeightInPixels)
-            {
-                currentPixelExists = false;
-            }
-        }
-#pragma warning(pop)
+    // Lines within the destination rectangle.
+    RowBandExecutor executor(yBegin, yEnd, m_parallelExecutionEnabled);
+    prepareRowBandFilters(executor.bandCount());
 
-        if (currentPixelExists)
-        {
-            getYuy2Pixel(frame, _neighborYuy2Pixels[foundNeighborPixelCount], (UINT32)currentX, (UINT32)currentY, frameWidthInPixels);
-            foundNeighborPixelCount++;
-        }
-        else
+    executor.run([&](const UINT32& bandIndex, const UINT32& top, const UINT32& bottom)
+    {
+        for (UINT32 y = top; y < bottom; ++y)
         {
-            currentPixelExists = true;
-            continue;
+            copyLineMargins(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, lineLength, begin, end);
         }
-    }
 
-    return foundNeighborPixelCount;
+        filterPlane(
+            bandIndex, pSrc, lSrcStride, pDest, lDestStride, lineLength, dwHeightInPixels,
+            begin, end, top, bottom, 2, 4);
+    });
 }
 
 
 //-------------------------------------------------------------------
-// applyNearestNeighborSmootherYuy2
-//
+// applySmootherNv12
 //
+// Smooths the destination rectangle of an NV12 image. The Y plane is
+// filtered in full resolution and the U-V plane in half resolution.
 //-------------------------------------------------------------------
-void NoiseRemovalEffect::applyNearestNeighborSmootherYuy2(
+void NoiseRemovalEffect::applySmootherNv12(
     const D2D_RECT_U& rcDest,
     _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
     _In_ LONG lDestStride,
@@ -129,261 +135,145 @@ void NoiseRemovalEffect::applyNearestNeighborSmootherYuy2(
     _In_ DWORD dwWidthInPixels,
     _In_ DWORD dwHeightInPixels)
 {
-    BYTE* sourceBeginning = const_cast<BYTE*>(pSrc);
-    DWORD y = 0;
-
-    // Lines above the destination rectangle.
-    for (; y < rcDest.top; y++)
-    {
-        memcpy(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-    }
-
-    const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
-    WORD* pSrc_Pixel = NULL;
-    WORD* pDest_Pixel = NULL;
+    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
+    const DWORD uvPlaneHeight = dwHeightInPixels / 2;
+    const DWORD uvEnd = min(rcDest.bottom, dwHeightInPixels) / 2;
+    const DWORD uvBegin = min(rcDest.top / 2, uvEnd);
+    const UINT32 begin = rcDest.left & ~1;
+    const UINT32 end = min(rcDest.right, dwWidthInPixels) & ~1;
 
-    UINT8 neighborPixelCount = 0;
-    Yuy2Pixel averagePixel;
+    BYTE* pDestUV = pDest + (LONG)dwHeightInPixels * lDestStride;
+    const BYTE* pSrcUV = pSrc + (LONG)dwHeightInPixels * lSrcStride;
 
-    // Lines within the destination rectangle.
-    for (; y < yEnd; y++)
+    // Lines above and below the destination rectangle.
+    for (DWORD y = 0; y < uvBegin * 2; y++)
     {
-        pSrc_Pixel = (WORD*)pSrc;
-        pDest_Pixel = (WORD*)pDest;
-
-        for (UINT32 x = 0; (x + 1) < dwWidthInPixels; x += 2)
-        {
-            // Byte order is Y0 U0 Y1 V0
-            // Each WORD is a byte pair (Y, U/V)
-            // Windows is little-endian so the order appears reversed.
-
-            if (x >= rcDest.left && x < rcDest.right)
-            {
-                neighborPixelCount = getYuy2NeighborPixels(sourceBeginning, x, y, dwWidthInPixels, dwHeightInPixels);
-                averagePixel.calculateAverage(_neighborYuy2Pixels, neighborPixelCount);
-
-                pDest_Pixel[x] = averagePixel._y0 | (averagePixel._u << 8);
-                pDest_Pixel[x + 1] = averagePixel._y1 | (averagePixel._v << 8);
-            }
-            else
-            {
-#pragma warning(push)
-#pragma warning(disable: 6385) 
-#pragma warning(disable: 6386) 
-                pDest_Pixel[x] = pSrc_Pixel[x];
-                pDest_Pixel[x + 1] = pSrc_Pixel[x + 1];
-#pragma warning(pop)
-            }
-        }
-
-        pDest += lDestStride;
-        pSrc += lSrcStride;
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels);
     }
 
-    // Lines below the destination rectangle.
-    for (; y < dwHeightInPixels; y++)
+    for (DWORD y = uvEnd * 2; y < dwHeightInPixels; y++)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels * 2);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
+        memcpy(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels);
     }
-}
-
-
-
-inline void NoiseRemovalEffect::getNv12Pixel(
-    const BYTE* frame, SimpleYuvPixel& pixel, const DWORD& x, const DWORD& y,
-    const DWORD& yPlaneLength, const DWORD& frameWidthInPixels) const
-{
-    bool uComesFirst = (x % 2 == 0);
-    const DWORD yIndex = y * frameWidthInPixels + x;
-    const DWORD uvLineIndex = frameWidthInPixels * (y / 2);
-
-    pixel._y = frame[yIndex];
 
-    if (uComesFirst)
+    for (DWORD y = 0; y < uvBegin; y++)
     {
-        pixel._u = frame[yPlaneLength + uvLineIndex + x];
-        pixel._v = frame[yPlaneLength + uvLineIndex + x + 1];
+        memcpy(pDestUV + (LONG)y * lDestStride, pSrcUV + (LONG)y * lSrcStride, dwWidthInPixels);
     }
-    else
+
+    for (DWORD y = uvEnd; y < uvPlaneHeight; y++)
     {
-        pixel._v = frame[yPlaneLength + uvLineIndex + x];
-        pixel._u = frame[yPlaneLength + uvLineIndex + x + 1];
+        memcpy(pDestUV + (LONG)y * lDestStride, pSrcUV + (LONG)y * lSrcStride, dwWidthInPixels);
     }
-}
 
+    // Lines within the destination rectangle. The bands are U-V plane
+    // lines, each covering two lines of the Y plane.
+    RowBandExecutor executor(uvBegin, uvEnd, m_parallelExecutionEnabled);
+    prepareRowBandFilters(executor.bandCount());
 
-inline const UINT8 NoiseRemovalEffect::getNv12NeighborPixels(
-    const BYTE* frame, const DWORD& x, const DWORD& y, const DWORD& frameWidthInPixels, const DWORD& frameHeightInPixels)
-{
-    UINT8 foundNeighborPixelCount = 0;
-    int currentX = 0;
-    int currentY = 0;
-    bool currentPixelExists = true;
-
-    for (DWORD i = 0; i < 8; ++i)
+    executor.run([&](const UINT32& bandIndex, const UINT32& uvTop, const UINT32& uvBottom)
     {
-        currentX =
-            (i == 0 || i == 3 || i == 5) ? x - 1
-            : (i == 1 || i == 6) ? x
-            : x + 1;
-
-#pragma warning(push)
-#pragma warning(disable: 4018) 
-        if (currentX < 0 || currentX >= frameWidthInPixels)
+        for (UINT32 y = uvTop * 2; y < uvBottom * 2; ++y)
         {
-            currentPixelExists = false;
+            copyLineMargins(pDest + (LONG)y * lDestStride, pSrc + (LONG)y * lSrcStride, dwWidthInPixels, begin, end);
         }
 
-        if (currentPixelExists)
+        for (UINT32 y = uvTop; y < uvBottom; ++y)
         {
-            currentY =
-                (i < 3) ? y - 1
-                : (i > 4) ? y + 1
-                : y;
-
-            if (currentY < 0 || currentY >= frameHeightInPixels)
-            {
-                currentPixelExists = false;
-            }
-#pragma warning(pop)
+            copyLineMargins(pDestUV + (LONG)y * lDestStride, pSrcUV + (LONG)y * lSrcStride, dwWidthInPixels, begin, end);
         }
 
-        if (currentPixelExists)
-        {
-            const DWORD yPlaneLength = frameWidthInPixels * frameHeightInPixels;
-            getNv12Pixel(frame, _neighborNv12Pixels[foundNeighborPixelCount], (DWORD)currentX, (DWORD)currentY, yPlaneLength, frameWidthInPixels);
-            foundNeighborPixelCount++;
-        }
-        else
-        {
-            currentPixelExists = true;
-            continue;
-        }
-    }
+        filterPlane(
+            bandIndex, pSrc, lSrcStride, pDest, lDestStride, dwWidthInPixels, dwHeightInPixels,
+            begin, end, uvTop * 2, uvBottom * 2, 1, 1);
 
-    return foundNeighborPixelCount;
+        filterPlane(
+            bandIndex, pSrcUV, lSrcStride, pDestUV, lDestStride, dwWidthInPixels, uvPlaneHeight,
+            begin, end, uvTop, uvBottom, 2, 2);
+    });
 }
 
 
 //-------------------------------------------------------------------
-// applyNearestNeighborSmootherNv12
-//
+// filterPlane
 //
+// Filters the given part of a plane with the filter of the given band
+// selected by prepareRowBandFilters().
 //-------------------------------------------------------------------
-void NoiseRemovalEffect::applyNearestNeighborSmootherNv12(
-    const D2D_RECT_U& rcDest,
-    _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
-    _In_ LONG lDestStride,
-    _In_reads_(_Inexpressible_(lSrcStride * dwHeightInPixels)) const BYTE* pSrc,
-    _In_ LONG lSrcStride,
-    _In_ DWORD dwWidthInPixels,
-    _In_ DWORD dwHeightInPixels)
+void NoiseRemovalEffect::filterPlane(
+    const UINT32& bandIndex,
+    const BYTE* pSrc, const LONG& lSrcStride,
+    BYTE* pDest, const LONG& lDestStride,
+    const UINT32& lineLength, const UINT32& lineCount,
+    const UINT32& begin, const UINT32& end,
+    const UINT32& top, const UINT32& bottom,
+    const UINT32& stepEven, const UINT32& stepOdd)
 {
-    BYTE* sourceBeginning = const_cast<BYTE*>(pSrc);
-    BYTE* yPlaneDest = pDest;
-
-    CopyMemory(pDest, pSrc, dwWidthInPixels * dwHeightInPixels);
+    RowBandFilters& filters = m_rowBandFilters[bandIndex];
 
-    pDest += lDestStride * dwHeightInPixels;
-    pSrc += lSrcStride * dwHeightInPixels;
-
-    // U-V plane
-
-    // NOTE: The U-V plane has 1/2 the number of lines as the Y plane.
-
-    // Lines above the destination rectangle.
-    const UINT32 numberOfLinesAboveDestRect = rcDest.top / 2;
-    DWORD y = 0;
-
-    if (numberOfLinesAboveDestRect > 0)
+    if (m_preserveEdges)
     {
-        memcpy(pDest, pSrc, dwWidthInPixels * numberOfLinesAboveDestRect);
-        pSrc += lSrcStride * numberOfLinesAboveDestRect;
-        const LONG temp = lDestStride * numberOfLinesAboveDestRect;
-        pDest += temp;
-        yPlaneDest += temp * 2;
-        y += numberOfLinesAboveDestRect - 1;
+        filters.edgePreserving.filter(
+            pSrc, lSrcStride, pDest, lDestStride, lineLength, lineCount,
+            begin, end, top, bottom, stepEven, stepOdd);
     }
+    else
+    {
+        filters.smoothing.filter(
+            pSrc, lSrcStride, pDest, lDestStride, lineLength, lineCount,
+            begin, end, top, bottom, stepEven, stepOdd);
+    }
+}
 
-    // Lines within the destination rectangle.
-    const DWORD yEnd = min(rcDest.bottom, dwHeightInPixels);
-    const DWORD endOfDestinationRectangleY = yEnd / 2;
 
-    const DWORD rectWidth = (rcDest.right > dwWidthInPixels) ? 0 : rcDest.right - rcDest.left;
-    const DWORD endOfDestinationRectangleX = (rectWidth == 0) ? dwWidthInPixels : rectWidth;
+//-------------------------------------------------------------------
+// prepareRowBandFilters
+//
+// Makes sure there is a filter for each band and configures them
+// according to the current settings.
+//-------------------------------------------------------------------
+void NoiseRemovalEffect::prepareRowBandFilters(const UINT32& bandCount)
+{
+    if (m_rowBandFilters.size() < bandCount)
+    {
+        m_rowBandFilters.resize(bandCount);
+    }
 
-    UINT8 neighborPixelCount = 0;
-    SimpleYuvPixel averagePixel;
+    SeparableFilter::Kernel smoothingKernel = SeparableFilter::BoxKernel;
+    EdgePreservingFilter::Kernel edgePreservingKernel = EdgePreservingFilter::Median3x3Kernel;
+    m_preserveEdges = true;
 
-    for (; y < endOfDestinationRectangleY; ++y)
+    switch (m_snapshot->noiseFilter)
     {
-        if (rectWidth > 0 && rcDest.left > 0)
-        {
-            memcpy(pDest, pSrc, rcDest.left);
-            pDest += rcDest.left;
-            pSrc += rcDest.left;
-            yPlaneDest += rcDest.left;
-        }
+    case NoiseFilter::GaussianFilter:
+        smoothingKernel = SeparableFilter::GaussianKernel;
+        m_preserveEdges = false;
+        break;
+    case NoiseFilter::Median3x3Filter:
+        edgePreservingKernel = EdgePreservingFilter::Median3x3Kernel;
+        break;
+    case NoiseFilter::Median5x5Filter:
+        edgePreservingKernel = EdgePreservingFilter::Median5x5Kernel;
+        break;
+    case NoiseFilter::BilateralFilter:
+        edgePreservingKernel = EdgePreservingFilter::BilateralKernel;
+        break;
+    default:
+        m_preserveEdges = false;
+        break;
+    }
 
-#ifdef TWO_PIXELS_AT_A_TIME
-        for (DWORD x = 0; (x + 1) < endOfDestinationRectangleX; x += 2)
-#else
-        for (DWORD x = 0; x < endOfDestinationRectangleX; ++x)
-#endif
-        {
-            neighborPixelCount = getNv12NeighborPixels(sourceBeginning, x, y, dwWidthInPixels, dwHeightInPixels);
-            averagePixel.calculateAverage(_neighborNv12Pixels, neighborPixelCount);
-
-#ifdef TWO_PIXELS_AT_A_TIME
-            yPlaneDest[x] = averagePixel._y;
-            yPlaneDest[x + 1] = averagePixel._y;
-
-            if ((x & 2) == 0)
-            {
-                pDest[x] = averagePixel._u;
-                pDest[x + 1] = averagePixel._v;
-            }
-#else
-            yPlaneDest[x] = averagePixel._y;
-
-            if (x & 2 == 0)
-            {
-                pDest[x] = averagePixel._u;
-            }
-            else
-            {
-                pDest[x] = averagePixel._v;
-            }
-#endif
-        }
+    const UINT32 radius = (UINT32)m_snapshot->noiseFilterRadius;
 
-        if (rectWidth > 0)
+    for (UINT32 i = 0; i < bandCount; ++i)
+    {
+        if (m_preserveEdges)
         {
-            /*pDest += rectWidth;
-            pSrc += rectWidth;
-            yPlaneDest += rectWidth;
-            memcpy(pDest, pSrc, dwWidthInPixels - rcDest.right);*/
-            pDest += dwWidthInPixels - rcDest.right;
-            pSrc += dwWidthInPixels - rcDest.right;
-            yPlaneDest += dwWidthInPixels - rcDest.right + lDestStride;
+            m_rowBandFilters[i].edgePreserving.setKernel(edgePreservingKernel, radius, m_snapshot->bilateralRangeSigma);
         }
         else
         {
-            pDest += lDestStride;
-            pSrc += lSrcStride;
-            yPlaneDest += lDestStride * 2;
+            m_rowBandFilters[i].smoothing.setKernel(smoothingKernel, radius);
         }
     }
-
-    // Lines below the destination rectangle.
-    for (; y < dwHeightInPixels / 2; y++)
-    {
-        memcpy(pDest, pSrc, dwWidthInPixels);
-        pSrc += lSrcStride;
-        pDest += lDestStride;
-    }
 }
@@ -2,10 +2,8 @@
 #define NOISEREMOVALEFFECT_H
 
 #include "AbstractEffect.h"
-#include "ImageProcessing\Yuy2Pixel.h"
-#include "ImageProcessing\SimpleYuvPixel.h"
-
-#define NEIGHBOR_PIXEL_COUNT 8
+#include "ImageProcessing\EdgePreservingFilter.h"
+#include "ImageProcessing\SeparableFilter.h"
 
 
 class NoiseRemovalEffect : public AbstractEffect
@@ -24,15 +22,15 @@ public: // From AbstractFilter
         _In_ DWORD widthInPixels,
         _In_ DWORD heightInPixels);
 
-protected: // New methods
-    void getYuy2Pixel(const WORD* frame, Yuy2Pixel& pixel, const UINT32& index) const;
-    void getYuy2Pixel(const BYTE* frame, Yuy2Pixel& pixel, const UINT32& x, const UINT32& y, const DWORD& frameWidthInPixels) const;
-
-    const UINT8 getYuy2NeighborPixels(
-        const BYTE* frame, const UINT32& x, const UINT32& y,
-        const DWORD& frameWidthInPixels, const DWORD& frameHeightInPixels);
+protected: // Types
+    struct RowBandFilters
+    {
+        SeparableFilter smoothing;
+        EdgePreservingFilter edgePreserving;
+    };
 
-    void applyNearestNeighborSmootherYuy2(
+protected: // New methods
+    void applySmootherYuy2(
         const D2D_RECT_U& rcDest,
         _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
         _In_ LONG lDestStride,
@@ -41,15 +39,7 @@ protected: // New methods
         _In_ DWORD dwWidthInPixels,
         _In_ DWORD dwHeightInPixels);
 
-    void getNv12Pixel(
-        const BYTE* frame, SimpleYuvPixel& pixel, const DWORD& x, const DWORD& y,
-        const DWORD& yPlaneLength, const DWORD& frameWidthInPixels) const;
-
-    const UINT8 getNv12NeighborPixels(
-        const BYTE* frame, const DWORD& x, const DWORD& y,
-        const DWORD& frameWidthInPixels, const DWORD& frameHeightInPixels);
-
-    void applyNearestNeighborSmootherNv12(
+    void applySmootherNv12(
         const D2D_RECT_U& rcDest,
         _Inout_updates_(_Inexpressible_(lDestStride * dwHeightInPixels)) BYTE* pDest,
         _In_ LONG lDestStride,
@@ -58,9 +48,20 @@ protected: // New methods
         _In_ DWORD dwWidthInPixels,
         _In_ DWORD dwHeightInPixels);
 
+    void filterPlane(
+        const UINT32& bandIndex,
+        const BYTE* pSrc, const LONG& lSrcStride,
+        BYTE* pDest, const LONG& lDestStride,
+        const UINT32& lineLength, const UINT32& lineCount,
+        const UINT32& begin, const UINT32& end,
+        const UINT32& top, const UINT32& bottom,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+    void prepareRowBandFilters(const UINT32& bandCount);
+
 protected: // Members
-    Yuy2Pixel _neighborYuy2Pixels[NEIGHBOR_PIXEL_COUNT];
-    SimpleYuvPixel _neighborNv12Pixels[NEIGHBOR_PIXEL_COUNT];
+    std::vector<RowBandFilters> m_rowBandFilters;
+    bool m_preserveEdges;
 };
 
 #endif // NOISEREMOVALEFFECT_H
@@ -0,0 +1,68 @@
+#include "pch.h"
+
+#include "RowBandExecutor.h"
+
+
+// Constants
+const UINT32 MinRowsPerBand = 32; // Smaller bands cost more in scheduling than they save
+const UINT32 MaxRowBandCount = 16;
+
+
+RowBandExecutor::RowBandExecutor(const UINT32& firstRow, const UINT32& endRow, const bool& parallel)
+    : m_firstRow(firstRow),
+    m_endRow(endRow > firstRow ? endRow : firstRow),
+    m_bandCount(1)
+{
+    if (parallel)
+    {
+        const UINT32 rowCount = m_endRow - m_firstRow;
+        UINT32 bandCount = processorCount();
+
+        if (bandCount > MaxRowBandCount)
+        {
+            bandCount = MaxRowBandCount;
+        }
+
+        if (bandCount > rowCount / MinRowsPerBand)
+        {
+            bandCount = rowCount / MinRowsPerBand;
+        }
+
+        m_bandCount = (bandCount > 0) ? bandCount : 1;
+    }
+}
+
+
+UINT32 RowBandExecutor::bandCount() const
+{
+    return m_bandCount;
+}
+
+
+//-------------------------------------------------------------------
+// bandRows
+//
+// Resolves the rows of the band with the given index. The rows are
+// distributed evenly; the first bands get one extra row if the row
+// count is not divisible by the band count.
+//-------------------------------------------------------------------
+void RowBandExecutor::bandRows(const UINT32& bandIndex, UINT32& top, UINT32& bottom) const
+{
+    const UINT32 rowCount = m_endRow - m_firstRow;
+    const UINT32 rowsPerBand = rowCount / m_bandCount;
+    const UINT32 remainder = rowCount % m_bandCount;
+
+    top = m_firstRow + bandIndex * rowsPerBand + (bandIndex < remainder ? bandIndex : remainder);
+    bottom = top + rowsPerBand + (bandIndex < remainder ? 1 : 0);
+}
+
+
+//-------------------------------------------------------------------
+// processorCount
+//
+// Returns the number of logical processors available for the bands.
+//-------------------------------------------------------------------
+UINT32 RowBandExecutor::processorCount()
+{
+    return concurrency::GetProcessorCount();
+}
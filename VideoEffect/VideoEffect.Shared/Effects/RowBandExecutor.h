@@ -0,0 +1,59 @@
+#ifndef ROWBANDEXECUTOR_H
+#define ROWBANDEXECUTOR_H
+
+#include <mfapi.h>
+#include <ppl.h>
+
+
+//-------------------------------------------------------------------
+// RowBandExecutor
+//
+// Splits a range of rows into horizontal bands and runs the given
+// function for each band, in parallel if enabled. The band layout
+// only depends on the row range and the processor count, so effects
+// can keep per-band reductions (indexed by the band index) and merge
+// them in band order to get deterministic results.
+//-------------------------------------------------------------------
+class RowBandExecutor
+{
+public:
+    RowBandExecutor(const UINT32& firstRow, const UINT32& endRow, const bool& parallel);
+
+public:
+    UINT32 bandCount() const;
+    void bandRows(const UINT32& bandIndex, UINT32& top, UINT32& bottom) const;
+
+    //-------------------------------------------------------------------
+    // run
+    //
+    // Calls bandFunction(bandIndex, top, bottom) for each band. The
+    // bottom row is exclusive. Returns when all the bands are done.
+    //-------------------------------------------------------------------
+    template<class BandFunction>
+    void run(const BandFunction& bandFunction) const
+    {
+        if (m_bandCount <= 1)
+        {
+            bandFunction(0, m_firstRow, m_endRow);
+            return;
+        }
+
+        concurrency::parallel_for(0u, m_bandCount, [&](UINT32 bandIndex)
+        {
+            UINT32 top = 0;
+            UINT32 bottom = 0;
+            bandRows(bandIndex, top, bottom);
+            bandFunction(bandIndex, top, bottom);
+        });
+    }
+
+public: // Static methods
+    static UINT32 processorCount();
+
+private: // Members
+    UINT32 m_firstRow;
+    UINT32 m_endRow;
+    UINT32 m_bandCount;
+};
+
+#endif // ROWBANDEXECUTOR_H
@@ -0,0 +1,46 @@
+#include "pch.h"
+
+#include "AnalysisMailbox.h" // Own header
+
+
+// Constants
+const UINT32 MailboxIndexMask = 0x3;
+const UINT32 MailboxPostedFlag = 0x4;
+
+
+AnalysisMailbox::AnalysisMailbox()
+    : m_back(0),
+    m_front(1),
+    m_middle(2)
+{
+}
+
+
+AnalysisResult& AnalysisMailbox::back()
+{
+    return m_results[m_back];
+}
+
+
+//-------------------------------------------------------------------
+// post
+//
+// Exchanges the back result with the middle one. The release makes
+// the contents of the result visible to the reader with the flag.
+//-------------------------------------------------------------------
+void AnalysisMailbox::post()
+{
+    m_back = m_middle.exchange(m_back | MailboxPostedFlag, std::memory_order_acq_rel) & MailboxIndexMask;
+}
+
+
+const AnalysisResult* AnalysisMailbox::take()
+{
+    if ((m_middle.load(std::memory_order_relaxed) & MailboxPostedFlag) == 0)
+    {
+        return NULL;
+    }
+
+    m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & MailboxIndexMask;
+    return &m_results[m_front];
+}
@@ -0,0 +1,64 @@
+#ifndef ANALYSISMAILBOX_H
+#define ANALYSISMAILBOX_H
+
+#include <D2d1helper.h>
+#include <mfapi.h>
+#include <atomic>
+#include <vector>
+
+#include "ObjectDetails.h"
+#include "OverlayCommandList.h"
+
+
+//-------------------------------------------------------------------
+// AnalysisResult
+//
+// What the analysis of a frame found, for the streaming thread to
+// apply to the lock state.
+//-------------------------------------------------------------------
+struct AnalysisResult
+{
+    UINT32 generation; // Of the lock state the frame was analyzed with
+    bool targetLocked;
+    ObjectDetails objectDetails; // The followed object, if locked
+    std::vector<ObjectDetails> candidates; // If locking
+    int bestCandidateIndex;
+    D2D_POINT_2L cameraMotion; // Since the previous analyzed frame, if locked
+    OverlayCommandList overlays;
+    LONGLONG duration; // Of the analysis in ticks, if pipelined
+};
+
+
+//-------------------------------------------------------------------
+// AnalysisMailbox
+//
+// Passes the latest AnalysisResult from one writer thread to one
+// reader thread without locks (a triple buffer). The writer fills
+// back() and posts it, the reader takes the latest posted result.
+// A result not taken before the next post is replaced by it.
+//
+// The results are reused, so their vectors are allocated only until
+// they have grown to the size needed.
+//-------------------------------------------------------------------
+class AnalysisMailbox
+{
+public:
+    AnalysisMailbox();
+
+public:
+    // Writer
+    AnalysisResult& back();
+    void post();
+
+    // Reader: the latest result posted since the previous take, NULL if
+    // none. Valid until the next take.
+    const AnalysisResult* take();
+
+protected: // Members
+    AnalysisResult m_results[3];
+    UINT32 m_back; // Owned by the writer
+    UINT32 m_front; // Owned by the reader
+    std::atomic<UINT32> m_middle; // Index and the posted flag
+};
+
+#endif // ANALYSISMAILBOX_H
@@ -0,0 +1,186 @@
+#include "pch.h"
+
+#include "AnalysisScheduler.h" // Own header
+
+#include "StageProfiler.h"
+
+#include <climits>
+
+
+// Constants
+const float DefaultFrameRate = 30.0f;
+const float CostSmoothingFactor = 0.2f;
+const UINT32 MaxResolutionLevelOffset = 2;
+const UINT32 AnalysesBetweenResolutionChanges = 15; // Lets the costs settle at the new resolution
+const float ResolutionCostRatio = 4.0f; // A level has a quarter of the pixels
+const float ResolutionRecoveryMargin = 0.75f; // Of the budget, to avoid toggling between the resolutions
+
+const float LatencyBudget = 0.7f; // Of the frame interval
+const float BalancedBudget = 0.9f;
+const UINT32 LatencyMaxCadence = 2;
+const UINT32 BalancedMaxCadence = 4;
+
+
+AnalysisScheduler::AnalysisScheduler()
+    : m_ticksPerSecond(1),
+    m_frameInterval(0)
+{
+    LARGE_INTEGER frequency;
+
+    if (QueryPerformanceFrequency(&frequency) && frequency.QuadPart > 0)
+    {
+        m_ticksPerSecond = frequency.QuadPart;
+    }
+
+    m_frameInterval = (float)m_ticksPerSecond / DefaultFrameRate;
+    reset();
+}
+
+
+void AnalysisScheduler::reset()
+{
+    m_analysisCost = 0;
+    m_passCost = 0;
+    m_cadence = 1;
+    m_framesUntilAnalysis = 0;
+    m_resolutionLevelOffset = 0;
+    m_analysesSinceResolutionChange = 0;
+}
+
+
+void AnalysisScheduler::setFrameRate(const UINT32& numerator, const UINT32& denominator)
+{
+    if (numerator > 0 && denominator > 0)
+    {
+        m_frameInterval = (float)m_ticksPerSecond * denominator / numerator;
+    }
+}
+
+
+bool AnalysisScheduler::shouldAnalyze(const SchedulingPolicy& policy)
+{
+    if (policy == SchedulingPolicy::AccuracyPolicy)
+    {
+        m_cadence = 1;
+        m_framesUntilAnalysis = 0;
+        m_resolutionLevelOffset = 0;
+        return true;
+    }
+
+    if (m_framesUntilAnalysis > 0)
+    {
+        --m_framesUntilAnalysis;
+        return false;
+    }
+
+    m_framesUntilAnalysis = m_cadence - 1;
+    return true;
+}
+
+
+void AnalysisScheduler::endFrame(const LONGLONG& startTimestamp, const bool& analyzed, const SchedulingPolicy& policy)
+{
+    measure((float)max(StageProfiler::timestamp() - startTimestamp, 0LL), analyzed, policy);
+}
+
+
+void AnalysisScheduler::addAnalysis(const LONGLONG& duration, const SchedulingPolicy& policy)
+{
+    measure((float)max(duration, 0LL), true, policy);
+}
+
+
+UINT32 AnalysisScheduler::cadence() const
+{
+    return m_cadence;
+}
+
+
+UINT32 AnalysisScheduler::resolutionLevelOffset() const
+{
+    return m_resolutionLevelOffset;
+}
+
+
+void AnalysisScheduler::measure(const float& duration, const bool& analyzed, const SchedulingPolicy& policy)
+{
+    float &cost = analyzed ? m_analysisCost : m_passCost;
+
+    cost = (cost > 0) ? cost + (duration - cost) * CostSmoothingFactor : duration;
+
+    if (analyzed)
+    {
+        ++m_analysesSinceResolutionChange;
+        adapt(policy);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// adapt
+//
+// The latency policy has the smaller budget and gives up resolution
+// at the shorter cadence, so the target is followed more often but
+// more coarsely.
+//-------------------------------------------------------------------
+void AnalysisScheduler::adapt(const SchedulingPolicy& policy)
+{
+    if (policy == SchedulingPolicy::AccuracyPolicy)
+    {
+        return;
+    }
+
+    const float budget =
+        m_frameInterval * (policy == SchedulingPolicy::LatencyPolicy ? LatencyBudget : BalancedBudget);
+    const UINT32 maxCadence =
+        (policy == SchedulingPolicy::LatencyPolicy) ? LatencyMaxCadence : BalancedMaxCadence;
+    const UINT32 cadence = requiredCadence(m_analysisCost, budget);
+
+    if (m_analysesSinceResolutionChange >= AnalysesBetweenResolutionChanges)
+    {
+        if (cadence > maxCadence && m_resolutionLevelOffset < MaxResolutionLevelOffset)
+        {
+            ++m_resolutionLevelOffset;
+            m_analysesSinceResolutionChange = 0;
+        }
+        else if (m_resolutionLevelOffset > 0)
+        {
+            const float higherResolutionCost =
+                (m_analysisCost - m_passCost) * ResolutionCostRatio + m_passCost;
+
+            if (requiredCadence(higherResolutionCost, budget * ResolutionRecoveryMargin) <= maxCadence)
+            {
+                --m_resolutionLevelOffset;
+                m_analysesSinceResolutionChange = 0;
+            }
+        }
+    }
+
+    // Beyond the longest cadence the output runs late rather than the
+    // analysis losing the target altogether
+    m_cadence = min(cadence, maxCadence);
+    m_framesUntilAnalysis = min(m_framesUntilAnalysis, m_cadence - 1);
+}
+
+
+//-------------------------------------------------------------------
+// requiredCadence
+//
+// The shortest cadence n for which one analyzed and n - 1 passed
+// frames fit n times the budget.
+//-------------------------------------------------------------------
+UINT32 AnalysisScheduler::requiredCadence(const float& analysisCost, const float& budget) const
+{
+    if (analysisCost <= budget)
+    {
+        return 1;
+    }
+
+    if (budget <= m_passCost)
+    {
+        return UINT_MAX;
+    }
+
+    const float cadence = ceil((analysisCost - m_passCost) / (budget - m_passCost));
+    return (cadence < (float)UINT_MAX) ? (UINT32)cadence : UINT_MAX;
+}
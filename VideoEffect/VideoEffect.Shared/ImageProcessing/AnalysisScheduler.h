@@ -0,0 +1,70 @@
+#ifndef ANALYSISSCHEDULER_H
+#define ANALYSISSCHEDULER_H
+
+#include <mfapi.h>
+
+#include "Common.h"
+
+
+//-------------------------------------------------------------------
+// AnalysisScheduler
+//
+// Decides which frames are analyzed so that the output keeps up with
+// the camera when the analysis takes longer than the frame interval.
+// The other frames are passed through, which is cheap, and the cost
+// of an analyzed frame is spread over the frames of the cadence.
+//
+// The durations of the analyzed and the passed frames are measured,
+// and the cadence is the shortest one that fits the budget of the
+// policy. When even the longest cadence of the policy does not fit,
+// the analysis resolution is lowered, and raised again once the cost
+// at the higher resolution would fit with a margin.
+//
+// An analysis pipelined off the streaming thread is measured where it
+// runs and added with addAnalysis(). Its frame costs only the pass on
+// the streaming thread.
+//-------------------------------------------------------------------
+class AnalysisScheduler
+{
+public:
+    AnalysisScheduler();
+
+public:
+    // Back to analyzing every frame at the full resolution
+    void reset();
+
+    void setFrameRate(const UINT32& numerator, const UINT32& denominator);
+
+    // Whether the current frame is to be analyzed, advances the cadence
+    bool shouldAnalyze(const SchedulingPolicy& policy);
+
+    // Measures the frame started at the given timestamp, see
+    // StageProfiler::timestamp()
+    void endFrame(const LONGLONG& startTimestamp, const bool& analyzed, const SchedulingPolicy& policy);
+
+    // Adds an analysis of the given duration in ticks, measured off the
+    // streaming thread
+    void addAnalysis(const LONGLONG& duration, const SchedulingPolicy& policy);
+
+    UINT32 cadence() const;
+
+    // Pyramid levels to add to the analysis resolution
+    UINT32 resolutionLevelOffset() const;
+
+protected: // New methods
+    void measure(const float& duration, const bool& analyzed, const SchedulingPolicy& policy);
+    void adapt(const SchedulingPolicy& policy);
+    UINT32 requiredCadence(const float& analysisCost, const float& budget) const;
+
+protected: // Members
+    LONGLONG m_ticksPerSecond;
+    float m_frameInterval; // In ticks
+    float m_analysisCost; // Moving average in ticks, 0 if not measured yet
+    float m_passCost;
+    UINT32 m_cadence; // Every nth frame is analyzed
+    UINT32 m_framesUntilAnalysis;
+    UINT32 m_resolutionLevelOffset;
+    UINT32 m_analysesSinceResolutionChange;
+};
+
+#endif // ANALYSISSCHEDULER_H
@@ -0,0 +1,256 @@
+#include "pch.h"
+
+#include "AppearanceTracker.h" // Own header
+
+#include "Common.h"
+
+
+// Constants
+const UINT32 TemplateSize = 16; // Samples per dimension at most
+const UINT32 MinTemplateSize = 4;
+const float RelativeSearchRadius = 1.0f; // Relative to the target size
+const float MinTemplateDeviation = 2.0f; // Standard deviation of the luma of a usable template
+
+
+AppearanceTracker::AppearanceTracker()
+    : m_templateEnergy(0),
+    m_step(1),
+    m_columns(0),
+    m_rows(0),
+    m_hasModel(false)
+{
+}
+
+
+void AppearanceTracker::reset()
+{
+    m_hasModel = false;
+}
+
+
+bool AppearanceTracker::hasModel() const
+{
+    return m_hasModel;
+}
+
+
+bool AppearanceTracker::initialize(
+    const BYTE* image, const UINT32& stride, const UINT32& width, const UINT32& height,
+    const GUID& videoFormatSubtype, const ObjectDetails& target)
+{
+    m_hasModel = false;
+
+    if (target._width == 0 || target._height == 0)
+    {
+        return false;
+    }
+
+    m_step = max((max(target._width, target._height) + TemplateSize - 1) / TemplateSize, 1U);
+    m_columns = clamp(target._width / m_step, MinTemplateSize, TemplateSize);
+    m_rows = clamp(target._height / m_step, MinTemplateSize, TemplateSize);
+
+    const LONG left = (LONG)target._centerX - (LONG)(m_columns * m_step / 2);
+    const LONG top = (LONG)target._centerY - (LONG)(m_rows * m_step / 2);
+    const UINT32 sampleCount = m_columns * m_rows;
+
+    m_window.resize(sampleCount);
+
+    if (!sampleLuma(image, stride, width, height, videoFormatSubtype, left, top, m_columns, m_rows, m_window.data()))
+    {
+        return false;
+    }
+
+    float mean = 0;
+
+    for (UINT32 i = 0; i < sampleCount; ++i)
+    {
+        mean += m_window[i];
+    }
+
+    mean /= sampleCount;
+
+    m_template.resize(sampleCount);
+    m_templateEnergy = 0;
+
+    for (UINT32 i = 0; i < sampleCount; ++i)
+    {
+        m_template[i] = m_window[i] - mean;
+        m_templateEnergy += m_template[i] * m_template[i];
+    }
+
+    if (m_templateEnergy < MinTemplateDeviation * MinTemplateDeviation * sampleCount)
+    {
+        return false;
+    }
+
+    m_target = target;
+    m_target._confidence = 1.0f;
+    m_hasModel = true;
+    return true;
+}
+
+
+bool AppearanceTracker::track(
+    const BYTE* image, const UINT32& stride, const UINT32& width, const UINT32& height,
+    const GUID& videoFormatSubtype, const ObjectDetails& predicted, ObjectDetails& objectDetails)
+{
+    if (!m_hasModel)
+    {
+        return false;
+    }
+
+    const ObjectDetails& center = (predicted._width > 0) ? predicted : m_target;
+    const UINT32 radius = (UINT32)(max(m_columns, m_rows) * RelativeSearchRadius + 0.5f);
+    const UINT32 windowColumns = m_columns + 2 * radius;
+    const UINT32 windowRows = m_rows + 2 * radius;
+    const LONG windowLeft = (LONG)center._centerX - (LONG)(m_columns * m_step / 2) - (LONG)(radius * m_step);
+    const LONG windowTop = (LONG)center._centerY - (LONG)(m_rows * m_step / 2) - (LONG)(radius * m_step);
+
+    m_window.resize(windowColumns * windowRows);
+
+    if (!sampleLuma(
+            image, stride, width, height, videoFormatSubtype,
+            windowLeft, windowTop, windowColumns, windowRows, m_window.data()))
+    {
+        return false;
+    }
+
+    buildIntegralImages(windowColumns, windowRows);
+
+    const UINT32 sampleCount = m_columns * m_rows;
+    const UINT32 sumsStride = windowColumns + 1;
+    float bestCorrelation = -1.0f;
+    UINT32 bestX = radius;
+    UINT32 bestY = radius;
+
+    for (UINT32 y = 0; y + m_rows <= windowRows; ++y)
+    {
+        for (UINT32 x = 0; x + m_columns <= windowColumns; ++x)
+        {
+            const UINT32 i0 = y * sumsStride + x;
+            const UINT32 i1 = (y + m_rows) * sumsStride + x;
+            const double sum = m_sums[i1 + m_columns] - m_sums[i1] - m_sums[i0 + m_columns] + m_sums[i0];
+            const double squareSum = m_squareSums[i1 + m_columns] - m_squareSums[i1]
+                - m_squareSums[i0 + m_columns] + m_squareSums[i0];
+            const double windowEnergy = squareSum - sum * sum / sampleCount; // In double, as it cancels
+
+            if (windowEnergy <= 0)
+            {
+                continue;
+            }
+
+            // The template has zero mean, so the mean of the window cancels out
+            float product = 0;
+
+            for (UINT32 row = 0; row < m_rows; ++row)
+            {
+                const BYTE* windowLine = m_window.data() + (y + row) * windowColumns + x;
+                const float* templateLine = m_template.data() + row * m_columns;
+
+                for (UINT32 column = 0; column < m_columns; ++column)
+                {
+                    product += templateLine[column] * windowLine[column];
+                }
+            }
+
+            const float correlation = (float)(product / sqrt(m_templateEnergy * windowEnergy));
+
+            if (correlation > bestCorrelation)
+            {
+                bestCorrelation = correlation;
+                bestX = x;
+                bestY = y;
+            }
+        }
+    }
+
+    const LONG centerX = windowLeft + (LONG)(bestX * m_step + m_columns * m_step / 2);
+    const LONG centerY = windowTop + (LONG)(bestY * m_step + m_rows * m_step / 2);
+
+    m_target._centerX = (UINT32)clamp<LONG>(centerX, 0, (LONG)width - 1);
+    m_target._centerY = (UINT32)clamp<LONG>(centerY, 0, (LONG)height - 1);
+    m_target._confidence = clamp(bestCorrelation, 0.0f, 1.0f);
+
+    objectDetails = m_target;
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// sampleLuma
+//
+// Averages the luma of the blocks of m_step x m_step pixels starting
+// at the given position. The pixels outside the frame repeat the
+// edges.
+//-------------------------------------------------------------------
+bool AppearanceTracker::sampleLuma(
+    const BYTE* image, const UINT32& stride, const UINT32& width, const UINT32& height,
+    const GUID& videoFormatSubtype, const LONG& left, const LONG& top,
+    const UINT32& columns, const UINT32& rows, BYTE* samples) const
+{
+    UINT32 pixelStep = 0;
+
+    if (videoFormatSubtype == MFVideoFormat_NV12)
+    {
+        pixelStep = 1;
+    }
+    else if (videoFormatSubtype == MFVideoFormat_YUY2)
+    {
+        pixelStep = 2; // Y0 U Y1 V
+    }
+    else
+    {
+        return false;
+    }
+
+    const UINT32 blockArea = m_step * m_step;
+
+    for (UINT32 row = 0; row < rows; ++row)
+    {
+        for (UINT32 column = 0; column < columns; ++column)
+        {
+            const LONG blockLeft = left + (LONG)(column * m_step);
+            const LONG blockTop = top + (LONG)(row * m_step);
+            UINT32 sum = 0;
+
+            for (UINT32 y = 0; y < m_step; ++y)
+            {
+                const BYTE* line = image + clamp<LONG>(blockTop + (LONG)y, 0, (LONG)height - 1) * stride;
+
+                for (UINT32 x = 0; x < m_step; ++x)
+                {
+                    sum += line[clamp<LONG>(blockLeft + (LONG)x, 0, (LONG)width - 1) * pixelStep];
+                }
+            }
+
+            samples[row * columns + column] = (BYTE)((sum + blockArea / 2) / blockArea);
+        }
+    }
+
+    return true;
+}
+
+
+void AppearanceTracker::buildIntegralImages(const UINT32& columns, const UINT32& rows)
+{
+    const UINT32 sumsStride = columns + 1;
+
+    m_sums.assign(sumsStride * (rows + 1), 0);
+    m_squareSums.assign(sumsStride * (rows + 1), 0);
+
+    for (UINT32 y = 0; y < rows; ++y)
+    {
+        UINT32 lineSum = 0;
+        UINT32 lineSquareSum = 0;
+
+        for (UINT32 x = 0; x < columns; ++x)
+        {
+            const UINT32 value = m_window[y * columns + x];
+            lineSum += value;
+            lineSquareSum += value * value;
+
+            m_sums[(y + 1) * sumsStride + x + 1] = m_sums[y * sumsStride + x + 1] + lineSum;
+            m_squareSums[(y + 1) * sumsStride + x + 1] = m_squareSums[y * sumsStride + x + 1] + lineSquareSum;
+        }
+    }
+}
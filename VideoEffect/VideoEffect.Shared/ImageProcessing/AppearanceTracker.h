@@ -0,0 +1,78 @@
+#ifndef APPEARANCETRACKER_H
+#define APPEARANCETRACKER_H
+
+#include <mfapi.h>
+#include <vector>
+
+#include "ObjectDetails.h"
+
+
+//-------------------------------------------------------------------
+// AppearanceTracker
+//
+// Follows a locked target by its appearance instead of detecting it
+// again, so the cost does not depend on the effect.
+//
+// The model is a template of the luma at the target, sampled in
+// blocks so that it has at most TemplateSize samples per dimension.
+// The target is found by the normalized cross-correlation of the
+// template with the same blocks around the predicted position. The
+// sums of the window under the template come from integral images,
+// so each position costs one multiply-add per template sample. The
+// correlation is insensitive to changes of brightness and contrast,
+// and its peak is the confidence of the match.
+//-------------------------------------------------------------------
+class AppearanceTracker
+{
+public:
+    AppearanceTracker();
+
+public:
+    // Forgets the model
+    void reset();
+
+    bool hasModel() const;
+
+    //-------------------------------------------------------------------
+    // initialize
+    //
+    // Takes the model at the target. Returns false, if the target is too
+    // flat to be matched.
+    //-------------------------------------------------------------------
+    bool initialize(
+        const BYTE* image, const UINT32& stride, const UINT32& width, const UINT32& height,
+        const GUID& videoFormatSubtype, const ObjectDetails& target);
+
+    //-------------------------------------------------------------------
+    // track
+    //
+    // Returns true and the best match around the predicted target, with
+    // the correlation as the confidence, if there is a model.
+    //-------------------------------------------------------------------
+    bool track(
+        const BYTE* image, const UINT32& stride, const UINT32& width, const UINT32& height,
+        const GUID& videoFormatSubtype, const ObjectDetails& predicted, ObjectDetails& objectDetails);
+
+protected: // New methods
+    bool sampleLuma(
+        const BYTE* image, const UINT32& stride, const UINT32& width, const UINT32& height,
+        const GUID& videoFormatSubtype, const LONG& left, const LONG& top,
+        const UINT32& columns, const UINT32& rows, BYTE* samples) const;
+
+    void buildIntegralImages(const UINT32& columns, const UINT32& rows);
+
+protected: // Members
+    ObjectDetails m_target; // Size of the target, the position of the last match
+    std::vector<float> m_template; // Zero mean
+    float m_templateEnergy; // Sum of the squares of the template
+    UINT32 m_step; // Block size in pixels
+    UINT32 m_columns;
+    UINT32 m_rows;
+    bool m_hasModel;
+
+    std::vector<BYTE> m_window; // Samples of the search window
+    std::vector<UINT32> m_sums; // Integral images of the window, one larger per dimension
+    std::vector<UINT32> m_squareSums;
+};
+
+#endif // APPEARANCETRACKER_H
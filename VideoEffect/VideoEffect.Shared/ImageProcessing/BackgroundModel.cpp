@@ -0,0 +1,199 @@
+#include "pch.h"
+
+#include "BackgroundModel.h" // Own header
+
+#include "Common.h"
+#include "Simd.h"
+
+
+// Constants
+const int FractionBits = 7; // (x << 7) - mean stays within signed 16 bits
+const int SpreadFactor = 3; // Limit in mean absolute deviations (about 2.4 sigma)
+
+
+//-------------------------------------------------------------------
+// sampleAt
+//
+// Returns sample i of a line with the given layout.
+//-------------------------------------------------------------------
+static inline int sampleAt(const BYTE* source, const BackgroundModel::SampleLayout& layout, const UINT32& i)
+{
+    switch (layout)
+    {
+    case BackgroundModel::LowBytesOfWords:
+        return source[i * 2];
+    case BackgroundModel::HighBytesOfWords:
+        return source[i * 2 + 1];
+    default:
+        return source[i];
+    }
+}
+
+
+BackgroundModel::BackgroundModel()
+    : m_sampleCount(0),
+    m_lineCount(0),
+    m_frameCount(0)
+{
+}
+
+
+//-------------------------------------------------------------------
+// reset
+//
+// Allocates the model and forgets the background.
+//-------------------------------------------------------------------
+void BackgroundModel::reset(const UINT32& sampleCount, const UINT32& lineCount)
+{
+    m_sampleCount = sampleCount;
+    m_lineCount = lineCount;
+    m_frameCount = 0;
+    m_mean.assign((size_t)sampleCount * lineCount, 0);
+    m_meanDeviation.assign((size_t)sampleCount * lineCount, 0);
+}
+
+
+bool BackgroundModel::matches(const UINT32& sampleCount, const UINT32& lineCount) const
+{
+    return m_sampleCount == sampleCount && m_lineCount == lineCount;
+}
+
+
+bool BackgroundModel::isEmpty() const
+{
+    return m_frameCount == 0;
+}
+
+
+void BackgroundModel::update(
+    const UINT32& line, const BYTE* source, const SampleLayout& layout,
+    const UINT32& begin, const UINT32& end, const int& learningShift,
+    BYTE* deviation, BYTE* spread)
+{
+    WORD* mean = &m_mean[(size_t)line * m_sampleCount];
+    WORD* meanDeviation = &m_meanDeviation[(size_t)line * m_sampleCount];
+    UINT32 i = begin;
+
+    if (m_frameCount == 0)
+    {
+        for (; i < end; ++i)
+        {
+            mean[i] = (WORD)(sampleAt(source, layout, i) << FractionBits);
+            meanDeviation[i] = 0;
+            deviation[i] = 0;
+            spread[i] = 0;
+        }
+
+        return;
+    }
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i shift = _mm_cvtsi32_si128(learningShift);
+    const __m128i spreadScale = _mm_set1_epi16((short)(SpreadFactor << (16 - FractionBits)));
+
+    for (; i + 8 <= end; i += 8)
+    {
+        __m128i samples;
+
+        if (layout == PlanarBytes)
+        {
+            samples = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(source + i)), zero);
+        }
+        else
+        {
+            const __m128i words = _mm_loadu_si128((const __m128i*)(source + i * 2));
+            samples = (layout == LowBytesOfWords) ? _mm_and_si128(words, lowBytes) : _mm_srli_epi16(words, 8);
+        }
+
+        __m128i meanVector = _mm_loadu_si128((const __m128i*)(mean + i));
+        __m128i meanDeviationVector = _mm_loadu_si128((const __m128i*)(meanDeviation + i));
+
+        // Deviation from the rounded background value
+        const __m128i background = _mm_srli_epi16(_mm_add_epi16(meanVector, _mm_set1_epi16(1 << (FractionBits - 1))), FractionBits);
+        const __m128i difference = _mm_sub_epi16(samples, background);
+        const __m128i absoluteDifference = _mm_max_epi16(difference, _mm_sub_epi16(zero, difference));
+
+        // mean += ((x << FractionBits) - mean) >> learningShift
+        meanVector = _mm_add_epi16(meanVector,
+            _mm_sra_epi16(_mm_sub_epi16(_mm_slli_epi16(samples, FractionBits), meanVector), shift));
+        meanDeviationVector = _mm_add_epi16(meanDeviationVector,
+            _mm_sra_epi16(_mm_sub_epi16(_mm_slli_epi16(absoluteDifference, FractionBits), meanDeviationVector), shift));
+
+        _mm_storeu_si128((__m128i*)(mean + i), meanVector);
+        _mm_storeu_si128((__m128i*)(meanDeviation + i), meanDeviationVector);
+
+        _mm_storel_epi64((__m128i*)(deviation + i), _mm_packus_epi16(absoluteDifference, absoluteDifference));
+        const __m128i limit = _mm_mulhi_epu16(meanDeviationVector, spreadScale);
+        _mm_storel_epi64((__m128i*)(spread + i), _mm_packus_epi16(limit, limit));
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    const int16x8_t shift = vdupq_n_s16((short)-learningShift);
+
+    for (; i + 8 <= end; i += 8)
+    {
+        int16x8_t samples;
+
+        if (layout == PlanarBytes)
+        {
+            samples = vreinterpretq_s16_u16(vmovl_u8(vld1_u8(source + i)));
+        }
+        else
+        {
+            const uint8x8x2_t bytes = vld2_u8(source + i * 2);
+            samples = vreinterpretq_s16_u16(vmovl_u8((layout == LowBytesOfWords) ? bytes.val[0] : bytes.val[1]));
+        }
+
+        int16x8_t meanVector = vreinterpretq_s16_u16(vld1q_u16(mean + i));
+        int16x8_t meanDeviationVector = vreinterpretq_s16_u16(vld1q_u16(meanDeviation + i));
+
+        // Deviation from the rounded background value
+        const int16x8_t background = vreinterpretq_s16_u16(vrshrq_n_u16(vreinterpretq_u16_s16(meanVector), FractionBits));
+        const int16x8_t absoluteDifference = vabdq_s16(samples, background);
+
+        // mean += ((x << FractionBits) - mean) >> learningShift
+        meanVector = vaddq_s16(meanVector,
+            vshlq_s16(vsubq_s16(vshlq_n_s16(samples, FractionBits), meanVector), shift));
+        meanDeviationVector = vaddq_s16(meanDeviationVector,
+            vshlq_s16(vsubq_s16(vshlq_n_s16(absoluteDifference, FractionBits), meanDeviationVector), shift));
+
+        vst1q_u16(mean + i, vreinterpretq_u16_s16(meanVector));
+        vst1q_u16(meanDeviation + i, vreinterpretq_u16_s16(meanDeviationVector));
+
+        vst1_u8(deviation + i, vqmovun_s16(absoluteDifference));
+        const uint16x8_t meanDeviationBits = vreinterpretq_u16_s16(meanDeviationVector);
+        const uint16x8_t limit = vcombine_u16(
+            vshrn_n_u32(vmull_n_u16(vget_low_u16(meanDeviationBits), SpreadFactor), FractionBits),
+            vshrn_n_u32(vmull_n_u16(vget_high_u16(meanDeviationBits), SpreadFactor), FractionBits));
+        vst1_u8(spread + i, vqmovn_u16(limit));
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        const int sample = sampleAt(source, layout, i);
+        const int background = (mean[i] + (1 << (FractionBits - 1))) >> FractionBits;
+        const int absoluteDifference = abs(sample - background);
+
+        mean[i] = (WORD)(mean[i] + (((sample << FractionBits) - mean[i]) >> learningShift));
+        meanDeviation[i] = (WORD)(meanDeviation[i] + (((absoluteDifference << FractionBits) - meanDeviation[i]) >> learningShift));
+
+        deviation[i] = (BYTE)absoluteDifference;
+        spread[i] = (BYTE)min((meanDeviation[i] * SpreadFactor) >> FractionBits, 255);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// advance
+//
+// Marks the end of a frame.
+//-------------------------------------------------------------------
+void BackgroundModel::advance()
+{
+    if (m_frameCount < 2)
+    {
+        ++m_frameCount;
+    }
+}
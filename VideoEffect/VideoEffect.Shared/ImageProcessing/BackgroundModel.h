@@ -0,0 +1,58 @@
+#ifndef BACKGROUNDMODEL_H
+#define BACKGROUNDMODEL_H
+
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// BackgroundModel
+//
+// Per-sample exponential running average of a single plane with a
+// running mean absolute deviation as the estimate of its spread. Both
+// are kept in fixed point with FractionBits fractional bits so that
+// the update fits 16-bit vector lanes.
+//
+// update() compares the samples of a line to the model and updates
+// the model in the same pass. The learning rate is 2^-learningShift.
+//-------------------------------------------------------------------
+class BackgroundModel
+{
+public:
+    // How the samples of a plane are stored in a line
+    enum SampleLayout
+    {
+        PlanarBytes = 0, // NV12 Y and U-V planes
+        LowBytesOfWords = 1, // YUY2 luma
+        HighBytesOfWords = 2 // YUY2 chroma
+    };
+
+public:
+    BackgroundModel();
+
+public:
+    void reset(const UINT32& sampleCount, const UINT32& lineCount);
+    bool matches(const UINT32& sampleCount, const UINT32& lineCount) const;
+    bool isEmpty() const;
+
+    // Updates the samples [begin, end) of the given line and writes their
+    // absolute deviations from the background and three times their mean
+    // absolute deviations (saturated to 255) into the given arrays,
+    // indexed by sample. While the model is empty, the samples are
+    // taken as the background as is.
+    void update(
+        const UINT32& line, const BYTE* source, const SampleLayout& layout,
+        const UINT32& begin, const UINT32& end, const int& learningShift,
+        BYTE* deviation, BYTE* spread);
+
+    void advance();
+
+protected: // Members
+    std::vector<WORD> m_mean;
+    std::vector<WORD> m_meanDeviation;
+    UINT32 m_sampleCount;
+    UINT32 m_lineCount;
+    UINT32 m_frameCount;
+};
+
+#endif // BACKGROUNDMODEL_H
@@ -0,0 +1,95 @@
+#include "pch.h"
+
+#include "DetectionCache.h" // Own header
+
+
+DetectionCache::DetectionCache()
+    : m_lastScheduled(0),
+    m_lastCompleted(0)
+{
+}
+
+
+void DetectionCache::resize(const UINT32& depth)
+{
+    m_entries.resize(depth);
+    clear();
+}
+
+
+void DetectionCache::clear()
+{
+    for (Entry& entry : m_entries)
+    {
+        entry.sequence = 0;
+        entry.done = false;
+        entry.found = false;
+        entry.objectDetails.reset();
+    }
+}
+
+
+//-------------------------------------------------------------------
+// schedule
+//
+// Marks the detection of the given slot pending and returns the
+// sequence number to give to store().
+//-------------------------------------------------------------------
+UINT32 DetectionCache::schedule(const UINT32& index)
+{
+    Entry& entry = m_entries[index];
+    entry.sequence = ++m_lastScheduled;
+    entry.done = false;
+    entry.found = false;
+    return entry.sequence;
+}
+
+
+void DetectionCache::invalidate(const UINT32& index)
+{
+    Entry& entry = m_entries[index];
+    entry.sequence = 0;
+    entry.done = false;
+    entry.found = false;
+}
+
+
+bool DetectionCache::isPending(const UINT32& index) const
+{
+    return index < m_entries.size()
+        && m_entries[index].sequence > m_lastCompleted.load(std::memory_order_acquire);
+}
+
+
+void DetectionCache::store(const UINT32& index, const UINT32& sequence, const ObjectDetails* objectDetails)
+{
+    Entry& entry = m_entries[index];
+
+    if (objectDetails)
+    {
+        entry.objectDetails = *objectDetails;
+    }
+
+    entry.found = (objectDetails != NULL);
+    entry.done = true;
+
+    m_lastCompleted.store(sequence, std::memory_order_release);
+}
+
+
+bool DetectionCache::lookup(const UINT32& index, const ObjectDetails*& objectDetails) const
+{
+    objectDetails = NULL;
+
+    if (index >= m_entries.size() || !m_entries[index].done)
+    {
+        return false;
+    }
+
+    if (m_entries[index].found)
+    {
+        objectDetails = &m_entries[index].objectDetails;
+    }
+
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef DETECTIONCACHE_H
+#define DETECTIONCACHE_H
+
+#include <mfapi.h>
+#include <atomic>
+#include <vector>
+
+#include "ObjectDetails.h"
+
+
+//-------------------------------------------------------------------
+// DetectionCache
+//
+// Object detection results per ring buffer slot, filled by detection
+// tasks that run one at a time in the order they were scheduled.
+//
+// The slot owner schedules a detection (giving it a sequence number)
+// and the task stores its result and completes the sequence number.
+// A slot must not be rescheduled nor its frame overwritten while its
+// detection is pending, and the results may be looked up only once
+// the tasks have been waited for.
+//-------------------------------------------------------------------
+class DetectionCache
+{
+public:
+    DetectionCache();
+
+public:
+    // Clears the cache. No detection may be pending.
+    void resize(const UINT32& depth);
+    void clear();
+
+    UINT32 schedule(const UINT32& index);
+
+    // Forgets the detection of the slot, called when its frame is
+    // overwritten. The detection must not be pending.
+    void invalidate(const UINT32& index);
+    bool isPending(const UINT32& index) const;
+
+    // Called by the detection task. The details are copied, if given.
+    void store(const UINT32& index, const UINT32& sequence, const ObjectDetails* objectDetails);
+
+    // Returns true, if the detection of the slot is done. The details are
+    // NULL, if no object was found.
+    bool lookup(const UINT32& index, const ObjectDetails*& objectDetails) const;
+
+protected: // Types
+    struct Entry
+    {
+        UINT32 sequence; // 0 if not scheduled
+        bool done;
+        bool found;
+        ObjectDetails objectDetails;
+    };
+
+protected: // Members
+    std::vector<Entry> m_entries;
+    UINT32 m_lastScheduled;
+    std::atomic<UINT32> m_lastCompleted;
+};
+
+#endif // DETECTIONCACHE_H
@@ -0,0 +1,386 @@
+#include "pch.h"
+
+#include "EdgePreservingFilter.h" // Own header
+
+#include <math.h>
+
+#include "Common.h"
+#include "Simd.h"
+
+
+// Constants
+const int MaxRangeSigma = 255;
+
+// Median selection networks (Paeth, Devillard). After the exchanges
+// the median is in the middle of the array.
+static const BYTE Median9Network[][2] =
+{
+    { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 1 }, { 3, 4 },
+    { 6, 7 }, { 1, 2 }, { 4, 5 }, { 7, 8 }, { 0, 3 },
+    { 5, 8 }, { 4, 7 }, { 3, 6 }, { 1, 4 }, { 2, 5 },
+    { 4, 7 }, { 4, 2 }, { 6, 4 }, { 4, 2 }
+};
+
+static const BYTE Median25Network[][2] =
+{
+    { 0, 1 }, { 3, 4 }, { 2, 4 }, { 2, 3 }, { 6, 7 },
+    { 5, 7 }, { 5, 6 }, { 9, 10 }, { 8, 10 }, { 8, 9 },
+    { 12, 13 }, { 11, 13 }, { 11, 12 }, { 15, 16 }, { 14, 16 },
+    { 14, 15 }, { 18, 19 }, { 17, 19 }, { 17, 18 }, { 21, 22 },
+    { 20, 22 }, { 20, 21 }, { 23, 24 }, { 2, 5 }, { 3, 6 },
+    { 0, 6 }, { 0, 3 }, { 4, 7 }, { 1, 7 }, { 1, 4 },
+    { 11, 14 }, { 8, 14 }, { 8, 11 }, { 12, 15 }, { 9, 15 },
+    { 9, 12 }, { 13, 16 }, { 10, 16 }, { 10, 13 }, { 20, 23 },
+    { 17, 23 }, { 17, 20 }, { 21, 24 }, { 18, 24 }, { 18, 21 },
+    { 19, 22 }, { 8, 17 }, { 9, 18 }, { 0, 18 }, { 0, 9 },
+    { 10, 19 }, { 1, 19 }, { 1, 10 }, { 11, 20 }, { 2, 20 },
+    { 2, 11 }, { 12, 21 }, { 3, 21 }, { 3, 12 }, { 13, 22 },
+    { 4, 22 }, { 4, 13 }, { 14, 23 }, { 5, 23 }, { 5, 14 },
+    { 15, 24 }, { 6, 24 }, { 6, 15 }, { 7, 16 }, { 7, 19 },
+    { 13, 21 }, { 15, 23 }, { 7, 13 }, { 7, 15 }, { 1, 9 },
+    { 3, 11 }, { 5, 17 }, { 11, 17 }, { 9, 17 }, { 4, 10 },
+    { 6, 12 }, { 7, 14 }, { 4, 6 }, { 4, 7 }, { 12, 14 },
+    { 10, 14 }, { 6, 7 }, { 10, 12 }, { 6, 10 }, { 6, 17 },
+    { 12, 17 }, { 7, 17 }, { 7, 10 }, { 12, 18 }, { 7, 12 },
+    { 10, 18 }, { 12, 20 }, { 10, 20 }, { 10, 12 }
+};
+
+static const int BinomialWeights[2][5] =
+{
+    { 1, 2, 1, 0, 0 },
+    { 1, 4, 6, 4, 1 }
+};
+
+
+//-------------------------------------------------------------------
+// sortPair
+//
+// Orders the given values so that a <= b.
+//-------------------------------------------------------------------
+static inline void sortPair(BYTE& a, BYTE& b)
+{
+    const BYTE smaller = min(a, b);
+    b = max(a, b);
+    a = smaller;
+}
+
+#if defined(VIDEOEFFECT_SSE2)
+static inline void sortPair(__m128i& a, __m128i& b)
+{
+    const __m128i smaller = _mm_min_epu8(a, b);
+    b = _mm_max_epu8(a, b);
+    a = smaller;
+}
+#elif defined(VIDEOEFFECT_NEON)
+static inline void sortPair(uint8x16_t& a, uint8x16_t& b)
+{
+    const uint8x16_t smaller = vminq_u8(a, b);
+    b = vmaxq_u8(a, b);
+    a = smaller;
+}
+#endif
+
+
+//-------------------------------------------------------------------
+// selectMedian
+//
+// Runs the given network over the values and returns the median.
+//-------------------------------------------------------------------
+template<typename T>
+static inline T selectMedian(T* values, const UINT32& valueCount)
+{
+    if (valueCount == 9)
+    {
+        for (UINT32 i = 0; i < sizeof(Median9Network) / sizeof(Median9Network[0]); ++i)
+        {
+            sortPair(values[Median9Network[i][0]], values[Median9Network[i][1]]);
+        }
+    }
+    else
+    {
+        for (UINT32 i = 0; i < sizeof(Median25Network) / sizeof(Median25Network[0]); ++i)
+        {
+            sortPair(values[Median25Network[i][0]], values[Median25Network[i][1]]);
+        }
+    }
+
+    return values[valueCount / 2];
+}
+
+
+EdgePreservingFilter::EdgePreservingFilter()
+    : m_kernel(Median3x3Kernel),
+    m_radius(1),
+    m_rangeSigma(0),
+    m_padding(0),
+    m_paddedLineLength(0)
+{
+    setKernel(Median3x3Kernel, 1, 20);
+}
+
+
+//-------------------------------------------------------------------
+// setKernel
+//
+// Sets the kernel. The radius applies to the bilateral kernel only and
+// rangeSigma is the standard deviation of its range weights in
+// intensity levels.
+//-------------------------------------------------------------------
+void EdgePreservingFilter::setKernel(const Kernel& kernel, const UINT32& radius, const int& rangeSigma)
+{
+    m_kernel = kernel;
+
+    switch (kernel)
+    {
+    case Median3x3Kernel:
+        m_radius = 1;
+        break;
+    case Median5x5Kernel:
+        m_radius = 2;
+        break;
+    default:
+        m_radius = clamp<UINT32>(radius, 1, 2);
+        break;
+    }
+
+    const int sigma = clamp(rangeSigma, 1, MaxRangeSigma);
+
+    if (sigma != m_rangeSigma)
+    {
+        m_rangeSigma = sigma;
+
+        for (int difference = 0; difference < 256; ++difference)
+        {
+            const double exponent = -(double)(difference * difference) / (2.0 * sigma * sigma);
+            m_rangeWeights[difference] = (WORD)(256.0 * exp(exponent) + 0.5);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// filter
+//
+// Filters the bytes [begin, end) of the lines [top, bottom) of the
+// given plane into the destination. The rest of the destination is
+// not touched. The source and the destination must not overlap.
+//-------------------------------------------------------------------
+void EdgePreservingFilter::filter(
+    const BYTE* pSrc, const LONG& lSrcStride,
+    BYTE* pDest, const LONG& lDestStride,
+    const UINT32& lineLength, const UINT32& lineCount,
+    const UINT32& begin, const UINT32& end,
+    const UINT32& top, const UINT32& bottom,
+    const UINT32& stepEven, const UINT32& stepOdd)
+{
+    if (begin >= end || top >= bottom)
+    {
+        return;
+    }
+
+    // The window reaches this far from the filtered bytes
+    const UINT32 reach = m_radius * ((stepEven > stepOdd) ? stepEven : stepOdd);
+    const UINT32 low = (begin > reach) ? begin - reach : 0;
+    const UINT32 high = (end + reach < lineLength) ? end + reach : lineLength;
+    const UINT32 windowSize = m_radius * 2 + 1;
+
+    m_padding = reach;
+    m_paddedLineLength = lineLength + reach * 2;
+    m_lines.resize(m_paddedLineLength * windowSize);
+    m_lineNumbers.assign(windowSize, -1);
+
+    const BYTE* lines[5];
+
+    for (UINT32 y = top; y < bottom; ++y)
+    {
+        for (UINT32 k = 0; k < windowSize; ++k)
+        {
+            const int line = clamp((int)y + (int)k - (int)m_radius, 0, (int)lineCount - 1);
+            lines[k] = paddedLine(pSrc, lSrcStride, line, lineLength, low, high, stepEven, stepOdd);
+        }
+
+        if (m_kernel == BilateralKernel)
+        {
+            filterBilateralLine(pDest + (LONG)y * lDestStride, lines, begin, end, stepEven, stepOdd);
+        }
+        else
+        {
+            filterMedianLine(pDest + (LONG)y * lDestStride, lines, begin, end, stepEven, stepOdd);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// paddedLine
+//
+// Returns the bytes [low, high) of the given source line with the
+// borders replicated. Each line is copied once while it stays in the
+// window.
+//-------------------------------------------------------------------
+const BYTE* EdgePreservingFilter::paddedLine(
+    const BYTE* pSrc, const LONG& lSrcStride, const int& line,
+    const UINT32& lineLength, const UINT32& low, const UINT32& high,
+    const UINT32& stepEven, const UINT32& stepOdd)
+{
+    const UINT32 slot = (UINT32)line % m_lineNumbers.size();
+    BYTE* padded = &m_lines[slot * m_paddedLineLength + m_padding];
+
+    if (m_lineNumbers[slot] == line)
+    {
+        return padded;
+    }
+
+    memcpy(padded + low, pSrc + (LONG)line * lSrcStride + low, high - low);
+
+    if (low == 0)
+    {
+        for (int i = -1; i >= -(int)m_padding; --i)
+        {
+            padded[i] = padded[i + (int)((i & 1) ? stepOdd : stepEven)];
+        }
+    }
+
+    if (high == lineLength)
+    {
+        for (UINT32 i = lineLength; i < lineLength + m_padding; ++i)
+        {
+            padded[i] = padded[i - ((i & 1) ? stepOdd : stepEven)];
+        }
+    }
+
+    m_lineNumbers[slot] = line;
+    return padded;
+}
+
+
+//-------------------------------------------------------------------
+// filterMedianLine
+//
+// Calculates the medians of a line. The vector paths gather the
+// window of 16 bytes at a time; with mixed steps the odd bytes take
+// their samples from the odd step.
+//-------------------------------------------------------------------
+void EdgePreservingFilter::filterMedianLine(
+    BYTE* destLine, const BYTE* const* lines, const UINT32& begin, const UINT32& end,
+    const UINT32& stepEven, const UINT32& stepOdd)
+{
+    const int radius = (int)m_radius;
+    const UINT32 windowSize = m_radius * 2 + 1;
+    const UINT32 valueCount = windowSize * windowSize;
+    UINT32 i = begin;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i oddLanes = (begin & 1) ? _mm_set1_epi16(0x00FF) : _mm_set1_epi16((short)0xFF00);
+    __m128i window[25];
+
+    for (; i + 16 <= end; i += 16)
+    {
+        UINT32 n = 0;
+
+        for (UINT32 dy = 0; dy < windowSize; ++dy)
+        {
+            for (int dx = -radius; dx <= radius; ++dx)
+            {
+                const BYTE* center = lines[dy] + i;
+                window[n] = _mm_loadu_si128((const __m128i*)(center + dx * (int)stepEven));
+
+                if (stepOdd != stepEven)
+                {
+                    const __m128i odd = _mm_loadu_si128((const __m128i*)(center + dx * (int)stepOdd));
+                    window[n] = _mm_or_si128(_mm_andnot_si128(oddLanes, window[n]), _mm_and_si128(oddLanes, odd));
+                }
+
+                ++n;
+            }
+        }
+
+        _mm_storeu_si128((__m128i*)(destLine + i), selectMedian(window, valueCount));
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    const uint8x16_t oddLanes = vreinterpretq_u8_u16(vdupq_n_u16((begin & 1) ? 0x00FF : 0xFF00));
+    uint8x16_t window[25];
+
+    for (; i + 16 <= end; i += 16)
+    {
+        UINT32 n = 0;
+
+        for (UINT32 dy = 0; dy < windowSize; ++dy)
+        {
+            for (int dx = -radius; dx <= radius; ++dx)
+            {
+                const BYTE* center = lines[dy] + i;
+                window[n] = vld1q_u8(center + dx * (int)stepEven);
+
+                if (stepOdd != stepEven)
+                {
+                    window[n] = vbslq_u8(oddLanes, vld1q_u8(center + dx * (int)stepOdd), window[n]);
+                }
+
+                ++n;
+            }
+        }
+
+        vst1q_u8(destLine + i, selectMedian(window, valueCount));
+    }
+#endif
+
+    BYTE values[25];
+
+    for (; i < end; ++i)
+    {
+        const int step = (int)((i & 1) ? stepOdd : stepEven);
+        UINT32 n = 0;
+
+        for (UINT32 dy = 0; dy < windowSize; ++dy)
+        {
+            for (int dx = -radius; dx <= radius; ++dx)
+            {
+                values[n++] = lines[dy][(int)i + dx * step];
+            }
+        }
+
+        destLine[i] = selectMedian(values, valueCount);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// filterBilateralLine
+//
+// Calculates the bilateral averages of a line. The weight of a sample
+// is the product of its binomial spatial weight and the range weight
+// of its difference to the center sample.
+//-------------------------------------------------------------------
+void EdgePreservingFilter::filterBilateralLine(
+    BYTE* destLine, const BYTE* const* lines, const UINT32& begin, const UINT32& end,
+    const UINT32& stepEven, const UINT32& stepOdd)
+{
+    const int radius = (int)m_radius;
+    const int* spatialWeights = BinomialWeights[radius - 1];
+
+    for (UINT32 i = begin; i < end; ++i)
+    {
+        const int step = (int)((i & 1) ? stepOdd : stepEven);
+        const int center = lines[radius][i];
+        int sum = 0;
+        int weightSum = 0;
+
+        for (int dy = 0; dy <= radius * 2; ++dy)
+        {
+            const BYTE* line = lines[dy] + (int)i;
+
+            for (int dx = 0; dx <= radius * 2; ++dx)
+            {
+                const int value = line[(dx - radius) * step];
+                const int weight =
+                    spatialWeights[dy] * spatialWeights[dx] * m_rangeWeights[abs(value - center)];
+                sum += weight * value;
+                weightSum += weight;
+            }
+        }
+
+        // The center sample always has a non-zero weight
+        destLine[i] = (BYTE)((sum + weightSum / 2) / weightSum);
+    }
+}
@@ -0,0 +1,70 @@
+#ifndef EDGEPRESERVINGFILTER_H
+#define EDGEPRESERVINGFILTER_H
+
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// EdgePreservingFilter
+//
+// Smoothing of a single plane that keeps the edges sharp: a median of
+// the 3x3 or 5x5 neighbourhood (fixed sorting networks) or an
+// approximate bilateral filter with binomial spatial weights and a
+// lookup table of range weights. The cost per pixel is fixed by the
+// window size.
+//
+// The interleaved planes are handled the same way as with
+// SeparableFilter, see the sample steps there. One instance holds the
+// line buffers of one row band.
+//-------------------------------------------------------------------
+class EdgePreservingFilter
+{
+public:
+    enum Kernel
+    {
+        Median3x3Kernel = 0,
+        Median5x5Kernel = 1,
+        BilateralKernel = 2 // Radius 1 or 2
+    };
+
+public:
+    EdgePreservingFilter();
+
+public:
+    void setKernel(const Kernel& kernel, const UINT32& radius, const int& rangeSigma);
+
+    void filter(
+        const BYTE* pSrc, const LONG& lSrcStride,
+        BYTE* pDest, const LONG& lDestStride,
+        const UINT32& lineLength, const UINT32& lineCount,
+        const UINT32& begin, const UINT32& end,
+        const UINT32& top, const UINT32& bottom,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+protected: // New methods
+    const BYTE* paddedLine(
+        const BYTE* pSrc, const LONG& lSrcStride, const int& line,
+        const UINT32& lineLength, const UINT32& low, const UINT32& high,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+    void filterMedianLine(
+        BYTE* destLine, const BYTE* const* lines, const UINT32& begin, const UINT32& end,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+    void filterBilateralLine(
+        BYTE* destLine, const BYTE* const* lines, const UINT32& begin, const UINT32& end,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+protected: // Members
+    Kernel m_kernel;
+    UINT32 m_radius;
+    int m_rangeSigma;
+    UINT32 m_padding;
+    UINT32 m_paddedLineLength;
+    std::vector<BYTE> m_lines; // 2 * radius + 1 lines, m_padding bytes before index 0
+    std::vector<int> m_lineNumbers; // Source line held by each slot, -1 if none
+    WORD m_rangeWeights[256];
+};
+
+#endif // EDGEPRESERVINGFILTER_H
@@ -0,0 +1,212 @@
+#include "pch.h"
+
+#include "EdgeThinner.h" // Own header
+
+#include "Effects\RowBandExecutor.h"
+#include "ImageProcessingCommon.h"
+
+
+// Constants
+const BYTE NoEdge = 0;
+const BYTE WeakEdge = 1;
+const BYTE StrongEdge = 2;
+
+
+EdgeThinner::EdgeThinner()
+    : m_width(0),
+    m_height(0),
+    m_paddedWidth(2)
+{
+}
+
+
+//-------------------------------------------------------------------
+// resize
+//
+// Sets the size of the area to thin. The buffers are only
+// reallocated when they grow.
+//-------------------------------------------------------------------
+void EdgeThinner::resize(const UINT32& width, const UINT32& height)
+{
+    m_width = width;
+    m_height = height;
+    m_paddedWidth = width + 2;
+
+    const UINT32 paddedSize = m_paddedWidth * (height + 2);
+    m_magnitude.resize(paddedSize);
+    m_state.resize(paddedSize);
+    m_direction.resize(width * height + 1);
+
+    // Clear the borders
+    memset(&m_magnitude[0], 0, m_paddedWidth * sizeof(short));
+    memset(&m_magnitude[paddedSize - m_paddedWidth], 0, m_paddedWidth * sizeof(short));
+    memset(&m_state[0], NoEdge, m_paddedWidth);
+    memset(&m_state[paddedSize - m_paddedWidth], NoEdge, m_paddedWidth);
+
+    for (UINT32 y = 1; y <= height; ++y)
+    {
+        m_magnitude[y * m_paddedWidth] = 0;
+        m_magnitude[y * m_paddedWidth + width + 1] = 0;
+        m_state[y * m_paddedWidth] = NoEdge;
+        m_state[y * m_paddedWidth + width + 1] = NoEdge;
+    }
+}
+
+
+UINT32 EdgeThinner::width() const
+{
+    return m_width;
+}
+
+
+UINT32 EdgeThinner::height() const
+{
+    return m_height;
+}
+
+
+short* EdgeThinner::magnitudeLine(const UINT32& y)
+{
+    return &m_magnitude[(y + 1) * m_paddedWidth + 1];
+}
+
+
+BYTE* EdgeThinner::directionLine(const UINT32& y)
+{
+    return &m_direction[y * m_width];
+}
+
+
+const BYTE* EdgeThinner::edgeLine(const UINT32& y) const
+{
+    return &m_state[(y + 1) * m_paddedWidth + 1];
+}
+
+
+//-------------------------------------------------------------------
+// thin
+//
+// Keeps the pixels, which are local maxima along their gradient
+// direction and whose magnitude exceeds the high threshold, and the
+// local maxima exceeding the low threshold connected to them.
+//-------------------------------------------------------------------
+void EdgeThinner::thin(const int& lowThreshold, const int& highThreshold, const bool& parallel)
+{
+    if (m_width == 0 || m_height == 0)
+    {
+        return;
+    }
+
+    RowBandExecutor executor(0, m_height, parallel);
+
+    executor.run([&](const UINT32& bandIndex, const UINT32& top, const UINT32& bottom)
+    {
+        suppressNonMaxima(lowThreshold, highThreshold, top, bottom);
+    });
+
+    trackEdges();
+}
+
+
+//-------------------------------------------------------------------
+// suppressNonMaxima
+//
+// Classifies the pixels on the lines [top, bottom) as strong or weak
+// edges, or as non-edges if they are not local maxima.
+//-------------------------------------------------------------------
+void EdgeThinner::suppressNonMaxima(
+    const int& lowThreshold, const int& highThreshold, const UINT32& top, const UINT32& bottom)
+{
+    // Offsets to the neighbours along the gradient direction
+    const int neighbourOffsets[4] =
+    {
+        1,
+        (int)m_paddedWidth + 1,
+        (int)m_paddedWidth,
+        (int)m_paddedWidth - 1
+    };
+
+    for (UINT32 y = top; y < bottom; ++y)
+    {
+        const UINT32 lineStart = (y + 1) * m_paddedWidth + 1;
+        const short* magnitude = &m_magnitude[lineStart];
+        const BYTE* direction = &m_direction[y * m_width];
+        BYTE* state = &m_state[lineStart];
+
+        for (UINT32 x = 0; x < m_width; ++x)
+        {
+            const short value = magnitude[x];
+
+            if (value <= lowThreshold)
+            {
+                state[x] = NoEdge;
+                continue;
+            }
+
+            // On plateaus only the first pixel along the direction is kept
+            const int offset = neighbourOffsets[direction[x] & 0x3];
+
+            if (value > magnitude[(int)x - offset] && value >= magnitude[x + offset])
+            {
+                state[x] = (value > highThreshold) ? StrongEdge : WeakEdge;
+            }
+            else
+            {
+                state[x] = NoEdge;
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// trackEdges
+//
+// Promotes the weak edges 8-connected to the strong ones to edges
+// with a stack based flood fill. Each pixel is pushed at most once.
+// The remaining weak edges are left as they are.
+//-------------------------------------------------------------------
+void EdgeThinner::trackEdges()
+{
+    const int neighbourOffsets[8] =
+    {
+        -(int)m_paddedWidth - 1, -(int)m_paddedWidth, -(int)m_paddedWidth + 1,
+        -1, 1,
+        (int)m_paddedWidth - 1, (int)m_paddedWidth, (int)m_paddedWidth + 1
+    };
+
+    m_stack.clear();
+
+    for (UINT32 y = 1; y <= m_height; ++y)
+    {
+        const UINT32 lineEnd = y * m_paddedWidth + m_width + 1;
+
+        for (UINT32 i = y * m_paddedWidth + 1; i < lineEnd; ++i)
+        {
+            if (m_state[i] != StrongEdge)
+            {
+                continue;
+            }
+
+            m_state[i] = SelectedPixelValue;
+            m_stack.push_back(i);
+
+            while (!m_stack.empty())
+            {
+                const UINT32 current = m_stack.back();
+                m_stack.pop_back();
+
+                for (int j = 0; j < 8; ++j)
+                {
+                    const UINT32 neighbour = current + neighbourOffsets[j];
+
+                    if (m_state[neighbour] == WeakEdge || m_state[neighbour] == StrongEdge)
+                    {
+                        m_state[neighbour] = SelectedPixelValue;
+                        m_stack.push_back(neighbour);
+                    }
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#ifndef EDGETHINNER_H
+#define EDGETHINNER_H
+
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// EdgeThinner
+//
+// Canny-style thinning of gradient magnitudes: non-maximum
+// suppression along the quantized gradient direction followed by
+// hysteresis thresholding. The caller fills the magnitude and the
+// direction of each pixel, calls thin() and reads the edge lines.
+//
+// The directions are quantized as follows:
+// 0: Horizontal gradient (vertical edge)
+// 1: Diagonal gradient towards the lower right corner
+// 2: Vertical gradient (horizontal edge)
+// 3: Diagonal gradient towards the lower left corner
+//-------------------------------------------------------------------
+class EdgeThinner
+{
+public:
+    EdgeThinner();
+
+public:
+    void resize(const UINT32& width, const UINT32& height);
+    UINT32 width() const;
+    UINT32 height() const;
+
+    short* magnitudeLine(const UINT32& y);
+    BYTE* directionLine(const UINT32& y);
+
+    void thin(const int& lowThreshold, const int& highThreshold, const bool& parallel);
+
+    // After thin(), the edge pixels have value SelectedPixelValue
+    const BYTE* edgeLine(const UINT32& y) const;
+
+protected: // New methods
+    void suppressNonMaxima(const int& lowThreshold, const int& highThreshold, const UINT32& top, const UINT32& bottom);
+    void trackEdges();
+
+protected: // Members
+    UINT32 m_width;
+    UINT32 m_height;
+    UINT32 m_paddedWidth;
+    std::vector<short> m_magnitude; // One pixel wide zero border
+    std::vector<BYTE> m_direction;
+    std::vector<BYTE> m_state; // One pixel wide border of non-edge pixels
+    std::vector<UINT32> m_stack;
+};
+
+#endif // EDGETHINNER_H
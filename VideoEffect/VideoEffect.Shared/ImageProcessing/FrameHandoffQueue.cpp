@@ -0,0 +1,106 @@
+#include "pch.h"
+
+#include "FrameHandoffQueue.h" // Own header
+
+
+FrameHandoffQueue::FrameHandoffQueue()
+    : m_capacity(1),
+    m_head(0),
+    m_tail(0)
+{
+}
+
+
+void FrameHandoffQueue::setCapacity(const UINT32& capacity)
+{
+    m_capacity = max(capacity, 1u);
+    m_frames.release();
+    m_head.store(0, std::memory_order_relaxed);
+    m_tail.store(0, std::memory_order_relaxed);
+}
+
+
+UINT32 FrameHandoffQueue::capacity() const
+{
+    return m_capacity;
+}
+
+
+bool FrameHandoffQueue::isEmpty() const
+{
+    return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+}
+
+
+//-------------------------------------------------------------------
+// beginWrite
+//
+// The positions run modulo twice the capacity, so that a full queue
+// (positions the capacity apart) can be told from an empty one
+// (equal positions). The slot is the position modulo the capacity.
+//-------------------------------------------------------------------
+int FrameHandoffQueue::beginWrite(const size_t& frameSize)
+{
+    const UINT32 tail = m_tail.load(std::memory_order_relaxed);
+    const UINT32 head = m_head.load(std::memory_order_acquire);
+
+    if ((tail + 2 * m_capacity - head) % (2 * m_capacity) >= m_capacity)
+    {
+        return -1;
+    }
+
+    if (frameSize != m_frames.frameSize() || m_frames.depth() != m_capacity)
+    {
+        if (tail != head)
+        {
+            // The consumer may be reading a slot
+            return -1;
+        }
+
+        m_frames.allocate(frameSize, m_capacity);
+
+        if (m_frames.depth() != m_capacity)
+        {
+            return -1;
+        }
+    }
+
+    return (int)(tail % m_capacity);
+}
+
+
+void FrameHandoffQueue::endWrite()
+{
+    m_tail.store(nextPosition(m_tail.load(std::memory_order_relaxed)), std::memory_order_release);
+}
+
+
+int FrameHandoffQueue::front() const
+{
+    const UINT32 head = m_head.load(std::memory_order_relaxed);
+
+    if (head == m_tail.load(std::memory_order_acquire))
+    {
+        return -1;
+    }
+
+    return (int)(head % m_capacity);
+}
+
+
+void FrameHandoffQueue::popFront()
+{
+    m_head.store(nextPosition(m_head.load(std::memory_order_relaxed)), std::memory_order_release);
+}
+
+
+BYTE* FrameHandoffQueue::frame(const UINT32& slot) const
+{
+    return m_frames.slot(slot);
+}
+
+
+UINT32 FrameHandoffQueue::nextPosition(const UINT32& position) const
+{
+    return (position + 1) % (2 * m_capacity);
+}
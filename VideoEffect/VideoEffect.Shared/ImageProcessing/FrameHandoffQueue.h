@@ -0,0 +1,55 @@
+#ifndef FRAMEHANDOFFQUEUE_H
+#define FRAMEHANDOFFQUEUE_H
+
+#include <mfapi.h>
+#include <atomic>
+
+#include "FrameRingBuffer.h"
+
+
+//-------------------------------------------------------------------
+// FrameHandoffQueue
+//
+// Single-producer single-consumer queue of frames over the slots of
+// a FrameRingBuffer. The producer writes a frame into the slot it
+// got from beginWrite() and publishes it with endWrite(). The
+// consumer processes the frame in front() and frees its slot with
+// popFront(). Neither side takes locks nor waits. When the queue is
+// full the producer gets no slot and drops the frame.
+//
+// The producer owns the storage: the slots are reallocated, if the
+// frame size changes, only when the queue is empty.
+//-------------------------------------------------------------------
+class FrameHandoffQueue
+{
+public:
+    FrameHandoffQueue();
+
+public:
+    // The queue must be empty, e.g. the consumer waited for
+    void setCapacity(const UINT32& capacity);
+    UINT32 capacity() const;
+    bool isEmpty() const;
+
+    // Producer: the slot to write a frame of the given size into, -1 if
+    // the queue is full
+    int beginWrite(const size_t& frameSize);
+    void endWrite();
+
+    // Consumer: the slot of the oldest frame, -1 if the queue is empty
+    int front() const;
+    void popFront();
+
+    BYTE* frame(const UINT32& slot) const;
+
+protected: // New methods
+    UINT32 nextPosition(const UINT32& position) const;
+
+protected: // Members
+    FrameRingBuffer m_frames;
+    UINT32 m_capacity;
+    std::atomic<UINT32> m_head; // Position of the oldest frame, written by the consumer
+    std::atomic<UINT32> m_tail; // Position of the next frame, written by the producer
+};
+
+#endif // FRAMEHANDOFFQUEUE_H
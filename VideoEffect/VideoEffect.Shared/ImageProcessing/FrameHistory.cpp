@@ -0,0 +1,87 @@
+#include "pch.h"
+
+#include "FrameHistory.h" // Own header
+
+
+FrameHistory::FrameHistory()
+    : m_lineLength(0),
+    m_lineCount(0),
+    m_depth(0),
+    m_oldestIndex(0),
+    m_frameCount(0)
+{
+}
+
+
+//-------------------------------------------------------------------
+// reset
+//
+// Allocates the slots and forgets the stored frames.
+//-------------------------------------------------------------------
+void FrameHistory::reset(const UINT32& lineLength, const UINT32& lineCount, const UINT32& depth)
+{
+    m_lineLength = lineLength;
+    m_lineCount = lineCount;
+    m_depth = depth;
+    m_oldestIndex = 0;
+    m_frameCount = 0;
+    m_frames.resize((size_t)lineLength * lineCount * depth);
+}
+
+
+bool FrameHistory::matches(const UINT32& lineLength, const UINT32& lineCount, const UINT32& depth) const
+{
+    return m_lineLength == lineLength && m_lineCount == lineCount && m_depth == depth;
+}
+
+
+UINT32 FrameHistory::lineLength() const
+{
+    return m_lineLength;
+}
+
+
+UINT32 FrameHistory::depth() const
+{
+    return m_depth;
+}
+
+
+bool FrameHistory::isFull() const
+{
+    return m_depth > 0 && m_frameCount == m_depth;
+}
+
+
+const BYTE* FrameHistory::frame(const UINT32& framesBack) const
+{
+    if (framesBack == 0 || framesBack > m_frameCount)
+    {
+        return NULL;
+    }
+
+    const UINT32 index = (m_oldestIndex + m_depth - framesBack) % m_depth;
+    return &m_frames[(size_t)index * m_lineLength * m_lineCount];
+}
+
+
+BYTE* FrameHistory::oldestFrame()
+{
+    return &m_frames[(size_t)m_oldestIndex * m_lineLength * m_lineCount];
+}
+
+
+//-------------------------------------------------------------------
+// advance
+//
+// Makes the oldest slot the newest frame.
+//-------------------------------------------------------------------
+void FrameHistory::advance()
+{
+    m_oldestIndex = (m_oldestIndex + 1) % m_depth;
+
+    if (m_frameCount < m_depth)
+    {
+        ++m_frameCount;
+    }
+}
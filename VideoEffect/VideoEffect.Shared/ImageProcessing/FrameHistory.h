@@ -0,0 +1,50 @@
+#ifndef FRAMEHISTORY_H
+#define FRAMEHISTORY_H
+
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// FrameHistory
+//
+// Ring of the last N frames of a single packed plane. The slot of the
+// oldest frame is reused for the current frame and advance() makes it
+// the newest one, so the history is kept without copying frames
+// around. The caller decides what a "plane" holds, e.g. only the
+// chroma samples of the frame.
+//-------------------------------------------------------------------
+class FrameHistory
+{
+public:
+    FrameHistory();
+
+public:
+    void reset(const UINT32& lineLength, const UINT32& lineCount, const UINT32& depth);
+    bool matches(const UINT32& lineLength, const UINT32& lineCount, const UINT32& depth) const;
+
+    UINT32 lineLength() const;
+    UINT32 depth() const;
+    bool isFull() const;
+
+    // The frame the given number of frames back (1 is the previous frame)
+    // or NULL if the history does not reach that far yet
+    const BYTE* frame(const UINT32& framesBack) const;
+
+    // The slot of the oldest frame; it holds the frame depth() frames
+    // back when the history is full and is overwritten with the current
+    // frame before calling advance()
+    BYTE* oldestFrame();
+
+    void advance();
+
+protected: // Members
+    std::vector<BYTE> m_frames;
+    UINT32 m_lineLength;
+    UINT32 m_lineCount;
+    UINT32 m_depth;
+    UINT32 m_oldestIndex;
+    UINT32 m_frameCount;
+};
+
+#endif // FRAMEHISTORY_H
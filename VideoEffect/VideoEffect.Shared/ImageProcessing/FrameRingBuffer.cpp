@@ -0,0 +1,175 @@
+#include "pch.h"
+
+#include "FrameRingBuffer.h" // Own header
+
+
+// Constants
+const size_t SlotAlignment = 4096;
+
+
+FrameRingBuffer::FrameRingBuffer()
+    : m_frameSize(0),
+    m_slotSize(0),
+    m_depth(0)
+{
+}
+
+
+FrameRingBuffer::~FrameRingBuffer()
+{
+    release();
+}
+
+
+//-------------------------------------------------------------------
+// allocate
+//
+// If the allocation fails, the buffer has no slots.
+//-------------------------------------------------------------------
+void FrameRingBuffer::allocate(const size_t& frameSize, const UINT32& depth)
+{
+    if (frameSize != m_frameSize || depth != m_depth)
+    {
+        release();
+
+        const size_t slotSize = (frameSize + SlotAlignment - 1) / SlotAlignment * SlotAlignment;
+
+        for (UINT32 i = 0; slotSize > 0 && i < depth; ++i)
+        {
+            BYTE* storage = (BYTE*)_aligned_malloc(slotSize, SlotAlignment);
+
+            if (!storage)
+            {
+                break;
+            }
+
+            m_slots.push_back(storage);
+        }
+
+        if (slotSize > 0 && depth > 0 && m_slots.size() == depth)
+        {
+            m_frameSize = frameSize;
+            m_slotSize = slotSize;
+            m_depth = depth;
+        }
+        else
+        {
+            release();
+        }
+    }
+
+    m_filled.assign(m_depth, false);
+}
+
+
+void FrameRingBuffer::release()
+{
+    for (BYTE* storage : m_slots)
+    {
+        _aligned_free(storage);
+    }
+
+    for (BYTE* storage : m_spares)
+    {
+        _aligned_free(storage);
+    }
+
+    m_slots.clear();
+    m_spares.clear();
+    m_frameSize = 0;
+    m_slotSize = 0;
+    m_depth = 0;
+    m_filled.clear();
+}
+
+
+UINT32 FrameRingBuffer::depth() const
+{
+    return m_depth;
+}
+
+
+size_t FrameRingBuffer::frameSize() const
+{
+    return m_frameSize;
+}
+
+
+BYTE* FrameRingBuffer::slot(const UINT32& index) const
+{
+    return (index < m_depth) ? m_slots[index] : NULL;
+}
+
+
+//-------------------------------------------------------------------
+// prepareSlot
+//
+// A detached slot takes a spare storage, or new storage if all the
+// detached ones are still in use.
+//-------------------------------------------------------------------
+BYTE* FrameRingBuffer::prepareSlot(const UINT32& index)
+{
+    if (index >= m_depth)
+    {
+        return NULL;
+    }
+
+    if (!m_slots[index])
+    {
+        if (!m_spares.empty())
+        {
+            m_slots[index] = m_spares.back();
+            m_spares.pop_back();
+        }
+        else
+        {
+            m_slots[index] = (BYTE*)_aligned_malloc(m_slotSize, SlotAlignment);
+        }
+    }
+
+    return m_slots[index];
+}
+
+
+BYTE* FrameRingBuffer::frame(const UINT32& index) const
+{
+    return (index < m_depth && m_filled[index]) ? m_slots[index] : NULL;
+}
+
+
+void FrameRingBuffer::setFilled(const UINT32& index, const bool& filled)
+{
+    if (index < m_depth)
+    {
+        m_filled[index] = filled && m_slots[index];
+    }
+}
+
+
+void FrameRingBuffer::clear()
+{
+    m_filled.assign(m_depth, false);
+}
+
+
+BYTE* FrameRingBuffer::detach(const UINT32& index)
+{
+    BYTE* storage = frame(index);
+
+    if (storage)
+    {
+        m_slots[index] = NULL;
+        m_filled[index] = false;
+    }
+
+    return storage;
+}
+
+
+void FrameRingBuffer::reclaim(BYTE* storage)
+{
+    if (storage)
+    {
+        m_spares.push_back(storage);
+    }
+}
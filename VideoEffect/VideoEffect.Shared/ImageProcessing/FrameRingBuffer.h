@@ -0,0 +1,67 @@
+#ifndef FRAMERINGBUFFER_H
+#define FRAMERINGBUFFER_H
+
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// FrameRingBuffer
+//
+// Fixed set of frame slots allocated once and reused for the lifetime
+// of the stream. Each slot has storage of its own starting on its own
+// page, so that the copies into different slots do not share cache
+// lines or pages. A slot is either empty or holds a frame.
+//
+// The storage of a slot can be detached to hand the frame over without
+// copying it. The slot then has no storage until a spare one is
+// reclaimed, or until it is written to again, in which case it takes a
+// spare or allocates new storage.
+//-------------------------------------------------------------------
+class FrameRingBuffer
+{
+public:
+    FrameRingBuffer();
+    ~FrameRingBuffer();
+
+public:
+    // Reallocates only if the frame size or the depth changes. All slots
+    // are empty afterwards.
+    void allocate(const size_t& frameSize, const UINT32& depth);
+    void release();
+
+    UINT32 depth() const;
+    size_t frameSize() const;
+
+    // Storage of the given slot regardless of whether it holds a frame,
+    // NULL while detached
+    BYTE* slot(const UINT32& index) const;
+
+    // Storage of the given slot to write a frame into. A detached slot
+    // gets storage again here. NULL if that fails.
+    BYTE* prepareSlot(const UINT32& index);
+
+    // The frame in the given slot or NULL if the slot is empty
+    BYTE* frame(const UINT32& index) const;
+
+    void setFilled(const UINT32& index, const bool& filled);
+    void clear();
+
+    // Hands the storage of the slot with its frame over to the caller.
+    // NULL if the slot is empty.
+    BYTE* detach(const UINT32& index);
+
+    // Takes back the storage given by detach() as a spare. Must be called
+    // before the buffer is reallocated, the storage is freed with it.
+    void reclaim(BYTE* storage);
+
+protected: // Members
+    std::vector<BYTE*> m_slots; // NULL while detached
+    std::vector<BYTE*> m_spares;
+    size_t m_frameSize;
+    size_t m_slotSize;
+    UINT32 m_depth;
+    std::vector<bool> m_filled;
+};
+
+#endif // FRAMERINGBUFFER_H
@@ -0,0 +1,248 @@
+#include "pch.h"
+
+#include "GlobalMotionEstimator.h" // Own header
+
+#include "Common.h"
+#include "Simd.h"
+
+#include <algorithm>
+
+
+// Constants
+const UINT32 MotionTileSize = 16; // The vectorized SAD handles exactly 16 pixels per row
+const UINT32 MotionTileColumns = 4;
+const UINT32 MotionTileRows = 3;
+const LONG MotionSearchRadius = 4;
+const UINT32 MinTileTexture = 4 * MotionTileSize * MotionTileSize; // Mean absolute deviation of 4 luma levels
+const UINT32 MinMatchedTiles = 3;
+
+
+GlobalMotionEstimator::GlobalMotionEstimator()
+    : m_width(0),
+    m_height(0),
+    m_hasPrevious(false)
+{
+}
+
+
+void GlobalMotionEstimator::reset()
+{
+    m_hasPrevious = false;
+}
+
+
+bool GlobalMotionEstimator::estimate(
+    const BYTE* image, const UINT32& stride, const UINT32& width, const UINT32& height,
+    const GUID& videoFormatSubtype, const D2D_RECT_U& excludedRect, D2D_POINT_2L& motion)
+{
+    motion.x = 0;
+    motion.y = 0;
+
+    if (videoFormatSubtype != MFVideoFormat_NV12 && videoFormatSubtype != MFVideoFormat_YUY2)
+    {
+        m_hasPrevious = false;
+        return false;
+    }
+
+    if (width != m_width || height != m_height)
+    {
+        m_width = width;
+        m_height = height;
+        m_previous.resize(width * height);
+        m_current.resize(width * height);
+        m_hasPrevious = false;
+    }
+
+    extractLuma(image, stride, videoFormatSubtype, m_current.data());
+
+    LONG motionsX[MotionTileColumns * MotionTileRows];
+    LONG motionsY[MotionTileColumns * MotionTileRows];
+    UINT32 matchedCount = 0;
+
+    if (m_hasPrevious)
+    {
+        for (UINT32 row = 0; row < MotionTileRows; ++row)
+        {
+            for (UINT32 column = 0; column < MotionTileColumns; ++column)
+            {
+                // Centered in the cells of the grid, all the candidate
+                // positions within the frame
+                const LONG left = (LONG)((2 * column + 1) * m_width / (2 * MotionTileColumns)) - (LONG)MotionTileSize / 2;
+                const LONG top = (LONG)((2 * row + 1) * m_height / (2 * MotionTileRows)) - (LONG)MotionTileSize / 2;
+
+                if (left < MotionSearchRadius || top < MotionSearchRadius
+                    || left + (LONG)MotionTileSize + MotionSearchRadius > (LONG)m_width
+                    || top + (LONG)MotionTileSize + MotionSearchRadius > (LONG)m_height)
+                {
+                    continue;
+                }
+
+                if ((UINT32)left < excludedRect.right && (UINT32)left + MotionTileSize > excludedRect.left
+                    && (UINT32)top < excludedRect.bottom && (UINT32)top + MotionTileSize > excludedRect.top)
+                {
+                    continue;
+                }
+
+                D2D_POINT_2L tileMotion;
+
+                if (matchTile((UINT32)left, (UINT32)top, tileMotion))
+                {
+                    motionsX[matchedCount] = tileMotion.x;
+                    motionsY[matchedCount] = tileMotion.y;
+                    ++matchedCount;
+                }
+            }
+        }
+    }
+
+    m_previous.swap(m_current);
+    m_hasPrevious = true;
+
+    if (matchedCount < MinMatchedTiles)
+    {
+        return false;
+    }
+
+    const UINT32 middle = matchedCount / 2;
+    std::nth_element(motionsX, motionsX + middle, motionsX + matchedCount);
+    std::nth_element(motionsY, motionsY + middle, motionsY + matchedCount);
+    motion.x = motionsX[middle];
+    motion.y = motionsY[middle];
+
+    return true;
+}
+
+
+void GlobalMotionEstimator::extractLuma(
+    const BYTE* image, const UINT32& stride, const GUID& videoFormatSubtype, BYTE* luma) const
+{
+    for (UINT32 y = 0; y < m_height; ++y)
+    {
+        const BYTE* line = image + y * stride;
+        BYTE* lumaLine = luma + y * m_width;
+
+        if (videoFormatSubtype == MFVideoFormat_NV12)
+        {
+            memcpy(lumaLine, line, m_width);
+        }
+        else
+        {
+            // YUY2: Y0 U Y1 V
+            for (UINT32 x = 0; x < m_width; ++x)
+            {
+                lumaLine[x] = line[x * 2];
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// matchTile
+//
+// Full search of the displacement with the smallest sum of absolute
+// differences. Of equal matches the smallest displacement wins, so a
+// flat background yields no motion. Returns false for tiles without
+// texture, since they match anywhere.
+//-------------------------------------------------------------------
+bool GlobalMotionEstimator::matchTile(const UINT32& left, const UINT32& top, D2D_POINT_2L& motion) const
+{
+    const BYTE* tile = m_current.data() + top * m_width + left;
+
+    if (tileTexture(tile) < MinTileTexture)
+    {
+        return false;
+    }
+
+    UINT32 bestSad = 0;
+    LONG bestDistance = 0;
+    bool found = false;
+
+    for (LONG dy = -MotionSearchRadius; dy <= MotionSearchRadius; ++dy)
+    {
+        for (LONG dx = -MotionSearchRadius; dx <= MotionSearchRadius; ++dx)
+        {
+            // The content moved by (dx, dy), so it was at (x - dx, y - dy)
+            const BYTE* previousTile = m_previous.data() + (top - dy) * m_width + (left - dx);
+            const UINT32 sad = tileSad(tile, previousTile, m_width);
+            const LONG distance = abs(dx) + abs(dy);
+
+            if (!found || sad < bestSad || (sad == bestSad && distance < bestDistance))
+            {
+                bestSad = sad;
+                bestDistance = distance;
+                motion.x = dx;
+                motion.y = dy;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+
+UINT32 GlobalMotionEstimator::tileTexture(const BYTE* tile) const
+{
+    UINT32 sum = 0;
+
+    for (UINT32 y = 0; y < MotionTileSize; ++y)
+    {
+        for (UINT32 x = 0; x < MotionTileSize; ++x)
+        {
+            sum += tile[y * m_width + x];
+        }
+    }
+
+    const LONG mean = (LONG)(sum / (MotionTileSize * MotionTileSize));
+    UINT32 deviation = 0;
+
+    for (UINT32 y = 0; y < MotionTileSize; ++y)
+    {
+        for (UINT32 x = 0; x < MotionTileSize; ++x)
+        {
+            deviation += (UINT32)abs((LONG)tile[y * m_width + x] - mean);
+        }
+    }
+
+    return deviation;
+}
+
+
+UINT32 GlobalMotionEstimator::tileSad(const BYTE* tile0, const BYTE* tile1, const UINT32& stride)
+{
+#if defined(VIDEOEFFECT_SSE2)
+    __m128i sums = _mm_setzero_si128();
+
+    for (UINT32 y = 0; y < MotionTileSize; ++y)
+    {
+        sums = _mm_add_epi64(sums, _mm_sad_epu8(
+            _mm_loadu_si128((const __m128i*)(tile0 + y * stride)),
+            _mm_loadu_si128((const __m128i*)(tile1 + y * stride))));
+    }
+
+    return (UINT32)(_mm_cvtsi128_si32(sums) + _mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+#elif defined(VIDEOEFFECT_NEON)
+    uint16x8_t sums = vdupq_n_u16(0);
+
+    for (UINT32 y = 0; y < MotionTileSize; ++y)
+    {
+        sums = vpadalq_u8(sums, vabdq_u8(vld1q_u8(tile0 + y * stride), vld1q_u8(tile1 + y * stride)));
+    }
+
+    const uint64x2_t total = vpaddlq_u32(vpaddlq_u16(sums));
+    return (UINT32)(vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1));
+#else
+    UINT32 sad = 0;
+
+    for (UINT32 y = 0; y < MotionTileSize; ++y)
+    {
+        for (UINT32 x = 0; x < MotionTileSize; ++x)
+        {
+            sad += (UINT32)abs((LONG)tile0[y * stride + x] - (LONG)tile1[y * stride + x]);
+        }
+    }
+
+    return sad;
+#endif
+}
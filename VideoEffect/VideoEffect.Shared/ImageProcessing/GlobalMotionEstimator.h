@@ -0,0 +1,59 @@
+#ifndef GLOBALMOTIONESTIMATOR_H
+#define GLOBALMOTIONESTIMATOR_H
+
+#include <D2d1helper.h>
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// GlobalMotionEstimator
+//
+// Estimates the motion of the background between two consecutive
+// frames, e.g. camera shake, by block matching a grid of tiles of
+// the luma. Meant for a downscaled frame (a pyramid level), where a
+// small search range covers a large motion of the full frame.
+//
+// The tiles overlapping the excluded rectangle (the object) and the
+// tiles without texture are skipped, and the motion is the median of
+// the tile motions, so a minority of tiles on moving objects does not
+// affect it.
+//-------------------------------------------------------------------
+class GlobalMotionEstimator
+{
+public:
+    GlobalMotionEstimator();
+
+public:
+    // Forgets the previous frame
+    void reset();
+
+    //-------------------------------------------------------------------
+    // estimate
+    //
+    // Returns true and the motion of the content since the previous
+    // frame, in the pixels of the given image, if it could be estimated.
+    // The frame becomes the previous frame in any case.
+    //-------------------------------------------------------------------
+    bool estimate(
+        const BYTE* image, const UINT32& stride, const UINT32& width, const UINT32& height,
+        const GUID& videoFormatSubtype, const D2D_RECT_U& excludedRect, D2D_POINT_2L& motion);
+
+protected: // New methods
+    void extractLuma(
+        const BYTE* image, const UINT32& stride, const GUID& videoFormatSubtype, BYTE* luma) const;
+
+    bool matchTile(const UINT32& left, const UINT32& top, D2D_POINT_2L& motion) const;
+    UINT32 tileTexture(const BYTE* tile) const;
+
+    static UINT32 tileSad(const BYTE* tile0, const BYTE* tile1, const UINT32& stride);
+
+protected: // Members
+    std::vector<BYTE> m_previous; // Packed luma
+    std::vector<BYTE> m_current;
+    UINT32 m_width;
+    UINT32 m_height;
+    bool m_hasPrevious;
+};
+
+#endif // GLOBALMOTIONESTIMATOR_H
@@ -4,15 +4,20 @@
 
 #include "ImageProcessingUtils.h"
 #include "ObjectDetails.h"
+#include "OverlayCommandList.h"
+#include "StageProfiler.h"
 
 
 // Constants
 const double TwoPi = Pi * 2;
 const double AngleIncrement = 0.1667 * Pi; // Roughly 1/6 * pi
+const double MinCircleFillRatio = 0.5; // No confidence at or below
+const double FullConfidenceCircleFillRatio = 0.85; // Full confidence at or above
 
 
 ImageAnalyzer::ImageAnalyzer(ImageProcessingUtils* imageProcessingUtils)
-    : m_imageProcessingUtils(imageProcessingUtils)
+    : m_imageProcessingUtils(imageProcessingUtils),
+    m_stageProfiler(NULL)
 {
 }
 
@@ -22,6 +27,12 @@ ImageAnalyzer::~ImageAnalyzer()
 }
 
 
+void ImageAnalyzer::setStageProfiler(StageProfiler* stageProfiler)
+{
+    m_stageProfiler = stageProfiler;
+}
+
+
 //------------------------------------------------------------------
 // extractObjectDetails
 //
@@ -130,6 +141,7 @@ std::vector<ConvexHull*> ImageAnalyzer::extractConvexHullsOfLargestObjects(
 {
     std::vector<ConvexHull*> convexHulls;
 
+    LONGLONG labellingStartTimestamp = m_stageProfiler ? StageProfiler::timestamp() : 0;
     UINT16* objectMap = m_imageProcessingUtils->createObjectMap(binaryImage, imageWidth, imageHeight, targetRect, videoFormatSubtype);
 
     if (objectMap)
@@ -138,6 +150,13 @@ std::vector<ConvexHull*> ImageAnalyzer::extractConvexHullsOfLargestObjects(
         UINT32 minSize = (UINT32)((float)imageWidth * (float)imageHeight * RelativeObjectSizeThreshold);
         std::vector<UINT16>* largeObjectIds = resolveLargeObjectIds(objectMap, imageWidth, imageHeight, objectCount, minSize);
         objectCount = largeObjectIds->size();
+
+        if (m_stageProfiler)
+        {
+            m_stageProfiler->record(LabellingStage, labellingStartTimestamp);
+        }
+
+        StageTimer hullsTimer(m_stageProfiler, HullsStage);
         std::vector<D2D_POINT_2U>* sortedPoints = NULL;
         ConvexHull* convexHull = NULL;
 
@@ -377,6 +396,38 @@ double ImageAnalyzer::circleAreaError(UINT32 measuredDiameter, UINT32 measuredAr
 }
 
 
+//------------------------------------------------------------------
+// circleFitConfidence
+//
+// The area of the hull (shoelace formula) relative to the area of
+// the circle. A digitized disc fills most of its enclosing circle,
+// a square about 64 % and a triangle at most 41 %.
+//------------------------------------------------------------------
+float ImageAnalyzer::circleFitConfidence(const ConvexHull& convexHull, const double& radius) const
+{
+    const UINT32 pointCount = convexHull.size();
+
+    if (pointCount < 3 || radius <= 0)
+    {
+        return 0;
+    }
+
+    double doubleArea = 0;
+
+    for (UINT32 i = 0; i < pointCount; ++i)
+    {
+        const D2D_POINT_2U& point1 = convexHull.at(i);
+        const D2D_POINT_2U& point2 = convexHull.at((i + 1) % pointCount);
+        doubleArea += (double)point1.x * point2.y - (double)point2.x * point1.y;
+    }
+
+    const double fillRatio = abs(doubleArea) / 2 / (Pi * radius * radius);
+
+    return (float)clamp(
+        (fillRatio - MinCircleFillRatio) / (FullConfidenceCircleFillRatio - MinCircleFillRatio), 0.0, 1.0);
+}
+
+
 
 //-------------------------------------------------------------------
 // extractBestCircularConvexHull
@@ -421,35 +472,30 @@ ConvexHull* ImageAnalyzer::extractBestCircularConvexHull(std::vector<ConvexHull*
 // Extracts convex hulls from the given frame and tries to determine
 // the best candidate to match the desired (circular) object.
 //
-// Note that the returned convex hull is owned by the caller.
+// Note that the returned convex hull is owned by the caller. If the
+// overlays are given, the hulls are added to them instead of drawing
+// them to the image.
 //-------------------------------------------------------------------
 ConvexHull* ImageAnalyzer::extractBestCircularConvexHull(
     BYTE* binaryImage, const UINT32& imageWidth, const UINT32& imageHeight, const D2D_RECT_U& targetRect,
-    const UINT8& maxCandidates, const GUID& videoFormatSubtype, bool drawConvexHulls) const
+    const UINT8& maxCandidates, const GUID& videoFormatSubtype, OverlayCommandList* overlays) const
 {
     std::vector<ConvexHull*> convexHulls =
         extractConvexHullsOfLargestObjects(binaryImage, imageWidth, imageHeight, targetRect, maxCandidates, videoFormatSubtype);
 
-    if (drawConvexHulls)
+    if (overlays)
     {
-#pragma warning(push)
-#pragma warning(disable: 4018) 
-        for (int i = 0; i < convexHulls.size(); ++i)
+        for (ConvexHull* candidate : convexHulls)
         {
-            m_imageProcessingUtils->visualizeConvexHull(
-                binaryImage, imageWidth, imageHeight,
-                *convexHulls.at(i), videoFormatSubtype, 4, 0x4c, 0x54, 0xff);
+            overlays->addPolyline(*candidate, false, 4, 0x4c, 0x54, 0xff);
         }
-#pragma warning(pop)
     }
 
     ConvexHull* convexHull = extractBestCircularConvexHull(convexHulls);
 
-    if (convexHull && drawConvexHulls)
+    if (convexHull && overlays)
     {
-        m_imageProcessingUtils->visualizeConvexHull(
-            binaryImage, imageWidth, imageHeight,
-            *convexHull, videoFormatSubtype, 4, 0xff, 0x0, 0x0);
+        overlays->addPolyline(*convexHull, false, 4, 0xff, 0x0, 0x0);
     }
 
     return convexHull;
@@ -463,7 +509,7 @@ ConvexHull* ImageAnalyzer::extractBestCircularConvexHull(
 //-------------------------------------------------------------------
 ConvexHull* ImageAnalyzer::extractBestCircularConvexHull(
     BYTE* binaryImage, const UINT32& imageWidth, const UINT32& imageHeight,
-    const UINT8& maxCandidates, const GUID& videoFormatSubtype, bool drawConvexHulls) const
+    const UINT8& maxCandidates, const GUID& videoFormatSubtype, OverlayCommandList* overlays) const
 {
     D2D_RECT_U targetRect;
     targetRect.left = 0;
@@ -473,7 +519,69 @@ ConvexHull* ImageAnalyzer::extractBestCircularConvexHull(
 
     return extractBestCircularConvexHull(
         binaryImage, imageWidth, imageHeight, targetRect,
-        maxCandidates, videoFormatSubtype, drawConvexHulls);
+        maxCandidates, videoFormatSubtype, overlays);
+}
+
+
+//-------------------------------------------------------------------
+// extractCircularObjects
+//
+// As extractBestCircularConvexHull but keeps all the candidates, e.g.
+// for tracking several objects at once.
+//-------------------------------------------------------------------
+int ImageAnalyzer::extractCircularObjects(
+    BYTE* binaryImage, const UINT32& imageWidth, const UINT32& imageHeight, const D2D_RECT_U& targetRect,
+    const UINT8& maxCandidates, const GUID& videoFormatSubtype,
+    std::vector<ObjectDetails>& objects, OverlayCommandList* overlays) const
+{
+    std::vector<ConvexHull*> convexHulls =
+        extractConvexHullsOfLargestObjects(binaryImage, imageWidth, imageHeight, targetRect, maxCandidates, videoFormatSubtype);
+
+    LONG error = 0;
+    const ConvexHull* bestConvexHull = convexHullClosestToCircle(convexHulls, error);
+    int bestIndex = -1;
+
+    objects.clear();
+
+    for (ConvexHull* convexHull : convexHulls)
+    {
+        if (!convexHull)
+        {
+            continue;
+        }
+
+        double radius = 0;
+        D2D_POINT_2U center;
+        getMinimalEnclosingCircle(*convexHull, radius, center);
+
+        ObjectDetails objectDetails;
+        objectDetails._centerX = center.x;
+        objectDetails._centerY = center.y;
+        objectDetails._width = (UINT32)(radius * 2);
+        objectDetails._height = objectDetails._width;
+        objectDetails._confidence = circleFitConfidence(*convexHull, radius);
+
+        if (convexHull == bestConvexHull)
+        {
+            bestIndex = (int)objects.size();
+        }
+
+        if (overlays)
+        {
+            overlays->addPolyline(*convexHull, false, 4, 0x4c, 0x54, 0xff);
+        }
+
+        objects.push_back(objectDetails);
+    }
+
+    if (bestConvexHull && overlays)
+    {
+        overlays->addPolyline(*bestConvexHull, false, 4, 0xff, 0x0, 0x0);
+    }
+
+    DeletePointerVector(convexHulls);
+
+    return bestIndex;
 }
 
 
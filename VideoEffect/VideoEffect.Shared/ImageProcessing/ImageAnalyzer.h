@@ -8,6 +8,8 @@
 // Forward declarations
 class ImageProcessingUtils;
 class ObjectDetails;
+class OverlayCommandList;
+class StageProfiler;
 
 
 class ImageAnalyzer
@@ -17,6 +19,9 @@ public:
     ~ImageAnalyzer();
 
 public:
+    // The labelling and the hull stages are recorded, if set
+    void setStageProfiler(StageProfiler* stageProfiler);
+
     std::vector<ObjectDetails*> extractObjectDetails(
         const UINT16* organizedObjectMap, const UINT32& objectMapWidth, const UINT32& objectMapHeight, const UINT16& objectCount) const;
 
@@ -44,15 +49,25 @@ public:
 
     double circleAreaError(UINT32 measuredDiameter, UINT32 measuredArea) const;
 
+    // 0..1 from how much of its minimal enclosing circle the convex hull fills
+    float circleFitConfidence(const ConvexHull& convexHull, const double& radius) const;
+
     ConvexHull* extractBestCircularConvexHull(std::vector<ConvexHull*>& convexHulls) const;
 
     ConvexHull* extractBestCircularConvexHull(
         BYTE* binaryImage, const UINT32& imageWidth, const UINT32& imageHeight, const D2D_RECT_U& targetRect,
-        const UINT8& maxCandidates, const GUID& videoFormatSubtype, bool drawConvexHulls = false) const;
+        const UINT8& maxCandidates, const GUID& videoFormatSubtype, OverlayCommandList* overlays = NULL) const;
 
     ConvexHull* extractBestCircularConvexHull(
         BYTE* binaryImage, const UINT32& imageWidth, const UINT32& imageHeight,
-        const UINT8& maxCandidates, const GUID& videoFormatSubtype, bool drawConvexHulls = false) const;
+        const UINT8& maxCandidates, const GUID& videoFormatSubtype, OverlayCommandList* overlays = NULL) const;
+
+    // Extracts the candidates as their minimal enclosing circles. Returns
+    // the index of the candidate closest to a circle, -1 if none.
+    int extractCircularObjects(
+        BYTE* binaryImage, const UINT32& imageWidth, const UINT32& imageHeight, const D2D_RECT_U& targetRect,
+        const UINT8& maxCandidates, const GUID& videoFormatSubtype,
+        std::vector<ObjectDetails>& objects, OverlayCommandList* overlays = NULL) const;
 
     bool objectCenterIsWithinConvexHullBounds(const ObjectDetails& objectDetails, const ConvexHull& convexHull) const;
 
@@ -64,6 +79,7 @@ private:
 
 private: // Members
     ImageProcessingUtils* m_imageProcessingUtils; // Not owned
+    StageProfiler* m_stageProfiler; // Not owned
 };
 
 #endif // IMAGEANALYZER_H
@@ -3,6 +3,7 @@
 #include "BufferLock.h"
 #include "ImageProcessingCommon.h"
 #include "ImageProcessingUtils.h"
+#include "LineRenderer.h"
 #include "Interop\MessengerInterface.h"
 #include "ObjectDetails.h"
 
@@ -41,7 +42,7 @@ ImageProcessingUtils::~ImageProcessingUtils()
 //-------------------------------------------------------------------
 // drawLine
 //
-//
+// See LineRenderer.
 //-------------------------------------------------------------------
 void ImageProcessingUtils::drawLine(
     BYTE* image, const UINT32& imageWidth, const UINT32& imageHeight,
@@ -50,154 +51,10 @@ void ImageProcessingUtils::drawLine(
     const UINT32& thickness,
     const BYTE& yy, const BYTE& u, const BYTE& v) const
 {
-    if (videoFormatSubtype == MFVideoFormat_NV12)
-    {
-        double a = 0;
-        int b = 0;
-
-        bool lineIsNotVertical = calculateLineEquation(point1, point2, &a, &b);
-        D2D_RECT_U lineBoundingBox = this->lineBoundingBox(point1, point2, true);
-
-        const UINT32 uvPlaneStart = imageWidth * imageHeight - 1;
-
-        int yIndex1 = 0;
-        int yIndex2 = 0;
-        int yIndexForUVPlane = 0;
-
-        UINT32 trueThickness = thickness * 2;
-        int thicknessIndexReduction = ((int)ceil((double)thickness / 2) - 1) * 2;
-        UINT32 xStartForThickness = 0;
-
-        if (lineIsNotVertical)
-        {
-            int x = 0;
-            int y = 0;
-
-            for (x = lineBoundingBox.left; x < (int)lineBoundingBox.right && x < (int)imageWidth; x += 2)
-            {
-                y = (int)floor(a * x + b);
-
-                if (y < 0)
-                {
-                    continue;
-                }
-
-                yIndex1 = y * imageWidth;
-                yIndex2 = (y + 1) * imageWidth;
-                yIndexForUVPlane = uvPlaneStart + y / 2 * imageWidth;
-
-                xStartForThickness = x - thicknessIndexReduction;
-
-                for (UINT32 xx = xStartForThickness; xx < xStartForThickness + trueThickness && xx + 1 < imageWidth; xx += 2)
-                {
-                    image[yIndex1 + xx] = yy;
-                    image[yIndex2 + xx] = yy;
-                    image[yIndexForUVPlane + xx] = v;
-                    image[yIndex1 + xx + 1] = yy;
-                    image[yIndex2 + xx + 1] = yy;
-                    image[yIndexForUVPlane + xx + 1] = u;
-                }
-            }
-
-            for (y = lineBoundingBox.top; y < (int)lineBoundingBox.bottom && y < (int)imageHeight; ++y)
-            {
-                x = (int)round((y - b) / a);
-
-                if (x % 2 != 0)
-                {
-                    x -= 1;
-                }
-
-                yIndex1 = y * imageWidth;
-                yIndex2 = (y + 1) * imageWidth;
-                yIndexForUVPlane = uvPlaneStart + y / 2 * imageWidth;
-
-                xStartForThickness = x - thicknessIndexReduction;
-
-                for (UINT32 xx = xStartForThickness; xx < xStartForThickness + trueThickness && xx + 1 < imageWidth; xx += 2)
-                {
-                    image[yIndex1 + xx] = yy;
-                    image[yIndex2 + xx] = yy;
-                    image[yIndexForUVPlane + xx] = v;
-                    image[yIndex1 + xx + 1] = yy;
-                    image[yIndex2 + xx + 1] = yy;
-                    image[yIndexForUVPlane + xx + 1] = u;
-                }
-            }
-        }
-        else
-        {
-            int x = lineBoundingBox.left;
-
-            for (UINT32 y = lineBoundingBox.top; y < lineBoundingBox.bottom && y < imageHeight; ++y)
-            {
-                yIndex1 = y * imageWidth;
-                yIndex2 = (y + 1) * imageWidth;
-                yIndexForUVPlane = uvPlaneStart + y / 2 * imageWidth;
-
-                for (UINT32 xx = (x - trueThickness >= 0) ? x - trueThickness : 0;
-                xx < x + trueThickness && xx + 1 < imageWidth;
-                    xx += 2)
-                {
-                    image[yIndex1 + xx] = yy;
-                    image[yIndex2 + xx] = yy;
-                    image[yIndexForUVPlane + xx] = v;
-                    image[yIndex1 + xx + 1] = yy;
-                    image[yIndex2 + xx + 1] = yy;
-                    image[yIndexForUVPlane + xx + 1] = u;
-                }
-            }
-        }
-    }
-    else if (videoFormatSubtype == MFVideoFormat_YUY2)
-    {
-        double a = 0;
-        int b = 0;
-        D2D_RECT_U lineBoundingBox = this->lineBoundingBox(point1, point2, true);
-
-#pragma warning(push)
-#pragma warning(disable: 4018) 
-        // Not vertical line
-        if (calculateLineEquation(point1, point2, &a, &b))
-        {
-            if (lineBoundingBox.right - lineBoundingBox.left > lineBoundingBox.bottom - lineBoundingBox.top)
-            {
-                for (int x = lineBoundingBox.left; x < lineBoundingBox.right - 1 && x < imageWidth - 1; x += 2)
-                {
-                    int y = (int)floor(a * x + b);
-
-                    if (y < 0 || y >= (int)imageHeight)
-                    {
-                        continue;
-                    }
-
-                    *(int*)(image + (((y * imageWidth) + x) << 1)) = (v << 24) | (yy << 16) | (u << 8) | (yy);
-                }
-            }
-            else
-            {
-                for (int y = lineBoundingBox.top; y < lineBoundingBox.bottom && y < imageHeight; ++y)
-                {
-                    int x = (int)round((y - b) / a);
-
-                    if (x % 2 != 0)
-                    {
-                        x -= 1;
-                    }
-
-                    *(int*)(image + (((y * imageWidth) + x) << 1)) = (v << 24) | (yy << 16) | (u << 8) | (yy);
-                }
-            }
-        }
-        else // vertical line
-        {
-            for (int y = lineBoundingBox.top; y < lineBoundingBox.bottom && y < imageHeight; ++y)
-            {
-                *(int*)(image + (((y * imageWidth) + lineBoundingBox.left) << 1)) = (v << 24) | (yy << 16) | (u << 8) | (yy);
-            }
-        }
-#pragma warning(pop)
-    }
+    LineRenderer lineRenderer(image, imageWidth, imageHeight, videoFormatSubtype);
+    lineRenderer.setColor(yy, u, v);
+    lineRenderer.setThickness(thickness);
+    lineRenderer.drawLine(point1, point2);
 }
 
 
@@ -925,57 +782,6 @@ inline UINT16 ImageProcessingUtils::objectIdOfPixelAbove(
 }
 
 
-//------------------------------------------------------------------
-// calculateLineEquation
-//
-// Returns false, if no equations could be calculated (when delta X
-// is zero).
-//------------------------------------------------------------------
-bool ImageProcessingUtils::calculateLineEquation(const D2D_POINT_2U& point1, const D2D_POINT_2U& point2, double* a, int* b) const
-{
-    int deltaX = (int)(point2.x) - (int)(point1.x);
-
-    if (deltaX != 0)
-    {
-        *a = (double)((int)(point2.y) - (int)(point1.y)) / (double)deltaX;
-        *b = (int)round((int)(point1.y) - *a * point1.x);
-        return true;
-    }
-
-    return false;
-}
-
-
-//------------------------------------------------------------------
-// lineBoundingBox
-//
-//------------------------------------------------------------------
-D2D_RECT_U ImageProcessingUtils::lineBoundingBox(
-    const D2D_POINT_2U& point1, const D2D_POINT_2U& point2, bool leftAndRightHaveToHaveEvenValues) const
-{
-    D2D_RECT_U rect;
-    rect.left = point1.x < point2.x ? point1.x : point2.x;
-    rect.top = point1.y < point2.y ? point1.y : point2.y;
-    rect.right = point1.x < point2.x ? point2.x : point1.x;
-    rect.bottom = point1.y < point2.y ? point2.y : point1.y;
-
-    if (leftAndRightHaveToHaveEvenValues)
-    {
-        if (rect.left % 2 != 0)
-        {
-            rect.left -= 1;
-        }
-        
-        if (rect.right % 2 != 0)
-        {
-            rect.right -= 1;
-        }
-    }
-
-    return rect;
-}
-
-
 //------------------------------------------------------------------
 // visualizeObjectNV12
 //
@@ -988,7 +794,7 @@ void ImageProcessingUtils::visualizeObjectNV12(
     UINT32 yIndex1 = 0;
     UINT32 yIndex2 = 0;
     UINT32 yIndexForUVPlane = 0;
-    const UINT32 uvPlaneStart = imageWidth * imageHeight - 1;
+    const UINT32 uvPlaneStart = imageWidth * imageHeight;
 
     BYTE yy = 0xe0;
     BYTE u = 0x00;
@@ -1028,13 +834,10 @@ void ImageProcessingUtils::visualizeConvexHull(
     const UINT32& lineThickness,
     const BYTE& y, const BYTE& u, const BYTE& v) const
 {
-    for (UINT32 i = 0; i < convexHull.size() - 1; ++i)
-    {
-        drawLine(
-            image, imageWidth, imageHeight,
-            convexHull.at(i), convexHull.at(i + 1),
-            videoFormatSubtype, lineThickness, y, u, v);
-    }
+    LineRenderer lineRenderer(image, imageWidth, imageHeight, videoFormatSubtype);
+    lineRenderer.setColor(y, u, v);
+    lineRenderer.setThickness(lineThickness);
+    lineRenderer.drawPolyline(convexHull, false);
 }
 
 
@@ -74,8 +74,6 @@ private:
         BYTE* binaryImage, UINT16* objectMap, const UINT32& currentIndex, const UINT32& imageWidth,
         bool fromLeftToRight = true);
 
-    bool calculateLineEquation(const D2D_POINT_2U& point1, const D2D_POINT_2U& point2, double* a, int* b) const;
-    D2D_RECT_U lineBoundingBox(const D2D_POINT_2U& point1, const D2D_POINT_2U& point2, bool leftAndRightHaveToHaveEvenValues = false) const;
     bool idExists(const std::vector<UINT16>& ids, const UINT16& id);
 };
 
@@ -0,0 +1,289 @@
+#include "pch.h"
+
+#include "ImagePyramid.h" // Own header
+
+#include "Simd.h"
+
+
+ImagePyramid::ImagePyramid()
+    : m_videoFormatSubtype(GUID_NULL),
+    m_levelCount(0)
+{
+    for (UINT32 i = 0; i <= MaxPyramidLevel; ++i)
+    {
+        m_widths[i] = 0;
+        m_heights[i] = 0;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// build
+//
+// The sizes of the NV12 levels are rounded down to even and the
+// widths of the YUY2 levels to whole pixel pairs. The building stops
+// at the first level that would be empty.
+//-------------------------------------------------------------------
+void ImagePyramid::build(
+    const BYTE* frame, const LONG& stride,
+    const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype,
+    const UINT32& levelCount)
+{
+    if (videoFormatSubtype != MFVideoFormat_NV12 && videoFormatSubtype != MFVideoFormat_YUY2)
+    {
+        throw "Video format not supported";
+    }
+
+    const bool isNV12 = (videoFormatSubtype == MFVideoFormat_NV12);
+    m_videoFormatSubtype = videoFormatSubtype;
+    m_widths[0] = width;
+    m_heights[0] = height;
+    m_levelCount = 0;
+
+    for (UINT32 i = 1; i <= min(levelCount, MaxPyramidLevel); ++i)
+    {
+        const UINT32 levelWidth = (m_widths[i - 1] / 2) & ~1;
+        const UINT32 levelHeight = isNV12 ? ((m_heights[i - 1] / 2) & ~1) : (m_heights[i - 1] / 2);
+
+        if (levelWidth == 0 || levelHeight == 0)
+        {
+            break;
+        }
+
+        const BYTE* src = (i == 1) ? frame : m_levels[i - 1].data();
+        const UINT32 srcStride = (i == 1) ? (UINT32)stride : levelStride(i - 1);
+
+        m_widths[i] = levelWidth;
+        m_heights[i] = levelHeight;
+        m_levels[i].resize(isNV12 ? (levelWidth * levelHeight * 3 / 2) : (levelWidth * levelHeight * 2));
+
+        if (isNV12)
+        {
+            halveNV12(src, srcStride, m_heights[i - 1], m_levels[i].data(), levelWidth, levelHeight);
+        }
+        else
+        {
+            halveYUY2(src, srcStride, m_levels[i].data(), levelWidth, levelHeight);
+        }
+
+        m_levelCount = i;
+    }
+}
+
+
+UINT32 ImagePyramid::levelCount() const
+{
+    return m_levelCount;
+}
+
+
+BYTE* ImagePyramid::level(const UINT32& index)
+{
+    return (index > 0 && index <= m_levelCount) ? m_levels[index].data() : NULL;
+}
+
+
+UINT32 ImagePyramid::levelWidth(const UINT32& index) const
+{
+    return (index <= m_levelCount) ? m_widths[index] : 0;
+}
+
+
+UINT32 ImagePyramid::levelHeight(const UINT32& index) const
+{
+    return (index <= m_levelCount) ? m_heights[index] : 0;
+}
+
+
+UINT32 ImagePyramid::levelStride(const UINT32& index) const
+{
+    return (m_videoFormatSubtype == MFVideoFormat_NV12) ? levelWidth(index) : levelWidth(index) * 2;
+}
+
+
+//-------------------------------------------------------------------
+// halveNV12
+//
+// The U-V plane of the source starts after srcHeight lines.
+//-------------------------------------------------------------------
+void ImagePyramid::halveNV12(
+    const BYTE* src, const UINT32& srcStride, const UINT32& srcHeight,
+    BYTE* dest, const UINT32& destWidth, const UINT32& destHeight) const
+{
+    const BYTE* srcUV = src + srcHeight * srcStride;
+    BYTE* destUV = dest + destWidth * destHeight;
+
+    for (UINT32 y = 0; y < destHeight; ++y)
+    {
+        const BYTE* line0 = src + y * 2 * srcStride;
+        halveLumaLine(line0, line0 + srcStride, dest + y * destWidth, destWidth);
+    }
+
+    for (UINT32 y = 0; y < destHeight / 2; ++y)
+    {
+        const BYTE* line0 = srcUV + y * 2 * srcStride;
+        halveChromaLine(line0, line0 + srcStride, destUV + y * destWidth, destWidth / 2);
+    }
+}
+
+
+void ImagePyramid::halveYUY2(
+    const BYTE* src, const UINT32& srcStride,
+    BYTE* dest, const UINT32& destWidth, const UINT32& destHeight) const
+{
+    for (UINT32 y = 0; y < destHeight; ++y)
+    {
+        const BYTE* line0 = src + y * 2 * srcStride;
+        halveYUY2Line(line0, line0 + srcStride, dest + y * destWidth * 2, destWidth / 2);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// halveLumaLine
+//
+// Averages the 2x2 blocks of a plane with one byte per sample.
+//-------------------------------------------------------------------
+void ImagePyramid::halveLumaLine(const BYTE* line0, const BYTE* line1, BYTE* dest, const UINT32& destWidth)
+{
+    UINT32 x = 0;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i two = _mm_set1_epi16(2);
+
+    for (; x + 8 <= destWidth; x += 8)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(line0 + x * 2));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(line1 + x * 2));
+        __m128i sums = _mm_add_epi16(
+            _mm_add_epi16(_mm_and_si128(a, lowBytes), _mm_srli_epi16(a, 8)),
+            _mm_add_epi16(_mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8)));
+        sums = _mm_srli_epi16(_mm_add_epi16(sums, two), 2);
+        _mm_storel_epi64((__m128i*)(dest + x), _mm_packus_epi16(sums, sums));
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    for (; x + 8 <= destWidth; x += 8)
+    {
+        const uint16x8_t sums = vaddq_u16(vpaddlq_u8(vld1q_u8(line0 + x * 2)), vpaddlq_u8(vld1q_u8(line1 + x * 2)));
+        vst1_u8(dest + x, vrshrn_n_u16(sums, 2));
+    }
+#endif
+
+    for (; x < destWidth; ++x)
+    {
+        const UINT32 i = x * 2;
+        dest[x] = (BYTE)((line0[i] + line0[i + 1] + line1[i] + line1[i + 1] + 2) >> 2);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// halveChromaLine
+//
+// Averages the 2x2 blocks of interleaved U-V pairs.
+//-------------------------------------------------------------------
+void ImagePyramid::halveChromaLine(const BYTE* line0, const BYTE* line1, BYTE* dest, const UINT32& destPairs)
+{
+    UINT32 x = 0;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi32(2);
+
+    for (; x + 4 <= destPairs; x += 4)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(line0 + x * 4));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(line1 + x * 4));
+
+        // The 16-bit lanes are U-V pairs, so the sums of the adjacent
+        // lanes are the sums of the horizontal pairs
+        __m128i u = _mm_add_epi32(
+            _mm_madd_epi16(_mm_and_si128(a, lowBytes), ones),
+            _mm_madd_epi16(_mm_and_si128(b, lowBytes), ones));
+        __m128i v = _mm_add_epi32(
+            _mm_madd_epi16(_mm_srli_epi16(a, 8), ones),
+            _mm_madd_epi16(_mm_srli_epi16(b, 8), ones));
+
+        u = _mm_srli_epi32(_mm_add_epi32(u, two), 2);
+        v = _mm_srli_epi32(_mm_add_epi32(v, two), 2);
+
+        const __m128i uv = _mm_unpacklo_epi16(_mm_packs_epi32(u, u), _mm_packs_epi32(v, v));
+        _mm_storel_epi64((__m128i*)(dest + x * 2), _mm_packus_epi16(uv, uv));
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    for (; x + 8 <= destPairs; x += 8)
+    {
+        const uint8x8x4_t a = vld4_u8(line0 + x * 4);
+        const uint8x8x4_t b = vld4_u8(line1 + x * 4);
+        uint8x8x2_t uv;
+        uv.val[0] = vrshrn_n_u16(vaddq_u16(vaddl_u8(a.val[0], a.val[2]), vaddl_u8(b.val[0], b.val[2])), 2);
+        uv.val[1] = vrshrn_n_u16(vaddq_u16(vaddl_u8(a.val[1], a.val[3]), vaddl_u8(b.val[1], b.val[3])), 2);
+        vst2_u8(dest + x * 2, uv);
+    }
+#endif
+
+    for (; x < destPairs; ++x)
+    {
+        const UINT32 i = x * 4;
+        dest[x * 2] = (BYTE)((line0[i] + line0[i + 2] + line1[i] + line1[i + 2] + 2) >> 2);
+        dest[x * 2 + 1] = (BYTE)((line0[i + 1] + line0[i + 3] + line1[i + 1] + line1[i + 3] + 2) >> 2);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// halveYUY2Line
+//
+// Each destination pixel pair (Y0 U Y1 V) is made of two source
+// pairs: the lumas of the first pair give Y0, those of the second Y1
+// and the chroma is averaged over both pairs. There is no NEON path
+// since the phones use NV12.
+//-------------------------------------------------------------------
+void ImagePyramid::halveYUY2Line(const BYTE* line0, const BYTE* line1, BYTE* dest, const UINT32& destPairs)
+{
+    UINT32 x = 0;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i two = _mm_set1_epi32(2);
+
+    for (; x + 2 <= destPairs; x += 2)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(line0 + x * 8));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(line1 + x * 8));
+
+        // Lumas are in the low bytes of the 16-bit lanes, adjacent lanes
+        // belong to the same destination luma
+        __m128i luma = _mm_add_epi32(
+            _mm_madd_epi16(_mm_and_si128(a, lowBytes), ones),
+            _mm_madd_epi16(_mm_and_si128(b, lowBytes), ones));
+
+        // Chromas are in the high bytes as U V U V, reordered to U U V V
+        __m128i chromaA = _mm_srli_epi16(a, 8);
+        __m128i chromaB = _mm_srli_epi16(b, 8);
+        chromaA = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chromaA, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        chromaB = _mm_shufflehi_epi16(_mm_shufflelo_epi16(chromaB, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+        __m128i chroma = _mm_add_epi32(_mm_madd_epi16(chromaA, ones), _mm_madd_epi16(chromaB, ones));
+
+        luma = _mm_srli_epi32(_mm_add_epi32(luma, two), 2);
+        chroma = _mm_srli_epi32(_mm_add_epi32(chroma, two), 2);
+
+        const __m128i pixels = _mm_unpacklo_epi16(_mm_packs_epi32(luma, luma), _mm_packs_epi32(chroma, chroma));
+        _mm_storel_epi64((__m128i*)(dest + x * 4), _mm_packus_epi16(pixels, pixels));
+    }
+#endif
+
+    for (; x < destPairs; ++x)
+    {
+        const BYTE* a = line0 + x * 8;
+        const BYTE* b = line1 + x * 8;
+        BYTE* pixel = dest + x * 4;
+        pixel[0] = (BYTE)((a[0] + a[2] + b[0] + b[2] + 2) >> 2);
+        pixel[1] = (BYTE)((a[1] + a[5] + b[1] + b[5] + 2) >> 2);
+        pixel[2] = (BYTE)((a[4] + a[6] + b[4] + b[6] + 2) >> 2);
+        pixel[3] = (BYTE)((a[3] + a[7] + b[3] + b[7] + 2) >> 2);
+    }
+}
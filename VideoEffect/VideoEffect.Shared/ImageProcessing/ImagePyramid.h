@@ -0,0 +1,64 @@
+#ifndef IMAGEPYRAMID_H
+#define IMAGEPYRAMID_H
+
+#include <mfapi.h>
+#include <vector>
+
+
+// Constants
+const UINT32 MaxPyramidLevel = 3;
+
+
+//-------------------------------------------------------------------
+// ImagePyramid
+//
+// Downscaled copies of a frame, each level half the size of the
+// previous one in both dimensions. Every level is a 2x2 box reduction
+// of the previous one, so level n is the average of 2^n x 2^n blocks
+// of the frame. The levels are packed (the stride equals the line
+// length) and in the same format as the frame (NV12 or YUY2), so the
+// effects and the analyzer can process them as they are.
+//
+// The buffers are kept between the frames.
+//-------------------------------------------------------------------
+class ImagePyramid
+{
+public:
+    ImagePyramid();
+
+public:
+    // Builds the levels 1 to levelCount. The level 0 is the frame itself
+    // and not copied.
+    void build(
+        const BYTE* frame, const LONG& stride,
+        const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype,
+        const UINT32& levelCount);
+
+    UINT32 levelCount() const;
+    BYTE* level(const UINT32& index);
+    UINT32 levelWidth(const UINT32& index) const;
+    UINT32 levelHeight(const UINT32& index) const;
+    UINT32 levelStride(const UINT32& index) const;
+
+protected: // New methods
+    void halveNV12(
+        const BYTE* src, const UINT32& srcStride, const UINT32& srcHeight,
+        BYTE* dest, const UINT32& destWidth, const UINT32& destHeight) const;
+
+    void halveYUY2(
+        const BYTE* src, const UINT32& srcStride,
+        BYTE* dest, const UINT32& destWidth, const UINT32& destHeight) const;
+
+    static void halveLumaLine(const BYTE* line0, const BYTE* line1, BYTE* dest, const UINT32& destWidth);
+    static void halveChromaLine(const BYTE* line0, const BYTE* line1, BYTE* dest, const UINT32& destPairs);
+    static void halveYUY2Line(const BYTE* line0, const BYTE* line1, BYTE* dest, const UINT32& destPairs);
+
+protected: // Members
+    std::vector<BYTE> m_levels[MaxPyramidLevel + 1]; // The first is unused
+    UINT32 m_widths[MaxPyramidLevel + 1];
+    UINT32 m_heights[MaxPyramidLevel + 1];
+    GUID m_videoFormatSubtype;
+    UINT32 m_levelCount;
+};
+
+#endif // IMAGEPYRAMID_H
@@ -0,0 +1,218 @@
+#include "pch.h"
+
+#include "KalmanTracker.h" // Own header
+
+#include "Common.h"
+
+
+// Constants
+const float RelativeMeasurementDeviation = 0.1f; // Of the object size
+const float RelativeAccelerationDeviation = 0.05f; // Of the object size per frame squared
+const float MinDeviation = 1.0f; // Pixels, keeps the filter working with tiny objects
+const float SizeSmoothingFactor = 0.3f;
+const float SearchWindowPadding = 0.5f; // Relative to the object size on each side
+const float SearchWindowDeviations = 3.0f;
+
+
+KalmanTracker::KalmanTracker()
+{
+    reset();
+}
+
+
+void KalmanTracker::reset()
+{
+    initializeAxis(m_x, 0, 0);
+    initializeAxis(m_y, 0, 0);
+    m_width = 0;
+    m_height = 0;
+    m_missedFrameCount = 0;
+    m_initialized = false;
+}
+
+
+bool KalmanTracker::isInitialized() const
+{
+    return m_initialized;
+}
+
+
+UINT32 KalmanTracker::missedFrameCount() const
+{
+    return m_missedFrameCount;
+}
+
+
+//-------------------------------------------------------------------
+// initialize
+//
+// Starts from the given object at rest. The velocity is unknown, so
+// its variance is that of an object moving its own size per frame.
+//-------------------------------------------------------------------
+void KalmanTracker::initialize(const ObjectDetails& objectDetails)
+{
+    m_width = (float)objectDetails._width;
+    m_height = (float)objectDetails._height;
+
+    const float variance = measurementVariance();
+    initializeAxis(m_x, (float)objectDetails._centerX, variance);
+    initializeAxis(m_y, (float)objectDetails._centerY, variance);
+
+    const float size = max(m_width, m_height);
+    m_x.velocityVariance = m_y.velocityVariance = size * size;
+
+    m_missedFrameCount = 0;
+    m_initialized = true;
+}
+
+
+void KalmanTracker::predict()
+{
+    if (m_initialized)
+    {
+        const float variance = accelerationVariance();
+        predictAxis(m_x, variance);
+        predictAxis(m_y, variance);
+    }
+}
+
+
+void KalmanTracker::correct(const ObjectDetails& objectDetails)
+{
+    if (!m_initialized)
+    {
+        initialize(objectDetails);
+        return;
+    }
+
+    const float variance = measurementVariance();
+    correctAxis(m_x, (float)objectDetails._centerX, variance);
+    correctAxis(m_y, (float)objectDetails._centerY, variance);
+
+    m_width += ((float)objectDetails._width - m_width) * SizeSmoothingFactor;
+    m_height += ((float)objectDetails._height - m_height) * SizeSmoothingFactor;
+    m_missedFrameCount = 0;
+}
+
+
+void KalmanTracker::miss()
+{
+    ++m_missedFrameCount;
+}
+
+
+//-------------------------------------------------------------------
+// shift
+//
+// The shift is known exactly, so the uncertainties do not change.
+// Since it only adds to the positions, it may come before or after
+// the prediction of the same frame.
+//-------------------------------------------------------------------
+void KalmanTracker::shift(const D2D_POINT_2L& displacement)
+{
+    if (m_initialized)
+    {
+        m_x.position += (float)displacement.x;
+        m_y.position += (float)displacement.y;
+    }
+}
+
+
+ObjectDetails KalmanTracker::estimate() const
+{
+    ObjectDetails objectDetails;
+
+    if (m_initialized)
+    {
+        objectDetails._centerX = (UINT32)max(m_x.position + 0.5f, 0.0f);
+        objectDetails._centerY = (UINT32)max(m_y.position + 0.5f, 0.0f);
+        objectDetails._width = (UINT32)(m_width + 0.5f);
+        objectDetails._height = (UINT32)(m_height + 0.5f);
+    }
+
+    return objectDetails;
+}
+
+
+D2D_RECT_U KalmanTracker::searchWindow(const UINT32& frameWidth, const UINT32& frameHeight) const
+{
+    if (!m_initialized)
+    {
+        return D2D1::RectU(0, 0, frameWidth, frameHeight);
+    }
+
+    const float halfWidth =
+        m_width * (0.5f + SearchWindowPadding) + SearchWindowDeviations * sqrt(m_x.positionVariance);
+    const float halfHeight =
+        m_height * (0.5f + SearchWindowPadding) + SearchWindowDeviations * sqrt(m_y.positionVariance);
+
+    const float left = clamp(m_x.position - halfWidth, 0.0f, (float)frameWidth);
+    const float right = clamp(m_x.position + halfWidth + 1, 0.0f, (float)frameWidth);
+    const float top = clamp(m_y.position - halfHeight, 0.0f, (float)frameHeight);
+    const float bottom = clamp(m_y.position + halfHeight + 1, 0.0f, (float)frameHeight);
+
+    return D2D1::RectU((UINT32)left, (UINT32)top, (UINT32)right, (UINT32)bottom);
+}
+
+
+void KalmanTracker::initializeAxis(Axis& axis, const float& position, const float& variance)
+{
+    axis.position = position;
+    axis.velocity = 0;
+    axis.positionVariance = variance;
+    axis.covariance = 0;
+    axis.velocityVariance = variance;
+}
+
+
+//-------------------------------------------------------------------
+// predictAxis
+//
+// x' = F x and P' = F P F^T + Q, where F = [1 1; 0 1] and Q is the
+// noise of a random acceleration constant over the frame,
+// a^2 [1/4 1/2; 1/2 1].
+//-------------------------------------------------------------------
+void KalmanTracker::predictAxis(Axis& axis, const float& accelerationVariance)
+{
+    axis.position += axis.velocity;
+
+    axis.positionVariance +=
+        2 * axis.covariance + axis.velocityVariance + accelerationVariance * 0.25f;
+    axis.covariance += axis.velocityVariance + accelerationVariance * 0.5f;
+    axis.velocityVariance += accelerationVariance;
+}
+
+
+//-------------------------------------------------------------------
+// correctAxis
+//
+// Only the position is measured, H = [1 0].
+//-------------------------------------------------------------------
+void KalmanTracker::correctAxis(Axis& axis, const float& measuredPosition, const float& measurementVariance)
+{
+    const float innovation = measuredPosition - axis.position;
+    const float innovationVariance = axis.positionVariance + measurementVariance;
+    const float positionGain = axis.positionVariance / innovationVariance;
+    const float velocityGain = axis.covariance / innovationVariance;
+
+    axis.position += positionGain * innovation;
+    axis.velocity += velocityGain * innovation;
+
+    axis.velocityVariance -= velocityGain * axis.covariance;
+    axis.positionVariance *= 1 - positionGain;
+    axis.covariance *= 1 - positionGain;
+}
+
+
+float KalmanTracker::measurementVariance() const
+{
+    const float deviation = max(max(m_width, m_height) * RelativeMeasurementDeviation, MinDeviation);
+    return deviation * deviation;
+}
+
+
+float KalmanTracker::accelerationVariance() const
+{
+    const float deviation = max(max(m_width, m_height) * RelativeAccelerationDeviation, MinDeviation);
+    return deviation * deviation;
+}
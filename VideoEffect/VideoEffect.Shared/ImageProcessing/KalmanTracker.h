@@ -0,0 +1,76 @@
+#ifndef KALMANTRACKER_H
+#define KALMANTRACKER_H
+
+#include <D2d1helper.h>
+#include <mfapi.h>
+
+#include "ObjectDetails.h"
+
+
+//-------------------------------------------------------------------
+// KalmanTracker
+//
+// Constant velocity Kalman filter of the object center, run
+// independently for both axes with one frame as the time step. The
+// noises scale with the object size so that the filter behaves the
+// same regardless of the resolution. The size is smoothed
+// exponentially.
+//
+// Each frame is predicted first and then either corrected with the
+// measured object or left uncorrected, in which case the uncertainty
+// and so the search window keep growing.
+//-------------------------------------------------------------------
+class KalmanTracker
+{
+public:
+    KalmanTracker();
+
+public:
+    void reset();
+    bool isInitialized() const;
+    UINT32 missedFrameCount() const;
+
+    void initialize(const ObjectDetails& objectDetails);
+    void predict();
+    void correct(const ObjectDetails& objectDetails);
+    void miss();
+
+    // Moves the estimate by the given displacement of the background,
+    // so that the velocity stays relative to the background
+    void shift(const D2D_POINT_2L& displacement);
+
+    // The current estimate, i.e. the prediction until corrected
+    ObjectDetails estimate() const;
+
+    // The estimated object padded by its size and by three standard
+    // deviations of the position, clipped to the frame
+    D2D_RECT_U searchWindow(const UINT32& frameWidth, const UINT32& frameHeight) const;
+
+protected: // Types
+    struct Axis
+    {
+        float position;
+        float velocity;
+        float positionVariance;
+        float covariance;
+        float velocityVariance;
+    };
+
+protected: // New methods
+    static void initializeAxis(Axis& axis, const float& position, const float& variance);
+    static void predictAxis(Axis& axis, const float& accelerationVariance);
+    static void correctAxis(Axis& axis, const float& measuredPosition, const float& measurementVariance);
+
+    float measurementVariance() const;
+    float accelerationVariance() const;
+
+protected: // Members
+    Axis m_x;
+    Axis m_y;
+    float m_width;
+    float m_height;
+    UINT32 m_missedFrameCount;
+    bool m_initialized;
+};
+
+#endif // KALMANTRACKER_H
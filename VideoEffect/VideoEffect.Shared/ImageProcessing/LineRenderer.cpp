@@ -0,0 +1,313 @@
+#include "pch.h"
+
+#include "LineRenderer.h" // Own header
+
+#include "Common.h"
+
+#include <math.h>
+#include <stdlib.h>
+
+
+//-------------------------------------------------------------------
+// clipLine
+//
+// Clips the line to the grid (Liang-Barsky). Returns false, if the
+// line is completely outside.
+//-------------------------------------------------------------------
+static bool clipLine(int& x0, int& y0, int& x1, int& y1, const int& gridWidth, const int& gridHeight)
+{
+    if (x0 >= 0 && x0 < gridWidth && x1 >= 0 && x1 < gridWidth
+        && y0 >= 0 && y0 < gridHeight && y1 >= 0 && y1 < gridHeight)
+    {
+        return true;
+    }
+
+    const double dx = x1 - x0;
+    const double dy = y1 - y0;
+    const double p[4] = { -dx, dx, -dy, dy };
+    const double q[4] = { (double)x0, (double)(gridWidth - 1 - x0), (double)y0, (double)(gridHeight - 1 - y0) };
+    double t0 = 0;
+    double t1 = 1;
+
+    for (int i = 0; i < 4; ++i)
+    {
+        if (p[i] == 0)
+        {
+            if (q[i] < 0)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            const double t = q[i] / p[i];
+
+            if (p[i] < 0)
+            {
+                t0 = max(t0, t);
+            }
+            else
+            {
+                t1 = min(t1, t);
+            }
+        }
+    }
+
+    if (t0 > t1)
+    {
+        return false;
+    }
+
+    // Clamped against rounding at the edges
+    const int clippedX0 = clamp<int>((int)floor(x0 + t0 * dx + 0.5), 0, gridWidth - 1);
+    const int clippedY0 = clamp<int>((int)floor(y0 + t0 * dy + 0.5), 0, gridHeight - 1);
+    x1 = clamp<int>((int)floor(x0 + t1 * dx + 0.5), 0, gridWidth - 1);
+    y1 = clamp<int>((int)floor(y0 + t1 * dy + 0.5), 0, gridHeight - 1);
+    x0 = clippedX0;
+    y0 = clippedY0;
+    return true;
+}
+
+
+LineRenderer::LineRenderer(
+        BYTE* image, const UINT32& imageWidth, const UINT32& imageHeight, const GUID& videoFormatSubtype)
+    : m_image(image),
+    m_imageWidth(imageWidth),
+    m_imageHeight(imageHeight),
+    m_videoFormatSubtype(videoFormatSubtype),
+    m_y(0xff),
+    m_u(0x80),
+    m_v(0x80),
+    m_thickness(1)
+{
+}
+
+
+void LineRenderer::setColor(const BYTE& y, const BYTE& u, const BYTE& v)
+{
+    m_y = y;
+    m_u = u;
+    m_v = v;
+}
+
+
+void LineRenderer::setThickness(const UINT32& thickness)
+{
+    m_thickness = max(thickness, 1u);
+}
+
+
+//-------------------------------------------------------------------
+// drawLine
+//
+// The chroma grid is half the luma grid in both directions in NV12
+// and only horizontally in YUY2. The chroma runs are scaled the same
+// way.
+//-------------------------------------------------------------------
+void LineRenderer::drawLine(const D2D1_POINT_2U& point1, const D2D1_POINT_2U& point2)
+{
+    if (!m_image || m_imageWidth < 2 || m_imageHeight < 2)
+    {
+        return;
+    }
+
+    const int width = (int)m_imageWidth;
+    const int height = (int)m_imageHeight;
+    const int thickness = (int)m_thickness;
+    const int chromaThickness = (thickness + 1) / 2;
+
+    rasterize(LumaPlane, point1.x, point1.y, point2.x, point2.y, width, height, thickness, thickness);
+
+    if (m_videoFormatSubtype == MFVideoFormat_NV12)
+    {
+        rasterize(
+            ChromaPlane, point1.x / 2, point1.y / 2, point2.x / 2, point2.y / 2,
+            width / 2, height / 2, chromaThickness, chromaThickness);
+    }
+    else if (m_videoFormatSubtype == MFVideoFormat_YUY2)
+    {
+        rasterize(
+            ChromaPlane, point1.x / 2, point1.y, point2.x / 2, point2.y,
+            width / 2, height, chromaThickness, thickness);
+    }
+}
+
+
+void LineRenderer::drawPolyline(const std::vector<D2D1_POINT_2U>& points, const bool& closed)
+{
+    for (size_t i = 1; i < points.size(); ++i)
+    {
+        drawLine(points[i - 1], points[i]);
+    }
+
+    if (closed && points.size() > 2)
+    {
+        drawLine(points.back(), points.front());
+    }
+}
+
+
+//-------------------------------------------------------------------
+// rasterize
+//
+// Bresenham over the given grid after clipping the line to it. The
+// thickness is given separately for the horizontal runs (y-major
+// lines) and the vertical runs (x-major lines).
+//-------------------------------------------------------------------
+void LineRenderer::rasterize(
+    const Plane& plane, int x0, int y0, int x1, int y1,
+    const int& gridWidth, const int& gridHeight,
+    const int& horizontalThickness, const int& verticalThickness)
+{
+    if (!clipLine(x0, y0, x1, y1, gridWidth, gridHeight))
+    {
+        return;
+    }
+
+    const int dx = abs(x1 - x0);
+    const int dy = -abs(y1 - y0);
+    const int stepX = (x0 < x1) ? 1 : -1;
+    const int stepY = (y0 < y1) ? 1 : -1;
+    const bool xMajor = (dx >= -dy);
+    const int runOffset = xMajor ? (verticalThickness - 1) / 2 : (horizontalThickness - 1) / 2;
+    int error = dx + dy;
+
+    while (true)
+    {
+        if (xMajor)
+        {
+            fillVerticalRun(plane, x0, y0 - runOffset, verticalThickness);
+        }
+        else
+        {
+            fillHorizontalRun(plane, x0 - runOffset, y0, horizontalThickness);
+        }
+
+        if (x0 == x1 && y0 == y1)
+        {
+            break;
+        }
+
+        const int doubleError = error * 2;
+
+        if (doubleError >= dy)
+        {
+            error += dy;
+            x0 += stepX;
+        }
+
+        if (doubleError <= dx)
+        {
+            error += dx;
+            y0 += stepY;
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// fillHorizontalRun
+//
+// The coordinates are on the grid of the plane. The run is clamped
+// to the image.
+//-------------------------------------------------------------------
+void LineRenderer::fillHorizontalRun(const Plane& plane, const int& x, const int& y, const int& length)
+{
+    const bool isNV12 = (m_videoFormatSubtype == MFVideoFormat_NV12);
+    const int gridWidth = (plane == LumaPlane) ? (int)m_imageWidth : (int)m_imageWidth / 2;
+    const int first = max(x, 0);
+    const int last = min(x + length, gridWidth) - 1;
+
+    if (first > last)
+    {
+        return;
+    }
+
+    if (isNV12 && plane == LumaPlane)
+    {
+        memset(m_image + y * m_imageWidth + first, m_y, last - first + 1);
+    }
+    else if (isNV12)
+    {
+        BYTE* uv = m_image + m_imageWidth * m_imageHeight + y * m_imageWidth;
+
+        for (int i = first; i <= last; ++i)
+        {
+            uv[i * 2] = m_u;
+            uv[i * 2 + 1] = m_v;
+        }
+    }
+    else if (plane == LumaPlane)
+    {
+        BYTE* line = m_image + y * m_imageWidth * 2;
+
+        for (int i = first; i <= last; ++i)
+        {
+            line[i * 2] = m_y;
+        }
+    }
+    else
+    {
+        BYTE* line = m_image + y * m_imageWidth * 2;
+
+        for (int i = first; i <= last; ++i)
+        {
+            line[i * 4 + 1] = m_u;
+            line[i * 4 + 3] = m_v;
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// fillVerticalRun
+//
+// The coordinates are on the grid of the plane. The run is clamped
+// to the image.
+//-------------------------------------------------------------------
+void LineRenderer::fillVerticalRun(const Plane& plane, const int& x, const int& y, const int& length)
+{
+    const bool isNV12 = (m_videoFormatSubtype == MFVideoFormat_NV12);
+    const int gridHeight = (isNV12 && plane == ChromaPlane) ? (int)m_imageHeight / 2 : (int)m_imageHeight;
+    const int first = max(y, 0);
+    const int last = min(y + length, gridHeight) - 1;
+
+    BYTE* sample = NULL;
+    UINT32 stride = 0;
+
+    if (isNV12 && plane == LumaPlane)
+    {
+        sample = m_image + x;
+        stride = m_imageWidth;
+    }
+    else if (isNV12)
+    {
+        sample = m_image + m_imageWidth * m_imageHeight + x * 2;
+        stride = m_imageWidth;
+    }
+    else if (plane == LumaPlane)
+    {
+        sample = m_image + x * 2;
+        stride = m_imageWidth * 2;
+    }
+    else
+    {
+        sample = m_image + x * 4 + 1;
+        stride = m_imageWidth * 2;
+    }
+
+    for (int i = first; i <= last; ++i)
+    {
+        BYTE* pointer = sample + i * stride;
+
+        if (plane == LumaPlane)
+        {
+            *pointer = m_y;
+        }
+        else
+        {
+            pointer[0] = m_u;
+            pointer[isNV12 ? 1 : 2] = m_v;
+        }
+    }
+}
@@ -0,0 +1,62 @@
+#ifndef LINERENDERER_H
+#define LINERENDERER_H
+
+#include <d2d1.h>
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// LineRenderer
+//
+// Draws solid lines on NV12 and YUY2 images with the integer
+// Bresenham algorithm. Each line is clipped once to the image and
+// then the luma and the chroma samples are rasterized separately on
+// their own grids, so every sample on the line is written once.
+//
+// The thickness is in pixels: x-major lines are drawn as vertical
+// runs and y-major lines as horizontal runs of that length.
+//-------------------------------------------------------------------
+class LineRenderer
+{
+public:
+    LineRenderer(BYTE* image, const UINT32& imageWidth, const UINT32& imageHeight, const GUID& videoFormatSubtype);
+
+public:
+    void setColor(const BYTE& y, const BYTE& u, const BYTE& v);
+    void setThickness(const UINT32& thickness);
+
+    void drawLine(const D2D1_POINT_2U& point1, const D2D1_POINT_2U& point2);
+
+    // Draws the segments between the consecutive points and, if closed,
+    // from the last point back to the first one
+    void drawPolyline(const std::vector<D2D1_POINT_2U>& points, const bool& closed);
+
+protected: // Types
+    enum Plane
+    {
+        LumaPlane = 0,
+        ChromaPlane = 1
+    };
+
+protected: // New methods
+    void rasterize(
+        const Plane& plane, int x0, int y0, int x1, int y1,
+        const int& gridWidth, const int& gridHeight,
+        const int& horizontalThickness, const int& verticalThickness);
+
+    void fillHorizontalRun(const Plane& plane, const int& x, const int& y, const int& length);
+    void fillVerticalRun(const Plane& plane, const int& x, const int& y, const int& length);
+
+protected: // Members
+    BYTE* m_image;
+    UINT32 m_imageWidth;
+    UINT32 m_imageHeight;
+    GUID m_videoFormatSubtype;
+    BYTE m_y;
+    BYTE m_u;
+    BYTE m_v;
+    UINT32 m_thickness;
+};
+
+#endif // LINERENDERER_H
@@ -0,0 +1,292 @@
+#include "pch.h"
+
+#include "MotionAnalyzer.h" // Own header
+
+#include "ImageProcessingCommon.h"
+#include "Simd.h"
+
+
+//-------------------------------------------------------------------
+// differenceBlocks
+//
+// Sets difference to SelectedPixelValue where the blocks differ by
+// more than the threshold and motion to the same where both this and
+// the previous difference are set.
+//-------------------------------------------------------------------
+static void differenceBlocks(
+    const BYTE* current, const BYTE* previous, const BYTE& threshold,
+    BYTE* difference, BYTE* motion, const UINT32& count)
+{
+    UINT32 i = 0;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i thresholdVector = _mm_set1_epi8((char)threshold);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi8((char)0xFF);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i*)(current + i));
+        const __m128i b = _mm_loadu_si128((const __m128i*)(previous + i));
+        const __m128i absoluteDifference = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+
+        // Set where the absolute difference exceeds the threshold
+        const __m128i exceeds = _mm_xor_si128(_mm_cmpeq_epi8(_mm_subs_epu8(absoluteDifference, thresholdVector), zero), ones);
+        const __m128i previousDifference = _mm_loadu_si128((const __m128i*)(difference + i));
+
+        _mm_storeu_si128((__m128i*)(motion + i), _mm_and_si128(exceeds, previousDifference));
+        _mm_storeu_si128((__m128i*)(difference + i), exceeds);
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    const uint8x16_t thresholdVector = vdupq_n_u8(threshold);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        const uint8x16_t exceeds = vcgtq_u8(vabdq_u8(vld1q_u8(current + i), vld1q_u8(previous + i)), thresholdVector);
+        vst1q_u8(motion + i, vandq_u8(exceeds, vld1q_u8(difference + i)));
+        vst1q_u8(difference + i, exceeds);
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        const BYTE exceeds = (abs(current[i] - previous[i]) > threshold) ? SelectedPixelValue : 0x0;
+        motion[i] = exceeds & difference[i];
+        difference[i] = exceeds;
+    }
+}
+
+
+MotionAnalyzer::MotionAnalyzer(const UINT32& ringSize, const UINT32& scaleShift)
+    : m_motionMasks(ringSize),
+    m_motionMaskValid(ringSize, false),
+    m_videoFormatSubtype(GUID_NULL),
+    m_width(0),
+    m_height(0),
+    m_scaleShift(max(scaleShift, 1U)),
+    m_maskWidth(0),
+    m_maskHeight(0),
+    m_frameCount(0),
+    m_currentBlocks(0),
+    m_previousRingIndex(-1)
+{
+}
+
+
+//-------------------------------------------------------------------
+// clear
+//
+// Forgets the analyzed frames, e.g. when the ring buffer is cleared.
+//-------------------------------------------------------------------
+void MotionAnalyzer::clear()
+{
+    m_frameCount = 0;
+    m_previousRingIndex = -1;
+    m_motionMaskValid.assign(m_motionMaskValid.size(), false);
+}
+
+
+//-------------------------------------------------------------------
+// addFrame
+//
+// Differences the frame against the previous one. Once three frames
+// have been added, this completes the motion mask of the previous
+// frame.
+//-------------------------------------------------------------------
+void MotionAnalyzer::addFrame(
+    const UINT32& ringIndex, const BYTE* frame,
+    const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype,
+    const BYTE& threshold)
+{
+    if (width != m_width || height != m_height || videoFormatSubtype != m_videoFormatSubtype)
+    {
+        reset(width, height, videoFormatSubtype);
+    }
+
+    // The slot no longer holds the frame the mask was made for
+    m_motionMaskValid[ringIndex] = false;
+
+    const UINT32 previousBlocks = m_currentBlocks;
+    m_currentBlocks = 1 - m_currentBlocks;
+    downsampleLuma(frame, m_blocks[m_currentBlocks].data());
+
+    if (m_frameCount > 0)
+    {
+        // With only two frames there is no earlier difference yet, so
+        // the mask of the first frame is incomplete
+        std::vector<BYTE>& motionMask = m_motionMasks[m_previousRingIndex];
+        motionMask.resize(m_previousDifference.size());
+
+        differenceBlocks(
+            m_blocks[m_currentBlocks].data(), m_blocks[previousBlocks].data(), threshold,
+            m_previousDifference.data(), motionMask.data(), (UINT32)m_previousDifference.size());
+
+        m_motionMaskValid[m_previousRingIndex] = (m_frameCount > 1);
+    }
+
+    if (m_frameCount < 2)
+    {
+        ++m_frameCount;
+    }
+
+    m_previousRingIndex = (int)ringIndex;
+}
+
+
+bool MotionAnalyzer::hasMotionMask(const UINT32& ringIndex) const
+{
+    return ringIndex < m_motionMaskValid.size() && m_motionMaskValid[ringIndex];
+}
+
+
+const BYTE* MotionAnalyzer::motionMask(const UINT32& ringIndex) const
+{
+    return hasMotionMask(ringIndex) ? m_motionMasks[ringIndex].data() : NULL;
+}
+
+
+UINT32 MotionAnalyzer::maskWidth() const
+{
+    return m_maskWidth;
+}
+
+
+UINT32 MotionAnalyzer::maskHeight() const
+{
+    return m_maskHeight;
+}
+
+
+UINT32 MotionAnalyzer::scale() const
+{
+    return 1 << m_scaleShift;
+}
+
+
+//-------------------------------------------------------------------
+// renderMotionMask
+//
+// The luma of a moving block is SelectedPixelValue and the chroma is
+// neutral.
+//-------------------------------------------------------------------
+void MotionAnalyzer::renderMotionMask(const UINT32& ringIndex, BYTE* frame) const
+{
+    const BYTE* mask = motionMask(ringIndex);
+
+    if (!mask || !frame)
+    {
+        return;
+    }
+
+    const UINT32 maskSize = m_maskWidth * m_maskHeight;
+
+    if (m_videoFormatSubtype == MFVideoFormat_NV12)
+    {
+        memcpy(frame, mask, maskSize);
+        memset(frame + maskSize, 0x80, maskSize / 2);
+    }
+    else if (m_videoFormatSubtype == MFVideoFormat_YUY2)
+    {
+        WORD* pixel = (WORD*)frame;
+
+        for (UINT32 i = 0; i < maskSize; ++i)
+        {
+            pixel[i] = mask[i] | (0x80 << 8);
+        }
+    }
+}
+
+
+void MotionAnalyzer::reset(const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype)
+{
+    if (videoFormatSubtype != MFVideoFormat_NV12 && videoFormatSubtype != MFVideoFormat_YUY2)
+    {
+        throw "Video format not supported";
+    }
+
+    m_width = width;
+    m_height = height;
+    m_videoFormatSubtype = videoFormatSubtype;
+
+    // Even dimensions so that the rendered mask has whole chroma blocks
+    m_maskWidth = (width >> m_scaleShift) & ~1;
+    m_maskHeight = (height >> m_scaleShift) & ~1;
+
+    const size_t blockCount = (size_t)m_maskWidth * m_maskHeight;
+    m_blocks[0].resize(blockCount);
+    m_blocks[1].resize(blockCount);
+    m_previousDifference.assign(blockCount, 0);
+
+    clear();
+}
+
+
+//-------------------------------------------------------------------
+// downsampleLuma
+//
+// Averages the luma of each block of scale x scale pixels. The 2x2
+// blocks of NV12 are vectorized.
+//-------------------------------------------------------------------
+void MotionAnalyzer::downsampleLuma(const BYTE* frame, BYTE* blocks) const
+{
+    const UINT32 blocksPerLine = m_maskWidth;
+    const UINT32 blockLines = m_maskHeight;
+    const UINT32 scale = 1 << m_scaleShift;
+    const UINT32 shift = m_scaleShift * 2;
+    const UINT32 rounding = (1 << shift) >> 1;
+    const bool isNV12 = (m_videoFormatSubtype == MFVideoFormat_NV12);
+    const UINT32 lineLength = isNV12 ? m_width : m_width * 2;
+    const UINT32 step = isNV12 ? 1 : 2; // Distance between the luma samples
+
+    for (UINT32 y = 0; y < blockLines; ++y)
+    {
+        const BYTE* line0 = frame + y * scale * lineLength;
+        const BYTE* line1 = line0 + lineLength;
+        BYTE* blockLine = blocks + y * blocksPerLine;
+        UINT32 x = 0;
+
+#if defined(VIDEOEFFECT_SSE2)
+        if (isNV12 && scale == 2)
+        {
+            const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+            const __m128i two = _mm_set1_epi16(2);
+
+            for (; x + 8 <= blocksPerLine; x += 8)
+            {
+                const __m128i a = _mm_loadu_si128((const __m128i*)(line0 + x * 2));
+                const __m128i b = _mm_loadu_si128((const __m128i*)(line1 + x * 2));
+                __m128i sums = _mm_add_epi16(
+                    _mm_add_epi16(_mm_and_si128(a, lowBytes), _mm_srli_epi16(a, 8)),
+                    _mm_add_epi16(_mm_and_si128(b, lowBytes), _mm_srli_epi16(b, 8)));
+                sums = _mm_srli_epi16(_mm_add_epi16(sums, two), 2);
+                _mm_storel_epi64((__m128i*)(blockLine + x), _mm_packus_epi16(sums, sums));
+            }
+        }
+#elif defined(VIDEOEFFECT_NEON)
+        if (isNV12 && scale == 2)
+        {
+            for (; x + 8 <= blocksPerLine; x += 8)
+            {
+                const uint16x8_t sums = vaddq_u16(vpaddlq_u8(vld1q_u8(line0 + x * 2)), vpaddlq_u8(vld1q_u8(line1 + x * 2)));
+                vst1_u8(blockLine + x, vrshrn_n_u16(sums, 2));
+            }
+        }
+#endif
+
+        for (; x < blocksPerLine; ++x)
+        {
+            const BYTE* block = line0 + x * scale * step;
+            UINT32 sum = 0;
+
+            for (UINT32 j = 0; j < scale; ++j)
+            {
+                for (UINT32 i = 0; i < scale; ++i)
+                {
+                    sum += block[j * lineLength + i * step];
+                }
+            }
+
+            blockLine[x] = (BYTE)((sum + rounding) >> shift);
+        }
+    }
+}
@@ -0,0 +1,68 @@
+#ifndef MOTIONANALYZER_H
+#define MOTIONANALYZER_H
+
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// MotionAnalyzer
+//
+// Three-frame differencing over the frames of a ring buffer. Each new
+// frame is differenced against the previous one, and a block of the
+// previous frame is moving if it differs from both of its neighbours
+// in time. The result is a motion mask per ring slot.
+//
+// The frames are analyzed as they enter the ring, so each frame is
+// touched once. The analysis runs on blocks of luma of scale x scale
+// pixels, so the masks are at the resolution of the proxies of the
+// frames.
+//-------------------------------------------------------------------
+class MotionAnalyzer
+{
+public:
+    MotionAnalyzer(const UINT32& ringSize, const UINT32& scaleShift);
+
+public:
+    void clear();
+
+    // Adds the frame just stored into the given slot of the ring. The
+    // frame must be packed (stride equals the line length).
+    void addFrame(
+        const UINT32& ringIndex, const BYTE* frame,
+        const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype,
+        const BYTE& threshold);
+
+    bool hasMotionMask(const UINT32& ringIndex) const;
+
+    // SelectedPixelValue for moving blocks, zero elsewhere
+    const BYTE* motionMask(const UINT32& ringIndex) const;
+    UINT32 maskWidth() const;
+    UINT32 maskHeight() const;
+    UINT32 scale() const;
+
+    // Writes the mask of the given slot as a binary frame of the size of
+    // the mask in the format of the analyzed frames, see ImageAnalyzer
+    void renderMotionMask(const UINT32& ringIndex, BYTE* frame) const;
+
+protected: // New methods
+    void reset(const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype);
+    void downsampleLuma(const BYTE* frame, BYTE* blocks) const;
+
+protected: // Members
+    std::vector<std::vector<BYTE>> m_motionMasks;
+    std::vector<BYTE> m_motionMaskValid; // Bytes so that the slots can be read from another thread
+    std::vector<BYTE> m_blocks[2]; // Block luma of the current and the previous frame
+    std::vector<BYTE> m_previousDifference; // Binary difference of the previous two frames
+    GUID m_videoFormatSubtype;
+    UINT32 m_width;
+    UINT32 m_height;
+    UINT32 m_scaleShift;
+    UINT32 m_maskWidth;
+    UINT32 m_maskHeight;
+    UINT32 m_frameCount;
+    UINT32 m_currentBlocks;
+    int m_previousRingIndex;
+};
+
+#endif // MOTIONANALYZER_H
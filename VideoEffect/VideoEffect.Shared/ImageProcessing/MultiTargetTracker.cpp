@@ -0,0 +1,268 @@
+#include "pch.h"
+
+#include "MultiTargetTracker.h" // Own header
+
+#include "Common.h"
+
+#include <algorithm>
+
+
+// Constants
+const UINT32 MaxMissedFrames = 3;
+const float MaxAssociationDistance = 1.5f; // Relative to the object size, for boxes that do not overlap
+
+
+MultiTargetTracker::MultiTargetTracker()
+    : m_lastId(0)
+{
+}
+
+
+void MultiTargetTracker::clear()
+{
+    m_tracks.clear();
+}
+
+
+bool MultiTargetTracker::isEmpty() const
+{
+    return m_tracks.empty();
+}
+
+
+UINT32 MultiTargetTracker::trackCount() const
+{
+    return (UINT32)m_tracks.size();
+}
+
+
+bool MultiTargetTracker::hasTrack(const UINT16& id) const
+{
+    return indexOf(id) >= 0;
+}
+
+
+void MultiTargetTracker::predict()
+{
+    for (Track& track : m_tracks)
+    {
+        track.tracker.predict();
+    }
+}
+
+
+//-------------------------------------------------------------------
+// update
+//
+// Greedy association is enough for the few targets there are, and
+// unlike the optimal assignment it never pairs a track with a far
+// detection just to make another pair possible.
+//-------------------------------------------------------------------
+void MultiTargetTracker::update(std::vector<ObjectDetails>& detections)
+{
+    m_associations.clear();
+
+    for (UINT32 i = 0; i < m_tracks.size(); ++i)
+    {
+        const ObjectDetails predicted = m_tracks[i].tracker.estimate();
+
+        for (UINT32 j = 0; j < detections.size(); ++j)
+        {
+            const float cost = associationCost(predicted, detections[j]);
+
+            if (cost >= 0)
+            {
+                Association association = { cost, i, j };
+                m_associations.push_back(association);
+            }
+        }
+    }
+
+    std::sort(m_associations.begin(), m_associations.end(),
+        [](const Association& a, const Association& b) { return a.cost < b.cost; });
+
+    std::vector<bool> trackMatched(m_tracks.size(), false);
+
+    for (ObjectDetails& detection : detections)
+    {
+        detection._id = 0;
+    }
+
+    for (const Association& association : m_associations)
+    {
+        ObjectDetails& detection = detections[association.detectionIndex];
+
+        if (!trackMatched[association.trackIndex] && detection._id == 0)
+        {
+            Track& track = m_tracks[association.trackIndex];
+            track.tracker.correct(detection);
+            detection._id = track.id;
+            trackMatched[association.trackIndex] = true;
+        }
+    }
+
+    for (UINT32 i = 0; i < trackMatched.size(); ++i)
+    {
+        if (!trackMatched[i])
+        {
+            m_tracks[i].tracker.miss();
+        }
+    }
+
+    m_tracks.erase(
+        std::remove_if(m_tracks.begin(), m_tracks.end(),
+            [](const Track& track) { return track.tracker.missedFrameCount() > MaxMissedFrames; }),
+        m_tracks.end());
+
+    for (ObjectDetails& detection : detections)
+    {
+        if (detection._id == 0 && m_tracks.size() < MaxTrackedTargets)
+        {
+            Track track;
+            track.id = nextId();
+            track.tracker.initialize(detection);
+            m_tracks.push_back(track);
+            detection._id = track.id;
+        }
+    }
+}
+
+
+void MultiTargetTracker::correct(const UINT16& id, const ObjectDetails& detection)
+{
+    const int index = indexOf(id);
+
+    if (index >= 0)
+    {
+        m_tracks[index].tracker.correct(detection);
+    }
+}
+
+
+void MultiTargetTracker::retain(const UINT16& id)
+{
+    m_tracks.erase(
+        std::remove_if(m_tracks.begin(), m_tracks.end(),
+            [&id](const Track& track) { return track.id != id; }),
+        m_tracks.end());
+}
+
+
+void MultiTargetTracker::shift(const D2D_POINT_2L& displacement)
+{
+    for (Track& track : m_tracks)
+    {
+        track.tracker.shift(displacement);
+    }
+}
+
+
+ObjectDetails MultiTargetTracker::estimate(const UINT16& id) const
+{
+    const int index = indexOf(id);
+
+    if (index < 0)
+    {
+        return ObjectDetails();
+    }
+
+    ObjectDetails objectDetails = m_tracks[index].tracker.estimate();
+    objectDetails._id = id;
+    return objectDetails;
+}
+
+
+D2D_RECT_U MultiTargetTracker::searchWindow(const UINT16& id, const UINT32& frameWidth, const UINT32& frameHeight) const
+{
+    const int index = indexOf(id);
+
+    if (index < 0)
+    {
+        return D2D1::RectU(0, 0, frameWidth, frameHeight);
+    }
+
+    return m_tracks[index].tracker.searchWindow(frameWidth, frameHeight);
+}
+
+
+//-------------------------------------------------------------------
+// searchRegion
+//
+// The effects process a single rectangle, so the windows are merged
+// to their bounding rectangle.
+//-------------------------------------------------------------------
+D2D_RECT_U MultiTargetTracker::searchRegion(const UINT32& frameWidth, const UINT32& frameHeight) const
+{
+    if (m_tracks.empty())
+    {
+        return D2D1::RectU(0, 0, frameWidth, frameHeight);
+    }
+
+    D2D_RECT_U region = m_tracks[0].tracker.searchWindow(frameWidth, frameHeight);
+
+    for (UINT32 i = 1; i < m_tracks.size(); ++i)
+    {
+        const D2D_RECT_U window = m_tracks[i].tracker.searchWindow(frameWidth, frameHeight);
+        region.left = min(region.left, window.left);
+        region.top = min(region.top, window.top);
+        region.right = max(region.right, window.right);
+        region.bottom = max(region.bottom, window.bottom);
+    }
+
+    return region;
+}
+
+
+int MultiTargetTracker::indexOf(const UINT16& id) const
+{
+    for (UINT32 i = 0; i < m_tracks.size(); ++i)
+    {
+        if (m_tracks[i].id == id)
+        {
+            return (int)i;
+        }
+    }
+
+    return -1;
+}
+
+
+UINT16 MultiTargetTracker::nextId()
+{
+    do
+    {
+        ++m_lastId;
+    }
+    while (m_lastId == 0 || hasTrack(m_lastId));
+
+    return m_lastId;
+}
+
+
+//-------------------------------------------------------------------
+// associationCost
+//
+// 1 - IoU for overlapping boxes and 1 + the relative distance of the
+// centers for the others. Negative if the two cannot be associated.
+//-------------------------------------------------------------------
+float MultiTargetTracker::associationCost(const ObjectDetails& predicted, const ObjectDetails& detection)
+{
+    const float left = max((float)predicted._centerX - predicted._width * 0.5f, (float)detection._centerX - detection._width * 0.5f);
+    const float right = min((float)predicted._centerX + predicted._width * 0.5f, (float)detection._centerX + detection._width * 0.5f);
+    const float top = max((float)predicted._centerY - predicted._height * 0.5f, (float)detection._centerY - detection._height * 0.5f);
+    const float bottom = min((float)predicted._centerY + predicted._height * 0.5f, (float)detection._centerY + detection._height * 0.5f);
+
+    if (right > left && bottom > top)
+    {
+        const float intersection = (right - left) * (bottom - top);
+        const float area = (float)predicted._width * predicted._height + (float)detection._width * detection._height;
+        return 1.0f - intersection / (area - intersection);
+    }
+
+    const float dx = (float)predicted._centerX - (float)detection._centerX;
+    const float dy = (float)predicted._centerY - (float)detection._centerY;
+    const float size = max((float)max(predicted._width, predicted._height), 1.0f);
+    const float distance = sqrt(dx * dx + dy * dy) / size;
+
+    return (distance <= MaxAssociationDistance) ? 1.0f + distance : -1.0f;
+}
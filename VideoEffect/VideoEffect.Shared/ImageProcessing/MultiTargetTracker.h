@@ -0,0 +1,90 @@
+#ifndef MULTITARGETTRACKER_H
+#define MULTITARGETTRACKER_H
+
+#include <D2d1helper.h>
+#include <mfapi.h>
+#include <vector>
+
+#include "KalmanTracker.h"
+#include "ObjectDetails.h"
+
+
+// Constants
+const UINT32 MaxTrackedTargets = 8;
+
+
+//-------------------------------------------------------------------
+// MultiTargetTracker
+//
+// Table of tracks, each with a stable ID and a KalmanTracker of its
+// own. The detections of a frame are associated to the predicted
+// tracks greedily, the best matching pairs first: by the overlap
+// (IoU) of the boxes or, when the boxes do not overlap, by the
+// distance of the centers relative to the object size. Unmatched
+// detections start new tracks and tracks missed for too many frames
+// are dropped.
+//
+// The IDs are never 0, so 0 can be used for "no track".
+//-------------------------------------------------------------------
+class MultiTargetTracker
+{
+public:
+    MultiTargetTracker();
+
+public:
+    void clear();
+    bool isEmpty() const;
+    UINT32 trackCount() const;
+    bool hasTrack(const UINT16& id) const;
+
+    void predict();
+
+    // Sets the IDs of the detections to those of their tracks
+    void update(std::vector<ObjectDetails>& detections);
+
+    // Corrects the given track only, e.g. when the detection is already
+    // known to belong to it
+    void correct(const UINT16& id, const ObjectDetails& detection);
+
+    // Drops the other tracks
+    void retain(const UINT16& id);
+
+    // Moves all the tracks by the given displacement of the background,
+    // see KalmanTracker::shift()
+    void shift(const D2D_POINT_2L& displacement);
+
+    // The estimate of the given track, empty if there is no such track
+    ObjectDetails estimate(const UINT16& id) const;
+
+    // The search window of the given track and the bounding rectangle of
+    // the windows of all the tracks, the whole frame if there are none
+    D2D_RECT_U searchWindow(const UINT16& id, const UINT32& frameWidth, const UINT32& frameHeight) const;
+    D2D_RECT_U searchRegion(const UINT32& frameWidth, const UINT32& frameHeight) const;
+
+protected: // Types
+    struct Track
+    {
+        UINT16 id;
+        KalmanTracker tracker;
+    };
+
+    struct Association
+    {
+        float cost;
+        UINT32 trackIndex;
+        UINT32 detectionIndex;
+    };
+
+protected: // New methods
+    int indexOf(const UINT16& id) const;
+    UINT16 nextId();
+
+    static float associationCost(const ObjectDetails& predicted, const ObjectDetails& detection);
+
+protected: // Members
+    std::vector<Track> m_tracks;
+    std::vector<Association> m_associations;
+    UINT16 m_lastId;
+};
+
+#endif // MULTITARGETTRACKER_H
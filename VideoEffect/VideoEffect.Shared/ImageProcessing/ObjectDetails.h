@@ -12,7 +12,8 @@ public:
         _width(0),
         _height(0),
         _centerX(0),
-        _centerY(0)
+        _centerY(0),
+        _confidence(1.0f)
     {
     }
 
@@ -26,6 +27,7 @@ public:
             _height = other._height;
             _centerX = other._centerX;
             _centerY = other._centerY;
+            _confidence = other._confidence;
         }
 
         return *this;
@@ -38,6 +40,7 @@ public:
         _height = 0;
         _centerX = 0;
         _centerY = 0;
+        _confidence = 1.0f;
     }
 
 public: // Members
@@ -47,6 +50,7 @@ public: // Members
     UINT32 _height;
     UINT32 _centerX;
     UINT32 _centerY;
+    float _confidence; // 0..1, how well the detection fits the expected shape
 };
 
 #endif // OBJECTDETAILS_H
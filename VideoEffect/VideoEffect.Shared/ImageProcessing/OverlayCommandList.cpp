@@ -0,0 +1,84 @@
+#include "pch.h"
+
+#include "OverlayCommandList.h" // Own header
+
+#include "LineRenderer.h"
+
+
+OverlayCommandList::OverlayCommandList()
+{
+}
+
+
+//-------------------------------------------------------------------
+// clear
+//
+// Keeps the capacity for the next frame.
+//-------------------------------------------------------------------
+void OverlayCommandList::clear()
+{
+    m_commands.clear();
+    m_points.clear();
+}
+
+
+bool OverlayCommandList::isEmpty() const
+{
+    return m_commands.empty();
+}
+
+
+void OverlayCommandList::addLine(
+    const D2D1_POINT_2U& point1, const D2D1_POINT_2U& point2, const UINT32& thickness,
+    const BYTE& y, const BYTE& u, const BYTE& v)
+{
+    Command command = { m_points.size(), 2, false, thickness, y, u, v };
+    m_points.push_back(point1);
+    m_points.push_back(point2);
+    m_commands.push_back(command);
+}
+
+
+void OverlayCommandList::addPolyline(
+    const std::vector<D2D1_POINT_2U>& points, const bool& closed, const UINT32& thickness,
+    const BYTE& y, const BYTE& u, const BYTE& v)
+{
+    if (points.size() < 2)
+    {
+        return;
+    }
+
+    Command command = { m_points.size(), points.size(), closed, thickness, y, u, v };
+    m_points.insert(m_points.end(), points.begin(), points.end());
+    m_commands.push_back(command);
+}
+
+
+void OverlayCommandList::render(
+    BYTE* image, const UINT32& imageWidth, const UINT32& imageHeight, const GUID& videoFormatSubtype) const
+{
+    if (m_commands.empty())
+    {
+        return;
+    }
+
+    LineRenderer lineRenderer(image, imageWidth, imageHeight, videoFormatSubtype);
+
+    for (const Command& command : m_commands)
+    {
+        lineRenderer.setColor(command.y, command.u, command.v);
+        lineRenderer.setThickness(command.thickness);
+
+        const D2D1_POINT_2U* points = m_points.data() + command.firstPoint;
+
+        for (size_t i = 1; i < command.pointCount; ++i)
+        {
+            lineRenderer.drawLine(points[i - 1], points[i]);
+        }
+
+        if (command.closed && command.pointCount > 2)
+        {
+            lineRenderer.drawLine(points[command.pointCount - 1], points[0]);
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#ifndef OVERLAYCOMMANDLIST_H
+#define OVERLAYCOMMANDLIST_H
+
+#include <d2d1.h>
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// OverlayCommandList
+//
+// Overlays (hulls, crosshairs) recorded by the analysis stages and
+// rasterized into the output frame in one go once the analysis is
+// done, so that the analysis never sees them. If nothing consumes
+// the visuals, the list is neither filled nor rendered.
+//
+// The points of all the polylines are kept in one vector to avoid
+// allocating per command.
+//-------------------------------------------------------------------
+class OverlayCommandList
+{
+public:
+    OverlayCommandList();
+
+public:
+    void clear();
+    bool isEmpty() const;
+
+    void addLine(
+        const D2D1_POINT_2U& point1, const D2D1_POINT_2U& point2, const UINT32& thickness,
+        const BYTE& y, const BYTE& u, const BYTE& v);
+
+    void addPolyline(
+        const std::vector<D2D1_POINT_2U>& points, const bool& closed, const UINT32& thickness,
+        const BYTE& y, const BYTE& u, const BYTE& v);
+
+    // Draws the commands in the order they were added
+    void render(BYTE* image, const UINT32& imageWidth, const UINT32& imageHeight, const GUID& videoFormatSubtype) const;
+
+protected: // Types
+    struct Command
+    {
+        size_t firstPoint;
+        size_t pointCount;
+        bool closed;
+        UINT32 thickness;
+        BYTE y;
+        BYTE u;
+        BYTE v;
+    };
+
+protected: // Members
+    std::vector<Command> m_commands;
+    std::vector<D2D1_POINT_2U> m_points;
+};
+
+#endif // OVERLAYCOMMANDLIST_H
@@ -0,0 +1,356 @@
+#include "pch.h"
+
+#include "ProxyFrameRing.h" // Own header
+
+
+ProxyFrameRing::ProxyFrameRing()
+    : m_videoFormatSubtype(GUID_NULL),
+    m_width(0),
+    m_height(0),
+    m_scaleShift(0),
+    m_proxyWidth(0),
+    m_proxyHeight(0),
+    m_frameCounter(0)
+{
+}
+
+
+//-------------------------------------------------------------------
+// allocate
+//
+// If an allocation fails, the ring has no slots.
+//-------------------------------------------------------------------
+void ProxyFrameRing::allocate(
+    const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype,
+    const UINT32& depth, const UINT32& scaleShift, const UINT32& fullFrameCount)
+{
+    size_t bytesPerPixelTimesTwo = 0;
+
+    if (videoFormatSubtype == MFVideoFormat_NV12)
+    {
+        bytesPerPixelTimesTwo = 3;
+    }
+    else if (videoFormatSubtype == MFVideoFormat_YUY2)
+    {
+        bytesPerPixelTimesTwo = 4;
+    }
+
+    m_videoFormatSubtype = videoFormatSubtype;
+    m_width = width;
+    m_height = height;
+    m_scaleShift = scaleShift;
+
+    // Even dimensions so that the chroma of the proxy maps to whole
+    // blocks of the chroma of the frame
+    m_proxyWidth = (width >> scaleShift) & ~1;
+    m_proxyHeight = (height >> scaleShift) & ~1;
+
+    m_proxies.allocate((size_t)m_proxyWidth * m_proxyHeight * bytesPerPixelTimesTwo / 2, depth);
+    m_fullFrames.allocate((size_t)width * height * bytesPerPixelTimesTwo / 2, fullFrameCount);
+
+    if (m_proxies.depth() == 0 || m_fullFrames.depth() == 0)
+    {
+        release();
+    }
+
+    clear();
+}
+
+
+void ProxyFrameRing::release()
+{
+    m_proxies.release();
+    m_fullFrames.release();
+    clear();
+}
+
+
+//-------------------------------------------------------------------
+// clear
+//
+// Empties all slots and unpins the pool.
+//-------------------------------------------------------------------
+void ProxyFrameRing::clear()
+{
+    m_proxies.clear();
+    m_fullFrames.clear();
+    m_fullSlotOfFrame.assign(m_proxies.depth(), -1);
+    m_frameOfFullSlot.assign(m_fullFrames.depth(), -1);
+    m_pinned.assign(m_fullFrames.depth(), false);
+    m_fullSlotAge.assign(m_fullFrames.depth(), 0);
+    m_frameCounter = 0;
+}
+
+
+UINT32 ProxyFrameRing::depth() const
+{
+    return m_proxies.depth();
+}
+
+
+UINT32 ProxyFrameRing::scale() const
+{
+    return 1 << m_scaleShift;
+}
+
+
+UINT32 ProxyFrameRing::proxyWidth() const
+{
+    return m_proxyWidth;
+}
+
+
+UINT32 ProxyFrameRing::proxyHeight() const
+{
+    return m_proxyHeight;
+}
+
+
+//-------------------------------------------------------------------
+// addFrame
+//
+// Replaces the frame in the given slot with the proxy of the given
+// frame. If requested, also keeps the frame in full, if there is an
+// unpinned slot in the pool.
+//-------------------------------------------------------------------
+void ProxyFrameRing::addFrame(const UINT32& ringIndex, const BYTE* frame, const bool& keepFullFrame)
+{
+    BYTE* proxy = m_proxies.slot(ringIndex);
+
+    if (!proxy)
+    {
+        return;
+    }
+
+    // The frame previously in the slot is gone also from the pool
+    releaseFullFrame(ringIndex);
+
+    if (!frame)
+    {
+        m_proxies.setFilled(ringIndex, false);
+        return;
+    }
+
+    if (m_videoFormatSubtype == MFVideoFormat_NV12)
+    {
+        downsampleNV12(frame, proxy);
+    }
+    else if (m_videoFormatSubtype == MFVideoFormat_YUY2)
+    {
+        downsampleYUY2(frame, proxy);
+    }
+
+    m_proxies.setFilled(ringIndex, true);
+
+    if (keepFullFrame)
+    {
+        storeFullFrame(ringIndex, frame);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// pinNewestFullFrames
+//
+// The pinned slots are not reused until the ring is cleared or the
+// frame in the corresponding ring slot is replaced.
+//-------------------------------------------------------------------
+void ProxyFrameRing::pinNewestFullFrames(const UINT32& count)
+{
+    for (UINT32 n = 0; n < count; ++n)
+    {
+        int newestSlot = -1;
+
+        for (UINT32 i = 0; i < m_fullFrames.depth(); ++i)
+        {
+            if (m_frameOfFullSlot[i] >= 0 && !m_pinned[i]
+                && (newestSlot < 0 || m_fullSlotAge[i] > m_fullSlotAge[newestSlot]))
+            {
+                newestSlot = (int)i;
+            }
+        }
+
+        if (newestSlot < 0)
+        {
+            break;
+        }
+
+        m_pinned[newestSlot] = true;
+    }
+}
+
+
+BYTE* ProxyFrameRing::proxy(const UINT32& ringIndex) const
+{
+    return m_proxies.frame(ringIndex);
+}
+
+
+BYTE* ProxyFrameRing::fullFrame(const UINT32& ringIndex) const
+{
+    if (ringIndex < m_proxies.depth() && m_fullSlotOfFrame[ringIndex] >= 0)
+    {
+        return m_fullFrames.frame((UINT32)m_fullSlotOfFrame[ringIndex]);
+    }
+
+    return NULL;
+}
+
+
+BYTE* ProxyFrameRing::detachFullFrame(const UINT32& ringIndex)
+{
+    if (ringIndex >= m_proxies.depth() || m_fullSlotOfFrame[ringIndex] < 0)
+    {
+        return NULL;
+    }
+
+    BYTE* storage = m_fullFrames.detach((UINT32)m_fullSlotOfFrame[ringIndex]);
+    releaseFullFrame(ringIndex);
+    return storage;
+}
+
+
+void ProxyFrameRing::reclaimFullFrame(BYTE* storage)
+{
+    m_fullFrames.reclaim(storage);
+}
+
+
+//-------------------------------------------------------------------
+// downsampleNV12
+//
+//
+//-------------------------------------------------------------------
+void ProxyFrameRing::downsampleNV12(const BYTE* frame, BYTE* proxy) const
+{
+    const BYTE* srcUV = frame + m_width * m_height;
+    BYTE* destUV = proxy + m_proxyWidth * m_proxyHeight;
+
+    downsampleComponent(frame, m_width, 1, proxy, m_proxyWidth, 1, m_proxyWidth, m_proxyHeight);
+    downsampleComponent(srcUV, m_width, 2, destUV, m_proxyWidth, 2, m_proxyWidth / 2, m_proxyHeight / 2);
+    downsampleComponent(srcUV + 1, m_width, 2, destUV + 1, m_proxyWidth, 2, m_proxyWidth / 2, m_proxyHeight / 2);
+}
+
+
+//-------------------------------------------------------------------
+// downsampleYUY2
+//
+//
+//-------------------------------------------------------------------
+void ProxyFrameRing::downsampleYUY2(const BYTE* frame, BYTE* proxy) const
+{
+    const UINT32 srcStride = m_width * 2;
+    const UINT32 destStride = m_proxyWidth * 2;
+
+    downsampleComponent(frame, srcStride, 2, proxy, destStride, 2, m_proxyWidth, m_proxyHeight);
+    downsampleComponent(frame + 1, srcStride, 4, proxy + 1, destStride, 4, m_proxyWidth / 2, m_proxyHeight);
+    downsampleComponent(frame + 3, srcStride, 4, proxy + 3, destStride, 4, m_proxyWidth / 2, m_proxyHeight);
+}
+
+
+//-------------------------------------------------------------------
+// downsampleComponent
+//
+// Averages the blocks of scale x scale samples of one component. The
+// steps are the distances between the samples of the component.
+//-------------------------------------------------------------------
+void ProxyFrameRing::downsampleComponent(
+    const BYTE* src, const UINT32& srcStride, const UINT32& srcStep,
+    BYTE* dest, const UINT32& destStride, const UINT32& destStep,
+    const UINT32& destWidth, const UINT32& destHeight) const
+{
+    const UINT32 scale = 1 << m_scaleShift;
+    const UINT32 shift = m_scaleShift * 2;
+    const UINT32 rounding = (1 << shift) >> 1;
+    const UINT32 blockStep = srcStep * scale;
+
+    for (UINT32 y = 0; y < destHeight; ++y)
+    {
+        const BYTE* srcLine = src + y * scale * srcStride;
+        BYTE* destLine = dest + y * destStride;
+
+        for (UINT32 x = 0; x < destWidth; ++x)
+        {
+            const BYTE* block = srcLine + x * blockStep;
+            UINT32 sum = 0;
+
+            for (UINT32 j = 0; j < scale; ++j)
+            {
+                for (UINT32 i = 0; i < scale; ++i)
+                {
+                    sum += block[j * srcStride + i * srcStep];
+                }
+            }
+
+            destLine[x * destStep] = (BYTE)((sum + rounding) >> shift);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// storeFullFrame
+//
+// Takes a free pool slot or the one with the oldest unpinned frame.
+//-------------------------------------------------------------------
+void ProxyFrameRing::storeFullFrame(const UINT32& ringIndex, const BYTE* frame)
+{
+    int fullSlot = -1;
+
+    for (UINT32 i = 0; i < m_fullFrames.depth(); ++i)
+    {
+        if (m_pinned[i])
+        {
+            continue;
+        }
+
+        if (m_frameOfFullSlot[i] < 0)
+        {
+            fullSlot = (int)i;
+            break;
+        }
+
+        if (fullSlot < 0 || m_fullSlotAge[i] < m_fullSlotAge[fullSlot])
+        {
+            fullSlot = (int)i;
+        }
+    }
+
+    if (fullSlot < 0)
+    {
+        // All pinned
+        return;
+    }
+
+    if (m_frameOfFullSlot[fullSlot] >= 0)
+    {
+        m_fullSlotOfFrame[m_frameOfFullSlot[fullSlot]] = -1;
+    }
+
+    BYTE* storage = m_fullFrames.prepareSlot(fullSlot);
+
+    if (!storage)
+    {
+        return;
+    }
+
+    memcpy(storage, frame, m_fullFrames.frameSize());
+    m_fullFrames.setFilled(fullSlot, true);
+    m_frameOfFullSlot[fullSlot] = (int)ringIndex;
+    m_fullSlotOfFrame[ringIndex] = fullSlot;
+    m_fullSlotAge[fullSlot] = ++m_frameCounter;
+}
+
+
+void ProxyFrameRing::releaseFullFrame(const UINT32& ringIndex)
+{
+    const int fullSlot = m_fullSlotOfFrame[ringIndex];
+
+    if (fullSlot >= 0)
+    {
+        m_fullFrames.setFilled(fullSlot, false);
+        m_frameOfFullSlot[fullSlot] = -1;
+        m_pinned[fullSlot] = false;
+        m_fullSlotOfFrame[ringIndex] = -1;
+    }
+}
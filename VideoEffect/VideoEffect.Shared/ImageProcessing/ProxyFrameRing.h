@@ -0,0 +1,92 @@
+#ifndef PROXYFRAMERING_H
+#define PROXYFRAMERING_H
+
+#include <mfapi.h>
+#include <vector>
+
+#include "FrameRingBuffer.h"
+
+
+//-------------------------------------------------------------------
+// ProxyFrameRing
+//
+// Frame ring that keeps a downscaled proxy of every frame and the
+// full resolution frame only for a small pool of the frames. The
+// pool follows the newest frames unless its slots are pinned, which
+// is done when the frames around a trigger must survive until the
+// post-processing. The caller decides which frames go to the pool, so
+// that only the frames the post-processing can use are copied. The
+// proxies are in the same format as the frames (NV12 or YUY2) so the
+// effects can be applied to them as they are.
+//
+// With the proxies downscaled to a quarter in both dimensions the
+// ring takes one sixteenth of the memory of the full frames plus the
+// pool.
+//-------------------------------------------------------------------
+class ProxyFrameRing
+{
+public:
+    ProxyFrameRing();
+
+public:
+    // Reallocates only if the format or the sizes change. All slots are
+    // empty and unpinned afterwards.
+    void allocate(
+        const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype,
+        const UINT32& depth, const UINT32& scaleShift, const UINT32& fullFrameCount);
+
+    void release();
+    void clear();
+
+    UINT32 depth() const;
+    UINT32 scale() const;
+    UINT32 proxyWidth() const;
+    UINT32 proxyHeight() const;
+
+    // The frame must be packed (stride equals the line length). NULL
+    // empties the slot. The frame is copied to the pool only if so
+    // requested.
+    void addFrame(const UINT32& ringIndex, const BYTE* frame, const bool& keepFullFrame);
+
+    // Pins the pool slots holding the given number of the newest frames
+    void pinNewestFullFrames(const UINT32& count);
+
+    // NULL if the slot is empty or the frame was not kept in full
+    BYTE* proxy(const UINT32& ringIndex) const;
+    BYTE* fullFrame(const UINT32& ringIndex) const;
+
+    // Hands the full frame of the slot over to the caller without
+    // copying it, see FrameRingBuffer::detach(). NULL if not kept in
+    // full. The storage is given back with reclaimFullFrame().
+    BYTE* detachFullFrame(const UINT32& ringIndex);
+    void reclaimFullFrame(BYTE* storage);
+
+protected: // New methods
+    void downsampleNV12(const BYTE* frame, BYTE* proxy) const;
+    void downsampleYUY2(const BYTE* frame, BYTE* proxy) const;
+
+    void downsampleComponent(
+        const BYTE* src, const UINT32& srcStride, const UINT32& srcStep,
+        BYTE* dest, const UINT32& destStride, const UINT32& destStep,
+        const UINT32& destWidth, const UINT32& destHeight) const;
+
+    void storeFullFrame(const UINT32& ringIndex, const BYTE* frame);
+    void releaseFullFrame(const UINT32& ringIndex);
+
+protected: // Members
+    FrameRingBuffer m_proxies;
+    FrameRingBuffer m_fullFrames;
+    GUID m_videoFormatSubtype;
+    UINT32 m_width;
+    UINT32 m_height;
+    UINT32 m_scaleShift;
+    UINT32 m_proxyWidth;
+    UINT32 m_proxyHeight;
+    std::vector<int> m_fullSlotOfFrame; // -1 if not kept in full
+    std::vector<int> m_frameOfFullSlot; // -1 if the pool slot is free
+    std::vector<bool> m_pinned;
+    std::vector<UINT32> m_fullSlotAge; // Order of the frames in the pool
+    UINT32 m_frameCounter;
+};
+
+#endif // PROXYFRAMERING_H
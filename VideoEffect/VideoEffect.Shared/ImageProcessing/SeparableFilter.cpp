@@ -0,0 +1,440 @@
+#include "pch.h"
+
+#include "SeparableFilter.h" // Own header
+
+#include "Common.h"
+#include "Simd.h"
+
+
+// Constants
+const UINT32 MaxBoxRadius = 7; // Keeps the column sums within 16 bits with some margin
+
+
+//-------------------------------------------------------------------
+// accumulateLine
+//
+// Adds the bytes [low, high) of the given line to the sums and
+// subtracts the bytes of the removed line, if given.
+//-------------------------------------------------------------------
+static void accumulateLine(WORD* sums, const BYTE* added, const BYTE* removed, const UINT32& low, const UINT32& high)
+{
+    UINT32 i = low;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= high; i += 16)
+    {
+        const __m128i addedBytes = _mm_loadu_si128((const __m128i*)(added + i));
+        __m128i low8 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sums + i)), _mm_unpacklo_epi8(addedBytes, zero));
+        __m128i high8 = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(sums + i + 8)), _mm_unpackhi_epi8(addedBytes, zero));
+
+        if (removed)
+        {
+            const __m128i removedBytes = _mm_loadu_si128((const __m128i*)(removed + i));
+            low8 = _mm_sub_epi16(low8, _mm_unpacklo_epi8(removedBytes, zero));
+            high8 = _mm_sub_epi16(high8, _mm_unpackhi_epi8(removedBytes, zero));
+        }
+
+        _mm_storeu_si128((__m128i*)(sums + i), low8);
+        _mm_storeu_si128((__m128i*)(sums + i + 8), high8);
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    for (; i + 16 <= high; i += 16)
+    {
+        const uint8x16_t addedBytes = vld1q_u8(added + i);
+        uint16x8_t low8 = vaddw_u8(vld1q_u16(sums + i), vget_low_u8(addedBytes));
+        uint16x8_t high8 = vaddw_u8(vld1q_u16(sums + i + 8), vget_high_u8(addedBytes));
+
+        if (removed)
+        {
+            const uint8x16_t removedBytes = vld1q_u8(removed + i);
+            low8 = vsubw_u8(low8, vget_low_u8(removedBytes));
+            high8 = vsubw_u8(high8, vget_high_u8(removedBytes));
+        }
+
+        vst1q_u16(sums + i, low8);
+        vst1q_u16(sums + i + 8, high8);
+    }
+#endif
+
+    for (; i < high; ++i)
+    {
+        sums[i] = sums[i] + added[i] - (removed ? removed[i] : 0);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// weightLines
+//
+// Calculates the weighted sums of the bytes [low, high) of the given
+// lines.
+//-------------------------------------------------------------------
+static void weightLines(
+    WORD* sums, const BYTE* const* lines, const WORD* weights, const UINT32& lineCount,
+    const UINT32& low, const UINT32& high)
+{
+    UINT32 i = low;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+
+    for (; i + 16 <= high; i += 16)
+    {
+        __m128i low8 = zero;
+        __m128i high8 = zero;
+
+        for (UINT32 j = 0; j < lineCount; ++j)
+        {
+            const __m128i bytes = _mm_loadu_si128((const __m128i*)(lines[j] + i));
+            const __m128i weight = _mm_set1_epi16(weights[j]);
+            low8 = _mm_add_epi16(low8, _mm_mullo_epi16(_mm_unpacklo_epi8(bytes, zero), weight));
+            high8 = _mm_add_epi16(high8, _mm_mullo_epi16(_mm_unpackhi_epi8(bytes, zero), weight));
+        }
+
+        _mm_storeu_si128((__m128i*)(sums + i), low8);
+        _mm_storeu_si128((__m128i*)(sums + i + 8), high8);
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    for (; i + 16 <= high; i += 16)
+    {
+        uint16x8_t low8 = vdupq_n_u16(0);
+        uint16x8_t high8 = vdupq_n_u16(0);
+
+        for (UINT32 j = 0; j < lineCount; ++j)
+        {
+            const uint8x16_t bytes = vld1q_u8(lines[j] + i);
+            const uint8x8_t weight = vdup_n_u8((uint8_t)weights[j]);
+            low8 = vmlal_u8(low8, vget_low_u8(bytes), weight);
+            high8 = vmlal_u8(high8, vget_high_u8(bytes), weight);
+        }
+
+        vst1q_u16(sums + i, low8);
+        vst1q_u16(sums + i + 8, high8);
+    }
+#endif
+
+    for (; i < high; ++i)
+    {
+        WORD sum = 0;
+
+        for (UINT32 j = 0; j < lineCount; ++j)
+        {
+            sum += lines[j][i] * weights[j];
+        }
+
+        sums[i] = sum;
+    }
+}
+
+
+SeparableFilter::SeparableFilter()
+    : m_kernel(BoxKernel),
+    m_radius(1),
+    m_padding(0)
+{
+}
+
+
+//-------------------------------------------------------------------
+// setKernel
+//
+// Sets the kernel and its radius. The radius is clamped to the range
+// supported by the kernel.
+//-------------------------------------------------------------------
+void SeparableFilter::setKernel(const Kernel& kernel, const UINT32& radius)
+{
+    m_kernel = kernel;
+    m_radius = clamp<UINT32>(radius, 1, (kernel == GaussianKernel) ? 2 : MaxBoxRadius);
+}
+
+
+//-------------------------------------------------------------------
+// filter
+//
+// Filters the bytes [begin, end) of the lines [top, bottom) of the
+// given plane into the destination. The rest of the destination is
+// not touched. The source and the destination must not overlap.
+//-------------------------------------------------------------------
+void SeparableFilter::filter(
+    const BYTE* pSrc, const LONG& lSrcStride,
+    BYTE* pDest, const LONG& lDestStride,
+    const UINT32& lineLength, const UINT32& lineCount,
+    const UINT32& begin, const UINT32& end,
+    const UINT32& top, const UINT32& bottom,
+    const UINT32& stepEven, const UINT32& stepOdd)
+{
+    if (begin >= end || top >= bottom)
+    {
+        return;
+    }
+
+    // The horizontal pass reaches this far from the filtered bytes
+    const UINT32 reach = m_radius * ((stepEven > stepOdd) ? stepEven : stepOdd);
+    const UINT32 low = (begin > reach) ? begin - reach : 0;
+    const UINT32 high = (end + reach < lineLength) ? end + reach : lineLength;
+
+    m_padding = reach;
+    m_columnSums.resize(lineLength + reach * 2);
+
+    for (UINT32 y = top; y < bottom; ++y)
+    {
+        sumColumns(pSrc, lSrcStride, lineCount, y, y == top, low, high);
+        replicateBorders(lineLength, low, high, stepEven, stepOdd);
+
+        if (m_kernel == GaussianKernel)
+        {
+            filterGaussianHorizontally(pDest + (LONG)y * lDestStride, begin, end, stepEven, stepOdd);
+        }
+        else
+        {
+            filterBoxHorizontally(pDest + (LONG)y * lDestStride, begin, end, stepEven, stepOdd);
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// sumColumns
+//
+// Calculates the vertical sums of the bytes [low, high) around the
+// given line. The box sums are updated from the previous line unless
+// firstLine is true.
+//-------------------------------------------------------------------
+void SeparableFilter::sumColumns(
+    const BYTE* pSrc, const LONG& lSrcStride, const UINT32& lineCount,
+    const int& line, const bool& firstLine, const UINT32& low, const UINT32& high)
+{
+    static const WORD GaussianWeights[2][5] =
+    {
+        { 1, 2, 1, 0, 0 },
+        { 1, 4, 6, 4, 1 }
+    };
+
+    const int radius = (int)m_radius;
+    const int lastLine = (int)lineCount - 1;
+    WORD* sums = &m_columnSums[m_padding];
+
+    if (m_kernel == GaussianKernel)
+    {
+        const BYTE* lines[5];
+
+        for (int k = -radius; k <= radius; ++k)
+        {
+            lines[k + radius] = pSrc + (LONG)clamp(line + k, 0, lastLine) * lSrcStride;
+        }
+
+        weightLines(sums, lines, GaussianWeights[radius - 1], radius * 2 + 1, low, high);
+    }
+    else if (firstLine)
+    {
+        memset(sums + low, 0, (high - low) * sizeof(WORD));
+
+        for (int k = -radius; k <= radius; ++k)
+        {
+            accumulateLine(sums, pSrc + (LONG)clamp(line + k, 0, lastLine) * lSrcStride, NULL, low, high);
+        }
+    }
+    else
+    {
+        accumulateLine(
+            sums,
+            pSrc + (LONG)clamp(line + radius, 0, lastLine) * lSrcStride,
+            pSrc + (LONG)clamp(line - radius - 1, 0, lastLine) * lSrcStride,
+            low, high);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// replicateBorders
+//
+// Fills the column sums beyond the line ends with the nearest sum of
+// the same component.
+//-------------------------------------------------------------------
+void SeparableFilter::replicateBorders(
+    const UINT32& lineLength, const UINT32& low, const UINT32& high,
+    const UINT32& stepEven, const UINT32& stepOdd)
+{
+    WORD* sums = &m_columnSums[m_padding];
+
+    if (low == 0)
+    {
+        for (int i = -1; i >= -(int)m_padding; --i)
+        {
+            sums[i] = sums[i + (int)((i & 1) ? stepOdd : stepEven)];
+        }
+    }
+
+    if (high == lineLength)
+    {
+        for (UINT32 i = lineLength; i < lineLength + m_padding; ++i)
+        {
+            sums[i] = sums[i - ((i & 1) ? stepOdd : stepEven)];
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// filterBoxHorizontally
+//
+// Calculates the box averages with running sums. Each component has
+// its own running sum; the last four sums are enough for the steps
+// used with the supported formats.
+//-------------------------------------------------------------------
+void SeparableFilter::filterBoxHorizontally(
+    BYTE* destLine, const UINT32& begin, const UINT32& end,
+    const UINT32& stepEven, const UINT32& stepOdd)
+{
+    const int radius = (int)m_radius;
+    const int divisor = (radius * 2 + 1) * (radius * 2 + 1);
+    const int reciprocal = (0x10000 + divisor / 2) / divisor; // 16.16 fixed point
+    const WORD* sums = &m_columnSums[m_padding];
+    int runningSums[4] = { 0, 0, 0, 0 };
+
+    for (UINT32 i = begin; i < end; ++i)
+    {
+        const int step = (int)((i & 1) ? stepOdd : stepEven);
+        int sum = 0;
+
+        if (i < begin + step)
+        {
+            for (int k = -radius; k <= radius; ++k)
+            {
+                sum += sums[(int)i + k * step];
+            }
+        }
+        else
+        {
+            sum = runningSums[(i - step) & 3] + sums[(int)i + radius * step] - sums[(int)i - (radius + 1) * step];
+        }
+
+        runningSums[i & 3] = sum;
+        destLine[i] = (BYTE)((sum * reciprocal + 0x8000) >> 16);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// filterGaussianHorizontally
+//
+// Calculates the binomial averages. The weighted sums stay below
+// 65536 so they fit unsigned 16-bit lanes.
+//-------------------------------------------------------------------
+void SeparableFilter::filterGaussianHorizontally(
+    BYTE* destLine, const UINT32& begin, const UINT32& end,
+    const UINT32& stepEven, const UINT32& stepOdd)
+{
+    const WORD* sums = &m_columnSums[m_padding];
+    const int shift = m_radius * 4;
+    const int rounding = 1 << (shift - 1);
+    UINT32 i = begin;
+
+#if defined(VIDEOEFFECT_SSE2)
+    const __m128i roundingVector = _mm_set1_epi16((short)rounding);
+    const __m128i shiftCount = _mm_cvtsi32_si128(shift);
+
+    // Lanes taking the odd step, depending on the parity of the first byte
+    const __m128i oddLanes = (begin & 1) ? _mm_set1_epi32(0x0000FFFF) : _mm_set1_epi32((int)0xFFFF0000);
+    const UINT32 steps[2] = { stepEven, stepOdd };
+    __m128i results[2];
+
+    for (; i + 8 <= end; i += 8)
+    {
+        for (int j = 0; j < 2; ++j)
+        {
+            if (j == 1 && stepOdd == stepEven)
+            {
+                results[1] = results[0];
+                break;
+            }
+
+            const WORD* center = sums + i;
+            const int step = (int)steps[j];
+            const __m128i neighbours = _mm_add_epi16(
+                _mm_loadu_si128((const __m128i*)(center - step)),
+                _mm_loadu_si128((const __m128i*)(center + step)));
+            const __m128i middle = _mm_loadu_si128((const __m128i*)center);
+
+            if (m_radius == 1)
+            {
+                results[j] = _mm_add_epi16(neighbours, _mm_slli_epi16(middle, 1));
+            }
+            else
+            {
+                results[j] = _mm_add_epi16(
+                    _mm_add_epi16(
+                        _mm_loadu_si128((const __m128i*)(center - step * 2)),
+                        _mm_loadu_si128((const __m128i*)(center + step * 2))),
+                    _mm_add_epi16(
+                        _mm_slli_epi16(neighbours, 2),
+                        _mm_mullo_epi16(middle, _mm_set1_epi16(6))));
+            }
+        }
+
+        __m128i result = _mm_or_si128(_mm_andnot_si128(oddLanes, results[0]), _mm_and_si128(oddLanes, results[1]));
+        result = _mm_srl_epi16(_mm_add_epi16(result, roundingVector), shiftCount);
+        _mm_storel_epi64((__m128i*)(destLine + i), _mm_packus_epi16(result, result));
+    }
+#elif defined(VIDEOEFFECT_NEON)
+    const uint16x8_t roundingVector = vdupq_n_u16((uint16_t)rounding);
+    const int16x8_t shiftCount = vdupq_n_s16((short)-shift);
+
+    // Lanes taking the odd step, depending on the parity of the first byte
+    const uint16x8_t oddLanes = vreinterpretq_u16_u32(vdupq_n_u32((begin & 1) ? 0x0000FFFF : 0xFFFF0000));
+    const UINT32 steps[2] = { stepEven, stepOdd };
+    uint16x8_t results[2];
+
+    for (; i + 8 <= end; i += 8)
+    {
+        for (int j = 0; j < 2; ++j)
+        {
+            if (j == 1 && stepOdd == stepEven)
+            {
+                results[1] = results[0];
+                break;
+            }
+
+            const WORD* center = sums + i;
+            const int step = (int)steps[j];
+            const uint16x8_t neighbours = vaddq_u16(vld1q_u16(center - step), vld1q_u16(center + step));
+            const uint16x8_t middle = vld1q_u16(center);
+
+            if (m_radius == 1)
+            {
+                results[j] = vaddq_u16(neighbours, vshlq_n_u16(middle, 1));
+            }
+            else
+            {
+                results[j] = vaddq_u16(
+                    vaddq_u16(vld1q_u16(center - step * 2), vld1q_u16(center + step * 2)),
+                    vmlaq_n_u16(vshlq_n_u16(neighbours, 2), middle, 6));
+            }
+        }
+
+        uint16x8_t result = vbslq_u16(oddLanes, results[1], results[0]);
+        result = vshlq_u16(vaddq_u16(result, roundingVector), shiftCount);
+        vst1_u8(destLine + i, vmovn_u16(result));
+    }
+#endif
+
+    for (; i < end; ++i)
+    {
+        const int step = (int)((i & 1) ? stepOdd : stepEven);
+        const WORD* center = sums + i;
+        int sum = 0;
+
+        if (m_radius == 1)
+        {
+            sum = center[-step] + 2 * center[0] + center[step];
+        }
+        else
+        {
+            sum = center[-2 * step] + 4 * (center[-step] + center[step]) + 6 * center[0] + center[2 * step];
+        }
+
+        destLine[i] = (BYTE)((sum + rounding) >> shift);
+    }
+}
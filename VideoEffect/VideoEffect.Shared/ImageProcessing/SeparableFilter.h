@@ -0,0 +1,73 @@
+#ifndef SEPARABLEFILTER_H
+#define SEPARABLEFILTER_H
+
+#include <mfapi.h>
+#include <vector>
+
+
+//-------------------------------------------------------------------
+// SeparableFilter
+//
+// Separable smoothing of a single plane with integer arithmetic: a
+// vertical pass into a line of 16-bit column sums followed by a
+// horizontal pass. The border lines and columns are replicated.
+//
+// Interleaved planes are supported by giving the distance between
+// the samples of the same component separately for the even and the
+// odd bytes:
+//
+// NV12 Y plane: 1, 1
+// NV12 U-V plane: 2, 2
+// YUY2 (Y0 U Y1 V): 2, 4
+//
+// One instance holds the line buffers of one row band, so the bands
+// of a frame need their own instances.
+//-------------------------------------------------------------------
+class SeparableFilter
+{
+public:
+    enum Kernel
+    {
+        BoxKernel = 0, // Running sums, radius 1 - 7
+        GaussianKernel = 1 // Binomial, radius 1 ([1 2 1]) or 2 ([1 4 6 4 1])
+    };
+
+public:
+    SeparableFilter();
+
+public:
+    void setKernel(const Kernel& kernel, const UINT32& radius);
+
+    void filter(
+        const BYTE* pSrc, const LONG& lSrcStride,
+        BYTE* pDest, const LONG& lDestStride,
+        const UINT32& lineLength, const UINT32& lineCount,
+        const UINT32& begin, const UINT32& end,
+        const UINT32& top, const UINT32& bottom,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+protected: // New methods
+    void sumColumns(
+        const BYTE* pSrc, const LONG& lSrcStride, const UINT32& lineCount,
+        const int& line, const bool& firstLine, const UINT32& low, const UINT32& high);
+
+    void replicateBorders(
+        const UINT32& lineLength, const UINT32& low, const UINT32& high,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+    void filterBoxHorizontally(
+        BYTE* destLine, const UINT32& begin, const UINT32& end,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+    void filterGaussianHorizontally(
+        BYTE* destLine, const UINT32& begin, const UINT32& end,
+        const UINT32& stepEven, const UINT32& stepOdd);
+
+protected: // Members
+    Kernel m_kernel;
+    UINT32 m_radius;
+    UINT32 m_padding;
+    std::vector<WORD> m_columnSums; // m_padding entries before index 0
+};
+
+#endif // SEPARABLEFILTER_H
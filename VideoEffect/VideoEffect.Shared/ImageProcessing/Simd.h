@@ -0,0 +1,20 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+//-------------------------------------------------------------------
+// SIMD support
+//
+// Defines VIDEOEFFECT_NEON on ARM (phones) and VIDEOEFFECT_SSE2 on
+// x86 and x64 (tablets and desktops) and includes the corresponding
+// intrinsics. The vectorized code paths are guarded with these and
+// always have a scalar fallback, which also handles the line tails.
+//-------------------------------------------------------------------
+#if defined(_M_ARM)
+#define VIDEOEFFECT_NEON
+#include <arm_neon.h>
+#elif defined(_M_IX86) || defined(_M_X64)
+#define VIDEOEFFECT_SSE2
+#include <emmintrin.h>
+#endif
+
+#endif // SIMD_H
@@ -0,0 +1,331 @@
+#include "pch.h"
+
+#include "StageProfiler.h" // Own header
+
+
+// Constants
+const UINT32 SubBucketBits = 4;
+const UINT32 SubBucketCount = 1 << SubBucketBits;
+const UINT64 MaxRecordedNanoseconds = (1ULL << 36) - 1;
+const UINT64 NanosecondsPerSecond = 1000000000ULL;
+
+
+StageProfiler::StageProfiler()
+    : m_threadBuffers(new ThreadBuffer[MaxProfiledThreads + 1]()),
+    m_threadBufferCount(0),
+    m_epoch(1),
+    m_overflowCount(0),
+    m_collectedOverflowCount(0),
+    m_collectedCounts(ProfilerStageCount * ProfilerBucketCount, 0),
+    m_ticksPerSecond(1)
+{
+    LARGE_INTEGER frequency;
+
+    if (QueryPerformanceFrequency(&frequency) && frequency.QuadPart > 0)
+    {
+        m_ticksPerSecond = frequency.QuadPart;
+    }
+}
+
+
+StageProfiler::~StageProfiler()
+{
+    delete[] m_threadBuffers;
+}
+
+
+//-------------------------------------------------------------------
+// timestamp
+//
+// The performance counter is monotonic and has a resolution of well
+// below a microsecond.
+//-------------------------------------------------------------------
+LONGLONG StageProfiler::timestamp()
+{
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    return counter.QuadPart;
+}
+
+
+void StageProfiler::record(const ProfilerStage& stage, const LONGLONG& startTimestamp)
+{
+    const LONGLONG ticks = max(timestamp() - startTimestamp, 0LL);
+
+    // Split to avoid overflowing with long durations
+    const UINT64 nanoseconds =
+        (UINT64)(ticks / m_ticksPerSecond) * NanosecondsPerSecond
+        + (UINT64)(ticks % m_ticksPerSecond) * NanosecondsPerSecond / (UINT64)m_ticksPerSecond;
+
+    recordNanoseconds(stage, nanoseconds);
+}
+
+
+//-------------------------------------------------------------------
+// recordNanoseconds
+//
+// Only the thread owning the buffer writes to it, so the counters are
+// updated without read-modify-write operations.
+//-------------------------------------------------------------------
+void StageProfiler::recordNanoseconds(const ProfilerStage& stage, const UINT64& nanoseconds)
+{
+    if (stage < 0 || stage >= ProfilerStageCount)
+    {
+        return;
+    }
+
+    ThreadBuffer* buffer = bufferOfCurrentThread();
+
+    if (!buffer)
+    {
+        recordShared(&m_threadBuffers[MaxProfiledThreads], stage, nanoseconds);
+        return;
+    }
+
+    const UINT32 epoch = m_epoch.load(std::memory_order_relaxed);
+
+    if (buffer->epoch.load(std::memory_order_relaxed) != epoch)
+    {
+        // The maxima belong to an already collected window
+        for (UINT32 i = 0; i < ProfilerStageCount; ++i)
+        {
+            buffer->maxima[i].store(0, std::memory_order_relaxed);
+        }
+
+        buffer->epoch.store(epoch, std::memory_order_release);
+    }
+
+    std::atomic<UINT32>& count = buffer->counts[stage][bucketIndex(nanoseconds)];
+    count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    if (nanoseconds > buffer->maxima[stage].load(std::memory_order_relaxed))
+    {
+        buffer->maxima[stage].store(nanoseconds, std::memory_order_relaxed);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// recordShared
+//
+// Records into the overflow buffer shared by the threads without a
+// buffer of their own. A maximum recorded exactly while another
+// thread starts a new window may be lost.
+//-------------------------------------------------------------------
+void StageProfiler::recordShared(ThreadBuffer* buffer, const ProfilerStage& stage, const UINT64& nanoseconds)
+{
+    const UINT32 epoch = m_epoch.load(std::memory_order_relaxed);
+    UINT32 bufferEpoch = buffer->epoch.load(std::memory_order_relaxed);
+
+    if (bufferEpoch != epoch && buffer->epoch.compare_exchange_strong(bufferEpoch, epoch, std::memory_order_acq_rel))
+    {
+        for (UINT32 i = 0; i < ProfilerStageCount; ++i)
+        {
+            buffer->maxima[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    buffer->counts[stage][bucketIndex(nanoseconds)].fetch_add(1, std::memory_order_relaxed);
+    m_overflowCount.fetch_add(1, std::memory_order_relaxed);
+
+    UINT64 maximum = buffer->maxima[stage].load(std::memory_order_relaxed);
+
+    while (nanoseconds > maximum
+        && !buffer->maxima[stage].compare_exchange_weak(maximum, nanoseconds, std::memory_order_relaxed))
+    {
+    }
+}
+
+
+//-------------------------------------------------------------------
+// collect
+//
+// The window counts are the differences to the totals of the previous
+// collect, so the recording threads never need to be reset. A maximum
+// recorded exactly while collecting may be missed.
+//-------------------------------------------------------------------
+UINT32 StageProfiler::collect(StageStatistics* statistics)
+{
+    const UINT32 epoch = m_epoch.load(std::memory_order_relaxed);
+    const UINT32 overflowCount = m_overflowCount.load(std::memory_order_relaxed);
+    std::vector<UINT32> windowCounts(ProfilerBucketCount);
+
+    // The claimed buffers and the overflow buffer
+    std::vector<ThreadBuffer*> buffers;
+
+    for (UINT32 j = 0; j < min(m_threadBufferCount.load(std::memory_order_acquire), MaxProfiledThreads); ++j)
+    {
+        buffers.push_back(&m_threadBuffers[j]);
+    }
+
+    buffers.push_back(&m_threadBuffers[MaxProfiledThreads]);
+
+    for (UINT32 stage = 0; stage < ProfilerStageCount; ++stage)
+    {
+        StageStatistics& stageStatistics = statistics[stage];
+        UINT32* collectedCounts = m_collectedCounts.data() + stage * ProfilerBucketCount;
+        stageStatistics.count = 0;
+        stageStatistics.max = 0;
+
+        for (UINT32 i = 0; i < ProfilerBucketCount; ++i)
+        {
+            UINT32 total = 0;
+
+            for (size_t j = 0; j < buffers.size(); ++j)
+            {
+                total += buffers[j]->counts[stage][i].load(std::memory_order_relaxed);
+            }
+
+            windowCounts[i] = total - collectedCounts[i];
+            collectedCounts[i] = total;
+            stageStatistics.count += windowCounts[i];
+        }
+
+        for (size_t j = 0; j < buffers.size(); ++j)
+        {
+            if (buffers[j]->epoch.load(std::memory_order_acquire) == epoch)
+            {
+                stageStatistics.max = max(stageStatistics.max, buffers[j]->maxima[stage].load(std::memory_order_relaxed));
+            }
+        }
+
+        // The ranks of the percentiles, rounded up
+        const UINT32 ranks[] =
+        {
+            (UINT32)(((UINT64)stageStatistics.count * 50 + 99) / 100),
+            (UINT32)(((UINT64)stageStatistics.count * 95 + 99) / 100),
+            (UINT32)(((UINT64)stageStatistics.count * 99 + 99) / 100)
+        };
+
+        UINT64* percentiles[] = { &stageStatistics.p50, &stageStatistics.p95, &stageStatistics.p99 };
+        UINT32 percentileIndex = 0;
+        UINT32 cumulativeCount = 0;
+
+        for (UINT32 i = 0; i < ProfilerBucketCount && percentileIndex < 3; ++i)
+        {
+            cumulativeCount += windowCounts[i];
+
+            while (percentileIndex < 3 && cumulativeCount >= ranks[percentileIndex] && cumulativeCount > 0)
+            {
+                *percentiles[percentileIndex++] = bucketValue(i);
+            }
+        }
+
+        while (percentileIndex < 3)
+        {
+            *percentiles[percentileIndex++] = 0;
+        }
+
+        if (stageStatistics.max > 0)
+        {
+            // The bucket midpoint may exceed the largest value in the bucket
+            stageStatistics.p50 = min(stageStatistics.p50, stageStatistics.max);
+            stageStatistics.p95 = min(stageStatistics.p95, stageStatistics.max);
+            stageStatistics.p99 = min(stageStatistics.p99, stageStatistics.max);
+        }
+    }
+
+    m_epoch.store(epoch + 1, std::memory_order_relaxed);
+
+    const UINT32 windowOverflowCount = overflowCount - m_collectedOverflowCount;
+    m_collectedOverflowCount = overflowCount;
+    return windowOverflowCount;
+}
+
+
+//-------------------------------------------------------------------
+// bufferOfCurrentThread
+//
+// Claims a free buffer for a thread recording for the first time.
+// Returns NULL, if all buffers have been claimed, in which case the
+// thread records to the overflow buffer.
+//-------------------------------------------------------------------
+StageProfiler::ThreadBuffer* StageProfiler::bufferOfCurrentThread()
+{
+    const DWORD threadId = GetCurrentThreadId();
+    UINT32 count = min(m_threadBufferCount.load(std::memory_order_acquire), MaxProfiledThreads);
+
+    for (UINT32 i = 0; i < count; ++i)
+    {
+        if (m_threadBuffers[i].threadId.load(std::memory_order_relaxed) == threadId)
+        {
+            return &m_threadBuffers[i];
+        }
+    }
+
+    while (count < MaxProfiledThreads
+        && !m_threadBufferCount.compare_exchange_weak(count, count + 1, std::memory_order_acq_rel))
+    {
+    }
+
+    if (count >= MaxProfiledThreads)
+    {
+        return NULL;
+    }
+
+    m_threadBuffers[count].threadId.store(threadId, std::memory_order_relaxed);
+    return &m_threadBuffers[count];
+}
+
+
+//-------------------------------------------------------------------
+// bucketIndex
+//
+// Values below SubBucketCount have buckets of their own. Above that,
+// each power of two is split into SubBucketCount buckets.
+//-------------------------------------------------------------------
+UINT32 StageProfiler::bucketIndex(const UINT64& nanoseconds)
+{
+    const UINT64 value = min(nanoseconds, MaxRecordedNanoseconds);
+
+    if (value < SubBucketCount)
+    {
+        return (UINT32)value;
+    }
+
+    UINT32 exponent = SubBucketBits;
+
+    while ((value >> (exponent + 1)) != 0)
+    {
+        ++exponent;
+    }
+
+    const UINT32 subBucket = (UINT32)(value >> (exponent - SubBucketBits)) & (SubBucketCount - 1);
+    return SubBucketCount + (exponent - SubBucketBits) * SubBucketCount + subBucket;
+}
+
+
+//-------------------------------------------------------------------
+// bucketValue
+//
+// Returns the midpoint of the bucket.
+//-------------------------------------------------------------------
+UINT64 StageProfiler::bucketValue(const UINT32& index)
+{
+    if (index < SubBucketCount)
+    {
+        return index;
+    }
+
+    const UINT32 shift = (index - SubBucketCount) / SubBucketCount;
+    const UINT64 subBucket = (index - SubBucketCount) % SubBucketCount;
+    const UINT64 lowerBound = (SubBucketCount + subBucket) << shift;
+    return lowerBound + ((1ULL << shift) >> 1);
+}
+
+
+StageTimer::StageTimer(StageProfiler* profiler, const ProfilerStage& stage)
+    : m_profiler(profiler),
+    m_stage(stage),
+    m_startTimestamp(profiler ? StageProfiler::timestamp() : 0)
+{
+}
+
+
+StageTimer::~StageTimer()
+{
+    if (m_profiler)
+    {
+        m_profiler->record(m_stage, m_startTimestamp);
+    }
+}
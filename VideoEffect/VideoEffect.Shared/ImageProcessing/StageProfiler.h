@@ -0,0 +1,112 @@
+#ifndef STAGEPROFILER_H
+#define STAGEPROFILER_H
+
+#include <mfapi.h>
+#include <atomic>
+#include <vector>
+
+#include "Common.h"
+
+
+// Constants
+const UINT32 ProfilerBucketCount = 16 + 32 * 16; // Exact below 16 ns, then 16 buckets per power of two up to 2^36 ns
+const UINT32 MaxProfiledThreads = 8;
+
+
+//-------------------------------------------------------------------
+// StageStatistics
+//
+// Durations of a stage in nanoseconds over a reporting window. The
+// percentiles are accurate to roughly 6 %, the maximum is exact.
+//-------------------------------------------------------------------
+struct StageStatistics
+{
+    UINT32 count;
+    UINT64 p50;
+    UINT64 p95;
+    UINT64 p99;
+    UINT64 max;
+};
+
+
+//-------------------------------------------------------------------
+// StageProfiler
+//
+// Collects the durations of the processing stages into log-linear
+// histograms. Each recording thread claims a buffer of its own, so
+// recording takes no locks and does not contend with other threads.
+// The threads beyond MaxProfiledThreads share an overflow buffer,
+// which is updated with atomic read-modify-write operations, so no
+// duration is lost.
+//
+// Any thread may record, but only one thread may collect. Collecting
+// returns the statistics since the previous collect.
+//-------------------------------------------------------------------
+class StageProfiler
+{
+public:
+    StageProfiler();
+    ~StageProfiler();
+
+public:
+    // Monotonic timestamp in performance counter ticks
+    static LONGLONG timestamp();
+
+    // Records the time elapsed since the given timestamp
+    void record(const ProfilerStage& stage, const LONGLONG& startTimestamp);
+    void recordNanoseconds(const ProfilerStage& stage, const UINT64& nanoseconds);
+
+    // Fills ProfilerStageCount statistics. Returns the number of the
+    // durations recorded in the overflow buffer since the previous
+    // collect; they are included in the statistics.
+    UINT32 collect(StageStatistics* statistics);
+
+protected: // Types
+    struct ThreadBuffer
+    {
+        std::atomic<DWORD> threadId; // 0 if not claimed
+        std::atomic<UINT32> epoch; // The collect the maxima belong to
+        std::atomic<UINT32> counts[ProfilerStageCount][ProfilerBucketCount];
+        std::atomic<UINT64> maxima[ProfilerStageCount];
+    };
+
+protected: // New methods
+    ThreadBuffer* bufferOfCurrentThread();
+    void recordShared(ThreadBuffer* buffer, const ProfilerStage& stage, const UINT64& nanoseconds);
+
+    static UINT32 bucketIndex(const UINT64& nanoseconds);
+    static UINT64 bucketValue(const UINT32& index);
+
+protected: // Members
+    ThreadBuffer* m_threadBuffers; // The last one is the overflow buffer
+    std::atomic<UINT32> m_threadBufferCount;
+    std::atomic<UINT32> m_epoch;
+    std::atomic<UINT32> m_overflowCount;
+    UINT32 m_collectedOverflowCount;
+    std::vector<UINT32> m_collectedCounts; // Totals at the previous collect
+    LONGLONG m_ticksPerSecond;
+
+private: // Not copyable
+    StageProfiler(const StageProfiler&);
+    StageProfiler& operator=(const StageProfiler&);
+};
+
+
+//-------------------------------------------------------------------
+// StageTimer
+//
+// Records the duration of its scope. Does nothing without a profiler.
+//-------------------------------------------------------------------
+class StageTimer
+{
+public:
+    StageTimer(StageProfiler* profiler, const ProfilerStage& stage);
+    ~StageTimer();
+
+protected: // Members
+    StageProfiler* m_profiler; // Not owned
+    ProfilerStage m_stage;
+    LONGLONG m_startTimestamp;
+};
+
+#endif // STAGEPROFILER_H
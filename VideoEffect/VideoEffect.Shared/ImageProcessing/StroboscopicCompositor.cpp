@@ -0,0 +1,270 @@
+#include "pch.h"
+
+#include "StroboscopicCompositor.h" // Own header
+
+#include <math.h>
+
+
+// Constants
+const float RegionRadiusScale = 1.25f; // Room for the motion blur around the object
+const UINT32 DefaultFeather = 4;
+const int OpaqueAlpha = 256;
+
+
+//-------------------------------------------------------------------
+// blend
+//
+// Blends the source over the destination with the given alpha
+// (0 - OpaqueAlpha).
+//-------------------------------------------------------------------
+static inline BYTE blend(const BYTE& destination, const BYTE& source, const int& alpha)
+{
+    return (BYTE)(destination + (((source - destination) * alpha) >> 8));
+}
+
+
+StroboscopicCompositor::StroboscopicCompositor(
+        const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype)
+    : m_width(width),
+    m_height(height),
+    m_videoFormatSubtype(videoFormatSubtype),
+    m_background(NULL),
+    m_feather((float)DefaultFeather)
+{
+}
+
+
+void StroboscopicCompositor::setBackground(const BYTE* frame)
+{
+    m_background = frame;
+}
+
+
+//-------------------------------------------------------------------
+// setFeather
+//
+// Sets the width of the edge of the regions, in pixels, over which
+// the frames fade into the background. Zero gives hard edges.
+//-------------------------------------------------------------------
+void StroboscopicCompositor::setFeather(const UINT32& feather)
+{
+    m_feather = (float)feather;
+}
+
+
+void StroboscopicCompositor::addFrame(const BYTE* frame, const ObjectDetails& objectDetails)
+{
+    if (!frame)
+    {
+        return;
+    }
+
+    Region region;
+    region.frame = frame;
+    region.centerX = (float)objectDetails._centerX;
+    region.centerY = (float)objectDetails._centerY;
+    region.radius = (float)max(objectDetails._width, objectDetails._height) * RegionRadiusScale / 2;
+    m_regions.push_back(region);
+}
+
+
+UINT32 StroboscopicCompositor::frameCount() const
+{
+    return (UINT32)m_regions.size();
+}
+
+
+bool StroboscopicCompositor::compose(BYTE* output) const
+{
+    if (!m_background || !output)
+    {
+        return false;
+    }
+
+    if (m_videoFormatSubtype == MFVideoFormat_NV12)
+    {
+        composeNV12(output);
+    }
+    else if (m_videoFormatSubtype == MFVideoFormat_YUY2)
+    {
+        composeYUY2(output);
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// span
+//
+// Resolves the samples of a line the region crosses. The samples are
+// at x = (i + 0.5) * sampleSpacing and y is the center of the line,
+// both in pixels. Returns false, if the region does not cross the
+// line.
+//-------------------------------------------------------------------
+bool StroboscopicCompositor::span(
+    const Region& region, const float& y, const float& sampleSpacing, const UINT32& sampleCount,
+    UINT32& first, UINT32& last) const
+{
+    const float dy = y - region.centerY;
+
+    if (dy <= -region.radius || dy >= region.radius || sampleCount == 0)
+    {
+        return false;
+    }
+
+    const float halfWidth = sqrtf(region.radius * region.radius - dy * dy);
+    const float begin = (region.centerX - halfWidth) / sampleSpacing - 0.5f;
+    const float end = (region.centerX + halfWidth) / sampleSpacing - 0.5f;
+
+    if (end < 0 || begin > (float)(sampleCount - 1))
+    {
+        return false;
+    }
+
+    first = (begin <= 0) ? 0 : (UINT32)ceilf(begin);
+    last = min((UINT32)end, sampleCount - 1);
+    return first <= last;
+}
+
+
+//-------------------------------------------------------------------
+// alpha
+//
+// Opaque inside the region, fading to zero over the feather at the
+// edge.
+//-------------------------------------------------------------------
+int StroboscopicCompositor::alpha(const Region& region, const float& x, const float& y) const
+{
+    const float dx = x - region.centerX;
+    const float dy = y - region.centerY;
+    const float distanceToEdge = region.radius - sqrtf(dx * dx + dy * dy);
+
+    if (distanceToEdge <= 0)
+    {
+        return 0;
+    }
+
+    if (distanceToEdge >= m_feather)
+    {
+        return OpaqueAlpha;
+    }
+
+    return (int)(distanceToEdge * OpaqueAlpha / m_feather);
+}
+
+
+//-------------------------------------------------------------------
+// composeNV12
+//
+// The chroma samples are blended with the alpha at their center.
+//-------------------------------------------------------------------
+void StroboscopicCompositor::composeNV12(BYTE* output) const
+{
+    const UINT32 lumaSize = m_width * m_height;
+    const UINT32 chromaWidth = m_width / 2;
+
+    for (UINT32 y = 0; y < m_height; ++y)
+    {
+        BYTE* outputLine = output + y * m_width;
+        memcpy(outputLine, m_background + y * m_width, m_width);
+
+        const float centerY = y + 0.5f;
+
+        for (const Region& region : m_regions)
+        {
+            UINT32 first = 0;
+            UINT32 last = 0;
+
+            if (!span(region, centerY, 1.0f, m_width, first, last))
+            {
+                continue;
+            }
+
+            const BYTE* frameLine = region.frame + y * m_width;
+
+            for (UINT32 x = first; x <= last; ++x)
+            {
+                outputLine[x] = blend(outputLine[x], frameLine[x], alpha(region, x + 0.5f, centerY));
+            }
+        }
+    }
+
+    for (UINT32 y = 0; y < m_height / 2; ++y)
+    {
+        BYTE* outputLine = output + lumaSize + y * m_width;
+        memcpy(outputLine, m_background + lumaSize + y * m_width, m_width);
+
+        const float centerY = (y + 0.5f) * 2;
+
+        for (const Region& region : m_regions)
+        {
+            UINT32 first = 0;
+            UINT32 last = 0;
+
+            if (!span(region, centerY, 2.0f, chromaWidth, first, last))
+            {
+                continue;
+            }
+
+            const BYTE* frameLine = region.frame + lumaSize + y * m_width;
+
+            for (UINT32 x = first; x <= last; ++x)
+            {
+                const int a = alpha(region, (x + 0.5f) * 2, centerY);
+                outputLine[x * 2] = blend(outputLine[x * 2], frameLine[x * 2], a);
+                outputLine[x * 2 + 1] = blend(outputLine[x * 2 + 1], frameLine[x * 2 + 1], a);
+            }
+        }
+    }
+}
+
+
+//-------------------------------------------------------------------
+// composeYUY2
+//
+// The chroma of a pixel pair is blended with the alpha at the center
+// of the pair.
+//-------------------------------------------------------------------
+void StroboscopicCompositor::composeYUY2(BYTE* output) const
+{
+    const UINT32 lineLength = m_width * 2;
+    const UINT32 pairCount = m_width / 2;
+
+    for (UINT32 y = 0; y < m_height; ++y)
+    {
+        BYTE* outputLine = output + y * lineLength;
+        memcpy(outputLine, m_background + y * lineLength, lineLength);
+
+        const float centerY = y + 0.5f;
+
+        for (const Region& region : m_regions)
+        {
+            UINT32 first = 0;
+            UINT32 last = 0;
+
+            if (!span(region, centerY, 2.0f, pairCount, first, last))
+            {
+                continue;
+            }
+
+            const BYTE* frameLine = region.frame + y * lineLength;
+
+            for (UINT32 pair = first; pair <= last; ++pair)
+            {
+                BYTE* out = outputLine + pair * 4;
+                const BYTE* in = frameLine + pair * 4;
+                const int chromaAlpha = alpha(region, (pair + 0.5f) * 2, centerY);
+
+                out[0] = blend(out[0], in[0], alpha(region, pair * 2 + 0.5f, centerY));
+                out[1] = blend(out[1], in[1], chromaAlpha);
+                out[2] = blend(out[2], in[2], alpha(region, pair * 2 + 1.5f, centerY));
+                out[3] = blend(out[3], in[3], chromaAlpha);
+            }
+        }
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef STROBOSCOPICCOMPOSITOR_H
+#define STROBOSCOPICCOMPOSITOR_H
+
+#include <mfapi.h>
+#include <vector>
+
+#include "ObjectDetails.h"
+
+
+//-------------------------------------------------------------------
+// StroboscopicCompositor
+//
+// Composes the object from a number of frames onto a background frame
+// so that the whole trajectory is seen in one image. Each frame
+// contributes a circular region around its object with a feathered
+// edge, the later frames on top of the earlier ones.
+//
+// The composition streams through the output line by line: the line
+// of the background is copied and the spans of the regions crossing
+// the line are blended over it, so there are no intermediate frames.
+// The frames are referenced, not copied, and must stay valid until
+// compose() returns.
+//-------------------------------------------------------------------
+class StroboscopicCompositor
+{
+public:
+    StroboscopicCompositor(const UINT32& width, const UINT32& height, const GUID& videoFormatSubtype);
+
+public:
+    void setBackground(const BYTE* frame);
+    void setFeather(const UINT32& feather);
+    void addFrame(const BYTE* frame, const ObjectDetails& objectDetails);
+    UINT32 frameCount() const;
+
+    // The output must hold a full frame. Returns false, if there is no
+    // background.
+    bool compose(BYTE* output) const;
+
+protected: // Types
+    struct Region
+    {
+        const BYTE* frame;
+        float centerX;
+        float centerY;
+        float radius;
+    };
+
+protected: // New methods
+    bool span(
+        const Region& region, const float& y, const float& sampleSpacing, const UINT32& sampleCount,
+        UINT32& first, UINT32& last) const;
+
+    int alpha(const Region& region, const float& x, const float& y) const;
+
+    void composeNV12(BYTE* output) const;
+    void composeYUY2(BYTE* output) const;
+
+protected: // Members
+    UINT32 m_width;
+    UINT32 m_height;
+    GUID m_videoFormatSubtype;
+    const BYTE* m_background;
+    float m_feather;
+    std::vector<Region> m_regions;
+};
+
+#endif // STROBOSCOPICCOMPOSITOR_H
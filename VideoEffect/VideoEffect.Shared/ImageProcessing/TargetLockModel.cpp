@@ -0,0 +1,194 @@
+#include "pch.h"
+
+#include "TargetLockModel.h" // Own header
+
+#include "Common.h"
+
+#include <algorithm>
+
+
+// Constants
+const float RelativeAgreementThreshold = 1.0f; // Jitter relative to the consensus size
+const float RelativeMotionThreshold = 0.8f; // Deviation from the prediction relative to the item size
+const float LockEnterScore = 0.6f; // E.g. five confident agreeing detections out of eight
+const float MotionExitScore = 0.75f;
+const float MotionEvidenceDecay = 0.5f;
+
+
+TargetLockModel::TargetLockModel()
+{
+    reset();
+}
+
+
+void TargetLockModel::reset()
+{
+    m_next = 0;
+    m_count = 0;
+    m_motionEvidence = 0;
+}
+
+
+void TargetLockModel::addDetection(const ObjectDetails& objectDetails)
+{
+    m_window[m_next].found = true;
+    m_window[m_next].objectDetails = objectDetails;
+    m_next = (m_next + 1) % LockWindowLength;
+    m_count = min(m_count + 1, LockWindowLength);
+}
+
+
+void TargetLockModel::addMiss()
+{
+    m_window[m_next].found = false;
+    m_next = (m_next + 1) % LockWindowLength;
+    m_count = min(m_count + 1, LockWindowLength);
+}
+
+
+float TargetLockModel::lockScore() const
+{
+    ObjectDetails reference;
+
+    if (!median(reference))
+    {
+        return 0;
+    }
+
+    float score = 0;
+
+    for (UINT32 i = 0; i < m_count; ++i)
+    {
+        if (m_window[i].found && agrees(m_window[i].objectDetails, reference))
+        {
+            score += m_window[i].objectDetails._confidence;
+        }
+    }
+
+    return score / LockWindowLength;
+}
+
+
+bool TargetLockModel::canEnterLock() const
+{
+    return lockScore() >= LockEnterScore;
+}
+
+
+ObjectDetails TargetLockModel::consensus() const
+{
+    ObjectDetails reference;
+
+    if (!median(reference))
+    {
+        return reference;
+    }
+
+    float weightSum = 0;
+    float centerX = 0;
+    float centerY = 0;
+    float width = 0;
+    float height = 0;
+
+    for (UINT32 i = 0; i < m_count; ++i)
+    {
+        const ObjectDetails& objectDetails = m_window[i].objectDetails;
+
+        if (m_window[i].found && agrees(objectDetails, reference))
+        {
+            const float weight = max(objectDetails._confidence, 0.01f);
+            weightSum += weight;
+            centerX += weight * objectDetails._centerX;
+            centerY += weight * objectDetails._centerY;
+            width += weight * objectDetails._width;
+            height += weight * objectDetails._height;
+        }
+    }
+
+    if (weightSum > 0)
+    {
+        reference._centerX = (UINT32)(centerX / weightSum + 0.5f);
+        reference._centerY = (UINT32)(centerY / weightSum + 0.5f);
+        reference._width = (UINT32)(width / weightSum + 0.5f);
+        reference._height = (UINT32)(height / weightSum + 0.5f);
+    }
+
+    return reference;
+}
+
+
+bool TargetLockModel::detectMotion(
+    const ObjectDetails& predicted, const ObjectDetails& objectDetails,
+    const float& itemWidth, const float& itemHeight)
+{
+    const float maxJitterX = itemWidth * RelativeMotionThreshold;
+    const float maxJitterY = itemHeight * RelativeMotionThreshold;
+
+    const bool deviates =
+        abs((float)predicted._centerX - (float)objectDetails._centerX) > maxJitterX
+        || abs((float)predicted._centerY - (float)objectDetails._centerY) > maxJitterY
+        || abs((float)predicted._width - (float)objectDetails._width) > maxJitterX
+        || abs((float)predicted._height - (float)objectDetails._height) > maxJitterY;
+
+    m_motionEvidence = m_motionEvidence * MotionEvidenceDecay + (deviates ? objectDetails._confidence : 0);
+
+    return m_motionEvidence >= MotionExitScore;
+}
+
+
+//-------------------------------------------------------------------
+// median
+//
+// The median of each dimension separately. Returns false, if there
+// are no detections in the window.
+//-------------------------------------------------------------------
+bool TargetLockModel::median(ObjectDetails& medianDetails) const
+{
+    UINT32 centerX[LockWindowLength];
+    UINT32 centerY[LockWindowLength];
+    UINT32 width[LockWindowLength];
+    UINT32 height[LockWindowLength];
+    UINT32 foundCount = 0;
+
+    for (UINT32 i = 0; i < m_count; ++i)
+    {
+        if (m_window[i].found)
+        {
+            centerX[foundCount] = m_window[i].objectDetails._centerX;
+            centerY[foundCount] = m_window[i].objectDetails._centerY;
+            width[foundCount] = m_window[i].objectDetails._width;
+            height[foundCount] = m_window[i].objectDetails._height;
+            ++foundCount;
+        }
+    }
+
+    if (foundCount == 0)
+    {
+        return false;
+    }
+
+    const UINT32 middle = foundCount / 2;
+    std::nth_element(centerX, centerX + middle, centerX + foundCount);
+    std::nth_element(centerY, centerY + middle, centerY + foundCount);
+    std::nth_element(width, width + middle, width + foundCount);
+    std::nth_element(height, height + middle, height + foundCount);
+
+    medianDetails._centerX = centerX[middle];
+    medianDetails._centerY = centerY[middle];
+    medianDetails._width = width[middle];
+    medianDetails._height = height[middle];
+
+    return true;
+}
+
+
+bool TargetLockModel::agrees(const ObjectDetails& objectDetails, const ObjectDetails& reference) const
+{
+    const float maxJitterX = reference._width * RelativeAgreementThreshold;
+    const float maxJitterY = reference._height * RelativeAgreementThreshold;
+
+    return abs((float)reference._centerX - (float)objectDetails._centerX) <= maxJitterX
+        && abs((float)reference._centerY - (float)objectDetails._centerY) <= maxJitterY
+        && abs((float)reference._width - (float)objectDetails._width) <= maxJitterX
+        && abs((float)reference._height - (float)objectDetails._height) <= maxJitterY;
+}
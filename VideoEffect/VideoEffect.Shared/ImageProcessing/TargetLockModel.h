@@ -0,0 +1,74 @@
+#ifndef TARGETLOCKMODEL_H
+#define TARGETLOCKMODEL_H
+
+#include <mfapi.h>
+
+#include "ObjectDetails.h"
+
+
+// Constants
+const UINT32 LockWindowLength = 8;
+
+
+//-------------------------------------------------------------------
+// TargetLockModel
+//
+// Decides when a target is stable enough to lock onto and when a
+// locked target has moved.
+//
+// While locking, the latest detections (and misses) are kept in a
+// sliding window. The consensus is the median of the detections,
+// and the lock score is the sum of the confidences of the detections
+// agreeing with the consensus relative to the window length. The
+// lock is entered once the score reaches the enter threshold. A
+// single outlier lowers the score but does not restart the locking.
+//
+// Once locked, the deviations from the prediction are accumulated as
+// decaying motion evidence weighted by the confidence, and the target
+// is considered moved once the evidence reaches the exit threshold.
+// A confident deviation suffices alone, uncertain ones only when
+// repeated.
+//-------------------------------------------------------------------
+class TargetLockModel
+{
+public:
+    TargetLockModel();
+
+public:
+    void reset();
+
+    // Locking
+    void addDetection(const ObjectDetails& objectDetails);
+    void addMiss();
+    float lockScore() const;
+    bool canEnterLock() const;
+
+    // The confidence weighted mean of the detections agreeing with the
+    // consensus, empty if there are no detections
+    ObjectDetails consensus() const;
+
+    // Locked: returns true, if the target has moved from the prediction
+    // considering the earlier detections too
+    bool detectMotion(
+        const ObjectDetails& predicted, const ObjectDetails& objectDetails,
+        const float& itemWidth, const float& itemHeight);
+
+protected: // Types
+    struct Observation
+    {
+        bool found;
+        ObjectDetails objectDetails;
+    };
+
+protected: // New methods
+    bool median(ObjectDetails& medianDetails) const;
+    bool agrees(const ObjectDetails& objectDetails, const ObjectDetails& reference) const;
+
+protected: // Members
+    Observation m_window[LockWindowLength];
+    UINT32 m_next; // Index of the next observation
+    UINT32 m_count;
+    float m_motionEvidence;
+};
+
+#endif // TARGETLOCKMODEL_H
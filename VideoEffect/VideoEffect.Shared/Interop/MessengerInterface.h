@@ -11,7 +11,11 @@ namespace VideoEffect
 
         virtual void SetLockedRect(int centerX, int centerY, int width, int height);
 
-        virtual void UpdateOperationDurationInMilliseconds(int milliseconds) = 0;
+        // Four values per ProfilerStage in microseconds: p50, p95, p99 and
+        // max, followed by the number of the durations recorded by the
+        // threads beyond the per-thread buffers of the profiler and the
+        // number of the frames the pipelined analysis had no room for
+        virtual void UpdateStageDurations(const Platform::Array<int, 1>^ durationsInMicroseconds) = 0;
 
         virtual void SaveFrame(
             const Platform::Array<byte, 1>^ pixelArray,
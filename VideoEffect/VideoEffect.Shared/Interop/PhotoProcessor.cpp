@@ -9,6 +9,7 @@
 #include "Effects\NoiseRemovalEffect.h"
 #include "ImageProcessing\ImageAnalyzer.h"
 #include "ImageProcessing\ImageProcessingUtils.h"
+#include "ImageProcessing\OverlayCommandList.h"
 #include "Settings.h"
 
 using namespace VideoEffect;
@@ -49,8 +50,7 @@ CPhotoProcessor::~CPhotoProcessor()
 
 void CPhotoProcessor::SetMode(int mode)
 {
-    Settings *settings = Settings::instance();
-    settings->m_mode = mode;
+    Settings::instance()->setMode(mode);
 
     delete m_effect;
     m_effect = NULL;
@@ -81,7 +81,7 @@ void CPhotoProcessor::SetTargetYUV(const Platform::Array<float, 1>^ targetYuv)
 
 void CPhotoProcessor::SetThreshold(float threshold)
 {
-    Settings::instance()->m_threshold = threshold;
+    Settings::instance()->setThreshold(threshold);
 }
 
 
@@ -103,6 +103,7 @@ Platform::Array<byte>^ CPhotoProcessor::ProcessFrames(int frameIndex, bool remov
 {
     BYTE *processedFrame = NULL;
     Platform::Array<byte>^ byteArray = nullptr;
+    const int mode = Settings::instance()->snapshot()->mode;
 
     if (m_effect && m_frame[frameIndex])
     {
@@ -131,7 +132,7 @@ Platform::Array<byte>^ CPhotoProcessor::ProcessFrames(int frameIndex, bool remov
         int secondFrameIndex = (frameIndex == 0) ? 1 : 0;
         BYTE* secondFrame = NULL;
 
-        if (Settings::instance()->m_mode == Mode::ChromaDelta)
+        if (mode == Mode::ChromaDelta)
         {
             secondFrame = m_frame[secondFrameIndex];
 
@@ -162,7 +163,7 @@ Platform::Array<byte>^ CPhotoProcessor::ProcessFrames(int frameIndex, bool remov
             originalFrame, stride,
             m_frameWidth[frameIndex], m_frameHeight[frameIndex]);
 
-        if (Settings::instance()->m_mode == Mode::ChromaDelta && secondFrame != NULL)
+        if (mode == Mode::ChromaDelta && secondFrame != NULL)
         {
             targetRect.right = m_frameWidth[secondFrameIndex];
             targetRect.bottom = m_frameHeight[secondFrameIndex];
@@ -175,11 +176,17 @@ Platform::Array<byte>^ CPhotoProcessor::ProcessFrames(int frameIndex, bool remov
                 m_frameWidth[secondFrameIndex], m_frameHeight[secondFrameIndex]);
         }
 
-        if (!applyEffectOnly && Settings::instance()->m_mode != Mode::ChromaDelta)
+        if (!applyEffectOnly && mode != Mode::ChromaDelta)
         {
+            OverlayCommandList overlays;
+
             delete m_imageAnalyzer->extractBestCircularConvexHull(
                 processedFrame, m_frameWidth[frameIndex], m_frameHeight[frameIndex],
-                5, m_effect->videoFormatSubtype(), true);
+                5, m_effect->videoFormatSubtype(), &overlays);
+
+            overlays.render(
+                processedFrame, m_frameWidth[frameIndex], m_frameHeight[frameIndex],
+                m_effect->videoFormatSubtype());
         }
 
         if (removeNoise)
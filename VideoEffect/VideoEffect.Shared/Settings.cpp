@@ -7,6 +7,43 @@
 static Settings* m_instance = NULL;
 
 
+SettingsSnapshot::SettingsSnapshot()
+    : version(0),
+    threshold(0),
+    removeNoise(false),
+    applyEffectOnly(false),
+    mode(Mode::ChromaFilter),
+    edgeOperator(EdgeOperator::ForwardDifference),
+    edgeDetectionUsesChroma(true),
+    thinEdges(true),
+    noiseFilter(NoiseFilter::BoxFilter),
+    noiseFilterRadius(1),
+    bilateralRangeSigma(20),
+    chromaDeltaFramesBack(1),
+    chromaDeltaRoiHistoryOnly(false),
+    chromaDeltaBackgroundModel(false),
+    backgroundLearningShift(5),
+    backgroundUsesLuma(false),
+    backgroundAdaptiveThreshold(true),
+    motionThreshold(15),
+    postProcessUsesMotionMask(false),
+    bufferDepth(35),
+    bufferStorage(0),
+    bufferProxyShift(2),
+    postProcessComposite(false),
+    drawOverlays(true),
+    acquisitionPyramidLevel(2),
+    schedulingPolicy(SchedulingPolicy::BalancedPolicy),
+    pipelinedAnalysis(false),
+    compensateCameraMotion(true),
+    appearanceTracking(false)
+{
+    targetYuv[0] = 0;
+    targetYuv[1] = 0;
+    targetYuv[2] = 0;
+}
+
+
 Settings* Settings::instance()
 {
     if (!m_instance)
@@ -19,14 +56,8 @@ Settings* Settings::instance()
 
 
 Settings::Settings()
-    : m_threshold(0),
-    m_mode(Mode::ChromaFilter),
-    m_removeNoise(false),
-    m_applyEffectOnly(false)
+    : m_snapshot(std::make_shared<SettingsSnapshot>())
 {
-    m_targetYuv[0] = 0;
-    m_targetYuv[1] = 0;
-    m_targetYuv[2] = 0;
 }
 
 
@@ -35,18 +66,79 @@ Settings::~Settings()
 }
 
 
+std::shared_ptr<const SettingsSnapshot> Settings::snapshot() const
+{
+    return std::atomic_load(&m_snapshot);
+}
+
+
 void Settings::setTargetYuv(const Platform::Array<float, 1>^ targetYuv)
 {
-    if (targetYuv)
+    if (!targetYuv || targetYuv->Length < 3)
     {
-        try
-        {
-            m_targetYuv[0] = targetYuv[0];
-            m_targetYuv[1] = targetYuv[1];
-            m_targetYuv[2] = targetYuv[2];
-        }
-        catch (...)
+        return;
+    }
+
+    publish([&targetYuv](SettingsSnapshot& snapshot)
+    {
+        snapshot.targetYuv[0] = targetYuv[0];
+        snapshot.targetYuv[1] = targetYuv[1];
+        snapshot.targetYuv[2] = targetYuv[2];
+    });
+}
+
+
+void Settings::setThreshold(const float& threshold)
+{
+    publish([&threshold](SettingsSnapshot& snapshot)
+    {
+        snapshot.threshold = threshold;
+    });
+}
+
+
+void Settings::setRemoveNoise(const bool& removeNoise)
+{
+    publish([&removeNoise](SettingsSnapshot& snapshot)
+    {
+        snapshot.removeNoise = removeNoise;
+    });
+}
+
+
+void Settings::setApplyEffectOnly(const bool& applyEffectOnly)
+{
+    publish([&applyEffectOnly](SettingsSnapshot& snapshot)
+    {
+        snapshot.applyEffectOnly = applyEffectOnly;
+    });
+}
+
+
+void Settings::setMode(const int& mode)
+{
+    publish([&mode](SettingsSnapshot& snapshot)
+    {
+        snapshot.mode = mode;
+    });
+}
+
+
+void Settings::setStreamingSettings(
+    const float& threshold, const Platform::Array<float, 1>^ targetYuv,
+    const bool& removeNoise, const bool& applyEffectOnly)
+{
+    publish([&](SettingsSnapshot& snapshot)
+    {
+        snapshot.threshold = threshold;
+        snapshot.removeNoise = removeNoise;
+        snapshot.applyEffectOnly = applyEffectOnly;
+
+        if (targetYuv && targetYuv->Length >= 3)
         {
+            snapshot.targetYuv[0] = targetYuv[0];
+            snapshot.targetYuv[1] = targetYuv[1];
+            snapshot.targetYuv[2] = targetYuv[2];
         }
-    }
+    });
 }
@@ -1,22 +1,106 @@
 #pragma once
 
+#include <memory>
+
+
+//-------------------------------------------------------------------
+// SettingsSnapshot
+//
+// All the settings. A published snapshot is never modified, a change
+// publishes a new one with the next version. The frame processing
+// takes the current snapshot once per frame and compares the versions
+// to notice the changes.
+//-------------------------------------------------------------------
+struct SettingsSnapshot
+{
+    SettingsSnapshot();
+
+    UINT32 version;
+    float targetYuv[3];
+    float threshold;
+    bool removeNoise;
+    bool applyEffectOnly;
+    int mode;
+    int edgeOperator;
+    bool edgeDetectionUsesChroma;
+    bool thinEdges;
+    int noiseFilter;
+    int noiseFilterRadius;
+    int bilateralRangeSigma;
+    int chromaDeltaFramesBack;
+    bool chromaDeltaRoiHistoryOnly;
+    bool chromaDeltaBackgroundModel;
+    int backgroundLearningShift;
+    bool backgroundUsesLuma;
+    bool backgroundAdaptiveThreshold;
+    int motionThreshold;
+    bool postProcessUsesMotionMask;
+    int bufferDepth;
+    int bufferStorage;
+    int bufferProxyShift;
+    bool postProcessComposite;
+    bool drawOverlays;
+    int acquisitionPyramidLevel;
+    int schedulingPolicy;
+    bool pipelinedAnalysis;
+    bool compensateCameraMotion;
+    bool appearanceTracking;
+};
+
+
 class Settings
 {
 public:
     static Settings* instance();
 
 public:
+    // Lock free, can be called from any thread
+    std::shared_ptr<const SettingsSnapshot> snapshot() const;
+
+    // Publish a new snapshot. The setters of the individual values keep
+    // the others of the current snapshot.
     void setTargetYuv(const Platform::Array<float, 1>^ targetYuv);
+    void setThreshold(const float& threshold);
+    void setRemoveNoise(const bool& removeNoise);
+    void setApplyEffectOnly(const bool& applyEffectOnly);
+    void setMode(const int& mode);
+    void setStreamingSettings(
+        const float& threshold, const Platform::Array<float, 1>^ targetYuv,
+        const bool& removeNoise, const bool& applyEffectOnly);
+
+    //-------------------------------------------------------------------
+    // publish
+    //
+    // Applies the change to a copy of the current snapshot and swaps the
+    // copy in. If another thread published in the meanwhile, the change
+    // is applied again to its snapshot, so no change is lost. Several
+    // settings changed at once are thus published as one version.
+    //-------------------------------------------------------------------
+    template <typename Change>
+    void publish(const Change& change);
 
 private:
     Settings();
     ~Settings();
 
-public:
-    float m_targetYuv[3];
-    float m_threshold;
-    int m_mode;
-    bool m_removeNoise;
-    bool m_applyEffectOnly;
+private:
+    std::shared_ptr<const SettingsSnapshot> m_snapshot; // Accessed only atomically
 };
 
+
+template <typename Change>
+void Settings::publish(const Change& change)
+{
+    std::shared_ptr<const SettingsSnapshot> current = snapshot();
+    std::shared_ptr<const SettingsSnapshot> next;
+
+    do
+    {
+        std::shared_ptr<SettingsSnapshot> changed = std::make_shared<SettingsSnapshot>(*current);
+        change(*changed);
+        changed->version = current->version + 1;
+        next = changed;
+    }
+    while (!std::atomic_compare_exchange_weak(&m_snapshot, &current, next));
+}
+
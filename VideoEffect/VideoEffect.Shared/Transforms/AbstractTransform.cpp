@@ -47,6 +47,11 @@ CAbstractTransform::CAbstractTransform() :
 
 CAbstractTransform::~CAbstractTransform()
 {
+    if (m_properties)
+    {
+        m_properties->MapChanged -= m_propertiesChangedToken;
+    }
+
     SafeRelease(&m_pInputType);
     SafeRelease(&m_pOutputType);
     SafeRelease(&m_pSample);
@@ -77,10 +82,189 @@ HRESULT CAbstractTransform::SetProperties(ABI::Windows::Foundation::Collections:
     pConfiguration->QueryInterface(IID_PPV_ARGS(&spSetting));
     IPropertySet^ properties = reinterpret_cast<IPropertySet^>(pConfiguration);
     m_messenger = safe_cast<VideoEffect::MessengerInterface^>(properties->Lookup(L"Communication"));
+
+    // The settings in the properties are published as one snapshot
+    m_settings->publish([&properties](SettingsSnapshot& settings)
+    {
+        ReadSettings(properties, nullptr, settings);
+    });
+
+    if (m_properties)
+    {
+        m_properties->MapChanged -= m_propertiesChangedToken;
+    }
+
+    // The settings may also be changed through the properties while
+    // streaming instead of the messenger. The handler runs on the thread
+    // of the application, so the values of the wrong type are ignored
+    // instead of throwing, and other keys publish nothing.
+    m_properties = properties;
+    m_propertiesChangedToken = properties->MapChanged +=
+        ref new MapChangedEventHandler<String^, Object^>(
+            [](IObservableMap<String^, Object^>^ sender, IMapChangedEventArgs<String^>^ args)
+            {
+                if (args->CollectionChange != CollectionChange::ItemInserted
+                    && args->CollectionChange != CollectionChange::ItemChanged)
+                {
+                    return;
+                }
+
+                Settings *settings = Settings::instance();
+                String^ key = args->Key;
+                SettingsSnapshot validated(*settings->snapshot());
+
+                if (ReadSettings(sender, key, validated))
+                {
+                    settings->publish([&sender, &key](SettingsSnapshot& changed)
+                    {
+                        ReadSettings(sender, key, changed);
+                    });
+                }
+            });
+
     return S_OK;
 }
 
 
+//-------------------------------------------------------------------
+// HasSetting
+//
+// Returns true, if the properties have the setting and it is the one
+// of the key, or no key is given.
+//-------------------------------------------------------------------
+static bool HasSetting(IMap<String^, Object^>^ properties, String^ key, String^ name)
+{
+    return (key == nullptr || String::CompareOrdinal(key, name) == 0)
+        && properties->HasKey(name);
+}
+
+
+//-------------------------------------------------------------------
+// LookupSetting
+//
+// Reads the setting to the value, if the properties have it and it is
+// of the type of the value. Returns true, if read.
+//-------------------------------------------------------------------
+template <typename T>
+static bool LookupSetting(IMap<String^, Object^>^ properties, String^ key, String^ name, T& value)
+{
+    if (!HasSetting(properties, key, name))
+    {
+        return false;
+    }
+
+    IBox<T>^ box = dynamic_cast<IBox<T>^>(properties->Lookup(name));
+
+    if (!box)
+    {
+        return false;
+    }
+
+    value = box->Value;
+    return true;
+}
+
+
+static bool LookupSetting(IMap<String^, Object^>^ properties, String^ key, String^ name, float (&value)[3])
+{
+    if (!HasSetting(properties, key, name))
+    {
+        return false;
+    }
+
+    IBoxArray<float>^ box = dynamic_cast<IBoxArray<float>^>(properties->Lookup(name));
+
+    if (!box || !box->Value || box->Value->Length < 3)
+    {
+        return false;
+    }
+
+    value[0] = box->Value[0];
+    value[1] = box->Value[1];
+    value[2] = box->Value[2];
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// ReadSettings
+//
+// Called also on the thread changing the properties, only the given
+// snapshot is touched.
+//-------------------------------------------------------------------
+bool CAbstractTransform::ReadSettings(IMap<String^, Object^>^ properties, String^ key, SettingsSnapshot& settings)
+{
+    bool read = false;
+
+    // Optional streaming settings, also changed through the messenger
+    read |= LookupSetting(properties, key, L"Threshold", settings.threshold);
+    read |= LookupSetting(properties, key, L"TargetYuv", settings.targetYuv);
+    read |= LookupSetting(properties, key, L"RemoveNoise", settings.removeNoise);
+    read |= LookupSetting(properties, key, L"ApplyEffectOnly", settings.applyEffectOnly);
+
+    // Optional edge detection configuration, see EdgeOperator
+    read |= LookupSetting(properties, key, L"EdgeOperator", settings.edgeOperator);
+    read |= LookupSetting(properties, key, L"EdgeDetectionUsesChroma", settings.edgeDetectionUsesChroma);
+    read |= LookupSetting(properties, key, L"ThinEdges", settings.thinEdges);
+
+    // Optional noise removal configuration, see NoiseFilter
+    read |= LookupSetting(properties, key, L"NoiseFilter", settings.noiseFilter);
+    read |= LookupSetting(properties, key, L"NoiseFilterRadius", settings.noiseFilterRadius);
+    read |= LookupSetting(properties, key, L"BilateralRangeSigma", settings.bilateralRangeSigma);
+
+    // Optional chroma delta history configuration
+    read |= LookupSetting(properties, key, L"ChromaDeltaFramesBack", settings.chromaDeltaFramesBack);
+    read |= LookupSetting(properties, key, L"ChromaDeltaRoiHistoryOnly", settings.chromaDeltaRoiHistoryOnly);
+
+    // Optional background model configuration for the chroma delta mode
+    read |= LookupSetting(properties, key, L"ChromaDeltaBackgroundModel", settings.chromaDeltaBackgroundModel);
+    read |= LookupSetting(properties, key, L"BackgroundLearningShift", settings.backgroundLearningShift);
+    read |= LookupSetting(properties, key, L"BackgroundUsesLuma", settings.backgroundUsesLuma);
+    read |= LookupSetting(properties, key, L"BackgroundAdaptiveThreshold", settings.backgroundAdaptiveThreshold);
+
+    // Optional motion analysis configuration of the buffering transform
+    read |= LookupSetting(properties, key, L"MotionThreshold", settings.motionThreshold);
+    read |= LookupSetting(properties, key, L"PostProcessUsesMotionMask", settings.postProcessUsesMotionMask);
+
+    // Number of frames buffered by the buffering transform, applied when
+    // the media type is set
+    read |= LookupSetting(properties, key, L"BufferDepth", settings.bufferDepth);
+
+    // Optional frame buffer storage configuration, see BufferStorage
+    read |= LookupSetting(properties, key, L"BufferStorage", settings.bufferStorage);
+    read |= LookupSetting(properties, key, L"BufferProxyShift", settings.bufferProxyShift);
+
+    // Optional post-processing configuration: composite of the whole
+    // trajectory instead of merging two frames
+    read |= LookupSetting(properties, key, L"PostProcessComposite", settings.postProcessComposite);
+
+    // Optional overlay configuration, false when nothing shows the frames
+    read |= LookupSetting(properties, key, L"DrawOverlays", settings.drawOverlays);
+
+    // Optional target acquisition configuration: the pyramid level the
+    // target is searched on while locking, 0 for the full resolution
+    read |= LookupSetting(properties, key, L"AcquisitionPyramidLevel", settings.acquisitionPyramidLevel);
+
+    // Optional overload handling of the realtime transform, see SchedulingPolicy
+    read |= LookupSetting(properties, key, L"SchedulingPolicy", settings.schedulingPolicy);
+
+    // Optional pipelining: the realtime transform analyzes the frames in
+    // a task of its own and applies the results to the later frames
+    read |= LookupSetting(properties, key, L"PipelinedAnalysis", settings.pipelinedAnalysis);
+
+    // Optional camera motion compensation: the motion of a locked target
+    // is measured relative to the background
+    read |= LookupSetting(properties, key, L"CompensateCameraMotion", settings.compensateCameraMotion);
+
+    // Optional locked state tracking: the realtime transform follows the
+    // locked target by its appearance instead of the detection of the
+    // effect. Modes other than the chroma filter always do.
+    read |= LookupSetting(properties, key, L"AppearanceTracking", settings.appearanceTracking);
+
+    return read;
+}
+
+
 // IMFTransform methods. Refer to the Media Foundation SDK documentation for details.
 
 //-------------------------------------------------------------------
@@ -1123,8 +1307,6 @@ HRESULT CAbstractTransform::UpdateFormatInfo()
             goto done;
         }
 
-        OnMfMtSubtypeResolved(subtype);
-
         hr = MFGetAttributeSize(m_pInputType, MF_MT_FRAME_SIZE, &m_imageWidthInPixels, &m_imageHeightInPixels);
         m_rcDest = D2D1::RectU(0, 0, m_imageWidthInPixels, m_imageHeightInPixels);
 
@@ -1135,6 +1317,10 @@ HRESULT CAbstractTransform::UpdateFormatInfo()
 
         // Calculate the image size (not including padding)
         hr = ImageProcessingUtils::getImageSize(subtype.Data1, m_imageWidthInPixels, m_imageHeightInPixels, &m_cbImageSize);
+
+        // Resolved only after the frame size so that the subclasses can
+        // allocate their frame buffers
+        OnMfMtSubtypeResolved(subtype);
     }
 
 done:
@@ -26,6 +26,7 @@
 class ImageAnalyzer;
 class ImageProcessingUtils;
 class Settings;
+struct SettingsSnapshot;
 
 
 class CAbstractTransform
@@ -195,6 +196,12 @@ protected:
 
     virtual void OnMfMtSubtypeResolved(const GUID subtype);
 
+    // Reads the settings in the properties to the snapshot, only the one
+    // of the key if given. Returns true, if any setting was read.
+    static bool ReadSettings(
+        Windows::Foundation::Collections::IMap<Platform::String^, Platform::Object^>^ properties,
+        Platform::String^ key, SettingsSnapshot& settings);
+
 
 protected: // Members
     CRITICAL_SECTION            m_critSec;
@@ -215,6 +222,8 @@ protected: // Members
     IMFAttributes               *m_pAttributes;
 
     VideoEffect::MessengerInterface ^m_messenger;
+    Windows::Foundation::Collections::IPropertySet ^m_properties;
+    Windows::Foundation::EventRegistrationToken m_propertiesChangedToken;
     ImageAnalyzer *m_imageAnalyzer;
     ImageProcessingUtils *m_imageProcessingUtils;
     Settings *m_settings;
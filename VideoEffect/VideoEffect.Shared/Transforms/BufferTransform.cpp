@@ -5,6 +5,7 @@
 #include "Effects\ChromaFilterEffect.h"
 #include "ImageProcessing\ImageAnalyzer.h"
 #include "ImageProcessing\ImageProcessingUtils.h"
+#include "ImageProcessing\MotionAnalyzer.h"
 #include "ImageProcessing\ObjectDetails.h"
 #include "Settings.h"
 
@@ -35,20 +36,22 @@ typedef void(*UnmanagedEventFromAppHandler)(String^ msg);
 CBufferTransform::CBufferTransform() :
     CAbstractTransform(),
     m_effect(NULL),
+    m_motionAnalyzer(NULL),
+    m_storesProxies(false),
+    m_detectionTask(concurrency::task_from_result()),
+    m_postProcessTask(concurrency::task_from_result()),
     m_currentBufferIndex(0),
     m_numberOfFramesBufferedAfterTriggered(0),
     m_bufferIndexWhenTriggered(-1)
 {
     InitializeCriticalSectionEx(&m_critSec, 3000, 0);
-
-    for (UINT8 i = 0; i < BufferSize; ++i)
-    {
-        m_frameRingBuffer[i] = NULL;
-    }
 }
 
 CBufferTransform::~CBufferTransform()
 {
+    WaitForPostProcessing();
+    ReclaimPostProcessedFrames();
+
     SafeRelease(&m_pInputType);
     SafeRelease(&m_pOutputType);
     SafeRelease(&m_pSample);
@@ -59,6 +62,7 @@ CBufferTransform::~CBufferTransform()
     DeleteCriticalSection(&m_critSec);
 
     delete m_effect;
+    delete m_motionAnalyzer;
 }
 
 
@@ -248,12 +252,16 @@ done:
 //-------------------------------------------------------------------
 // OnMfMtSubtypeResolved
 //
-// Sets the effect based on the given subtype.
+// Sets the effect based on the given subtype and allocates the frame
+// ring buffer for the frame size.
 //-------------------------------------------------------------------
 void CBufferTransform::OnMfMtSubtypeResolved(const GUID subtype)
 {
     CAbstractTransform::OnMfMtSubtypeResolved(subtype);
+    WaitForDetections();
+    delete m_effect;
     m_effect = new ChromaFilterEffect(subtype);
+    AllocateFrameRingBuffer();
 }
 
 
@@ -341,7 +349,7 @@ HRESULT CBufferTransform::ProcessInput(
     {
         m_numberOfFramesBufferedAfterTriggered++;
 
-        if (m_numberOfFramesBufferedAfterTriggered > BufferSize - 3)
+        if (m_numberOfFramesBufferedAfterTriggered > BufferSize() - 3)
         {
             m_messenger->SetState(VideoEffectState::PostProcess);
             m_numberOfFramesBufferedAfterTriggered = 0;
@@ -358,6 +366,9 @@ HRESULT CBufferTransform::ProcessInput(
     {
         //SaveBuffers();
 
+        // Most of the frames have been detected while buffering
+        WaitForDetections();
+
         // Find the object from last frame and the frame which triggered the state change
         UINT8 closestBufferIndexToTriggeredWithObject = 0;
         UINT8 lastBufferIndexWithObject = 0;
@@ -365,7 +376,7 @@ HRESULT CBufferTransform::ProcessInput(
         ObjectDetails objectDetailsFromLastFrame;
 
         UINT8 previousBufferIndexFromTriggeredFrame = PreviousBufferIndex(m_bufferIndexWhenTriggered);
-        UINT8 toIndexFromLastFrame = CalculateBufferIndex(m_currentBufferIndex, -((int)BufferSize) + 3);
+        UINT8 toIndexFromLastFrame = CalculateBufferIndex(m_currentBufferIndex, -((int)BufferSize()) + 3);
 
         if (GetFirstFrameWithObject(
                 m_bufferIndexWhenTriggered, previousBufferIndexFromTriggeredFrame, false,
@@ -375,36 +386,68 @@ HRESULT CBufferTransform::ProcessInput(
                 lastBufferIndexWithObject, objectDetailsFromLastFrame)
             && lastBufferIndexWithObject != closestBufferIndexToTriggeredWithObject)
         {
-            LONG stride = 0;
-            BYTE *lastFrame = m_frameRingBuffer[lastBufferIndexWithObject];
-            BYTE *triggeredFrame = m_frameRingBuffer[closestBufferIndexToTriggeredWithObject];
-
-            bool lastFrameIsLeft = objectDetailsFromLastFrame._centerX < objectDetailsCloseToTriggeredFrame._centerX;
-            UINT32 joinX = (objectDetailsFromLastFrame._centerX + objectDetailsCloseToTriggeredFrame._centerX) / 2;
-
-            BYTE *mergedFrame = NULL;
+            const UINT32 width = m_imageWidthInPixels;
+            const UINT32 height = m_imageHeightInPixels;
+            const GUID videoFormatSubtype = m_videoFormatSubtype;
+            std::vector<UINT8> frameIndices;
+            std::vector<BYTE*> frames;
 
-            if (m_effect->videoFormatSubtype() == MFVideoFormat_NV12)
+            if (m_settings->snapshot()->postProcessComposite)
             {
-                mergedFrame = ImageProcessingUtils::mergeFramesNV12(
-                              (lastFrameIsLeft ? lastFrame : triggeredFrame),
-                              (lastFrameIsLeft ? triggeredFrame : lastFrame),
-                              m_imageWidthInPixels, m_imageHeightInPixels, joinX);
+                std::vector<ObjectDetails> compositeObjectDetails;
+
+                SelectCompositeFrames(
+                    closestBufferIndexToTriggeredWithObject, lastBufferIndexWithObject,
+                    frameIndices, compositeObjectDetails);
+
+                if (frameIndices.empty() || frameIndices.back() != lastBufferIndexWithObject)
+                {
+                    frameIndices.push_back(lastBufferIndexWithObject); // Only the background
+                }
+
+                // Only the selected frames are handed off to the post-processing
+                // task, which composes them and notifies off the streaming thread
+                if (HandOffFrames(frameIndices, frames))
+                {
+                    StroboscopicCompositor compositor(width, height, videoFormatSubtype);
+                    compositor.setBackground(frames.back());
+
+                    for (size_t i = 0; i < compositeObjectDetails.size(); ++i)
+                    {
+                        compositor.addFrame(frames[i], compositeObjectDetails[i]);
+                    }
+
+                    m_postProcessTask = m_postProcessTask.then(
+                        [this, compositor, objectDetailsCloseToTriggeredFrame, objectDetailsFromLastFrame,
+                         width, height, videoFormatSubtype]()
+                        {
+                            ComposeFramesAndNotify(
+                                compositor, objectDetailsCloseToTriggeredFrame, objectDetailsFromLastFrame,
+                                width, height, videoFormatSubtype);
+                        });
+                }
             }
-            else if (m_effect->videoFormatSubtype() == MFVideoFormat_YUY2)
+            else
             {
-                mergedFrame = ImageProcessingUtils::mergeFramesYUY2(
-                              (lastFrameIsLeft ? lastFrame : triggeredFrame),
-                              (lastFrameIsLeft ? triggeredFrame : lastFrame),
-                              m_imageWidthInPixels, m_imageHeightInPixels, joinX);
-            }
-
-            if (mergedFrame)
-            {
-                NotifyPostProcessComplete(mergedFrame, FrameSizeAsUint32(),
-                                          objectDetailsCloseToTriggeredFrame, objectDetailsFromLastFrame);
-
-                delete[] mergedFrame;
+                frameIndices.push_back(lastBufferIndexWithObject);
+                frameIndices.push_back(closestBufferIndexToTriggeredWithObject);
+
+                // Only the two frames are handed off to the post-processing task,
+                // which merges them and notifies off the streaming thread
+                if (HandOffFrames(frameIndices, frames))
+                {
+                    BYTE *lastFrame = frames[0];
+                    BYTE *triggeredFrame = frames[1];
+
+                    m_postProcessTask = m_postProcessTask.then(
+                        [this, lastFrame, triggeredFrame, objectDetailsFromLastFrame, objectDetailsCloseToTriggeredFrame,
+                         width, height, videoFormatSubtype]()
+                        {
+                            MergeFramesAndNotify(
+                                lastFrame, triggeredFrame, objectDetailsFromLastFrame, objectDetailsCloseToTriggeredFrame,
+                                width, height, videoFormatSubtype);
+                        });
+                }
             }
         }
 
@@ -414,19 +457,39 @@ HRESULT CBufferTransform::ProcessInput(
         m_messenger->SetState(VideoEffectState::Idle);
     } // if (m_messenger->State() == VideoEffectState::PostProcess)
     
-    if (m_messenger->State() == VideoEffectState::Locked
+    if ((m_messenger->State() == VideoEffectState::Locked
         || m_messenger->State() == VideoEffectState::Triggered)
+        && BufferSize() > 0)
     {
-        if (m_frameRingBuffer[m_currentBufferIndex])
+        // The previous frame in the slot is overwritten in place, so its
+        // detection must be done first
+        if (m_detectionCache.isPending(m_currentBufferIndex))
         {
-            // Release the previous sample in the index
-            delete[] m_frameRingBuffer[m_currentBufferIndex];
-            m_frameRingBuffer[m_currentBufferIndex] = NULL;
+            WaitForDetections();
         }
 
-        m_frameRingBuffer[m_currentBufferIndex] = CopyFrameFromSample(pSample);
+        const bool stored = StoreFrameFromSample(pSample, m_currentBufferIndex);
 
-        m_currentBufferIndex >= BufferSize - 1 ? m_currentBufferIndex = 0 : m_currentBufferIndex++;
+        // The detection of the frame stored in the slot a lap earlier no
+        // longer applies. The slot is detected once the next frame is in.
+        m_detectionCache.invalidate(m_currentBufferIndex);
+
+        const ObjectDetails *newestObjectDetails = NULL;
+        assert(!m_detectionCache.lookup(m_currentBufferIndex, newestObjectDetails));
+
+        if (stored)
+        {
+            // The motion mask of the previous frame is complete now
+            ScheduleDetection(PreviousBufferIndex(m_currentBufferIndex));
+        }
+
+        if (m_storesProxies && m_currentBufferIndex == m_bufferIndexWhenTriggered)
+        {
+            // Keep the full frames up to the trigger for the merge
+            m_proxyFrameRing.pinNewestFullFrames(ProxyStorageFullFrames / 2);
+        }
+
+        m_currentBufferIndex >= BufferSize() - 1 ? m_currentBufferIndex = 0 : m_currentBufferIndex++;
     }
 
 done:
@@ -472,17 +535,84 @@ inline const UINT32 CBufferTransform::FrameSizeAsUint32() const
 }
 
 
+//-------------------------------------------------------------------
+// BufferSize()
+//
+// Returns the number of frames the ring buffer holds.
+//-------------------------------------------------------------------
+UINT8 CBufferTransform::BufferSize() const
+{
+    return (UINT8)(m_storesProxies ? m_proxyFrameRing.depth() : m_frameRingBuffer.depth());
+}
+
+
+//-------------------------------------------------------------------
+// AllocateFrameRingBuffer
+//
+// Allocates the slots of the ring buffer once for the current frame
+// size and the configured depth and storage. The slots are reused
+// until the media type changes. The motion analyzer exists only if
+// the post-processing uses the motion masks, and its masks are at the
+// resolution of the proxies also when the frames are stored in full.
+//-------------------------------------------------------------------
+void CBufferTransform::AllocateFrameRingBuffer()
+{
+    const std::shared_ptr<const SettingsSnapshot> settings = m_settings->snapshot();
+    const UINT32 depth = (UINT32)clamp<int>(settings->bufferDepth, MinBufferSize, MaxBufferSize);
+    const UINT32 proxyShift = (UINT32)clamp<int>(settings->bufferProxyShift, 1, 3);
+
+    // The frames handed off to the post-processing go back to the ring
+    // they came from before it is reallocated
+    WaitForDetections();
+    WaitForPostProcessing();
+    ReclaimPostProcessedFrames();
+    m_storesProxies = (settings->bufferStorage == ProxyStorage);
+
+    if (m_storesProxies)
+    {
+        m_frameRingBuffer.release();
+        m_proxyFrameRing.allocate(
+            m_imageWidthInPixels, m_imageHeightInPixels, m_videoFormatSubtype, depth,
+            proxyShift, ProxyStorageFullFrames);
+    }
+    else
+    {
+        m_proxyFrameRing.release();
+        m_frameRingBuffer.allocate(FrameSize(), depth);
+    }
+
+    delete m_motionAnalyzer;
+    m_motionAnalyzer = NULL;
+
+    if (settings->postProcessUsesMotionMask && BufferSize() > 0)
+    {
+        m_motionAnalyzer = new MotionAnalyzer(BufferSize(), proxyShift);
+    }
+
+    m_detectionCache.resize(BufferSize());
+    m_detectionBuffer.resize(FrameSize());
+    ClearFrameRingBuffer();
+    m_numberOfFramesBufferedAfterTriggered = 0;
+    m_bufferIndexWhenTriggered = -1;
+}
+
+
 //-------------------------------------------------------------------
 // ClearFrameRingBuffer
 //
-// Resets the frame ring buffer and counters.
+// Resets the frame ring buffer and counters. The slots stay allocated.
 //-------------------------------------------------------------------
 void CBufferTransform::ClearFrameRingBuffer()
 {
-    for (UINT8 i = 0; i < BufferSize; ++i)
+    WaitForDetections();
+    m_detectionCache.clear();
+
+    m_frameRingBuffer.clear();
+    m_proxyFrameRing.clear();
+
+    if (m_motionAnalyzer)
     {
-        delete[] m_frameRingBuffer[i];
-        m_frameRingBuffer[i] = NULL;
+        m_motionAnalyzer->clear();
     }
 
     m_currentBufferIndex = 0;
@@ -496,16 +626,16 @@ void CBufferTransform::ClearFrameRingBuffer()
 //-------------------------------------------------------------------
 inline UINT8 CBufferTransform::CalculateBufferIndex(const UINT8 &originalIndex, const int &delta)
 {
-    assert(abs(delta) < BufferSize);
+    assert(abs(delta) < BufferSize());
     int index = (int)originalIndex + delta;
 
     if (index < 0)
     {
-        index = BufferSize + index;
+        index = BufferSize() + index;
     }
-    else if (index > BufferSize - 1)
+    else if (index > BufferSize() - 1)
     {
-        index = index - BufferSize;
+        index = index - BufferSize();
     }
 
     return (UINT8)index;
@@ -523,7 +653,7 @@ inline UINT8 CBufferTransform::PreviousBufferIndex(const UINT8 &bufferIndex)
 
     if ((int)bufferIndex - 1 < 0)
     {
-        previousIndex = BufferSize - 1;
+        previousIndex = BufferSize() - 1;
     }
 
     return previousIndex;
@@ -531,14 +661,51 @@ inline UINT8 CBufferTransform::PreviousBufferIndex(const UINT8 &bufferIndex)
 
 
 //-------------------------------------------------------------------
-// CopyFrameFromSample
+// FullFrame
 //
-// Copies the frame from the given sample.
-// Returns a newly created frame or NULL in case of an error.
+// Returns the full resolution frame in the given buffer index or NULL,
+// if the slot is empty or only the proxy of the frame was kept.
 //-------------------------------------------------------------------
-BYTE* CBufferTransform::CopyFrameFromSample(IMFSample *pSample)
+BYTE *CBufferTransform::FullFrame(const UINT8 &bufferIndex) const
 {
-    BYTE *frame = NULL;
+    return m_storesProxies ? m_proxyFrameRing.fullFrame(bufferIndex) : m_frameRingBuffer.frame(bufferIndex);
+}
+
+
+//-------------------------------------------------------------------
+// KeepsFullFrame
+//
+// With proxy storage, tells whether the frame being stored is copied
+// in full. The post-processing merges only frames up to the trigger
+// and the newest frames before it starts. The trigger cannot be
+// foreseen, so the frames are kept until the trigger frame, but the
+// frames after it are kept only once they are among the newest.
+//-------------------------------------------------------------------
+bool CBufferTransform::KeepsFullFrame() const
+{
+    if (m_messenger->State() != VideoEffectState::Triggered || m_numberOfFramesBufferedAfterTriggered <= 1)
+    {
+        return true;
+    }
+
+    // The post-processing starts after BufferSize() - 3 frames
+    const int framesUntilPostProcess = (int)BufferSize() - 3 - (int)m_numberOfFramesBufferedAfterTriggered;
+    return framesUntilPostProcess < ProxyStorageFullFrames / 2;
+}
+
+
+//-------------------------------------------------------------------
+// StoreFrameFromSample
+//
+// Stores the frame from the given sample to the given buffer index
+// and analyzes its motion, if the motion masks are used. The frame is
+// analyzed as it enters the buffer instead of all at once when
+// post-processing.
+// Returns true, if successful, false otherwise.
+//-------------------------------------------------------------------
+bool CBufferTransform::StoreFrameFromSample(IMFSample *pSample, const UINT8 &bufferIndex)
+{
+    bool success = false;
 
     if (pSample)
     {
@@ -549,17 +716,55 @@ BYTE* CBufferTransform::CopyFrameFromSample(IMFSample *pSample)
         DWORD maxLength = 0;
         DWORD currentLength = 0;
 
-        mediaBuffer->Lock(&start, &maxLength, &currentLength);
+        if (mediaBuffer && SUCCEEDED(mediaBuffer->Lock(&start, &maxLength, &currentLength)))
+        {
+            const size_t frameSize = FrameSize();
+
+            if (currentLength >= frameSize)
+            {
+                // A slot handed off to the post-processing takes back the
+                // storage of a finished one, if any
+                ReclaimPostProcessedFrames();
+
+                if (m_storesProxies)
+                {
+                    m_proxyFrameRing.addFrame(bufferIndex, start, KeepsFullFrame());
+                    success = true;
+                }
+                else if (m_frameRingBuffer.prepareSlot(bufferIndex))
+                {
+                    memcpy(m_frameRingBuffer.slot(bufferIndex), start, frameSize);
+                    success = true;
+                }
+
+                if (success && m_motionAnalyzer)
+                {
+                    m_motionAnalyzer->addFrame(
+                        bufferIndex, start,
+                        m_imageWidthInPixels, m_imageHeightInPixels, m_videoFormatSubtype,
+                        (BYTE)m_settings->snapshot()->motionThreshold);
+                }
+            }
 
-        size_t frameSize = FrameSize();
-        frame = (BYTE*)malloc(frameSize);
-        memcpy(frame, start, frameSize);
+            mediaBuffer->Unlock();
+        }
 
-        mediaBuffer->Unlock();
         SafeRelease(&mediaBuffer);
     }
 
-    return frame;
+    if (m_storesProxies)
+    {
+        if (!success)
+        {
+            m_proxyFrameRing.addFrame(bufferIndex, NULL, false);
+        }
+    }
+    else
+    {
+        m_frameRingBuffer.setFilled(bufferIndex, success);
+    }
+
+    return success;
 }
 
 
@@ -623,9 +828,9 @@ void CBufferTransform::NotifyFrameCaptured(BYTE *pFrame, const UINT32 &frameSize
 //-------------------------------------------------------------------
 void CBufferTransform::NotifyFrameCaptured(const UINT8 &frameIndex, const int &frameId)
 {
-    if (m_frameRingBuffer[frameIndex])
+    if (FullFrame(frameIndex))
     {
-        NotifyFrameCaptured(m_frameRingBuffer[frameIndex], FrameSizeAsUint32(), frameId);
+        NotifyFrameCaptured(FullFrame(frameIndex), FrameSizeAsUint32(), frameId);
     }
 }
 
@@ -668,7 +873,7 @@ void CBufferTransform::NotifyFrameCaptured(IMFSample *pSample, const int &frameI
 //
 //-------------------------------------------------------------------
 void CBufferTransform::NotifyPostProcessComplete(
-    BYTE *pFrame, const UINT32 &frameSize,
+    BYTE *pFrame, const UINT32 &frameSize, const UINT32 &width, const UINT32 &height,
     const ObjectDetails &fromObjectDetails, const ObjectDetails &toObjectDetails)
 {
     if (pFrame)
@@ -676,13 +881,208 @@ void CBufferTransform::NotifyPostProcessComplete(
         Array<byte>^ array = ref new Array<byte>(pFrame, frameSize);
 
         m_messenger->NotifyPostProcessComplete(
-            array, (int)m_imageWidthInPixels, (int)m_imageHeightInPixels,
+            array, (int)width, (int)height,
             (int)fromObjectDetails._centerX, (int)fromObjectDetails._centerY, (int)fromObjectDetails._width, (int)fromObjectDetails._height,
             (int)toObjectDetails._centerX, (int)toObjectDetails._centerY, (int)toObjectDetails._width, (int)toObjectDetails._height);
     }
 }
 
 
+//-------------------------------------------------------------------
+// HandOffFrames
+//
+// Hands the frames in the given buffer indices over to the
+// post-processing task by detaching their storage from the ring, so
+// that nothing is copied and the ring can be reused right away. The
+// slots take the storage of the finished post-processings back, see
+// ReclaimPostProcessedFrames.
+//
+// Returns false, if a frame is not kept in full resolution.
+//-------------------------------------------------------------------
+bool CBufferTransform::HandOffFrames(const std::vector<UINT8> &frameIndices, std::vector<BYTE*> &frames)
+{
+    frames.clear();
+
+    for (size_t i = 0; i < frameIndices.size(); ++i)
+    {
+        if (!FullFrame(frameIndices[i]))
+        {
+            return false;
+        }
+    }
+
+    ReclaimPostProcessedFrames();
+
+    for (size_t i = 0; i < frameIndices.size(); ++i)
+    {
+        BYTE *frame = m_storesProxies
+            ? m_proxyFrameRing.detachFullFrame(frameIndices[i])
+            : m_frameRingBuffer.detach(frameIndices[i]);
+
+        frames.push_back(frame);
+        m_postProcessFrames.push_back(frame);
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// ReclaimPostProcessedFrames
+//
+// Gives the frames handed off to the post-processing back to the ring
+// once all the post-processings are done.
+//-------------------------------------------------------------------
+void CBufferTransform::ReclaimPostProcessedFrames()
+{
+    if (m_postProcessFrames.empty() || !m_postProcessTask.is_done())
+    {
+        return;
+    }
+
+    for (BYTE *frame : m_postProcessFrames)
+    {
+        if (m_storesProxies)
+        {
+            m_proxyFrameRing.reclaimFullFrame(frame);
+        }
+        else
+        {
+            m_frameRingBuffer.reclaim(frame);
+        }
+    }
+
+    m_postProcessFrames.clear();
+}
+
+
+//-------------------------------------------------------------------
+// WaitForPostProcessing
+//
+// Blocks until the post-processing task is done with its frames.
+//-------------------------------------------------------------------
+void CBufferTransform::WaitForPostProcessing()
+{
+    m_postProcessTask.wait();
+    m_postProcessTask = concurrency::task_from_result();
+}
+
+
+//-------------------------------------------------------------------
+// MergeFramesAndNotify
+//
+// Merges the frames at the midpoint of the objects and notifies the
+// result. Runs in the post-processing task, so the frames must have
+// been handed off to it and the other arguments must not depend on
+// the streaming state.
+//-------------------------------------------------------------------
+void CBufferTransform::MergeFramesAndNotify(
+    BYTE *pLastFrame, BYTE *pTriggeredFrame,
+    const ObjectDetails &lastObjectDetails, const ObjectDetails &triggeredObjectDetails,
+    const UINT32 &width, const UINT32 &height, const GUID &videoFormatSubtype)
+{
+    bool lastFrameIsLeft = lastObjectDetails._centerX < triggeredObjectDetails._centerX;
+    UINT32 joinX = (lastObjectDetails._centerX + triggeredObjectDetails._centerX) / 2;
+
+    BYTE *mergedFrame = NULL;
+
+    if (videoFormatSubtype == MFVideoFormat_NV12)
+    {
+        mergedFrame = ImageProcessingUtils::mergeFramesNV12(
+                      (lastFrameIsLeft ? pLastFrame : pTriggeredFrame),
+                      (lastFrameIsLeft ? pTriggeredFrame : pLastFrame),
+                      width, height, joinX);
+    }
+    else if (videoFormatSubtype == MFVideoFormat_YUY2)
+    {
+        mergedFrame = ImageProcessingUtils::mergeFramesYUY2(
+                      (lastFrameIsLeft ? pLastFrame : pTriggeredFrame),
+                      (lastFrameIsLeft ? pTriggeredFrame : pLastFrame),
+                      width, height, joinX);
+    }
+
+    if (mergedFrame)
+    {
+        NotifyPostProcessComplete(
+            mergedFrame, (UINT32)ImageProcessingUtils::frameSize(width, height, videoFormatSubtype),
+            width, height, triggeredObjectDetails, lastObjectDetails);
+
+        delete[] mergedFrame;
+    }
+}
+
+
+//-------------------------------------------------------------------
+// SelectCompositeFrames
+//
+// Selects the frames from the given index forward to the other given
+// index for the composite. A frame is skipped, if its object overlaps
+// the object of the previously selected frame, so that the positions
+// of the object stay apart.
+//-------------------------------------------------------------------
+void CBufferTransform::SelectCompositeFrames(
+    const UINT8 &fromFrameIndex, const UINT8 &toFrameIndex,
+    std::vector<UINT8> &frameIndices, std::vector<ObjectDetails> &objectDetailsOfFrames)
+{
+    const UINT32 objectMinWidth = (UINT32)((float)m_imageWidthInPixels * RelativeObjectSizeThreshold);
+    ObjectDetails previousObjectDetails;
+    bool hasPrevious = false;
+    UINT8 index = fromFrameIndex;
+
+    do
+    {
+        ObjectDetails *objectDetails = GetObjectFromFrame(index);
+
+        if (objectDetails && objectDetails->_width >= objectMinWidth)
+        {
+            const int dx = (int)objectDetails->_centerX - (int)previousObjectDetails._centerX;
+            const int dy = (int)objectDetails->_centerY - (int)previousObjectDetails._centerY;
+            const int minDistance = (int)max(objectDetails->_width, previousObjectDetails._width);
+
+            if (!hasPrevious || dx * dx + dy * dy >= minDistance * minDistance || index == toFrameIndex)
+            {
+                frameIndices.push_back(index);
+                objectDetailsOfFrames.push_back(*objectDetails);
+                previousObjectDetails = *objectDetails;
+                hasPrevious = true;
+            }
+        }
+
+        delete objectDetails;
+
+        if (index == toFrameIndex)
+        {
+            break;
+        }
+
+        index = (index >= BufferSize() - 1) ? 0 : index + 1;
+    } while (true);
+}
+
+
+//-------------------------------------------------------------------
+// ComposeFramesAndNotify
+//
+// Composes the frames and notifies the result. Runs in the
+// post-processing task like MergeFramesAndNotify.
+//-------------------------------------------------------------------
+void CBufferTransform::ComposeFramesAndNotify(
+    const StroboscopicCompositor &compositor,
+    const ObjectDetails &firstObjectDetails, const ObjectDetails &lastObjectDetails,
+    const UINT32 &width, const UINT32 &height, const GUID &videoFormatSubtype)
+{
+    const UINT32 frameSize = (UINT32)ImageProcessingUtils::frameSize(width, height, videoFormatSubtype);
+    BYTE *composite = new BYTE[frameSize];
+
+    if (compositor.compose(composite))
+    {
+        NotifyPostProcessComplete(composite, frameSize, width, height, firstObjectDetails, lastObjectDetails);
+    }
+
+    delete[] composite;
+}
+
+
 //-------------------------------------------------------------------
 // SaveBuffers
 //
@@ -693,7 +1093,7 @@ void CBufferTransform::SaveBuffers()
     int r = rand();
     int frameCounter = 0;
 
-    for (UINT32 i = m_currentBufferIndex + 1; i < BufferSize; ++i)
+    for (UINT32 i = m_currentBufferIndex + 1; i < BufferSize(); ++i)
     {
         SaveBuffer(i, frameCounter, r);
         frameCounter++;
@@ -714,47 +1114,194 @@ void CBufferTransform::SaveBuffers()
 //-------------------------------------------------------------------
 void CBufferTransform::SaveBuffer(const UINT8 &frameIndex, const int &frameCounter, const int &seriesIdentifier)
 {
-    if (m_frameRingBuffer[frameIndex])
+    if (FullFrame(frameIndex))
     {
-        Array<byte>^ array = ref new Array<byte>(m_frameRingBuffer[frameIndex], FrameSizeAsUint32());
+        Array<byte>^ array = ref new Array<byte>(FullFrame(frameIndex), FrameSizeAsUint32());
         m_messenger->SaveFrame(array, m_imageWidthInPixels, m_imageHeightInPixels, frameCounter, seriesIdentifier);
     }
 }
 
 
 //-------------------------------------------------------------------
-// GetObjectFromFrame
+// ScheduleDetection
 //
+// Detects the object from the given frame in the background. The
+// frame and its motion mask must be complete.
+//-------------------------------------------------------------------
+void CBufferTransform::ScheduleDetection(const UINT8 &frameIndex)
+{
+    BYTE *frame = NULL;
+    UINT32 width = 0;
+    UINT32 height = 0;
+    UINT32 scale = 1;
+    bool usesMotionMask = false;
+
+    if (!m_effect || !GetDetectionSource(frameIndex, &frame, width, height, scale, usesMotionMask))
+    {
+        return;
+    }
+
+    if (m_detectionCache.isPending(frameIndex))
+    {
+        WaitForDetections();
+    }
+
+    const UINT32 sequence = m_detectionCache.schedule(frameIndex);
+
+    m_detectionTask = m_detectionTask.then(
+        [this, frameIndex, frame, width, height, scale, usesMotionMask, sequence]()
+        {
+            ObjectDetails *objectDetails = DetectObject(frameIndex, frame, width, height, scale, usesMotionMask);
+            m_detectionCache.store(frameIndex, sequence, objectDetails);
+            delete objectDetails;
+        },
+        concurrency::task_continuation_context::use_arbitrary());
+}
+
+
+//-------------------------------------------------------------------
+// WaitForDetections
 //
+// Blocks until the scheduled detections are done.
 //-------------------------------------------------------------------
-ObjectDetails* CBufferTransform::GetObjectFromFrame(const UINT8 &frameIndex)
+void CBufferTransform::WaitForDetections()
+{
+    m_detectionTask.wait();
+    m_detectionTask = concurrency::task_from_result();
+}
+
+
+//-------------------------------------------------------------------
+// GetDetectionSource
+//
+// Resolves the frame (or its proxy) to detect the object from. If so
+// configured and the motion mask of the frame is available, the mask
+// is used instead of the frame.
+//
+// Returns false, if the frame is not kept in full resolution since
+// such a frame cannot be merged.
+//-------------------------------------------------------------------
+bool CBufferTransform::GetDetectionSource(
+    const UINT8 &frameIndex, BYTE **ppFrame, UINT32 &width, UINT32 &height,
+    UINT32 &scale, bool &usesMotionMask) const
+{
+    *ppFrame = FullFrame(frameIndex);
+
+    if (!*ppFrame)
+    {
+        return false;
+    }
+
+    width = m_imageWidthInPixels;
+    height = m_imageHeightInPixels;
+    scale = 1;
+    usesMotionMask = m_motionAnalyzer && m_motionAnalyzer->hasMotionMask(frameIndex);
+
+    if (usesMotionMask)
+    {
+        width = m_motionAnalyzer->maskWidth();
+        height = m_motionAnalyzer->maskHeight();
+        scale = m_motionAnalyzer->scale();
+    }
+    else if (m_storesProxies && m_proxyFrameRing.proxy(frameIndex))
+    {
+        *ppFrame = m_proxyFrameRing.proxy(frameIndex);
+        width = m_proxyFrameRing.proxyWidth();
+        height = m_proxyFrameRing.proxyHeight();
+        scale = m_proxyFrameRing.scale();
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// DetectObject
+//
+// Applies the effect to the given frame, or renders the motion mask,
+// and searches the object. The details are scaled to the frame.
+//
+// Note: Runs in the detection task, so this must not touch the state
+// the buffering changes.
+//-------------------------------------------------------------------
+ObjectDetails* CBufferTransform::DetectObject(
+    const UINT8 &frameIndex, BYTE *pFrame, const UINT32 &width, const UINT32 &height,
+    const UINT32 &scale, const bool &usesMotionMask)
 {
     ObjectDetails *objectDetails = NULL;
-    BYTE *frame = m_frameRingBuffer[frameIndex];
+    LONG stride = width;
+    D2D_RECT_U rcDest = D2D1::RectU(0, 0, width, height);
+    size_t frameSize = ImageProcessingUtils::frameSize(width, height, m_videoFormatSubtype);
+    BYTE *processedFrame = m_detectionBuffer.data();
 
-    if (m_effect && frame)
+    if (usesMotionMask)
+    {
+        m_motionAnalyzer->renderMotionMask(frameIndex, processedFrame);
+    }
+    else
     {
-        LONG stride = m_imageWidthInPixels;
-        m_rcDest = D2D1::RectU(0, 0, m_imageWidthInPixels, m_imageHeightInPixels);
-        size_t frameSize = FrameSize();
-        BYTE *processedFrame = (BYTE*)malloc(frameSize);
-        memcpy(processedFrame, frame, frameSize);
+        memcpy(processedFrame, pFrame, frameSize);
 
         dynamic_cast<ChromaFilterEffect*>(m_effect)->setDimmUnselectedPixels(false);
         m_effect->apply(
-            m_rcDest, processedFrame, stride, frame, stride,
-            m_imageWidthInPixels, m_imageHeightInPixels);
+            rcDest, processedFrame, stride, pFrame, stride,
+            width, height);
+    }
+
+    ConvexHull *convexHull =
+        m_imageAnalyzer->extractBestCircularConvexHull(
+            processedFrame, width, height, 3, m_effect->videoFormatSubtype());
+
+    if (convexHull)
+    {
+        objectDetails = m_imageAnalyzer->convexHullMinimalEnclosingCircleAsObjectDetails(*convexHull);
+    }
+
+    if (objectDetails && scale > 1)
+    {
+        objectDetails->_centerX = objectDetails->_centerX * scale + scale / 2;
+        objectDetails->_centerY = objectDetails->_centerY * scale + scale / 2;
+        objectDetails->_width *= scale;
+        objectDetails->_height *= scale;
+        objectDetails->_area *= scale * scale;
+    }
+
+    return objectDetails;
+}
+
 
-        ConvexHull *convexHull =
-            m_imageAnalyzer->extractBestCircularConvexHull(
-                processedFrame, m_imageWidthInPixels, m_imageHeightInPixels, 3, m_effect->videoFormatSubtype());
+//-------------------------------------------------------------------
+// GetObjectFromFrame
+//
+// Returns the cached detection of the frame, if any, and detects the
+// object otherwise. The detections must have been waited for.
+//-------------------------------------------------------------------
+ObjectDetails* CBufferTransform::GetObjectFromFrame(const UINT8 &frameIndex)
+{
+    ObjectDetails *objectDetails = NULL;
+    const ObjectDetails *cachedObjectDetails = NULL;
+    BYTE *frame = NULL;
+    UINT32 width = 0;
+    UINT32 height = 0;
+    UINT32 scale = 1;
+    bool usesMotionMask = false;
 
-        if (convexHull)
+    if (!m_effect || !GetDetectionSource(frameIndex, &frame, width, height, scale, usesMotionMask))
+    {
+        return NULL;
+    }
+
+    if (m_detectionCache.lookup(frameIndex, cachedObjectDetails))
+    {
+        if (cachedObjectDetails)
         {
-            objectDetails = m_imageAnalyzer->convexHullMinimalEnclosingCircleAsObjectDetails(*convexHull);
+            objectDetails = new ObjectDetails();
+            *objectDetails = *cachedObjectDetails;
         }
-
-        delete[] processedFrame;
+    }
+    else
+    {
+        objectDetails = DetectObject(frameIndex, frame, width, height, scale, usesMotionMask);
     }
 
     return objectDetails;
@@ -774,7 +1321,7 @@ bool CBufferTransform::GetFirstFrameWithObject(
     const UINT8 &fromFrameIndex, const UINT8 &toFrameIndex, const bool &seekForward,
     UINT8 &frameIndexWithObject, ObjectDetails &objectDetails)
 {
-    assert(fromFrameIndex < BufferSize && toFrameIndex < BufferSize);
+    assert(fromFrameIndex < BufferSize() && toFrameIndex < BufferSize());
 
     bool found = false;
     ObjectDetails *currentObjectDetails = NULL;
@@ -803,13 +1350,13 @@ bool CBufferTransform::GetFirstFrameWithObject(
 
         index += seekForward ? 1 : -1;
 
-        if (index > BufferSize)
+        if (index >= BufferSize())
         {
             index = 0;
         }
         else if (index < 0)
         {
-            index = BufferSize - 1;
+            index = BufferSize() - 1;
         }
     } while (true);
 
@@ -22,9 +22,14 @@
 
 #include "AbstractTransform.h"
 #include "Common.h"
+#include "ImageProcessing\DetectionCache.h"
+#include "ImageProcessing\FrameRingBuffer.h"
+#include "ImageProcessing\ProxyFrameRing.h"
+#include "ImageProcessing\StroboscopicCompositor.h"
 #include "Interop\MessengerInterface.h"
 
 class AbstractEffect;
+class MotionAnalyzer;
 class VideoBufferLock;
 
 /*
@@ -36,7 +41,9 @@ DEFINE_GUID(CLSID_BufferTransformMFT,
 
 
 // Constants
-const UINT8 BufferSize = 35;
+const UINT8 MinBufferSize = 4; // Post-processing needs frames on both sides of the trigger
+const UINT8 MaxBufferSize = 255;
+const UINT8 ProxyStorageFullFrames = 8; // Half pinned at the trigger, half following the newest frames
 
 
 class CBufferTransform WrlSealed : public CAbstractTransform
@@ -64,10 +71,14 @@ private: // New methods
     const size_t FrameSize() const;
     const UINT32 FrameSizeAsUint32() const;
 
+    UINT8 BufferSize() const;
+    void AllocateFrameRingBuffer();
     void ClearFrameRingBuffer();
     UINT8 CalculateBufferIndex(const UINT8 &originalIndex, const int &delta);
     UINT8 PreviousBufferIndex(const UINT8 &bufferIndex);
-    BYTE* CopyFrameFromSample(IMFSample *sample);
+    BYTE *FullFrame(const UINT8 &bufferIndex) const;
+    bool KeepsFullFrame() const;
+    bool StoreFrameFromSample(IMFSample *pSample, const UINT8 &bufferIndex);
     bool GetFrameFromSample(IMFSample *pSample, BYTE **ppFrame, LONG &lStride, VideoBufferLock **ppVideoBufferLock);
 
     void NotifyFrameCaptured(BYTE *pFrame, const UINT32 &frameSize, const int &frameId);
@@ -75,9 +86,38 @@ private: // New methods
     void NotifyFrameCaptured(const UINT8 &frameIndex, const int &frameId);
     
     void NotifyPostProcessComplete(
-        BYTE *pFrame, const UINT32 &frameSize,
+        BYTE *pFrame, const UINT32 &frameSize, const UINT32 &width, const UINT32 &height,
         const ObjectDetails &fromObjectDetails, const ObjectDetails &toObjectDetails);
 
+    bool HandOffFrames(const std::vector<UINT8> &frameIndices, std::vector<BYTE*> &frames);
+    void ReclaimPostProcessedFrames();
+    void WaitForPostProcessing();
+
+    void MergeFramesAndNotify(
+        BYTE *pLastFrame, BYTE *pTriggeredFrame,
+        const ObjectDetails &lastObjectDetails, const ObjectDetails &triggeredObjectDetails,
+        const UINT32 &width, const UINT32 &height, const GUID &videoFormatSubtype);
+
+    void SelectCompositeFrames(
+        const UINT8 &fromFrameIndex, const UINT8 &toFrameIndex,
+        std::vector<UINT8> &frameIndices, std::vector<ObjectDetails> &objectDetailsOfFrames);
+
+    void ComposeFramesAndNotify(
+        const StroboscopicCompositor &compositor,
+        const ObjectDetails &firstObjectDetails, const ObjectDetails &lastObjectDetails,
+        const UINT32 &width, const UINT32 &height, const GUID &videoFormatSubtype);
+
+    void ScheduleDetection(const UINT8 &frameIndex);
+    void WaitForDetections();
+
+    bool GetDetectionSource(
+        const UINT8 &frameIndex, BYTE **ppFrame, UINT32 &width, UINT32 &height,
+        UINT32 &scale, bool &usesMotionMask) const;
+
+    ObjectDetails *DetectObject(
+        const UINT8 &frameIndex, BYTE *pFrame, const UINT32 &width, const UINT32 &height,
+        const UINT32 &scale, const bool &usesMotionMask);
+
     void SaveBuffers();
     void SaveBuffer(const UINT8 &frameIndex, const int &frameCounter, const int &seriesIdentifier);
     ObjectDetails *GetObjectFromFrame(const UINT8 &frameIndex);
@@ -88,7 +128,15 @@ private: // New methods
 
 private: // Members
     AbstractEffect *m_effect;
-    std::vector<BYTE*> m_frameRingBuffer = std::vector<BYTE*>(BufferSize);
+    MotionAnalyzer *m_motionAnalyzer;
+    FrameRingBuffer m_frameRingBuffer;
+    ProxyFrameRing m_proxyFrameRing;
+    bool m_storesProxies;
+    DetectionCache m_detectionCache;
+    concurrency::task<void> m_detectionTask; // Detections run one at a time
+    std::vector<BYTE> m_detectionBuffer;
+    std::vector<BYTE*> m_postProcessFrames; // Detached from the ring, owned by the post-processing tasks until reclaimed
+    concurrency::task<void> m_postProcessTask; // The last one, post-processings run one at a time
     UINT8 m_currentBufferIndex;
     UINT8 m_numberOfFramesBufferedAfterTriggered;
     int m_bufferIndexWhenTriggered;
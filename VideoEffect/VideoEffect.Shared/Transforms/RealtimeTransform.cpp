@@ -41,11 +41,12 @@ ActivatableClass(CRealtimeTransform);
 
 
 // Constants
-const float RelativeJitterThresholdForItemLock = 1.0f; // Jitter relative to item size (0.5 means the jitter cannot exceed half of item size)
-const float RelativeJitterThresholdForDetectingMovement = 0.8f;
-const float RelativeTargetCropPadding = RelativeJitterThresholdForItemLock - 0.5f; // Padding size relative to item size
-const int NumberOfIterationsNeededForItemLock = 5;
-const int NumberOfOperationTimeMeasurementsNeededForAverage = 10;
+const float RelativeTargetCropPadding = 0.5f; // Padding size relative to item size
+const int StageReportIntervalInFrames = 30;
+const float RelativeAcquisitionPadding = 0.5f; // Padding of the acquired candidate relative to its size
+const UINT32 AnalysisQueueCapacity = 2; // Frames waiting for or in the pipelined analysis
+const UINT32 MotionPyramidLevel = 2; // The camera motion is estimated on a quarter of the resolution
+const float MinAppearanceConfidence = 0.5f; // Correlation of the appearance match below which the target is lost
 
 
 
@@ -53,33 +54,35 @@ CRealtimeTransform::CRealtimeTransform() :
     CAbstractTransform(),
     m_effect(NULL),
     m_noiseRemovalEffect(NULL),
+    m_acquisitionEffect(NULL),
+    m_targetId(0),
+    m_analysisTask(concurrency::task_from_result()),
+    m_analysisGeneration(0),
+    m_rejectedAnalysisCount(0),
+    m_analyzing(false),
+    m_framesSinceStageReport(0),
+    m_state(VideoEffectState::Idle),
 
     m_itemX(0),
     m_itemY(0),
     m_itemWidth(0),
     m_itemHeight(0),
-    m_targetLockIterations(0),
     m_targetLocked(false),
-    m_targetWasJustLocked(false),
-
-    m_operationTimeMeasurementAverageInMilliseconds(0),
-    m_operationTimeMeasurementCounter(0)
+    m_targetWasJustLocked(false)
 {
     InitializeCriticalSectionEx(&m_critSec, 3000, 0);
-
-    m_systemTime0 = new SYSTEMTIME();
-    m_systemTime1 = new SYSTEMTIME();
-
-    m_operationTimeMeasurementsInMilliseconds = new WORD[NumberOfOperationTimeMeasurementsNeededForAverage];
+    m_imageAnalyzer->setStageProfiler(&m_stageProfiler);
+    m_analysisQueue.setCapacity(AnalysisQueueCapacity);
+    m_analysisJobs.resize(AnalysisQueueCapacity);
 }
 
 CRealtimeTransform::~CRealtimeTransform()
 {
-    delete m_systemTime0;
-    delete m_systemTime1;
-    delete m_operationTimeMeasurementsInMilliseconds;
+    WaitForAnalysis();
+
     delete m_effect;
     delete m_noiseRemovalEffect;
+    delete m_acquisitionEffect;
 }
 
 // Initialize the instance.
@@ -168,25 +171,7 @@ HRESULT CRealtimeTransform::ProcessOutput(
         goto done;
     }
 
-    if (m_messenger)
-    {
-        if (m_messenger->IsSettingsChangedFlagRaised())
-        {
-            // Get the changed settings
-            m_settings->m_threshold = m_messenger->Threshold();
-            m_settings->setTargetYuv(m_messenger->TargetYuv());
-            m_settings->m_removeNoise = m_messenger->RemoveNoise();
-            m_settings->m_applyEffectOnly = m_messenger->ApplyEffectOnly();
-            ClearTargetLock();
-        }
-
-        if ((m_messenger->State() != VideoEffectState::Locked
-             && m_messenger->State() != VideoEffectState::Triggered)
-            && m_messenger->IsModeChangedFlagRaised())
-        {
-            SetMode((Mode)m_messenger->Mode());
-        }
-    }
+    UpdateSettings();
 
     hr = OnProcessOutput(pInput, pOutput);
 
@@ -227,6 +212,47 @@ done:
 }
 
 
+//-------------------------------------------------------------------
+// UpdateSettings
+//
+// Reads the state of the messenger and its changes once per frame,
+// and takes the settings snapshot of the frame. The settings published
+// since the previous frame, by the messenger or through the properties,
+// clear the target lock. TransformFrame reads only the snapshot and
+// the state read here.
+//-------------------------------------------------------------------
+void CRealtimeTransform::UpdateSettings()
+{
+    if (m_messenger)
+    {
+        if (m_messenger->IsSettingsChangedFlagRaised())
+        {
+            // Get the changed settings
+            m_settings->setStreamingSettings(
+                m_messenger->Threshold(), m_messenger->TargetYuv(),
+                m_messenger->RemoveNoise(), m_messenger->ApplyEffectOnly());
+        }
+
+        m_state = (VideoEffectState)m_messenger->State();
+
+        if ((m_state != VideoEffectState::Locked && m_state != VideoEffectState::Triggered)
+            && m_messenger->IsModeChangedFlagRaised())
+        {
+            SetMode((Mode)m_messenger->Mode());
+        }
+    }
+
+    const std::shared_ptr<const SettingsSnapshot> snapshot = m_settings->snapshot();
+
+    if (m_snapshot && snapshot->version != m_snapshot->version)
+    {
+        ClearTargetLock();
+    }
+
+    m_snapshot = snapshot;
+}
+
+
 //-------------------------------------------------------------------
 // OnProcessOutput
 //
@@ -234,6 +260,8 @@ done:
 //-------------------------------------------------------------------
 HRESULT CRealtimeTransform::OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut)
 {
+    const LONGLONG frameStartTimestamp = StageProfiler::timestamp();
+
     BYTE *pDest = NULL;         // Destination buffer.
     LONG lDestStride = 0;       // Destination stride.
 
@@ -270,187 +298,480 @@ HRESULT CRealtimeTransform::OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer
         goto done;
     }
 
+    m_stageProfiler.record(LockStage, frameStartTimestamp);
+
     // Invoke the image transform function.
+    TransformFrame(pDest, lDestStride, pSrc, lSrcStride, frameStartTimestamp);
 
-    GetSystemTime(m_systemTime0);
+    m_stageProfiler.record(FrameStage, frameStartTimestamp);
 
-    if (m_messenger->State() == VideoEffectState::Idle
-        || m_messenger->State() == VideoEffectState::Triggered
-        || m_messenger->State() == VideoEffectState::PostProcess
-        || m_settings->m_mode == Mode::Passthrough)
+    if (++m_framesSinceStageReport >= StageReportIntervalInFrames)
     {
-        // No transform - simply copy the frame
-        UINT32 arrayLength = lDestStride * m_imageHeightInPixels;
+        ReportStageDurations();
+        m_framesSinceStageReport = 0;
+    }
 
-        if (m_videoFormatSubtype == MFVideoFormat_NV12)
-        {
-#pragma warning(push)
-#pragma warning(disable: 4244)
-            arrayLength *= 1.5f;
-#pragma warning(pop)
-        }
+    // Set the data size on the output buffer.
+    hr = pOut->SetCurrentLength(m_cbImageSize);
+
+    // The VideoBufferLock class automatically unlocks the buffers.
+done:
+    return hr;
+}
+
+
+//-------------------------------------------------------------------
+// TransformFrame
+//
+// Applies the effect and the analysis of the current state, or
+// passes the frame, and draws the overlays.
+//-------------------------------------------------------------------
+void CRealtimeTransform::TransformFrame(
+    BYTE *pDest, const LONG &lDestStride, BYTE *pSrc, const LONG &lSrcStride,
+    const LONGLONG &frameStartTimestamp)
+{
+    const SchedulingPolicy policy = (SchedulingPolicy)m_snapshot->schedulingPolicy;
+    const bool analyzing =
+        (m_state == VideoEffectState::Locking || m_state == VideoEffectState::Locked)
+        && m_snapshot->mode != Mode::Passthrough;
+    bool analyzed = analyzing && m_scheduler.shouldAnalyze(policy);
+
+    if (m_analyzing && !analyzing)
+    {
+        // The queued analyses use the noise removal effect, which is
+        // applied here from now on. Their results no longer apply.
+        WaitForAnalysis();
+        m_analysisMailbox.take();
+    }
+
+    m_analyzing = analyzing;
+
+    // The result of the pipelined analysis of an earlier frame, if done
+    const AnalysisResult *pipelinedResult = m_analysisMailbox.take();
+
+    if (!analyzing)
+    {
+        m_overlays.clear();
+    }
+    else if (pipelinedResult)
+    {
+        m_scheduler.addAnalysis(pipelinedResult->duration, policy);
+        ApplyAnalysisResult(*pipelinedResult);
+    }
+
+    if (analyzing && !analyzed)
+    {
+        // Not analyzed to keep up with the camera, the frame is passed
+        // with the overlays of the last analyzed frame
+        CopyFrame(pDest, lDestStride, pSrc);
 
-        CopyMemory(pDest, pSrc, arrayLength);
+        // The trackers predict per frame regardless of the cadence
+        m_targets.predict();
+    }
+    else if (!analyzing)
+    {
+        // No transform - simply copy the frame
+        CopyFrame(pDest, lDestStride, pSrc);
 
-        if (m_settings->m_removeNoise && m_noiseRemovalEffect)
+        if (m_snapshot->removeNoise && m_noiseRemovalEffect)
         {
+            StageTimer noiseRemovalTimer(&m_stageProfiler, NoiseRemovalStage);
+
             m_noiseRemovalEffect->apply(
                 m_rcDest,
                 pDest, lDestStride, pSrc, lSrcStride,
                 m_imageWidthInPixels, m_imageHeightInPixels);
         }
     }
-    else if (m_messenger->State() == VideoEffectState::Locking
-             || m_messenger->State() == VideoEffectState::Locked)
+    else
     {
-        BYTE *sourceFrame = pSrc;
+        AnalysisJob job;
+        job.acquisitionLevel = 0;
 
-        if (m_settings->m_removeNoise && m_noiseRemovalEffect)
+        if (!m_targets.isEmpty())
         {
-            m_noiseRemovalEffect->apply(
-                m_rcDest,
-                pDest, lDestStride, sourceFrame, lSrcStride,
-                m_imageWidthInPixels, m_imageHeightInPixels);
+            // Process only the surroundings of the predicted candidates, once
+            // locked only those of the target
+            m_targets.predict();
+
+            m_rcDest = m_targetLocked
+                ? m_targets.searchWindow(m_targetId, m_imageWidthInPixels, m_imageHeightInPixels)
+                : m_targets.searchRegion(m_imageWidthInPixels, m_imageHeightInPixels);
+        }
+        else if (m_state == VideoEffectState::Locking
+                 && m_snapshot->acquisitionPyramidLevel + (int)m_scheduler.resolutionLevelOffset() > 0
+                 && !m_snapshot->applyEffectOnly)
+        {
+            // The scheduler lowers the resolution further under overload
+            job.acquisitionLevel = (UINT32)clamp(
+                m_snapshot->acquisitionPyramidLevel + (int)m_scheduler.resolutionLevelOffset(),
+                1, (int)MaxPyramidLevel);
+        }
+
+        job.rect = m_rcDest;
+        job.stride = lSrcStride;
+        job.width = m_imageWidthInPixels;
+        job.height = m_imageHeightInPixels;
+        job.videoFormatSubtype = m_videoFormatSubtype;
+        job.settings = m_snapshot;
+        job.targetLocked = m_targetLocked;
+        job.target = m_targetLocked ? m_targets.estimate(m_targetId) : ObjectDetails();
+        job.generation = m_analysisGeneration;
+
+        if (m_snapshot->pipelinedAnalysis)
+        {
+            // The frame passes as it is and the result applies to a later
+            // frame. If the analysis is still busy with the earlier frames,
+            // this one is not analyzed.
+            CopyFrame(pDest, lDestStride, pSrc);
+
+            if (!SubmitAnalysis(job, pSrc))
+            {
+                m_rejectedAnalysisCount++;
+                analyzed = false;
+            }
+        }
+        else
+        {
+            WaitForAnalysis();
+            AnalyzeFrame(job, pDest, lDestStride, pSrc, m_analysisResult);
+            ApplyAnalysisResult(m_analysisResult);
+        }
+    }
+
+    // The overlays are drawn only once the analysis is done with the frame
+    RenderOverlays(pDest);
+
+    if (analyzing)
+    {
+        // A pipelined analysis is measured by the analysis task, its frame
+        // costs only the pass here
+        m_scheduler.endFrame(frameStartTimestamp, analyzed && !m_snapshot->pipelinedAnalysis, policy);
+    }
+}
+
+
+//-------------------------------------------------------------------
+// AnalyzeFrame
+//
+// Applies the effects to the frame and finds the object or the
+// candidates. Touches only the job, the effects, the analyzer and the
+// acquisition buffers, so that this can run in the analysis task
+// while the streaming thread owns the lock state and the format.
+//-------------------------------------------------------------------
+void CRealtimeTransform::AnalyzeFrame(
+    const AnalysisJob &job, BYTE *pDest, const LONG &lDestStride, const BYTE *pSrc,
+    AnalysisResult &result)
+{
+    D2D_RECT_U rect = job.rect;
+    const BYTE *sourceFrame = pSrc;
+
+    result.generation = job.generation;
+    result.targetLocked = job.targetLocked;
+    result.objectDetails.reset();
+    result.candidates.clear();
+    result.bestCandidateIndex = -1;
+    result.cameraMotion.x = 0;
+    result.cameraMotion.y = 0;
+    result.overlays.clear();
+    result.duration = 0;
+
+    if (job.acquisitionLevel > 0)
+    {
+        // Search on a pyramid level and process the full resolution only
+        // around the candidate. Without a candidate the rectangle is empty
+        // and the frame passes as it is.
+        rect = D2D1::RectU();
+        AcquireTarget(job, pSrc, rect);
+    }
 
-            sourceFrame = pDest;
+    if (job.settings->removeNoise && m_noiseRemovalEffect)
+    {
+        StageTimer noiseRemovalTimer(&m_stageProfiler, NoiseRemovalStage);
+
+        m_noiseRemovalEffect->apply(
+            rect,
+            pDest, lDestStride, sourceFrame, job.stride,
+            job.width, job.height);
+
+        sourceFrame = pDest;
+    }
+
+    if (job.settings->mode == Mode::ChromaFilter)
+    {
+        dynamic_cast<ChromaFilterEffect*>(m_effect)->setDimmUnselectedPixels(job.targetLocked);
+    }
+
+    const LONGLONG effectStartTimestamp = StageProfiler::timestamp();
+
+    m_effect->apply(
+        rect,
+        pDest, lDestStride, sourceFrame, job.stride,
+        job.width, job.height);
+
+    m_stageProfiler.record(EffectStage, effectStartTimestamp);
+
+    if (job.settings->applyEffectOnly)
+    {
+        return;
+    }
+
+    if (job.targetLocked)
+    {
+        const bool tracked =
+            (job.settings->appearanceTracking || job.settings->mode != Mode::ChromaFilter)
+            && TrackAppearance(job, pSrc, result.objectDetails);
+
+        if (!tracked && job.settings->mode == Mode::ChromaFilter)
+        {
+            result.objectDetails = dynamic_cast<ChromaFilterEffect*>(m_effect)->currentObject();
         }
 
-        if (m_settings->m_mode == Mode::ChromaFilter)
+        if (job.settings->compensateCameraMotion)
         {
-            dynamic_cast<ChromaFilterEffect*>(m_effect)->setDimmUnselectedPixels(m_targetLocked);
+            EstimateCameraMotion(job, pSrc, result.cameraMotion);
         }
+    }
+    else
+    {
+        m_motionEstimator.reset();
+        m_appearanceTracker.reset();
+        result.bestCandidateIndex = ExtractCircularObjects(job, pDest, rect, result.candidates, result.overlays);
+    }
+}
+
 
-        m_effect->apply(
-            m_rcDest,
-            pDest, lDestStride, sourceFrame, lSrcStride,
-            m_imageWidthInPixels, m_imageHeightInPixels);
+//-------------------------------------------------------------------
+// ApplyAnalysisResult
+//
+// Updates the lock state with the result and replaces the overlays
+// with those of the result. The results of the frames analyzed
+// before the lock state changed are ignored, overlays included.
+//-------------------------------------------------------------------
+void CRealtimeTransform::ApplyAnalysisResult(const AnalysisResult &result)
+{
+    if (result.generation != m_analysisGeneration
+        || result.targetLocked != m_targetLocked)
+    {
+        return;
+    }
 
-        ObjectDetails objectDetails;
+    m_overlays = result.overlays;
 
-        if (!m_settings->m_applyEffectOnly)
+    if (m_snapshot->applyEffectOnly)
+    {
+        return;
+    }
+
+    if (m_targetLocked)
+    {
+        const ObjectDetails &objectDetails = result.objectDetails;
+
+        if (m_targetWasJustLocked)
         {
-            if (m_targetLocked)
+            if (m_snapshot->mode == Mode::ChromaFilter)
             {
-                if (m_targetWasJustLocked)
-                {
-                    if (m_settings->m_mode == Mode::ChromaFilter)
-                    {
-                        objectDetails = dynamic_cast<ChromaFilterEffect*>(m_effect)->currentObject();
 #pragma warning(push)
 #pragma warning(disable: 4244) 
-                        m_itemX = objectDetails._centerX;
-                        m_itemY = objectDetails._centerY;
-                        m_itemWidth = objectDetails._width;
-                        m_itemHeight = objectDetails._height;
+                m_itemX = objectDetails._centerX;
+                m_itemY = objectDetails._centerY;
+                m_itemWidth = objectDetails._width;
+                m_itemHeight = objectDetails._height;
 #pragma warning(pop)
-                    }
-
-                    m_targetWasJustLocked = false;
-                }
-                else
-                {
-                    if (m_settings->m_mode == Mode::ChromaFilter)
-                    {
-                        objectDetails = dynamic_cast<ChromaFilterEffect*>(m_effect)->currentObject();
-                    }
-                }
-
-                if (objectDetails._width > 0)
-                {
-                    UpdateTargetLock(objectDetails);
-                    DrawCrosshair(pDest, objectDetails);
-                }
-                else
-                {
-                    // No object detected, but state is locked -> trigger
-                    if (m_settings->m_mode == Mode::ChromaFilter)
-                    {
-                        m_messenger->SetState(VideoEffectState::Triggered);
-                    }
-
-                    ClearTargetLock();
-                }
             }
-            else
+
+            m_targetWasJustLocked = false;
+        }
+
+        if (objectDetails._width > 0)
+        {
+            UpdateTargetLock(objectDetails, result.cameraMotion);
+            DrawCrosshair(objectDetails);
+        }
+        else
+        {
+            // No object detected, but state is locked -> trigger
+            if (m_snapshot->mode == Mode::ChromaFilter)
             {
-                // Locking
-                ConvexHull *convexHull = ExtractBestCircularConvexHull(pDest, m_rcDest, 3, true);
-
-                if (convexHull)
-                {
-                    double radius = 0;
-                    D2D_POINT_2U circleCenter;
-                    m_imageAnalyzer->getMinimalEnclosingCircle(*convexHull, radius, circleCenter);
-                    
-                    objectDetails._centerX = circleCenter.x;
-                    objectDetails._centerY = circleCenter.y;
-                    objectDetails._width = (UINT32)(radius * 2);
-                    objectDetails._height = objectDetails._width;
-
-                    UpdateTargetLock(objectDetails);
-
-                    delete convexHull;
-
-                    DrawCrosshair(pDest, objectDetails);
-                }
-                else
-                {
-                    ClearTargetLock();
-                }
+                SetState(VideoEffectState::Triggered);
             }
+
+            ClearTargetLock();
         }
     }
+    else
+    {
+        // Locking. The candidates are tracked, so the target chosen as
+        // the one closest to a circle keeps its identity even if
+        // another candidate looks more circular in later frames.
+        m_candidates = result.candidates;
+        m_targets.update(m_candidates);
 
-    GetSystemTime(m_systemTime1);
-    UpdateOperationTimeAverage(m_systemTime1->wMilliseconds - m_systemTime0->wMilliseconds);
-    m_messenger->UpdateOperationDurationInMilliseconds(OperationTimeAverage());
+        if (!m_targets.hasTrack(m_targetId))
+        {
+            m_targetId = (result.bestCandidateIndex >= 0) ? m_candidates[result.bestCandidateIndex]._id : 0;
+            m_lockModel.reset();
+        }
 
-    // Set the data size on the output buffer.
-    hr = pOut->SetCurrentLength(m_cbImageSize);
+        const ObjectDetails *target = NULL;
 
-    // The VideoBufferLock class automatically unlocks the buffers.
-done:
-    return hr;
+        for (const ObjectDetails &candidate : m_candidates)
+        {
+            if (m_targetId != 0 && candidate._id == m_targetId)
+            {
+                target = &candidate;
+            }
+        }
+
+        if (target)
+        {
+            UpdateTargetLock(*target, result.cameraMotion);
+            DrawCrosshair(*target);
+        }
+        else if (m_targets.isEmpty())
+        {
+            ClearTargetLock();
+        }
+        else
+        {
+            // The target is still tracked but was not found in this frame
+            m_lockModel.addMiss();
+        }
+    }
 }
 
 
 //-------------------------------------------------------------------
-// OnMfMtSubtypeResolved
+// SubmitAnalysis
 //
-// Sets the effect based on the given subtype.
+// Copies the frame to the analysis queue and schedules its analysis.
+// Returns false, if the queue is full.
 //-------------------------------------------------------------------
-void CRealtimeTransform::OnMfMtSubtypeResolved(const GUID subtype)
+bool CRealtimeTransform::SubmitAnalysis(const AnalysisJob &job, const BYTE *pSrc)
 {
-    CAbstractTransform::OnMfMtSubtypeResolved(subtype);
-    m_noiseRemovalEffect = new NoiseRemovalEffect(subtype);
+    const UINT32 frameLength = FrameLength(job.stride, job.height, job.videoFormatSubtype);
+    const int slot = m_analysisQueue.beginWrite(frameLength);
+
+    if (slot < 0)
+    {
+        return false;
+    }
+
+    CopyMemory(m_analysisQueue.frame(slot), pSrc, frameLength);
+    m_analysisJobs[slot] = job;
+    m_analysisQueue.endWrite();
+
+    m_analysisTask = m_analysisTask.then(
+        [this]()
+        {
+            RunQueuedAnalysis();
+        },
+        concurrency::task_continuation_context::use_arbitrary());
+
+    return true;
 }
 
 
 //-------------------------------------------------------------------
-// OperationTimeAverage
+// RunQueuedAnalysis
 //
-// Returns the operation time average.
+// Analyzes the oldest queued frame and posts the result. Runs in the
+// analysis task, one frame at a time.
 //-------------------------------------------------------------------
-WORD CRealtimeTransform::OperationTimeAverage()
+void CRealtimeTransform::RunQueuedAnalysis()
 {
-    return m_operationTimeMeasurementAverageInMilliseconds;
+    const int slot = m_analysisQueue.front();
+
+    if (slot < 0)
+    {
+        return;
+    }
+
+    const AnalysisJob &job = m_analysisJobs[slot];
+    m_analysisFrame.resize(FrameLength(job.stride, job.height, job.videoFormatSubtype));
+
+    const LONGLONG analysisStartTimestamp = StageProfiler::timestamp();
+    AnalysisResult &result = m_analysisMailbox.back();
+
+    AnalyzeFrame(job, m_analysisFrame.data(), job.stride, m_analysisQueue.frame(slot), result);
+    result.duration = StageProfiler::timestamp() - analysisStartTimestamp;
+
+    m_analysisMailbox.post();
+    m_analysisQueue.popFront();
 }
 
 
 //-------------------------------------------------------------------
-// ExtractBestCircularConvexHull
+// WaitForAnalysis
 //
-// Extracts convex hulls from the given frame and tries to determine
-// the best candidate to match the desired object.
+// Blocks until the queued frames are analyzed. The results are left
+// in the mailbox.
+//-------------------------------------------------------------------
+void CRealtimeTransform::WaitForAnalysis()
+{
+    m_analysisTask.wait();
+    m_analysisTask = concurrency::task_from_result();
+}
+
+//-------------------------------------------------------------------
+// UpdateFormatInfo
 //
-// Note that the returned convex hull is owned by the caller.
+// The queued analyses are done before the format changes. Their
+// results and the lock state are in the coordinates of the previous
+// format, so they are dropped.
 //-------------------------------------------------------------------
-ConvexHull *CRealtimeTransform::ExtractBestCircularConvexHull(
-    BYTE *pFrame, const D2D_RECT_U &targetRect, int maxConvexHullCount, bool drawConvexHulls) const
+HRESULT CRealtimeTransform::UpdateFormatInfo()
 {
-    return m_imageAnalyzer->extractBestCircularConvexHull(
-        pFrame, m_imageWidthInPixels, m_imageHeightInPixels, targetRect,
-        maxConvexHullCount, m_effect->videoFormatSubtype(), drawConvexHulls);
+    WaitForAnalysis();
+    m_analysisMailbox.take();
+
+    const HRESULT hr = CAbstractTransform::UpdateFormatInfo();
+
+    ClearTargetLock();
+    return hr;
+}
+
+
+//-------------------------------------------------------------------
+// OnMfMtSubtypeResolved
+//
+// Sets the effect based on the given subtype. Called by
+// UpdateFormatInfo, so the analysis is not running.
+//-------------------------------------------------------------------
+void CRealtimeTransform::OnMfMtSubtypeResolved(const GUID subtype)
+{
+    CAbstractTransform::OnMfMtSubtypeResolved(subtype);
+
+    delete m_noiseRemovalEffect;
+    m_noiseRemovalEffect = new NoiseRemovalEffect(subtype);
+
+    UINT32 frameRateNumerator = 0;
+    UINT32 frameRateDenominator = 0;
+
+    if (SUCCEEDED(MFGetAttributeRatio(m_pInputType, MF_MT_FRAME_RATE, &frameRateNumerator, &frameRateDenominator)))
+    {
+        m_scheduler.setFrameRate(frameRateNumerator, frameRateDenominator);
+    }
+
+    m_scheduler.reset();
+}
+
+
+//-------------------------------------------------------------------
+// ExtractCircularObjects
+//
+// Extracts the candidate objects from the given frame. Returns the
+// index of the candidate best matching the desired object, -1 if
+// none. The hulls are added to the overlays, if so configured.
+//-------------------------------------------------------------------
+int CRealtimeTransform::ExtractCircularObjects(
+    const AnalysisJob &job, BYTE *pFrame, const D2D_RECT_U &targetRect,
+    std::vector<ObjectDetails> &objects, OverlayCommandList &overlays)
+{
+    return m_imageAnalyzer->extractCircularObjects(
+        pFrame, job.width, job.height, targetRect,
+        MaxTrackedTargets, job.videoFormatSubtype, objects,
+        job.settings->drawOverlays ? &overlays : NULL);
 }
 
 
@@ -460,24 +781,190 @@ ConvexHull *CRealtimeTransform::ExtractBestCircularConvexHull(
 //-------------------------------------------------------------------
 void CRealtimeTransform::SetMode(const Mode& mode)
 {
-    m_settings->m_mode = mode;
+    WaitForAnalysis();
+
+    m_settings->setMode(mode);
     ClearTargetLock();
 
     delete m_effect;
-    m_effect = NULL;
+    delete m_acquisitionEffect;
+    m_effect = CreateEffect(mode);
+    m_acquisitionEffect = CreateEffect(mode);
+}
 
+
+//-------------------------------------------------------------------
+// SetState
+//
+// Notifies the messenger and keeps the polled state in sync with it.
+//-------------------------------------------------------------------
+void CRealtimeTransform::SetState(const VideoEffectState& state)
+{
+    m_state = state;
+    m_messenger->SetState(state);
+}
+
+
+//-------------------------------------------------------------------
+// CreateEffect
+//
+// Returns NULL for the passthrough mode.
+//-------------------------------------------------------------------
+AbstractEffect *CRealtimeTransform::CreateEffect(const Mode& mode) const
+{
     switch (mode)
     {
     case Mode::ChromaDelta:
-        m_effect = new ChromaDeltaEffect(m_videoFormatSubtype);
-        break;
+        return new ChromaDeltaEffect(m_videoFormatSubtype);
     case Mode::ChromaFilter:
-        m_effect = new ChromaFilterEffect(m_videoFormatSubtype);
-        break;
+        return new ChromaFilterEffect(m_videoFormatSubtype);
     case Mode::EdgeDetection:
-        m_effect = new EdgeDetectionEffect(m_videoFormatSubtype);
-        break;
+        return new EdgeDetectionEffect(m_videoFormatSubtype);
+    }
+
+    return NULL;
+}
+
+
+//-------------------------------------------------------------------
+// AcquireTarget
+//
+// Applies the effect to a pyramid level and looks for the best
+// candidate there. Returns true and the padded rectangle of the
+// candidate in the full resolution, if one is found.
+//-------------------------------------------------------------------
+bool CRealtimeTransform::AcquireTarget(const AnalysisJob &job, const BYTE *pSrc, D2D_RECT_U &candidateRect)
+{
+    const UINT32 levelIndex = job.acquisitionLevel;
+
+    if (!m_acquisitionEffect)
+    {
+        return false;
+    }
+
+    m_pyramid.build(pSrc, job.stride, job.width, job.height, job.videoFormatSubtype, levelIndex);
+
+    if (m_pyramid.levelCount() < levelIndex)
+    {
+        return false;
+    }
+
+    const UINT32 levelWidth = m_pyramid.levelWidth(levelIndex);
+    const UINT32 levelHeight = m_pyramid.levelHeight(levelIndex);
+    const LONG levelStride = (LONG)m_pyramid.levelStride(levelIndex);
+    const D2D_RECT_U levelRect = D2D1::RectU(0, 0, levelWidth, levelHeight);
+
+    m_acquisitionFrame.resize(FrameLength(levelStride, levelHeight, job.videoFormatSubtype));
+
+    m_acquisitionEffect->apply(
+        levelRect,
+        m_acquisitionFrame.data(), levelStride, m_pyramid.level(levelIndex), levelStride,
+        levelWidth, levelHeight);
+
+    ConvexHull *convexHull = m_imageAnalyzer->extractBestCircularConvexHull(
+        m_acquisitionFrame.data(), levelWidth, levelHeight, levelRect, 3, job.videoFormatSubtype);
+
+    if (!convexHull)
+    {
+        return false;
     }
+
+    double radius = 0;
+    D2D_POINT_2U circleCenter;
+    m_imageAnalyzer->getMinimalEnclosingCircle(*convexHull, radius, circleCenter);
+    delete convexHull;
+
+    const float scaleX = (float)job.width / levelWidth;
+    const float scaleY = (float)job.height / levelHeight;
+    const float centerX = (circleCenter.x + 0.5f) * scaleX;
+    const float centerY = (circleCenter.y + 0.5f) * scaleY;
+    const float halfWidth = (float)radius * scaleX * (1 + RelativeAcquisitionPadding) + scaleX;
+    const float halfHeight = (float)radius * scaleY * (1 + RelativeAcquisitionPadding) + scaleY;
+
+    candidateRect.left = (UINT32)clamp(centerX - halfWidth, 0.0f, (float)job.width);
+    candidateRect.top = (UINT32)clamp(centerY - halfHeight, 0.0f, (float)job.height);
+    candidateRect.right = (UINT32)clamp(centerX + halfWidth, 0.0f, (float)job.width);
+    candidateRect.bottom = (UINT32)clamp(centerY + halfHeight, 0.0f, (float)job.height);
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// TrackAppearance
+//
+// Follows the locked target by its appearance, the model being taken
+// at the first locked frame. Returns false, if the target has no
+// usable appearance. The target is reported lost, if the best match
+// correlates poorly.
+//-------------------------------------------------------------------
+bool CRealtimeTransform::TrackAppearance(const AnalysisJob &job, const BYTE *pSrc, ObjectDetails &objectDetails)
+{
+    StageTimer appearanceTimer(&m_stageProfiler, LockUpdateStage);
+
+    if (!m_appearanceTracker.hasModel())
+    {
+        if (!m_appearanceTracker.initialize(
+                pSrc, job.stride, job.width, job.height, job.videoFormatSubtype, job.target))
+        {
+            return false;
+        }
+
+        objectDetails = job.target;
+        return true;
+    }
+
+    if (!m_appearanceTracker.track(
+            pSrc, job.stride, job.width, job.height, job.videoFormatSubtype,
+            job.target, objectDetails))
+    {
+        return false;
+    }
+
+    if (objectDetails._confidence < MinAppearanceConfidence)
+    {
+        objectDetails.reset();
+    }
+
+    return true;
+}
+
+
+//-------------------------------------------------------------------
+// EstimateCameraMotion
+//
+// Estimates the motion of the background since the previous analyzed
+// frame on a pyramid level, leaving out the target. Returns true and
+// the motion in the full resolution, if it could be estimated.
+//-------------------------------------------------------------------
+bool CRealtimeTransform::EstimateCameraMotion(const AnalysisJob &job, const BYTE *pSrc, D2D_POINT_2L &motion)
+{
+    const UINT32 levelIndex = min(MotionPyramidLevel, MaxPyramidLevel);
+    const D2D_RECT_U &targetRect = job.rect;
+
+    m_pyramid.build(pSrc, job.stride, job.width, job.height, job.videoFormatSubtype, levelIndex);
+
+    if (m_pyramid.levelCount() < levelIndex)
+    {
+        m_motionEstimator.reset();
+        return false;
+    }
+
+    const D2D_RECT_U levelTargetRect = D2D1::RectU(
+        targetRect.left >> levelIndex, targetRect.top >> levelIndex,
+        (targetRect.right >> levelIndex) + 1, (targetRect.bottom >> levelIndex) + 1);
+
+    if (!m_motionEstimator.estimate(
+            m_pyramid.level(levelIndex), m_pyramid.levelStride(levelIndex),
+            m_pyramid.levelWidth(levelIndex), m_pyramid.levelHeight(levelIndex),
+            job.videoFormatSubtype, levelTargetRect, motion))
+    {
+        return false;
+    }
+
+    motion.x *= (1 << levelIndex);
+    motion.y *= (1 << levelIndex);
+    return true;
 }
 
 
@@ -488,7 +975,10 @@ void CRealtimeTransform::ClearTargetLock()
 {
     m_targetWasJustLocked = false;
     m_targetLocked = false;
-    m_targetLockIterations = 0;
+    m_lockModel.reset();
+    m_targetId = 0;
+    m_targets.clear();
+    m_analysisGeneration++; // The analyses in progress no longer apply
     m_rcDest = D2D1::RectU(0, 0, m_imageWidthInPixels, m_imageHeightInPixels);
 }
 
@@ -496,49 +986,31 @@ void CRealtimeTransform::ClearTargetLock()
 //-------------------------------------------------------------------
 // UpdateTargetLock
 //
-//
+// The camera motion is that of the background since the previous
+// analyzed frame. Once locked, the track is moved with the background
+// before it is compared and corrected, so the velocity of the track
+// and the detected motion are those relative to the background, and
+// the next search window follows the pan. The target moving with the
+// background is not considered motion.
 //-------------------------------------------------------------------
-void CRealtimeTransform::UpdateTargetLock(const ObjectDetails &objectDetails)
+void CRealtimeTransform::UpdateTargetLock(const ObjectDetails &objectDetails, const D2D_POINT_2L &cameraMotion)
 {
-    if (m_targetLockIterations == 0)
-    {
-#pragma warning(push)
-#pragma warning(disable: 4244) 
-        m_itemX = objectDetails._centerX;
-        m_itemY = objectDetails._centerY;
-        m_itemWidth = objectDetails._width;
-        m_itemHeight = objectDetails._height;
-#pragma warning(pop)
-        m_targetLockIterations++;
-    }
-    else if (m_targetLockIterations < NumberOfIterationsNeededForItemLock)
-    {
-        const float maxJitterX = m_itemWidth * RelativeJitterThresholdForItemLock;
-        const float maxJitterY = m_itemHeight * RelativeJitterThresholdForItemLock;
+    StageTimer lockUpdateTimer(&m_stageProfiler, LockUpdateStage);
 
-        if (abs(m_itemX - objectDetails._centerX) > maxJitterX
-            || abs(m_itemY - objectDetails._centerY) > maxJitterY
-            || abs(m_itemWidth - objectDetails._width) > maxJitterX
-            || abs(m_itemHeight - objectDetails._height) > maxJitterY)
-        {
-            // Jitter threshold exceeded, discard the current locking process and start over
-            ClearTargetLock();
-        }
-        else
-        {
-            m_itemX = (m_itemX + objectDetails._centerX) / 2;
-            m_itemY = (m_itemY + objectDetails._centerY) / 2;
-            m_itemWidth = (m_itemWidth + objectDetails._width) / 2;
-            m_itemHeight = (m_itemHeight + objectDetails._height) / 2;
-            m_targetLockIterations++;
-        }
-    }
-
-    if (m_targetLockIterations == NumberOfIterationsNeededForItemLock)
+    if (!m_targetLocked)
     {
-        if (!m_targetLocked)
+        m_lockModel.addDetection(objectDetails);
+
+        if (m_lockModel.canEnterLock())
         {
             // Lock successfull
+            const ObjectDetails consensus = m_lockModel.consensus();
+
+            m_itemX = (float)consensus._centerX;
+            m_itemY = (float)consensus._centerY;
+            m_itemWidth = (float)consensus._width;
+            m_itemHeight = (float)consensus._height;
+
 #pragma warning(push)
 #pragma warning(disable: 4244) 
             int left = (float)m_itemX - (float)(m_itemWidth * (RelativeTargetCropPadding + 0.5f));
@@ -555,34 +1027,31 @@ void CRealtimeTransform::UpdateTargetLock(const ObjectDetails &objectDetails)
             {
                 top = 0;
             }
-            
-            m_rcDest.left = left;
-            m_rcDest.right = right;
-            m_rcDest.top = top;
-            m_rcDest.bottom = bottom;
 #pragma warning(pop)
 
             m_targetLocked = true;
+            m_targets.retain(m_targetId);
             
             m_messenger->SetLockedRect((int)m_itemX, (int)m_itemY, (int)(right - left), (int)(bottom - top));
-            m_messenger->SetState(VideoEffectState::Locked); // Notify
+            SetState(VideoEffectState::Locked); // Notify
             m_targetWasJustLocked = true;
         }
+    }
+    else
+    {
+        // Locked, the target is followed as long as it moves as predicted
+        m_targets.shift(cameraMotion);
+        const ObjectDetails predicted = m_targets.estimate(m_targetId);
+
+        if (m_lockModel.detectMotion(predicted, objectDetails, m_itemWidth, m_itemHeight))
+        {
+            // Target motion (or camera motion) exceeded the limit
+            SetState(VideoEffectState::Triggered);
+            ClearTargetLock();
+        }
         else
         {
-            // Locked
-            const float maxJitterX = m_itemWidth * RelativeJitterThresholdForDetectingMovement;
-            const float maxJitterY = m_itemHeight * RelativeJitterThresholdForDetectingMovement;
-
-            if (abs(m_itemX - objectDetails._centerX) > maxJitterX
-                || abs(m_itemY - objectDetails._centerY) > maxJitterY
-                || abs(m_itemWidth - objectDetails._width) > maxJitterX
-                || abs(m_itemHeight - objectDetails._height) > maxJitterY)
-            {
-                // Target motion (or camera motion) exceeded the limit
-                m_messenger->SetState(VideoEffectState::Triggered);
-                ClearTargetLock();
-            }
+            m_targets.correct(m_targetId, objectDetails);
         }
     }
 }
@@ -591,46 +1060,95 @@ void CRealtimeTransform::UpdateTargetLock(const ObjectDetails &objectDetails)
 //-------------------------------------------------------------------
 // DrawCrosshair
 //
-//
+// Adds a crosshair at the object to the overlays.
 //-------------------------------------------------------------------
-void CRealtimeTransform::DrawCrosshair(BYTE *pFrame, const ObjectDetails &objectDetails)
+void CRealtimeTransform::DrawCrosshair(const ObjectDetails &objectDetails)
 {
+    if (!m_snapshot->drawOverlays)
+    {
+        return;
+    }
+
     D2D1_POINT_2U point1 = { 0, objectDetails._centerY };
     D2D1_POINT_2U point2 = { m_imageWidthInPixels, objectDetails._centerY };
-    m_imageProcessingUtils->drawLine(pFrame, m_imageWidthInPixels, m_imageHeightInPixels, point1, point2, m_effect->videoFormatSubtype());
+    m_overlays.addLine(point1, point2, 1, 0xff, 0x80, 0x80);
 
     point1.x = point2.x = objectDetails._centerX;
     point1.y = 0;
     point2.y = m_imageHeightInPixels;
-    m_imageProcessingUtils->drawLine(pFrame, m_imageWidthInPixels, m_imageHeightInPixels, point1, point2, m_effect->videoFormatSubtype());
+    m_overlays.addLine(point1, point2, 1, 0xff, 0x80, 0x80);
 }
 
 
 //-------------------------------------------------------------------
-// UpdateOperationTimeAverage
+// CopyFrame
 //
+//-------------------------------------------------------------------
+void CRealtimeTransform::CopyFrame(BYTE *pDest, const LONG &lDestStride, const BYTE *pSrc)
+{
+    CopyMemory(pDest, pSrc, FrameLength(lDestStride, m_imageHeightInPixels, m_videoFormatSubtype));
+}
+
+
+//-------------------------------------------------------------------
+// FrameLength
 //
+// The length of a frame with the given stride, including the chroma
+// plane of NV12.
 //-------------------------------------------------------------------
-void CRealtimeTransform::UpdateOperationTimeAverage(const WORD &measuredOperationTimeInMilliseconds)
+UINT32 CRealtimeTransform::FrameLength(const LONG &lStride, const UINT32 &height, const GUID &videoFormatSubtype)
 {
-    if (m_operationTimeMeasurementCounter < NumberOfOperationTimeMeasurementsNeededForAverage)
+    UINT32 arrayLength = lStride * height;
+
+    if (videoFormatSubtype == MFVideoFormat_NV12)
     {
-        if (measuredOperationTimeInMilliseconds < 1000) // Sanity check
-        {
-            m_operationTimeMeasurementsInMilliseconds[m_operationTimeMeasurementCounter] = measuredOperationTimeInMilliseconds;
-            m_operationTimeMeasurementCounter++;
-        }
+#pragma warning(push)
+#pragma warning(disable: 4244)
+        arrayLength *= 1.5f;
+#pragma warning(pop)
     }
-    else
-    {
-        WORD sum = 0;
 
-        for (int i = 0; i < NumberOfOperationTimeMeasurementsNeededForAverage; ++i)
-        {
-            sum += m_operationTimeMeasurementsInMilliseconds[i];
-        }
+    return arrayLength;
+}
 
-        m_operationTimeMeasurementAverageInMilliseconds = sum / NumberOfOperationTimeMeasurementsNeededForAverage;
-        m_operationTimeMeasurementCounter = 0;
+
+//-------------------------------------------------------------------
+// RenderOverlays
+//
+//-------------------------------------------------------------------
+void CRealtimeTransform::RenderOverlays(BYTE *pFrame)
+{
+    StageTimer overlayTimer(&m_stageProfiler, OverlayStage);
+    m_overlays.render(pFrame, m_imageWidthInPixels, m_imageHeightInPixels, m_videoFormatSubtype);
+}
+
+
+//-------------------------------------------------------------------
+// ReportStageDurations
+//
+// Passes the stage durations since the previous report to the
+// messenger. They are followed by the number of the durations recorded
+// by the threads beyond MaxProfiledThreads and the number of the frames
+// not analyzed since the analysis queue was full.
+//-------------------------------------------------------------------
+void CRealtimeTransform::ReportStageDurations()
+{
+    StageStatistics statistics[ProfilerStageCount];
+    const UINT32 overflowCount = m_stageProfiler.collect(statistics);
+
+    Array<int>^ durations = ref new Array<int>(ProfilerStageCount * 4 + 2);
+
+    for (UINT32 i = 0; i < ProfilerStageCount; ++i)
+    {
+        durations[i * 4] = (int)(statistics[i].p50 / 1000);
+        durations[i * 4 + 1] = (int)(statistics[i].p95 / 1000);
+        durations[i * 4 + 2] = (int)(statistics[i].p99 / 1000);
+        durations[i * 4 + 3] = (int)(statistics[i].max / 1000);
     }
+
+    durations[ProfilerStageCount * 4] = (int)overflowCount;
+    durations[ProfilerStageCount * 4 + 1] = (int)m_rejectedAnalysisCount;
+    m_rejectedAnalysisCount = 0;
+
+    m_messenger->UpdateStageDurations(durations);
 }
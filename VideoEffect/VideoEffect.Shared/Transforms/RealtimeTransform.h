@@ -1,13 +1,26 @@
 #ifndef REALTIMEFINDERTRANSFORM_H
 #define REALTIMEFINDERTRANSFORM_H
 
+#include <memory>
+
 #include "AbstractTransform.h"
 #include "Common.h"
+#include "ImageProcessing\AnalysisMailbox.h"
+#include "ImageProcessing\AnalysisScheduler.h"
+#include "ImageProcessing\AppearanceTracker.h"
+#include "ImageProcessing\FrameHandoffQueue.h"
+#include "ImageProcessing\GlobalMotionEstimator.h"
+#include "ImageProcessing\ImagePyramid.h"
+#include "ImageProcessing\MultiTargetTracker.h"
+#include "ImageProcessing\OverlayCommandList.h"
+#include "ImageProcessing\StageProfiler.h"
+#include "ImageProcessing\TargetLockModel.h"
 #include "Interop\MessengerInterface.h"
 #include "RealtimeTransform_h.h"
 
 class AbstractEffect;
 class NoiseRemovalEffect;
+struct SettingsSnapshot;
 
 // CLSID of the MFT.
 DEFINE_GUID(CLSID_RealtimeTransformMFT,
@@ -33,41 +46,100 @@ public: // From CAbstratEffect
         MFT_OUTPUT_DATA_BUFFER  *pOutputSamples, // one per stream
         DWORD                   *pdwStatus);
 
-public: // New methods
-    WORD OperationTimeAverage();
-
 protected: // From CAbstratEffect
+    HRESULT UpdateFormatInfo();
     HRESULT OnProcessOutput(IMFMediaBuffer *pIn, IMFMediaBuffer *pOut);
     void OnMfMtSubtypeResolved(const GUID subtype);
 
+private: // Types
+    // Everything the analysis of a frame reads, so that it does not
+    // depend on the state of the streaming thread
+    struct AnalysisJob
+    {
+        D2D_RECT_U rect;
+        LONG stride;
+        UINT32 width;
+        UINT32 height;
+        GUID videoFormatSubtype;
+        std::shared_ptr<const SettingsSnapshot> settings; // Of the frame
+        UINT32 acquisitionLevel; // The pyramid level to acquire the target on, 0 if none
+        bool targetLocked;
+        ObjectDetails target; // Predicted, if locked
+        UINT32 generation;
+    };
+
 private: // New methods
-    ConvexHull *ExtractBestCircularConvexHull(
-        BYTE *pFrame, const D2D_RECT_U &targetRect,
-        int maxConvexHullCount, bool drawConvexHulls) const;
+    void UpdateSettings();
+
+    void TransformFrame(
+        BYTE *pDest, const LONG &lDestStride, BYTE *pSrc, const LONG &lSrcStride,
+        const LONGLONG &frameStartTimestamp);
+
+    void AnalyzeFrame(
+        const AnalysisJob &job, BYTE *pDest, const LONG &lDestStride, const BYTE *pSrc,
+        AnalysisResult &result);
 
+    void ApplyAnalysisResult(const AnalysisResult &result);
+    bool SubmitAnalysis(const AnalysisJob &job, const BYTE *pSrc);
+    void RunQueuedAnalysis();
+    void WaitForAnalysis();
+
+    int ExtractCircularObjects(
+        const AnalysisJob &job, BYTE *pFrame, const D2D_RECT_U &targetRect,
+        std::vector<ObjectDetails> &objects, OverlayCommandList &overlays);
+
+    bool AcquireTarget(const AnalysisJob &job, const BYTE *pSrc, D2D_RECT_U &candidateRect);
+    bool TrackAppearance(const AnalysisJob &job, const BYTE *pSrc, ObjectDetails &objectDetails);
+    bool EstimateCameraMotion(const AnalysisJob &job, const BYTE *pSrc, D2D_POINT_2L &motion);
+
+    AbstractEffect *CreateEffect(const Mode& mode) const;
     void SetMode(const Mode& mode);
+    void SetState(const VideoEffectState& state);
     void ClearTargetLock();
-    void UpdateTargetLock(const ObjectDetails &objectDetails);
-    void DrawCrosshair(BYTE *pFrame, const ObjectDetails &objectDetails);
-    void UpdateOperationTimeAverage(const UINT16 &millisecondsPerOperation);
+    void UpdateTargetLock(const ObjectDetails &objectDetails, const D2D_POINT_2L &cameraMotion);
+    void DrawCrosshair(const ObjectDetails &objectDetails);
+    void CopyFrame(BYTE *pDest, const LONG &lDestStride, const BYTE *pSrc);
+    static UINT32 FrameLength(const LONG &lStride, const UINT32 &height, const GUID &videoFormatSubtype);
+    void RenderOverlays(BYTE *pFrame);
+    void ReportStageDurations();
 
 private: // Members
     AbstractEffect *m_effect;
     NoiseRemovalEffect *m_noiseRemovalEffect;
+    AbstractEffect *m_acquisitionEffect; // Applied to the pyramid level, has a state of its own
+    ImagePyramid m_pyramid;
+    std::vector<BYTE> m_acquisitionFrame;
+    GlobalMotionEstimator m_motionEstimator; // Used by the analysis only while locked
+    AppearanceTracker m_appearanceTracker; // Likewise
+    OverlayCommandList m_overlays; // Rendered at the end of OnProcessOutput
+    StageProfiler m_stageProfiler;
+    AnalysisScheduler m_scheduler;
+    MultiTargetTracker m_targets; // Drives m_rcDest once candidates have been found
+    UINT16 m_targetId; // Track of the target being locked, 0 if none
+    std::vector<ObjectDetails> m_candidates;
+    AnalysisResult m_analysisResult; // Of the synchronous analysis
+
+    // Pipelined analysis: the frames go to the analysis task through the
+    // queue and the results come back through the mailbox
+    FrameHandoffQueue m_analysisQueue;
+    std::vector<AnalysisJob> m_analysisJobs; // Per queue slot
+    std::vector<BYTE> m_analysisFrame; // Owned by the analysis task
+    AnalysisMailbox m_analysisMailbox;
+    concurrency::task<void> m_analysisTask; // Analyses run one at a time
+    UINT32 m_analysisGeneration; // Changes when the lock state is cleared
+    UINT32 m_rejectedAnalysisCount; // Frames not analyzed since the queue was full, since the previous report
+    bool m_analyzing; // Whether the previous frame was in an analyzing state
+    int m_framesSinceStageReport;
+    VideoEffectState m_state; // Of the messenger as of this frame, or as set since
+    std::shared_ptr<const SettingsSnapshot> m_snapshot; // Of the frame being processed
 
     float m_itemX;
     float m_itemY;
     float m_itemWidth;
     float m_itemHeight;
-    int m_targetLockIterations;
+    TargetLockModel m_lockModel;
     bool m_targetLocked;
     bool m_targetWasJustLocked;
-
-    LPSYSTEMTIME m_systemTime0;
-    LPSYSTEMTIME m_systemTime1;
-    WORD *m_operationTimeMeasurementsInMilliseconds;
-    WORD m_operationTimeMeasurementAverageInMilliseconds;
-    int m_operationTimeMeasurementCounter;
 };
 
 #endif // REALTIMEFINDERTRANSFORM_H